@@ -0,0 +1,179 @@
+// Reply latency and CPU cost of receiving drone replies by sleeping in epoll vs. busy polling
+// (BusyPoller, include/busy_poll.hpp).
+//
+// A simulated drone runs on its own thread and loop. One Tello client sends a query every
+// --interval ms, as a teleop station polling telemetry would, first with the loop sleeping in
+// epoll between datagrams and then with the client socket handed to a BusyPoller. Reported are
+// the round-trip quantiles and the CPU time the client thread used over the wall time of the run:
+// the epoll loop sleeps between queries, the busy poller keeps its core at 100%.
+// Needs no RabbitMQ or controller.
+#include "busy_poll.hpp"
+#include "histogram.hpp"
+#include "tello.hpp"
+#include "tello_sim.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+
+struct BenchConfig {
+    int queries = 1000;
+    int interval_ms = 5;
+    std::string query = "battery?";
+    BusyPollConfig busy_poll;
+};
+
+struct ModeResult {
+    const char* name;
+    Histogram rtt_ns;
+    uint64_t failures = 0;
+    double cpu_percent = 0;
+    uint64_t spins = 0;
+};
+
+static uint64_t thread_cpu_ns() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ULL
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+// Send config.queries queries, one per interval, running the loop through `poller` if given
+static void run_mode(uv_loop_t* loop, BasicTello<LeanInstrumentation>& tello, BusyPoller* poller,
+                     const BenchConfig& config, ModeResult& result) {
+    struct State {
+        BasicTello<LeanInstrumentation>* tello;
+        const BenchConfig* config;
+        ModeResult* result;
+        int sent = 0;
+        int answered = 0;
+        bool outstanding = false;
+    } state{&tello, &config, &result};
+
+    uv_timer_t timer;
+    uv_timer_init(loop, &timer);
+    timer.data = &state;
+    uv_timer_start(&timer, [](uv_timer_t* handle) {
+        auto* state = static_cast<State*>(handle->data);
+        if (state->outstanding || state->sent == state->config->queries) {
+            return;
+        }
+        state->outstanding = true;
+        state->sent++;
+        uint64_t start = uv_hrtime();
+        state->tello->send_command_async(state->config->query, [state, start](std::optional<std::string> reply) {
+            state->result->rtt_ns.record(uv_hrtime() - start);
+            state->result->failures += reply ? 0 : 1;
+            state->answered++;
+            state->outstanding = false;
+        });
+    }, config.interval_ms, config.interval_ms);
+
+    uint64_t cpu_start = thread_cpu_ns();
+    uint64_t wall_start = uv_hrtime();
+    uint64_t spins_start = poller ? poller->spins() : 0;
+    while (state.answered < config.queries) {
+        if (poller) {
+            poller->poll_once();
+        } else {
+            uv_run(loop, UV_RUN_ONCE);
+        }
+    }
+    result.cpu_percent = 100.0 * (thread_cpu_ns() - cpu_start) / (uv_hrtime() - wall_start);
+    result.spins = poller ? poller->spins() - spins_start : 0;
+
+    uv_timer_stop(&timer);
+    uv_close(reinterpret_cast<uv_handle_t*>(&timer), nullptr);
+    uv_run(loop, UV_RUN_NOWAIT);
+}
+
+static void print_mode(const ModeResult& r, int queries) {
+    std::printf("  %-9s p50 %7.1f us  p99 %7.1f us  max %8.1f us  cpu %5.1f%%  failed %llu/%d", r.name,
+                r.rtt_ns.quantile(0.5) / 1000.0, r.rtt_ns.quantile(0.99) / 1000.0, r.rtt_ns.max() / 1000.0,
+                r.cpu_percent, static_cast<unsigned long long>(r.failures), queries);
+    if (r.spins > 0) {
+        std::printf("  spins %.0f/query", static_cast<double>(r.spins) / queries);
+    }
+    std::printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "-n") {
+            config.queries = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--interval") {
+            config.interval_ms = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--query") {
+            config.query = value;
+        } else if (arg == "--cpu") {
+            config.busy_poll.cpu = std::atoi(value.c_str());
+        } else if (arg == "--socket-busy-poll") {
+            config.busy_poll.socket_busy_poll_us = std::atoi(value.c_str());
+        }
+    }
+
+    // The drone gets its own thread, so its loop does not share the client's spin
+    std::promise<uv_async_t*> sim_ready;
+    std::thread sim_thread([&sim_ready] {
+        uv_loop_t sim_loop;
+        uv_loop_init(&sim_loop);
+        uv_async_t stop;
+        uv_async_init(&sim_loop, &stop, [](uv_async_t* handle) { uv_stop(handle->loop); });
+        try {
+            SimConfig sim_config;
+            sim_config.telemetry_hz = 0;
+            SimulatedTello sim(sim_loop, sim_config);
+            sim_ready.set_value(&stop);
+            uv_run(&sim_loop, UV_RUN_DEFAULT);
+        } catch (...) {
+            sim_ready.set_exception(std::current_exception());
+        }
+        uv_close(reinterpret_cast<uv_handle_t*>(&stop), nullptr);
+        uv_run(&sim_loop, UV_RUN_DEFAULT);
+        uv_loop_close(&sim_loop);
+    });
+
+    int status = 0;
+    uv_async_t* stop_sim = nullptr;
+    uv_loop_t* loop = uv_default_loop();
+    try {
+        stop_sim = sim_ready.get_future().get();
+        BasicTello<LeanInstrumentation> tello("127.0.0.2", 8889, *loop, 0);
+        if (!tello.connect()) {
+            throw std::runtime_error("Simulated drone did not enter SDK mode");
+        }
+
+        // Both modes on the same core, if one is given
+        if (config.busy_poll.cpu >= 0) {
+            pin_current_thread(config.busy_poll.cpu);
+        }
+        // epoll first: once the socket is handed to the poller, libuv no longer reads it
+        ModeResult epoll{"epoll", {}};
+        run_mode(loop, tello, nullptr, config, epoll);
+        BusyPoller poller(*loop, config.busy_poll);
+        tello.receive_with(poller);
+        ModeResult busy{"busy-poll", {}};
+        run_mode(loop, tello, &poller, config, busy);
+
+        std::printf("%d x %s, one every %d ms, simulated drone on its own thread:\n", config.queries,
+                    config.query.c_str(), config.interval_ms);
+        print_mode(epoll, config.queries);
+        print_mode(busy, config.queries);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+    if (stop_sim) {
+        uv_async_send(stop_sim);
+    }
+    sim_thread.join();
+    uv_run(loop, UV_RUN_NOWAIT);
+    return status;
+}
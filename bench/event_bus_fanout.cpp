@@ -0,0 +1,177 @@
+// Fan-out throughput of the in-process event bus (include/event_bus.hpp) with 1 to 16 subscribers.
+//
+// One publisher thread copies a telemetry-sized payload into a pooled buffer and publishes it;
+// each subscriber drains its own ring on its own thread and reads the payload. The bus itself
+// never waits, so to measure lossless fan-out the publisher here yields while a ring is full
+// (--lossy publishes flat out instead). Reported per subscriber count: events published and
+// delivered per second, events dropped, pool misses, and publish-to-consume latency. --slow US
+// makes the first subscriber sleep on every event and leaves it out of the waiting: it drops,
+// while the others still get every event.
+// Needs no RabbitMQ, controller or drones.
+#include "event_bus.hpp"
+#include "histogram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchConfig {
+    std::vector<int> subscriber_counts = {1, 2, 4, 8, 16};
+    uint64_t events = 1000000;
+    size_t capacity = 1024;
+    size_t payload = 64; // About one encoded telemetry frame
+    int slow_us = 0; // First subscriber sleeps this long per event
+    bool lossy = false; // Publish without waiting for full rings
+};
+
+struct Sample {
+    uint64_t index;
+    uint64_t published_ns;
+};
+
+struct CountResult {
+    int subscribers = 0;
+    double publish_per_s = 0;
+    double deliver_per_s = 0;
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    uint64_t dropped_fast = 0; // Dropped by every subscriber but a --slow one
+    uint64_t pool_misses = 0;
+    Histogram latency_ns;
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static CountResult run_count(const BenchConfig& config, int count) {
+    CountResult result;
+    result.subscribers = count;
+    // Every ring shares one buffer per event, so two rings' worth covers the deepest backlog
+    EventBus bus(config.capacity * 2 + 64, config.payload);
+    std::vector<Subscription<Sample>*> subscriptions;
+    for (int i = 0; i < count; ++i) {
+        subscriptions.push_back(&bus.subscribe<Sample>("sub" + std::to_string(i), config.capacity));
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<int> ready{0};
+    std::vector<Histogram> latencies(count);
+    std::vector<uint64_t> checksums(count);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; ++i) {
+        threads.emplace_back([&, i]() {
+            Subscription<Sample>& subscription = *subscriptions[i];
+            bool slow = i == 0 && config.slow_us > 0;
+            ready.fetch_add(1);
+            for (;;) {
+                bool finished = done.load(std::memory_order_acquire);
+                size_t drained = subscription.drain([&](const Event<Sample>& event) {
+                    latencies[i].record(now_ns() - event.header.published_ns);
+                    checksums[i] += static_cast<unsigned char>(event.payload.view()[event.header.index % config.payload]);
+                    if (slow) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(config.slow_us));
+                    }
+                }, 256);
+                if (drained == 0) {
+                    if (finished) {
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    while (ready.load() < count) {
+        std::this_thread::yield();
+    }
+
+    std::vector<Subscription<Sample>*> waited_on;
+    if (!config.lossy) {
+        waited_on.assign(subscriptions.begin() + (config.slow_us > 0 ? 1 : 0), subscriptions.end());
+    }
+    auto full = [&waited_on]() {
+        for (auto* subscription : waited_on) {
+            if (subscription->backlog() >= subscription->capacity()) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::string frame(config.payload, 'x');
+    uint64_t start = now_ns();
+    for (uint64_t index = 0; index < config.events; ++index) {
+        while (full()) {
+            std::this_thread::yield();
+        }
+        frame[index % config.payload] = static_cast<char>(index);
+        BufferRef payload = bus.pool().copy(frame);
+        bus.publish(Sample{index, now_ns()}, payload);
+    }
+    double publish_s = (now_ns() - start) / 1e9;
+    done.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double total_s = (now_ns() - start) / 1e9;
+
+    for (int i = 0; i < count; ++i) {
+        const Subscription<Sample>& subscription = *subscriptions[i];
+        result.delivered += subscription.delivered();
+        result.dropped += subscription.dropped();
+        if (i > 0 || config.slow_us == 0) {
+            result.dropped_fast += subscription.dropped();
+        }
+        result.latency_ns.merge(latencies[i]);
+    }
+    result.publish_per_s = config.events / publish_s;
+    result.deliver_per_s = result.delivered / total_s;
+    result.pool_misses = bus.pool().misses();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--counts") {
+            config.subscriber_counts.clear();
+            std::istringstream counts(argv[i + 1]);
+            for (std::string count; std::getline(counts, count, ',');) {
+                config.subscriber_counts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--events") {
+            config.events = std::max(1LL, std::atoll(argv[i + 1]));
+        } else if (arg == "--capacity") {
+            config.capacity = std::max(2, std::atoi(argv[i + 1]));
+        } else if (arg == "--payload") {
+            config.payload = std::max(1, std::atoi(argv[i + 1]));
+        } else if (arg == "--slow") {
+            config.slow_us = std::max(0, std::atoi(argv[i + 1]));
+        } else if (arg == "--lossy") {
+            config.lossy = std::atoi(argv[i + 1]) != 0;
+        }
+    }
+
+    std::printf("%4s  %12s  %14s  %9s  %9s  %11s  %-22s\n", "subs", "publish ev/s", "delivered ev/s", "dropped",
+                "fast drop", "pool misses", "latency us p50/p99");
+    for (int count : config.subscriber_counts) {
+        CountResult r = run_count(config, count);
+        uint64_t offered = config.events * static_cast<uint64_t>(count);
+        std::printf("%4d  %12.0f  %14.0f  %8.2f%%  %8.2f%%  %11llu  %9.1f / %-10.1f\n", r.subscribers, r.publish_per_s,
+                    r.deliver_per_s, 100.0 * r.dropped / offered, 100.0 * r.dropped_fast / offered,
+                    static_cast<unsigned long long>(r.pool_misses), r.latency_ns.quantile(0.5) / 1000.0,
+                    r.latency_ns.quantile(0.99) / 1000.0);
+        std::fflush(stdout);
+    }
+    std::printf("(%u hardware thread(s); subscribers beyond that share cores with the publisher)\n",
+                std::thread::hardware_concurrency());
+    return 0;
+}
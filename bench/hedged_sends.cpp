@@ -0,0 +1,175 @@
+// Tail latency of drone commands over a lossy link, with and without RedundancyConfig
+// (include/tello.hpp).
+//
+// Two simulated drones with the same fault injection (SimConfig command_loss, reply_loss and
+// reply_jitter_ms) each get one client: a plain one, and one that hedges queries and sends
+// land/emergency as spaced copies. Both are driven in lockstep so they see the same machine state.
+// Reported are the query latency quantiles (a lost command counts at its timeout), failures, and
+// the extra datagrams redundancy cost. stderr, which gets a line per timeout, is sent to
+// /dev/null unless --stderr is given.
+#include "histogram.hpp"
+#include "tello.hpp"
+#include "tello_sim.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+struct BenchConfig {
+    int queries = 1000;
+    int lands = 200;
+    std::string query = "battery?";
+    double loss = 0.03; // Each way
+    int jitter_ms = 10;
+    int timeout_ms = 500;
+    int critical_copies = 3;
+    bool keep_stderr = false;
+};
+
+struct Variant {
+    const char* name;
+    BasicTello<LeanInstrumentation>* tello;
+    Histogram latency_us;
+    uint64_t failures = 0;
+    bool done = false;
+};
+
+// Send cmd through every variant at once and run the loop until all have answered or timed out
+static void run_step(uv_loop_t* loop, std::vector<Variant*>& variants, const std::string& cmd, int timeout_ms) {
+    for (Variant* variant : variants) {
+        variant->done = false;
+        uint64_t start = uv_hrtime();
+        variant->tello->send_command_async(cmd,
+            [variant, start](std::optional<std::string> reply) {
+                variant->latency_us.record((uv_hrtime() - start) / 1000);
+                variant->failures += reply ? 0 : 1;
+                variant->done = true;
+            },
+            std::chrono::milliseconds(timeout_ms));
+    }
+    for (bool all_done = false; !all_done;) {
+        uv_run(loop, UV_RUN_ONCE);
+        all_done = true;
+        for (const Variant* variant : variants) {
+            all_done = all_done && variant->done;
+        }
+    }
+}
+
+static void print_variant(const Variant& v, int commands) {
+    std::printf("  %-10s p50 %7.1f ms  p95 %7.1f ms  p99 %7.1f ms  max %7.1f ms  failed %llu/%d\n", v.name,
+                v.latency_us.quantile(0.5) / 1000.0, v.latency_us.quantile(0.95) / 1000.0,
+                v.latency_us.quantile(0.99) / 1000.0, v.latency_us.max() / 1000.0,
+                static_cast<unsigned long long>(v.failures), commands);
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stderr") {
+            config.keep_stderr = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            break;
+        }
+        std::string value = argv[++i];
+        if (arg == "-n") {
+            config.queries = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--lands") {
+            config.lands = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--query") {
+            config.query = value;
+        } else if (arg == "--loss") {
+            config.loss = std::atof(value.c_str()) / 100;
+        } else if (arg == "--jitter") {
+            config.jitter_ms = std::atoi(value.c_str());
+        } else if (arg == "--timeout") {
+            config.timeout_ms = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--copies") {
+            config.critical_copies = std::max(1, std::atoi(value.c_str()));
+        }
+    }
+
+    uv_loop_t* loop = uv_default_loop();
+    try {
+        SimConfig sim_config;
+        sim_config.telemetry_hz = 0;
+        sim_config.command_loss = config.loss;
+        sim_config.reply_loss = config.loss;
+        sim_config.reply_jitter_ms = config.jitter_ms;
+        SimulatedTello plain_sim(*loop, sim_config);
+        sim_config.ip = "127.0.0.3";
+        SimulatedTello redundant_sim(*loop, sim_config);
+
+        BasicTello<LeanInstrumentation> plain_tello("127.0.0.2", 8889, *loop, 0);
+        BasicTello<LeanInstrumentation> redundant_tello("127.0.0.3", 8889, *loop, 0);
+        RedundancyConfig redundancy;
+        redundancy.hedge_queries = true;
+        redundancy.critical_copies = config.critical_copies;
+        redundant_tello.set_redundancy(redundancy);
+
+        // Getting into SDK mode goes through the same lossy link
+        for (auto* tello : {&plain_tello, &redundant_tello}) {
+            int attempts = 0;
+            while (!tello->connect()) {
+                if (++attempts == 20) {
+                    throw std::runtime_error("Simulated drone at " + tello->ip() + " never entered SDK mode");
+                }
+            }
+        }
+
+        int saved_stderr = -1;
+        if (!config.keep_stderr) {
+            saved_stderr = dup(STDERR_FILENO);
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+
+        Variant plain{"plain", &plain_tello, {}, 0, false};
+        Variant redundant{"redundant", &redundant_tello, {}, 0, false};
+        std::vector<Variant*> variants = {&plain, &redundant};
+        for (int i = 0; i < config.queries; ++i) {
+            run_step(loop, variants, config.query, config.timeout_ms);
+        }
+        Variant plain_land{"plain", &plain_tello, {}, 0, false};
+        Variant redundant_land{"redundant", &redundant_tello, {}, 0, false};
+        std::vector<Variant*> land_variants = {&plain_land, &redundant_land};
+        for (int i = 0; i < config.lands; ++i) {
+            run_step(loop, land_variants, "land", config.timeout_ms);
+        }
+
+        if (saved_stderr >= 0) {
+            dup2(saved_stderr, STDERR_FILENO);
+            close(saved_stderr);
+        }
+
+        std::printf("Link: %.1f%% loss each way, 0-%d ms reply jitter, %d ms timeout\n", config.loss * 100,
+                    config.jitter_ms, config.timeout_ms);
+        std::printf("%d x %s:\n", config.queries, config.query.c_str());
+        print_variant(plain, config.queries);
+        print_variant(redundant, config.queries);
+        if (config.lands > 0) {
+            std::printf("%d x land (%d copies):\n", config.lands, config.critical_copies);
+            print_variant(plain_land, config.lands);
+            print_variant(redundant_land, config.lands);
+        }
+        uint64_t commands = config.queries + config.lands;
+        std::printf("Extra datagrams: %llu (%.1f%% of commands), late duplicates absorbed: %llu\n",
+                    static_cast<unsigned long long>(redundant_tello.extra_copies_sent()),
+                    100.0 * redundant_tello.extra_copies_sent() / commands,
+                    static_cast<unsigned long long>(redundant_tello.duplicates_absorbed()));
+        std::printf("Simulators received %llu (plain) and %llu (redundant) commands\n",
+                    static_cast<unsigned long long>(plain_sim.commands_received()),
+                    static_cast<unsigned long long>(redundant_sim.commands_received()));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    uv_run(loop, UV_RUN_NOWAIT);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Cost of instrumentation on the drone command path: BasicTello<FullInstrumentation> vs.
+// BasicTello<LeanInstrumentation> (include/instrumentation.hpp).
+//
+// Both clients talk to the same in-process SimulatedTello on one loop, in alternating rounds so
+// they see the same machine state. Reported are the command round trip and the process CPU time
+// per command; the simulator's share of both is identical, so the difference is the client's.
+// stdout is sent to /dev/null while measuring (--stdout keeps it), which prices the formatting of
+// the full build's log lines but not a terminal's rendering of them.
+//
+// No RabbitMQ or drone is needed. For the end-to-end controller delta, build tello_controller with
+// and without TELLO_LEAN and compare runs with tello_loadgen --save/--baseline.
+#include "histogram.hpp"
+#include "tello.hpp"
+#include "tello_sim.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+
+struct BenchConfig {
+    int iterations = 2000; // Commands per client per round
+    int rounds = 5;
+    std::string command = "battery?";
+    std::string sim_ip = "127.0.0.2";
+    bool keep_stdout = false;
+};
+
+struct Variant {
+    const char* name;
+    Histogram rtt_us;
+    uint64_t cpu_us = 0;
+};
+
+static uint64_t process_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL + usage.ru_utime.tv_usec
+           + usage.ru_stime.tv_usec;
+}
+
+template <typename Policy>
+static bool run_round(BasicTello<Policy>& tello, const BenchConfig& config, Variant& variant) {
+    uint64_t cpu_start = process_cpu_us();
+    for (int i = 0; i < config.iterations; ++i) {
+        uint64_t start = uv_hrtime();
+        if (!tello.send_command(config.command)) {
+            return false;
+        }
+        variant.rtt_us.record((uv_hrtime() - start) / 1000);
+    }
+    variant.cpu_us += process_cpu_us() - cpu_start;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stdout") {
+            config.keep_stdout = true;
+        } else if (i + 1 < argc && arg == "-n") {
+            config.iterations = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "--rounds") {
+            config.rounds = std::atoi(argv[++i]);
+        } else if (i + 1 < argc && arg == "--command") {
+            config.command = argv[++i];
+        } else if (i + 1 < argc && arg == "--sim-ip") {
+            config.sim_ip = argv[++i];
+        }
+    }
+
+    uv_loop_t* loop = uv_default_loop();
+    int saved_stdout = -1;
+    Variant full{"full", {}, 0}, lean{"lean", {}, 0};
+    try {
+        SimConfig sim_config;
+        sim_config.ip = config.sim_ip;
+        sim_config.telemetry_hz = 0;
+        SimulatedTello sim(*loop, sim_config);
+        BasicTello<FullInstrumentation> full_tello(config.sim_ip, sim_config.port, *loop, 0);
+        BasicTello<LeanInstrumentation> lean_tello(config.sim_ip, sim_config.port, *loop, 0);
+        if (!full_tello.connect() || !lean_tello.connect()) {
+            std::cerr << "Simulated drone did not answer" << std::endl;
+            return 1;
+        }
+
+        if (!config.keep_stdout) {
+            std::fflush(stdout); // std::cout shares the stdio buffer
+            saved_stdout = dup(STDOUT_FILENO);
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+        bool ok = true;
+        for (int round = 0; ok && round < config.rounds; ++round) {
+            ok = run_round(full_tello, config, full) && run_round(lean_tello, config, lean);
+        }
+        if (saved_stdout >= 0) {
+            std::fflush(stdout);
+            dup2(saved_stdout, STDOUT_FILENO);
+            close(saved_stdout);
+        }
+        if (!ok) {
+            std::cerr << "Command " << config.command << " failed" << std::endl;
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    for (const Variant* variant : {&full, &lean}) {
+        std::printf("%-5s %s\n", variant->name, format_latency(variant->rtt_us).c_str());
+    }
+    double full_cpu = static_cast<double>(full.cpu_us) / std::max<uint64_t>(1, full.rtt_us.count());
+    double lean_cpu = static_cast<double>(lean.cpu_us) / std::max<uint64_t>(1, lean.rtt_us.count());
+    std::printf("\nCPU per command (client + simulator): full %.2f us, lean %.2f us (%+.1f%%)\n\n", full_cpu,
+                lean_cpu, full_cpu > 0 ? 100.0 * (lean_cpu - full_cpu) / full_cpu : 0.0);
+    std::printf("Round trip, lean vs. full:\n%s", format_latency_diff(full.rtt_us, lean.rtt_us).c_str());
+    return 0;
+}
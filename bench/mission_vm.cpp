@@ -0,0 +1,124 @@
+// Cost of running mission scripts (include/mission_vm.hpp) on the register VM, in ns per instruction.
+//
+// "arithmetic" loops over expressions, variables and a telemetry read without yielding, which is
+// the interpreter at its busiest. "commands" yields a command on every pass of a loop and resumes
+// at once, as a host does when the drone answers instantly: the cost of a yield point. "compile"
+// is the time to compile a 1000-line script. Needs no RabbitMQ, controller or drones.
+#include "mission_vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+struct BenchConfig {
+    int64_t iterations = 5000000;
+    int repeats = 5; // Best of
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::shared_ptr<const MissionProgram> compile_or_exit(const std::string& text) {
+    auto program = std::make_shared<MissionProgram>(compile_mission(text));
+    if (!program->ok()) {
+        const MissionDiagnostic& d = program->diagnostics.front();
+        std::fprintf(stderr, "line %zu: %s\n", d.line, d.message.c_str());
+        std::exit(1);
+    }
+    return program;
+}
+
+struct RunResult {
+    uint64_t ns = UINT64_MAX;
+    uint64_t instructions = 0;
+    uint64_t yields = 0;
+};
+
+static RunResult run_script(const std::shared_ptr<const MissionProgram>& program, int repeats) {
+    RunResult best;
+    for (int r = 0; r < repeats; ++r) {
+        MissionVm vm(program);
+        vm.set_telemetry(MissionTelemetry::BAT, 80);
+        uint64_t yields = 0;
+        uint64_t start = now_ns();
+        for (;;) {
+            MissionVm::State state = vm.run(UINT64_MAX);
+            if (state == MissionVm::State::DONE) {
+                break;
+            }
+            if (state == MissionVm::State::FAULT) {
+                std::fprintf(stderr, "%s\n", vm.error().c_str());
+                std::exit(1);
+            }
+            yields++;
+        }
+        uint64_t ns = now_ns() - start;
+        if (ns < best.ns) {
+            best = {ns, vm.executed(), yields};
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--iterations") {
+            config.iterations = std::max(1LL, std::atoll(argv[i + 1]));
+        } else if (arg == "--repeats") {
+            config.repeats = std::max(1, std::atoi(argv[i + 1]));
+        }
+    }
+    std::string n = std::to_string(config.iterations);
+
+    auto arithmetic = compile_or_exit(
+        "set i = 0\n"
+        "set sum = 0\n"
+        "while i < " + n + "\n"
+        "    set sum = sum + i * 3 % 7\n"
+        "    if bat < 30 or sum < 0\n"
+        "        break\n"
+        "    end\n"
+        "    set i = i + 1\n"
+        "end\n");
+    auto commands = compile_or_exit(
+        "repeat " + n + "\n"
+        "    forward 50\n"
+        "end\n");
+
+    std::string long_script = "takeoff\nset n = 0\n";
+    for (int i = 0; i < 1000; ++i) {
+        long_script += i % 4 == 0 ? "if tof > 100 and n < 3\n" : i % 4 == 1 ? "    down {tof / 2}\n"
+                     : i % 4 == 2 ? "    set n = n + 1\n" : "end\n";
+    }
+    long_script += "land\n";
+
+    std::printf("%-11s  %12s  %12s  %9s  %10s\n", "script", "instructions", "yields", "ns/instr", "ns/yield");
+    for (auto [name, program] : {std::make_pair("arithmetic", arithmetic), std::make_pair("commands", commands)}) {
+        RunResult r = run_script(program, config.repeats);
+        std::printf("%-11s  %12llu  %12llu  %9.2f", name, static_cast<unsigned long long>(r.instructions),
+                    static_cast<unsigned long long>(r.yields), static_cast<double>(r.ns) / r.instructions);
+        if (r.yields) {
+            std::printf("  %10.1f\n", static_cast<double>(r.ns) / r.yields);
+        } else {
+            std::printf("  %10s\n", "-");
+        }
+    }
+
+    uint64_t best = UINT64_MAX;
+    size_t code = 0;
+    for (int r = 0; r < config.repeats; ++r) {
+        uint64_t start = now_ns();
+        MissionProgram program = compile_mission(long_script);
+        best = std::min(best, now_ns() - start);
+        code = program.code.size();
+    }
+    std::printf("compile      %zu lines to %zu instructions in %.1f us\n", std::count(long_script.begin(),
+                long_script.end(), '\n'), code, best / 1000.0);
+    return 0;
+}
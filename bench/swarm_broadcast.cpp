@@ -0,0 +1,143 @@
+// Formation step dispatch: one send per drone through each drone's Tello vs. one sendmmsg()
+// through SwarmBroadcaster.
+//
+// For each swarm size, N simulated drones are started on 127.0.0.2 and up. Each round sends
+// every drone its own rc setpoint, first through the per-drone Tello clients and then through
+// the broadcaster. Dispatch time is the time from the first send until the last one returns,
+// which is how far apart the first and last drones see the step. Syscalls are counted per step.
+// Needs no RabbitMQ or controller; large swarms need `ulimit -n` above 2 * N (raised if allowed).
+#include "histogram.hpp"
+#include "swarm_broadcast.hpp"
+#include "tello.hpp"
+#include "tello_sim.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+struct BenchConfig {
+    std::vector<int> drone_counts = {10, 50, 100, 250, 500, 1000};
+    int rounds = 200;
+};
+
+struct SizeResult {
+    int drones = 0;
+    Histogram per_drone_ns;
+    Histogram broadcast_ns;
+    double per_drone_syscalls = 0;
+    double broadcast_syscalls = 0;
+};
+
+static std::string sim_address(int index) {
+    uint32_t address = (127u << 24) + 2 + index;
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xff) + "."
+           + std::to_string((address >> 8) & 0xff) + "." + std::to_string(address & 0xff);
+}
+
+static void raise_fd_limit(int needed) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < static_cast<rlim_t>(needed)) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, needed);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Run the loop until every simulated drone has read this round's datagrams
+static void drain(uv_loop_t* loop, const std::vector<std::unique_ptr<SimulatedTello>>& sims, uint64_t expected) {
+    for (int spins = 0; spins < 1000; ++spins) {
+        uint64_t received = 0;
+        for (const auto& sim : sims) {
+            received += sim->commands_received();
+        }
+        if (received >= expected) {
+            return;
+        }
+        uv_run(loop, UV_RUN_NOWAIT);
+    }
+}
+
+static SizeResult run_size(uv_loop_t* loop, int count, int rounds) {
+    SizeResult result;
+    result.drones = count;
+    std::vector<std::unique_ptr<SimulatedTello>> sims;
+    std::vector<std::unique_ptr<BasicTello<LeanInstrumentation>>> tellos;
+    SwarmBroadcaster broadcaster(*loop);
+    for (int i = 0; i < count; ++i) {
+        SimConfig sim;
+        sim.ip = sim_address(i);
+        sim.telemetry_hz = 0;
+        sims.push_back(std::make_unique<SimulatedTello>(*loop, sim));
+        tellos.push_back(std::make_unique<BasicTello<LeanInstrumentation>>(sim.ip, sim.port, *loop, 0));
+        broadcaster.add_drone(sim.ip, sim.port);
+    }
+
+    uint64_t expected = 0;
+    std::vector<std::string> setpoints(count);
+    for (int round = 0; round < rounds; ++round) {
+        // Each drone gets its own setpoint, as in a formation where drones fly different legs
+        for (int i = 0; i < count; ++i) {
+            setpoints[i] = "rc " + std::to_string((i + round) % 100) + " 0 " + std::to_string(i % 50) + " 0";
+        }
+
+        uint64_t start = uv_hrtime();
+        for (int i = 0; i < count; ++i) {
+            tellos[i]->send_command_async(setpoints[i], [](std::optional<std::string>) {});
+        }
+        result.per_drone_ns.record(uv_hrtime() - start);
+        expected += count;
+        drain(loop, sims, expected);
+
+        uint64_t syscalls = broadcaster.syscalls();
+        start = uv_hrtime();
+        broadcaster.send([&setpoints](size_t drone, std::string& out) { out += setpoints[drone]; });
+        result.broadcast_ns.record(uv_hrtime() - start);
+        result.broadcast_syscalls += broadcaster.syscalls() - syscalls;
+        expected += count;
+        drain(loop, sims, expected);
+    }
+    result.per_drone_syscalls = count;
+    result.broadcast_syscalls /= rounds;
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--counts") {
+            config.drone_counts.clear();
+            std::istringstream counts(argv[i + 1]);
+            for (std::string count; std::getline(counts, count, ',');) {
+                config.drone_counts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--rounds") {
+            config.rounds = std::max(1, std::atoi(argv[i + 1]));
+        }
+    }
+
+    uv_loop_t* loop = uv_default_loop();
+    std::printf("%6s  %-28s  %-28s  %9s  %7s\n", "drones", "per-drone sends us p50/p99", "sendmmsg us p50/p99",
+                "syscalls", "speedup");
+    for (int count : config.drone_counts) {
+        raise_fd_limit(2 * count + 64);
+        try {
+            SizeResult r = run_size(loop, count, config.rounds);
+            double per_drone_p50 = r.per_drone_ns.quantile(0.5) / 1000.0;
+            double broadcast_p50 = r.broadcast_ns.quantile(0.5) / 1000.0;
+            std::printf("%6d  %12.1f / %-13.1f  %12.1f / %-13.1f  %4.0f/%-4.1f  %6.1fx\n", r.drones, per_drone_p50,
+                        r.per_drone_ns.quantile(0.99) / 1000.0, broadcast_p50, r.broadcast_ns.quantile(0.99) / 1000.0,
+                        r.per_drone_syscalls, r.broadcast_syscalls,
+                        broadcast_p50 > 0 ? per_drone_p50 / broadcast_p50 : 0.0);
+            std::fflush(stdout);
+        } catch (const std::exception& e) {
+            std::cerr << "Error at " << count << " drones: " << e.what() << std::endl;
+            return 1;
+        }
+        // Let the closed handles of this size finish before binding the next
+        uv_run(loop, UV_RUN_NOWAIT);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Telemetry predicate subscriptions (include/telemetry_filter.hpp) against the obvious approach,
+// one std::function per subscription called for every sample.
+//
+// A batch holds one sample per drone, as the controller gathers them per loop iteration. Most
+// subscriptions watch one drone and a tenth watch all of them; thresholds come from a small set,
+// so subscriptions share comparisons as real clients' do. Both sides must report the same number
+// of matches (a drone's sample starting to match). Before timing anything it checks that predicates
+// nesting past the limit are rejected rather than overflowing the parser's stack, since any gateway
+// client can send one. Needs no RabbitMQ, controller or drones.
+#include "telemetry_filter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct BenchConfig {
+    std::vector<int> subscription_counts = {100, 1000, 5000, 10000};
+    int drones = 100;
+    int batches = 2000;
+};
+
+struct Watch {
+    std::string predicate;
+    uint32_t drone; // TelemetryFilters::kAnySource for all
+    std::function<bool(const TelloState&)> test;
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Watch make_watch(std::mt19937& rng, int drones) {
+    int k1 = 10 + 5 * static_cast<int>(rng() % 8);
+    int k2 = 100 + 50 * static_cast<int>(rng() % 6);
+    uint32_t drone = rng() % 10 == 0 ? TelemetryFilters::kAnySource : static_cast<uint32_t>(rng() % drones);
+    switch (rng() % 4) {
+        case 0:
+            return {"bat < " + std::to_string(k1), drone, [k1](const TelloState& s) { return s.bat < k1; }};
+        case 1:
+            return {"h > " + std::to_string(k2), drone, [k2](const TelloState& s) { return s.h > k2; }};
+        case 2:
+            return {"bat < " + std::to_string(k1) + " or h > " + std::to_string(k2), drone,
+                    [k1, k2](const TelloState& s) { return s.bat < k1 || s.h > k2; }};
+        default:
+            return {"tof < " + std::to_string(k1) + " and not (vgz >= 0)", drone,
+                    [k1](const TelloState& s) { return s.tof < k1 && !(s.vgz >= 0); }};
+    }
+}
+
+// Random walks, so predicates keep turning true and false
+static void step(std::mt19937& rng, std::vector<TelloState>& states) {
+    for (auto& s : states) {
+        s.bat = std::clamp(s.bat + static_cast<int>(rng() % 5) - 2, 0, 100);
+        s.h = std::clamp(s.h + static_cast<int>(rng() % 41) - 20, 0, 400);
+        s.tof = std::clamp(s.tof + static_cast<int>(rng() % 11) - 5, 0, 100);
+        s.vgz = static_cast<int>(rng() % 21) - 10;
+    }
+}
+
+// 64 levels of parentheses or negations parse; 30000 (a 60 KB gateway frame) must throw, not crash
+static bool check_nesting() {
+    TelemetryFilters filters;
+    auto nested = [](const std::string& open, const std::string& close, int levels) {
+        std::string predicate;
+        for (int i = 0; i < levels; ++i) {
+            predicate += open;
+        }
+        predicate += "bat < 1";
+        for (int i = 0; i < levels; ++i) {
+            predicate += close;
+        }
+        return predicate;
+    };
+    bool ok = true;
+    for (const auto& [open, close] : {std::make_pair(std::string("("), std::string(")")),
+                                      std::make_pair(std::string("not "), std::string()),
+                                      std::make_pair(std::string("!"), std::string())}) {
+        try {
+            filters.add(nested(open, close, 64));
+        } catch (const std::runtime_error& e) {
+            std::printf("64 levels of \"%s\" rejected: %s\n", open.c_str(), e.what());
+            ok = false;
+        }
+        try {
+            filters.add(nested(open, close, 30000));
+            std::printf("30000 levels of \"%s\" accepted\n", open.c_str());
+            ok = false;
+        } catch (const std::runtime_error&) {
+        }
+    }
+    return ok && filters.size() == 3;
+}
+
+int main(int argc, char* argv[]) {
+    if (!check_nesting()) {
+        std::printf("nesting check FAILED\n");
+        return 1;
+    }
+
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--counts") {
+            config.subscription_counts.clear();
+            std::istringstream counts(argv[i + 1]);
+            for (std::string count; std::getline(counts, count, ',');) {
+                config.subscription_counts.push_back(std::max(1, std::atoi(count.c_str())));
+            }
+        } else if (arg == "--drones") {
+            config.drones = std::max(1, std::atoi(argv[i + 1]));
+        } else if (arg == "--batches") {
+            config.batches = std::max(1, std::atoi(argv[i + 1]));
+        }
+    }
+
+    std::printf("%6s  %11s  %16s  %16s  %7s  %9s\n", "subs", "comparisons", "compiled ns/smp", "function ns/smp",
+                "speedup", "matches");
+    for (int count : config.subscription_counts) {
+        std::mt19937 rng(42);
+        TelemetryFilters filters;
+        std::vector<Watch> watches;
+        for (int i = 0; i < count; ++i) {
+            watches.push_back(make_watch(rng, config.drones));
+            filters.add(watches.back().predicate, watches.back().drone);
+        }
+
+        std::vector<TelloState> states(config.drones);
+        for (auto& s : states) {
+            s.bat = 50;
+            s.h = 150;
+            s.tof = 50;
+        }
+        std::vector<std::vector<uint8_t>> matching(count, std::vector<uint8_t>(config.drones));
+        TelemetryBatch batch;
+        std::vector<FilterMatch> matches;
+        uint64_t compiled_ns = 0, function_ns = 0, compiled_matches = 0, function_matches = 0;
+        for (int b = 0; b < config.batches; ++b) {
+            step(rng, states);
+
+            uint64_t start = now_ns();
+            batch.clear();
+            for (int drone = 0; drone < config.drones; ++drone) {
+                batch.add(drone, states[drone]);
+            }
+            matches.clear();
+            filters.evaluate(batch, matches);
+            compiled_ns += now_ns() - start;
+            compiled_matches += matches.size();
+
+            start = now_ns();
+            for (int drone = 0; drone < config.drones; ++drone) {
+                for (int i = 0; i < count; ++i) {
+                    const Watch& watch = watches[i];
+                    if (watch.drone != TelemetryFilters::kAnySource && watch.drone != static_cast<uint32_t>(drone)) {
+                        continue;
+                    }
+                    bool match = watch.test(states[drone]);
+                    function_matches += match && !matching[i][drone];
+                    matching[i][drone] = match;
+                }
+            }
+            function_ns += now_ns() - start;
+        }
+
+        double samples = static_cast<double>(config.batches) * config.drones;
+        std::printf("%6d  %11zu  %16.1f  %16.1f  %6.1fx  %9llu%s\n", count, filters.comparisons(),
+                    compiled_ns / samples, function_ns / samples,
+                    compiled_ns ? static_cast<double>(function_ns) / compiled_ns : 0.0,
+                    static_cast<unsigned long long>(compiled_matches),
+                    compiled_matches == function_matches ? "" : "  MISMATCH");
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+// Teleop round-trip latency: WebSocket gateway vs. the RabbitMQ command path.
+//
+// Sends the same query alternately through both paths of a running tello_controller and
+// reports RTT percentiles. Run it without flight_controller attached, since both consume
+// tello_responses.
+#include "histogram.hpp"
+#include "websocket.hpp"
+#include <amqpcpp.h>
+#include <amqpcpp/libuv.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+struct BenchConfig {
+    std::string gateway_host = "127.0.0.1";
+    int gateway_port = 8765;
+    std::string rabbitmq_host = "localhost";
+    int rabbitmq_port = 5672;
+    int iterations = 200;
+    std::string command = "battery?";
+};
+
+class TeleopLatencyBench {
+public:
+    explicit TeleopLatencyBench(const BenchConfig& config) : config_(config), handler_(uv_default_loop()) {
+        AMQP::Address address(config_.rabbitmq_host, config_.rabbitmq_port, AMQP::Login("guest", "guest"), "/");
+        conn_ = std::make_unique<AMQP::TcpConnection>(&handler_, address);
+        channel_ = std::make_unique<AMQP::TcpChannel>(conn_.get());
+        channel_->onError([](const char* message) {
+            std::cerr << "Channel error: " << message << std::endl;
+            uv_stop(uv_default_loop());
+        });
+        channel_->declareQueue("tello_responses", AMQP::durable);
+        channel_->consume("tello_responses", AMQP::noack)
+            .onSuccess([this]() {
+                amqp_ready_ = true;
+                maybe_start();
+            })
+            .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                if (message.correlationID() == expected_id_) {
+                    amqp_rtt_us_.record((uv_hrtime() - sent_at_) / 1000);
+                    next();
+                }
+            });
+
+        ws_ = std::make_unique<WebSocketClient>(*uv_default_loop(), config_.gateway_host, config_.gateway_port,
+            [this](bool ok) {
+                if (!ok) {
+                    uv_stop(uv_default_loop());
+                    return;
+                }
+                ws_ready_ = true;
+                maybe_start();
+            },
+            [this](WsOpcode opcode, std::string_view payload) {
+                if (opcode == WsOpcode::TEXT && payload.substr(0, payload.find(' ')) == expected_id_) {
+                    ws_rtt_us_.record((uv_hrtime() - sent_at_) / 1000);
+                    next();
+                }
+            });
+    }
+
+    void run() {
+        uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+        std::printf("%-10s %s\n", "websocket", format_latency(ws_rtt_us_).c_str());
+        std::printf("%-10s %s\n", "amqp", format_latency(amqp_rtt_us_).c_str());
+    }
+
+private:
+    void maybe_start() {
+        if (ws_ready_ && amqp_ready_ && step_ == 0) {
+            next();
+        }
+    }
+
+    // Alternate paths so both see the same drone and network conditions
+    void next() {
+        if (step_ >= 2 * config_.iterations) {
+            ws_->close();
+            conn_->close();
+            return;
+        }
+        expected_id_ = "bench-" + std::to_string(step_);
+        sent_at_ = uv_hrtime();
+        if (step_ % 2 == 0) {
+            ws_->send_text(expected_id_ + " " + config_.command);
+        } else {
+            AMQP::Envelope envelope(config_.command.data(), config_.command.size());
+            envelope.setCorrelationID(expected_id_);
+            channel_->publish("", "tello_commands", envelope);
+        }
+        step_++;
+    }
+
+    BenchConfig config_;
+    AMQP::LibUvHandler handler_;
+    std::unique_ptr<AMQP::TcpConnection> conn_;
+    std::unique_ptr<AMQP::TcpChannel> channel_;
+    std::unique_ptr<WebSocketClient> ws_;
+    bool ws_ready_ = false;
+    bool amqp_ready_ = false;
+    int step_ = 0;
+    std::string expected_id_;
+    uint64_t sent_at_ = 0;
+    Histogram ws_rtt_us_;
+    Histogram amqp_rtt_us_;
+};
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "-n") {
+            config.iterations = std::atoi(argv[i + 1]);
+        } else if (arg == "--command") {
+            config.command = argv[i + 1];
+        } else if (arg == "--gateway-port") {
+            config.gateway_port = std::atoi(argv[i + 1]);
+        } else if (arg == "--rabbitmq") {
+            config.rabbitmq_host = argv[i + 1];
+        }
+    }
+
+    try {
+        TeleopLatencyBench bench(config);
+        bench.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
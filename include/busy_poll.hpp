@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <sys/socket.h>
+#include <uv.h>
+#include <vector>
+
+struct BusyPollConfig {
+    int cpu = -1; // Pin the polling thread to this core (-1 leaves it where it is)
+    int socket_busy_poll_us = 0; // SO_BUSY_POLL per socket: the kernel spins on the NIC queue this long
+                                 // inside recvmmsg (needs CAP_NET_ADMIN and a driver with NAPI busy polling)
+};
+
+// Pin the calling thread to one core; false, with a message on std::cerr, if the kernel refuses
+bool pin_current_thread(int cpu);
+
+// Spin loop for a dedicated core. The UDP sockets handed to it are no longer watched by libuv;
+// every spin drains them with non-blocking recvmmsg and then makes one non-blocking pass over the
+// loop, which services timers and every other handle, the AMQP connection included. A reply is
+// then picked up as soon as it is in the socket instead of after an epoll wakeup, at the price of
+// the core running at 100% whether or not there is traffic. Sends are already non-blocking
+// (uv_udp_try_send, sendmmsg in SwarmBroadcaster) and go out from the handlers.
+class BusyPoller {
+public:
+    using DatagramHandler = std::function<void(std::string_view data, const struct sockaddr* from)>;
+
+    explicit BusyPoller(uv_loop_t& loop, const BusyPollConfig& config = BusyPollConfig{});
+
+    // Receive on `udp` from now on. The handler runs synchronously and must not keep `data` or
+    // add sockets.
+    void add(uv_udp_t* udp, DatagramHandler handler);
+
+    // One spin: drain the sockets, then run the loop without blocking. Returns whether anything
+    // was received or the loop still has work.
+    bool poll_once();
+
+    // Spin until stop(), pinned to BusyPollConfig::cpu if set
+    void run();
+    void stop() { stopped_ = true; }
+
+    uint64_t spins() const { return spins_; }
+    uint64_t datagrams() const { return datagrams_; }
+    uint64_t batches() const { return batches_; } // recvmmsg calls that returned datagrams
+
+private:
+    static constexpr unsigned kBatch = 16;
+    static constexpr size_t kDatagramSize = 2048;
+
+    struct Socket {
+        int fd;
+        DatagramHandler handler;
+    };
+
+    void drain(const Socket& socket);
+
+    uv_loop_t& loop_;
+    BusyPollConfig config_;
+    std::vector<Socket> sockets_;
+    std::vector<char> buffers_; // kBatch datagrams, shared by all sockets
+    struct mmsghdr messages_[kBatch];
+    struct iovec iovecs_[kBatch];
+    struct sockaddr_storage addresses_[kBatch];
+    bool stopped_ = false;
+    uint64_t spins_ = 0;
+    uint64_t datagrams_ = 0;
+    uint64_t batches_ = 0;
+};
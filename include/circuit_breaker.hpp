@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class BreakerState { CLOSED, OPEN, HALF_OPEN };
+
+const char* breaker_state_name(BreakerState state);
+
+struct BreakerConfig {
+    int failure_threshold = 3; // Consecutive timeouts that open the circuit
+    int outlier_threshold = 5; // Consecutive query round trips that are outliers
+    double outlier_factor = 4.0; // An outlier takes this many times the usual query round trip...
+    uint64_t min_outlier_ms = 200; // ...and at least this long
+    uint64_t open_ms = 1000; // Wait before the first probe; doubles with every failed probe
+    uint64_t max_open_ms = 16000;
+    int close_after = 2; // Consecutive good probes that close the circuit again
+};
+
+// Per-drone circuit breaker. CLOSED passes commands. Consecutive timeouts or round-trip outliers
+// trip it OPEN, where commands fail at once instead of each waiting out a timeout. After
+// open_ms it goes HALF_OPEN and the caller probes with a cheap query, one at a time.
+// close_after answered probes close it, and their mean round trip becomes the baseline outliers are
+// judged by. A probe that goes unanswered reopens it for twice as long.
+// land and emergency always pass. Time is passed in (uv_now() milliseconds).
+class CircuitBreaker {
+public:
+    explicit CircuitBreaker(const BreakerConfig& config = BreakerConfig{});
+
+    // Whether cmd may go to the drone now
+    bool allow(std::string_view cmd) const;
+
+    // A command was answered (rtt_us set) or timed out; returns true when the state changed.
+    // Only counts while CLOSED: in the other states the probes decide.
+    bool on_result(std::string_view cmd, std::optional<uint64_t> rtt_us, uint64_t now_ms);
+
+    // True when the caller should send a probe now; moves OPEN to HALF_OPEN once open_ms is up
+    bool probe_due(uint64_t now_ms);
+
+    // Outcome of the probe probe_due() asked for; returns true when the state changed
+    bool on_probe(std::optional<uint64_t> rtt_us, uint64_t now_ms);
+
+    BreakerState state() const { return state_; }
+    uint64_t trips() const { return trips_; }
+
+    // "state=OPEN failures=3 outliers=0 trips=1 retry_ms=2000"
+    std::string describe(uint64_t now_ms) const;
+
+private:
+    bool is_outlier(uint64_t rtt_us) const;
+    void open(uint64_t now_ms);
+
+    BreakerConfig config_;
+    BreakerState state_ = BreakerState::CLOSED;
+    int failures_ = 0; // Consecutive timeouts
+    int outliers_ = 0; // Consecutive outlier round trips
+    int good_probes_ = 0;
+    uint64_t probe_rtt_us_ = 0; // Sum over the good probes so far
+    bool probe_in_flight_ = false;
+    uint64_t baseline_us_ = 0; // Smoothed query round trip, outliers left out
+    uint64_t open_ms_;
+    uint64_t open_until_ms_ = 0;
+    uint64_t trips_ = 0;
+};
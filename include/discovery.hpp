@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <uv.h>
+#include <vector>
+
+// A drone that answered a discovery probe
+struct DiscoveredDrone {
+    std::string serial; // Answer to "sn?", stable across DHCP leases
+    std::string ip;
+};
+
+struct DiscoveryConfig {
+    std::string subnet = "192.168.10.0/24"; // CIDR; network and broadcast addresses are skipped below /31
+    int port = 8889; // SDK command port of the drones
+    int probes_per_second = 200; // Paces "command" probes (and their retries) across the subnet
+    int timeout_ms = 300; // Reply window for each probe
+    int attempts = 2; // Probes per host before it is given up on
+};
+
+// Finds Tellos in station mode by sending "command" to every host of a subnet from one UDP
+// socket, many probes in flight at once, and asking each responder for its serial with "sn?".
+// Probing puts responders in SDK mode, which is what a controller does first anyway.
+class DroneDiscovery {
+public:
+    using FoundCallback = std::function<void(const DiscoveredDrone& drone)>;
+    using DoneCallback = std::function<void(std::vector<DiscoveredDrone> drones)>;
+
+    // Throws std::runtime_error for a malformed subnet, one larger than /16, or a socket failure
+    DroneDiscovery(uv_loop_t& loop, const DiscoveryConfig& config);
+    ~DroneDiscovery() = default; // RAII cleanup via unique_ptr
+
+    // Scan once; on_found fires per drone as soon as its serial is known, on_done with all of
+    // them (ordered by address) after the last probe has timed out or been answered
+    void start(FoundCallback on_found, DoneCallback on_done);
+
+    // Blocking scan: runs the loop until start()'s scan is done
+    std::vector<DiscoveredDrone> run();
+
+    // Host addresses of a CIDR subnet in host byte order
+    static std::vector<uint32_t> subnet_hosts(const std::string& cidr);
+
+private:
+    struct UdpDeleter {
+        void operator()(uv_udp_t* udp) const {
+            if (udp) {
+                uv_udp_recv_stop(udp);
+                uv_close(reinterpret_cast<uv_handle_t*>(udp), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_udp_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct TimerDeleter {
+        void operator()(uv_timer_t* timer) const {
+            if (timer) {
+                uv_timer_stop(timer);
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    enum class Stage { QUEUED, PROBED, IDENTIFYING, FOUND, GONE };
+
+    struct Host {
+        Stage stage = Stage::QUEUED;
+        int attempts = 0; // Probes sent in the current stage
+        uint64_t deadline = 0; // uv_now() by which the current probe must be answered
+    };
+
+    void on_tick();
+    bool send_probe(uint32_t address, Host& host, std::string_view probe);
+    void identify(uint32_t address, Host& host);
+    void on_reply(uint32_t address, std::string_view reply);
+    void finish();
+
+    uv_loop_t& loop_;
+    DiscoveryConfig config_;
+    std::unique_ptr<uv_udp_t, UdpDeleter> udp_socket_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> tick_timer_;
+    std::unordered_map<uint32_t, Host> hosts_;
+    std::deque<uint32_t> queue_; // Hosts waiting for a paced "command" probe
+    std::deque<std::pair<uint64_t, uint32_t>> in_flight_; // (deadline, host), in send order
+    std::map<uint32_t, DiscoveredDrone> found_; // By address
+    FoundCallback on_found_;
+    DoneCallback on_done_;
+    uint64_t started_ = 0;
+    uint64_t paced_sent_ = 0;
+    bool running_ = false;
+    char recv_buffer_[256];
+};
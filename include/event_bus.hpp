@@ -0,0 +1,293 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class BufferPool;
+
+// Shared reference to a payload buffer. Copies share the buffer through an atomic count; the last
+// one to go returns it to its pool, from whichever thread drops it.
+class BufferRef {
+public:
+    BufferRef() = default;
+    BufferRef(const BufferRef& other) noexcept : block_(other.block_) {
+        if (block_) {
+            block_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    BufferRef(BufferRef&& other) noexcept : block_(other.block_) { other.block_ = nullptr; }
+    BufferRef& operator=(BufferRef other) noexcept {
+        std::swap(block_, other.block_);
+        return *this;
+    }
+    ~BufferRef() { reset(); }
+
+    void reset();
+
+    explicit operator bool() const { return block_ != nullptr; }
+    char* data() { return reinterpret_cast<char*>(block_ + 1); } // Writable until published
+    const char* data() const { return reinterpret_cast<const char*>(block_ + 1); }
+    size_t size() const { return block_ ? block_->size : 0; }
+    std::string_view view() const { return block_ ? std::string_view(data(), block_->size) : std::string_view(); }
+    uint32_t use_count() const { return block_ ? block_->refs.load(std::memory_order_relaxed) : 0; }
+
+private:
+    friend class BufferPool;
+
+    struct Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size;
+        BufferPool* pool; // Null for blocks allocated outside the pool
+        Block* next; // Free list link while in the pool
+        // The payload follows
+    };
+
+    explicit BufferRef(Block* block) : block_(block) {}
+
+    Block* block_ = nullptr;
+};
+
+// Fixed set of equally sized, cache-line-aligned buffers. acquire() belongs to one thread (the
+// publisher); buffers come back from any thread onto a lock-free stack, which needs no ABA guard
+// because only that thread pops. An empty pool or a payload bigger than a buffer falls back to a
+// heap block, counted in misses(), so a subscriber sitting on buffers slows nobody else down.
+class BufferPool {
+public:
+    BufferPool(size_t buffers, size_t buffer_size);
+    ~BufferPool(); // Every BufferRef to a pooled buffer must be gone
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    BufferRef acquire(size_t size);
+    BufferRef copy(std::string_view bytes); // The one copy a payload gets
+
+    size_t capacity() const { return buffers_; }
+    size_t buffer_size() const { return buffer_size_; }
+    size_t available() const { return available_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    friend class BufferRef;
+
+    void release(BufferRef::Block* block);
+
+    size_t buffers_;
+    size_t buffer_size_;
+    size_t stride_;
+    char* storage_ = nullptr;
+    std::atomic<BufferRef::Block*> free_{nullptr};
+    std::atomic<size_t> available_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+// One event as a subscriber sees it: a small typed header copied into the subscriber's ring and a
+// payload shared by every subscriber. Sequence numbers are per event type, so a gap shows how many
+// events this subscriber lost.
+template <typename T>
+struct Event {
+    uint64_t sequence = 0;
+    T header{};
+    BufferRef payload;
+};
+
+// A subscriber's single-producer single-consumer ring. The publisher never waits on it: when the
+// ring is full the event is dropped for this subscriber alone and counted in dropped().
+template <typename T>
+class Subscription {
+public:
+    Subscription(std::string name, size_t capacity)
+        : name_(std::move(name)), ring_(round_up(capacity)), mask_(ring_.size() - 1) {}
+
+    Subscription(const Subscription&) = delete;
+    Subscription& operator=(const Subscription&) = delete;
+
+    // Consumer thread
+    bool poll(Event<T>& out) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return false;
+            }
+        }
+        Event<T>& slot = ring_[head & mask_];
+        out.sequence = slot.sequence;
+        out.header = slot.header;
+        out.payload = std::move(slot.payload);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread: hand up to `max` events to handler(const Event<T>&); returns how many
+    template <typename F>
+    size_t drain(F&& handler, size_t max = SIZE_MAX) {
+        Event<T> event;
+        size_t count = 0;
+        while (count < max && poll(event)) {
+            handler(event);
+            count++;
+        }
+        event.payload.reset();
+        return count;
+    }
+
+    const std::string& name() const { return name_; }
+    size_t capacity() const { return ring_.size(); }
+    uint64_t delivered() const { return tail_.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    size_t backlog() const {
+        return static_cast<size_t>(tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed));
+    }
+
+private:
+    friend class EventBus;
+
+    static size_t round_up(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // Publisher thread
+    bool offer(uint64_t sequence, const T& header, const BufferRef& payload) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        Event<T>& slot = ring_[tail & mask_];
+        slot.sequence = sequence;
+        slot.header = header;
+        slot.payload = payload;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::string name_;
+    std::vector<Event<T>> ring_;
+    size_t mask_;
+    alignas(64) std::atomic<uint64_t> tail_{0}; // Next slot the publisher fills
+    uint64_t cached_head_ = 0; // Publisher's last look at head_
+    std::atomic<uint64_t> dropped_{0};
+    alignas(64) std::atomic<uint64_t> head_{0}; // Next slot the consumer reads
+    uint64_t cached_tail_ = 0; // Consumer's last look at tail_
+};
+
+// Typed publish/subscribe inside one process. Each event type T (a small, trivially copyable
+// header) has its own subscribers; publish() copies the header into every subscriber's ring and
+// shares the pooled payload between them, so fan-out costs a ring slot and a reference count per
+// subscriber and never copies the payload. Subscriptions may be drained on any one thread each,
+// but subscribe(), unsubscribe() and publish() all belong to the publisher's thread, and a
+// subscription must no longer be drained once unsubscribed.
+class EventBus {
+public:
+    explicit EventBus(size_t buffers = 4096, size_t buffer_size = 256) : pool_(buffers, buffer_size) {}
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    template <typename T>
+    Subscription<T>& subscribe(std::string name, size_t capacity = 1024) {
+        auto& subscribers = topic<T>().subscribers;
+        subscribers.push_back(std::make_unique<Subscription<T>>(std::move(name), capacity));
+        return *subscribers.back();
+    }
+
+    template <typename T>
+    void unsubscribe(const Subscription<T>& subscription) {
+        auto& subscribers = topic<T>().subscribers;
+        for (auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+            if (it->get() == &subscription) {
+                subscribers.erase(it);
+                return;
+            }
+        }
+    }
+
+    // Returns how many subscribers took the event
+    template <typename T>
+    size_t publish(const T& header, const BufferRef& payload = BufferRef()) {
+        static_assert(std::is_trivially_copyable_v<T>, "Event headers are copied into every ring");
+        Topic<T>& events = topic<T>();
+        uint64_t sequence = ++events.sequence;
+        size_t taken = 0;
+        for (auto& subscriber : events.subscribers) {
+            taken += subscriber->offer(sequence, header, payload);
+        }
+        return taken;
+    }
+
+    template <typename T>
+    bool has_subscribers() {
+        return !topic<T>().subscribers.empty();
+    }
+
+    // Every subscription, for metrics: visit(const std::string& name, delivered, dropped)
+    template <typename F>
+    void for_each_subscription(F&& visit) const {
+        for (const auto& topic : topics_) {
+            if (topic) {
+                topic->visit(visit);
+            }
+        }
+    }
+
+    BufferPool& pool() { return pool_; }
+
+private:
+    using Visitor = std::function<void(const std::string&, uint64_t, uint64_t)>;
+
+    struct TopicBase {
+        virtual ~TopicBase() = default;
+        virtual void visit(const Visitor& visitor) const = 0;
+    };
+
+    template <typename T>
+    struct Topic : TopicBase {
+        std::vector<std::unique_ptr<Subscription<T>>> subscribers;
+        uint64_t sequence = 0;
+
+        void visit(const Visitor& visitor) const override {
+            for (const auto& subscriber : subscribers) {
+                visitor(subscriber->name(), subscriber->delivered(), subscriber->dropped());
+            }
+        }
+    };
+
+    static size_t next_type_id();
+
+    template <typename T>
+    static size_t type_id() {
+        static const size_t id = next_type_id();
+        return id;
+    }
+
+    template <typename T>
+    Topic<T>& topic() {
+        size_t id = type_id<T>();
+        if (id >= topics_.size()) {
+            topics_.resize(id + 1);
+        }
+        if (!topics_[id]) {
+            topics_[id] = std::make_unique<Topic<T>>();
+        }
+        return static_cast<Topic<T>&>(*topics_[id]);
+    }
+
+    BufferPool pool_; // Declared first so it outlives the rings holding its buffers
+    std::vector<std::unique_ptr<TopicBase>> topics_; // By type_id()
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Log-linear histogram of non-negative integers, in the style of HdrHistogram: each power-of-two
+// range is split into 64 equal buckets, so any recorded value is reported within 1/64 (~1.6%)
+// across the full 64-bit range. Latency histograms in this tree record microseconds.
+//
+// Histogram has a single writer. ConcurrentHistogram shards atomic counters per thread for
+// lock-free recording from many threads and merges the shards into a Histogram on demand.
+class Histogram {
+public:
+    static constexpr int kSubBucketBits = 6;
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) << kSubBucketBits;
+
+    Histogram();
+
+    void record(uint64_t value, uint64_t count = 1);
+    void merge(const Histogram& other);
+    void reset();
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return count_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+    // Smallest recorded value v such that a fraction q of samples are <= v (to bucket precision)
+    uint64_t quantile(double q) const;
+
+    // One-line text form for export: "hist1 <count> <sum> <min> <max> <bucket>:<n> ..."
+    std::string serialize() const;
+    static std::optional<Histogram> deserialize(std::string_view text);
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_lower(size_t index);
+    static uint64_t bucket_upper(size_t index);
+
+private:
+    friend class ConcurrentHistogram;
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+// Multi-writer histogram. Each thread records into its own cache-line-aligned shard with relaxed
+// atomics (no locks, no shared cache lines between writers); snapshot() merges the shards.
+class ConcurrentHistogram {
+public:
+    explicit ConcurrentHistogram(unsigned shards = std::thread::hardware_concurrency());
+
+    void record(uint64_t value);
+    Histogram snapshot() const;
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> counts;
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> min{UINT64_MAX};
+        std::atomic<uint64_t> max{0};
+    };
+
+    Shard& local_shard();
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+// "n=... mean=... p50=... p90=... p99=... p99.9=... max=... ms" for a microsecond histogram
+std::string format_latency(const Histogram& us);
+
+// Quantile-by-quantile comparison of two microsecond histograms, e.g. a baseline run and this one
+std::string format_latency_diff(const Histogram& baseline_us, const Histogram& current_us);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <iostream>
+
+// Compile-time instrumentation policies for the hot-path classes (BasicTello, the controllers).
+// With a policy flag off, the matching code is discarded by `if constexpr`: no branch, no clock
+// read, no histogram update, no probe site. Error reports are not affected by the policy.
+//
+//   kLogging  informational per-command/per-datagram output on stdout
+//   kMetrics  latency histograms, counters and the tello_metrics publisher
+//   kTracing  USDT probes (include/probes.hpp), on top of TELLO_USDT
+//
+// The build picks DefaultInstrumentation with the TELLO_LEAN CMake option; both policies are
+// always instantiated for BasicTello so they can be compared in one binary (bench/lean_overhead).
+struct FullInstrumentation {
+    static constexpr bool kLogging = true;
+    static constexpr bool kMetrics = true;
+    static constexpr bool kTracing = true;
+};
+
+struct LeanInstrumentation {
+    static constexpr bool kLogging = false;
+    static constexpr bool kMetrics = false;
+    static constexpr bool kTracing = false;
+};
+
+#ifdef TELLO_LEAN
+using DefaultInstrumentation = LeanInstrumentation;
+#else
+using DefaultInstrumentation = FullInstrumentation;
+#endif
+
+// Informational line on stdout; the arguments are not even formatted when logging is compiled out
+template <typename Policy, typename... Args>
+inline void log_info(const Args&... args) {
+    if constexpr (Policy::kLogging) {
+        (std::cout << ... << args) << std::endl;
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <uv.h>
+#include <vector>
+
+// Unbounded multi-producer single-consumer queue (Vyukov): a push is one atomic exchange and one
+// store, a pop touches no shared counter. A pop can come up empty while a push is halfway through;
+// empty() already counts that push, so a consumer that checks it after giving up cannot lose it.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+    ~MpscQueue() {
+        T discard;
+        while (pop(discard)) {
+        }
+        if (tail_ != &stub_) {
+            delete tail_;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* previous = head_.exchange(node, std::memory_order_seq_cst);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer only
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        out = std::move(next->value);
+        next->value = T();
+        tail_ = next; // next becomes the stub
+        if (tail != &stub_) {
+            delete tail;
+        }
+        return true;
+    }
+
+    // Consumer only
+    bool empty() const { return head_.load(std::memory_order_seq_cst) == tail_; }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node*> head_; // Last pushed; producers swap themselves in here
+    Node* tail_; // Already consumed; its next is the oldest value
+    Node stub_;
+};
+
+// Runs tasks in order per key and different keys in parallel. Each key has a lock-free task queue
+// and is scheduled on at most one worker at a time, so its tasks never overlap or reorder. Keys
+// that have work wait in their home worker's ready deque; an idle worker steals whole keys from
+// the back of another worker's deque and becomes their home, so one hot key never splits across
+// threads and a worker with many busy keys sheds them.
+class KeyedExecutor {
+public:
+    using Task = std::function<void()>;
+    using Key = size_t;
+
+    explicit KeyedExecutor(unsigned threads = std::thread::hardware_concurrency());
+    ~KeyedExecutor(); // Runs what is queued, then joins
+
+    KeyedExecutor(const KeyedExecutor&) = delete;
+    KeyedExecutor& operator=(const KeyedExecutor&) = delete;
+
+    // Keys are spread round-robin over the workers. Not safe against concurrent submit().
+    Key add_key();
+
+    // Any thread. Tasks of one key run one after another, in submission order.
+    void submit(Key key, Task task);
+
+    // Block until every submitted task has finished
+    void wait_idle();
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+    size_t keys() const { return keys_.size(); }
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr int kBudget = 64; // Tasks per turn of a key, so one key cannot starve the rest
+
+    struct KeyState {
+        MpscQueue<Task> tasks;
+        std::atomic<bool> scheduled{false}; // In a ready deque or running
+        std::atomic<size_t> home{0};
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<KeyState*> ready;
+        std::thread thread;
+    };
+
+    void schedule(KeyState& key);
+    void run_key(KeyState& key);
+    void worker_loop(size_t index);
+    KeyState* pop_local(size_t index);
+    KeyState* steal(size_t thief);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<KeyState>> keys_;
+    std::atomic<size_t> ready_{0}; // Keys waiting in a deque
+    std::atomic<size_t> pending_{0}; // Tasks queued or running
+    std::atomic<uint64_t> steals_{0};
+    std::atomic<bool> stop_{false};
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable idle_cv_;
+};
+
+// Tasks posted from any thread and run on a libuv loop, in posting order per thread. Work done on
+// executor threads comes back through here to touch loop-owned handles (sockets, AMQP channel).
+class LoopMailbox {
+public:
+    using Task = std::function<void()>;
+
+    explicit LoopMailbox(uv_loop_t& loop);
+    ~LoopMailbox(); // Loop thread; drops tasks not yet run
+
+    void post(Task task);
+
+private:
+    struct AsyncDeleter {
+        void operator()(uv_async_t* async) const {
+            if (async) {
+                uv_close(reinterpret_cast<uv_handle_t*>(async), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_async_t*>(handle);
+                });
+            }
+        }
+    };
+
+    void drain();
+
+    MpscQueue<Task> tasks_;
+    std::unique_ptr<uv_async_t, AsyncDeleter> async_;
+};
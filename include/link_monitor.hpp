@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// How well a drone can currently be reached, worst first
+enum class LinkLevel { LOST, POOR, DEGRADED, GOOD };
+
+const char* link_level_name(LinkLevel level);
+
+// Limits between the levels. An indicator past a DEGRADED limit makes the link DEGRADED, past a
+// POOR limit POOR; the link is as bad as its worst indicator.
+struct LinkThresholds {
+    double degraded_loss = 0.05, poor_loss = 0.20; // Fraction of commands unanswered
+    double degraded_telemetry = 0.90, poor_telemetry = 0.60; // Fraction of expected state packets seen
+    uint64_t degraded_rtt_ms = 100, poor_rtt_ms = 300; // Smoothed query round trip
+    int degraded_snr = 60, poor_snr = 30; // "wifi?" answer
+    uint64_t lost_after_ms = 3000; // No telemetry and no replies for this long
+    int upgrade_after = 3; // Consecutive better evaluations before the level goes up
+};
+
+// What the controller does at each level, indexed by LinkLevel
+struct LinkPolicy {
+    int rc_rate_hz[4] = {2, 5, 10, 20};
+    int telemetry_mirror_hz[4] = {1, 2, 5, 10};
+    int video_bitrate[4] = {1, 1, 2, 0}; // SDK "setbitrate": 0 is auto, 1-5 Mbps
+    const char* video_fps[4] = {"low", "low", "middle", "high"}; // SDK "setfps"
+    uint64_t min_query_timeout_ms = 200, max_query_timeout_ms = 3000;
+};
+
+// Per-drone link estimator. Combines command loss, telemetry gaps, query round trips and the
+// Wi-Fi SNR the drone reports into one level, with hysteresis: a worse level applies at once, a
+// better one only after it has held for upgrade_after evaluations. Time is passed in (uv_now()
+// milliseconds), so the estimator has no loop of its own.
+class LinkEstimator {
+public:
+    explicit LinkEstimator(const LinkThresholds& thresholds = LinkThresholds{}, int telemetry_hz = 10);
+
+    // A command was answered (rtt_us set) or timed out. Only queries ("...?") feed the round trip:
+    // other commands are answered when the drone has finished executing them.
+    void on_command(std::string_view cmd, std::optional<uint64_t> rtt_us, uint64_t now_ms);
+    void on_telemetry(uint64_t now_ms);
+    void on_snr(int snr) { snr_ = snr; }
+
+    // Start from a level and round trip measured elsewhere (a standby taking over) instead of
+    // GOOD and no round trip; srtt_ms 0 leaves the round trip unknown
+    void restore(LinkLevel level, uint64_t srtt_ms);
+
+    // Fold the indicators since the last call into a level; returns true when the level changed
+    bool evaluate(uint64_t now_ms);
+
+    LinkLevel level() const { return level_; }
+    double loss() const { return loss_; }
+    double telemetry_ratio() const { return telemetry_ratio_; }
+    uint64_t srtt_ms() const { return srtt_us_ / 1000; }
+    std::optional<int> snr() const { return snr_; }
+
+    // Retransmission timeout for queries, RFC 6298 style: smoothed RTT plus four deviations
+    uint64_t query_timeout_ms(const LinkPolicy& policy) const;
+
+    // "level=DEGRADED loss=0.08 telemetry=0.95 srtt_ms=42 snr=55"
+    std::string describe() const;
+
+private:
+    LinkLevel measure(uint64_t now_ms) const;
+
+    LinkThresholds thresholds_;
+    uint64_t telemetry_period_ms_;
+    LinkLevel level_ = LinkLevel::GOOD;
+    LinkLevel candidate_ = LinkLevel::GOOD; // Better level waiting out the hysteresis
+    int candidate_count_ = 0;
+
+    double loss_ = 0; // EWMA over commands
+    uint64_t srtt_us_ = 0;
+    uint64_t rttvar_us_ = 0;
+    bool have_rtt_ = false;
+    std::optional<int> snr_;
+
+    double telemetry_ratio_ = 1; // EWMA over evaluation windows
+    uint64_t telemetry_in_window_ = 0;
+    uint64_t window_start_ms_ = 0;
+    uint64_t last_telemetry_ms_ = 0;
+    uint64_t last_reply_ms_ = 0;
+    uint64_t last_timeout_ms_ = 0;
+    bool seen_telemetry_ = false; // Drones without a state stream are judged on commands alone
+    bool started_ = false;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+// Mission files are plain text, one Tello SDK command per line:
+//
+//     # square.mission
+//     takeoff
+//     forward 50
+//     cw 90
+//     land
+//
+// Blank lines and everything after '#' are ignored.
+
+// Limits and models used by the mission validator
+struct MissionLimits {
+    // SDK ranges
+    int min_distance = 20; // Minimum distance in centimeters
+    int max_distance = 500; // Maximum distance in centimeters
+    int min_angle = 1; // Minimum angle in degrees
+    int max_angle = 360; // Maximum angle in degrees
+    int min_speed = 10; // Minimum speed in cm/s
+    int max_speed = 100; // Maximum speed in cm/s
+    int max_curve_speed = 60; // Maximum speed for curve in cm/s
+
+    // Geofence relative to the takeoff point (centimeters)
+    int fence_half_width = 300; // |x| and |y| limit
+    int fence_ceiling = 300; // Maximum height
+    int takeoff_height = 80; // Height reached by takeoff
+    bool start_airborne = false; // Mission continues a flight in progress (live patches); position is the origin
+
+    // Battery model (percent)
+    int start_battery = 100; // Assumed battery level at mission start
+    int min_battery_level = 20; // Reserve that must remain at landing
+    double drain_per_second = 0.13; // Average drain while airborne (~13 min flight time)
+    double takeoff_cost = 2.0; // Extra drain for takeoff
+    int default_speed = 50; // Speed assumed before any "speed" command, in cm/s
+    int yaw_rate = 90; // Rotation speed in degrees per second
+    double command_overhead = 2.0; // Seconds between commands (FlightControllerConfig::command_interval)
+};
+
+struct MissionDiagnostic {
+    enum class Severity { WARNING, ERROR };
+
+    size_t line;
+    Severity severity;
+    std::string message;
+};
+
+struct MissionStep {
+    size_t line;
+    std::string command;
+};
+
+struct MissionReport {
+    std::vector<MissionStep> steps;
+    std::vector<MissionDiagnostic> diagnostics;
+    double estimated_seconds = 0.0; // Airborne time estimate
+    double estimated_battery = 0.0; // Battery left at the end of the mission, in percent
+
+    bool ok() const;
+    size_t error_count() const;
+    size_t warning_count() const;
+};
+
+// Names of all commands accepted by the mission grammar, in SDK order
+const std::vector<std::string_view>& mission_command_names();
+
+// Number of arguments a command takes, or -1 for an unknown command
+int mission_command_arity(std::string_view name);
+
+// Check a single command against the SDK grammar and ranges; returns an error message or empty
+std::string check_mission_command(std::string_view cmd, const MissionLimits& limits = MissionLimits());
+
+// Parse and validate a whole mission (grammar, ranges, geofence, battery estimate)
+MissionReport validate_mission(std::string_view text, const MissionLimits& limits = MissionLimits());
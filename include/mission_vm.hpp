@@ -0,0 +1,131 @@
+#pragma once
+
+#include "mission.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Mission scripts extend the mission file format with variables, loops, conditions and telemetry
+// reads. Any plain mission file is also a script that sends its commands in order.
+//
+//     takeoff
+//     set laps = 0
+//     until bat < 30 or laps == 5     # tested before each pass
+//         repeat 4
+//             forward 50
+//             cw 90
+//         end
+//         set laps = laps + 1
+//     end
+//     while tof < 100                 # climb until a metre clear of the ground
+//         up 20
+//         wait 500                    # milliseconds
+//     end
+//     repeat 10
+//         if tof < 40
+//             break                   # leaves the innermost loop
+//         end
+//         down {h / 4}                # {expression} arguments are range-checked when sent
+//     end
+//     land
+//
+// Expressions work on 64-bit integers: + - * / %, comparisons, and, or, not, parentheses. Names are
+// variables given a value by an earlier `set`, or the integer telemetry fields (pitch, roll, yaw,
+// vgx, vgy, vgz, templ, temph, tof, h, bat, time). Blank lines and everything after '#' are ignored.
+// Parentheses, "-" and "not" nest at most 64 deep.
+
+// Telemetry a script can read; the host supplies it with MissionVm::set_telemetry()
+enum class MissionTelemetry : uint8_t { PITCH, ROLL, YAW, VGX, VGY, VGZ, TEMPL, TEMPH, TOF, H, BAT, TIME, COUNT };
+
+enum class MissionOp : uint8_t {
+    LOADK, // r[a] = constants[bx]
+    MOVE, // r[a] = r[b]
+    TEL, // r[a] = telemetry b; faults if the host has none
+    ADD, SUB, MUL, DIV, MOD, // r[a] = r[b] op r[c]; DIV and MOD fault on zero
+    LT, LE, EQ, NE, // r[a] = r[b] op r[c] ? 1 : 0
+    NEG, NOT, BOOL, // r[a] = -r[b], !r[b], r[b] != 0
+    JMP, // pc = bx
+    JMPF, JMPT, // pc = bx if r[a] is zero / non-zero
+    LOOP, // pc = bx if r[a] <= 0, else r[a]--
+    SEND, // Yield commands[bx]
+    SENDF, // Yield templates[bx] filled in from registers
+    WAIT, // Yield a timer of r[a] ms
+    HALT,
+};
+
+// Four bytes: three 8-bit operands, or one 8-bit and one 16-bit (bx)
+struct MissionInstruction {
+    MissionOp op;
+    uint8_t a, b, c;
+
+    uint16_t bx() const { return static_cast<uint16_t>(b | (c << 8)); }
+};
+
+// A command with {expression} arguments: parts[0] r0 parts[1] r1 ... parts[n]
+struct MissionCommandTemplate {
+    std::vector<std::string> parts;
+    std::vector<uint8_t> registers;
+};
+
+struct MissionProgram {
+    std::vector<MissionInstruction> code;
+    std::vector<uint32_t> lines; // Source line of each instruction, for faults
+    std::vector<int64_t> constants;
+    std::vector<std::string> commands;
+    std::vector<MissionCommandTemplate> templates;
+    size_t registers = 0;
+    bool scripted = false; // Uses anything beyond one literal command per line
+    MissionLimits limits; // Templates are checked against these when sent
+    std::vector<MissionDiagnostic> diagnostics;
+
+    bool ok() const;
+};
+
+// Compiles a script; errors are left in diagnostics, and the program is then empty
+MissionProgram compile_mission(std::string_view text, const MissionLimits& limits = MissionLimits());
+
+// Runs a compiled program. run() executes until the script yields a command or a timer, finishes,
+// or faults; the host carries out the command or waits, then calls run() again. The VM itself never
+// blocks, so one host thread can drive any number of them.
+class MissionVm {
+public:
+    enum class State { READY, COMMAND, WAIT, DONE, FAULT };
+
+    // A script that runs this many instructions without yielding is stuck in a loop and faults
+    static constexpr uint64_t kDefaultBudget = 1000000;
+
+    explicit MissionVm(std::shared_ptr<const MissionProgram> program);
+
+    State run(uint64_t budget = kDefaultBudget);
+
+    // Telemetry is read from the latest values set here. Reading a field that was never set, or was
+    // cleared because the host's feed went stale, faults rather than fly on a made-up value.
+    void set_telemetry(MissionTelemetry field, int64_t value);
+    void clear_telemetry() { telemetry_valid_ = 0; }
+
+    State state() const { return state_; }
+    const std::string& command() const { return command_; } // After COMMAND
+    int64_t wait_ms() const { return wait_ms_; } // After WAIT
+    const std::string& error() const { return error_; } // After FAULT, with the source line
+    size_t line() const; // Of the instruction about to run
+    uint64_t executed() const { return executed_; }
+    uint64_t commands_sent() const { return commands_sent_; }
+
+private:
+    State fault(size_t pc, std::string message);
+
+    std::shared_ptr<const MissionProgram> program_;
+    std::vector<int64_t> registers_;
+    int64_t telemetry_[static_cast<size_t>(MissionTelemetry::COUNT)] = {};
+    uint32_t telemetry_valid_ = 0; // One bit per MissionTelemetry
+    size_t pc_ = 0;
+    State state_ = State::READY;
+    std::string command_;
+    int64_t wait_ms_ = 0;
+    std::string error_;
+    uint64_t executed_ = 0;
+    uint64_t commands_sent_ = 0;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// USDT tracepoints (provider "tello") at the hot-path boundaries, for perf and bpftrace; see
+// scripts/bpftrace. An enabled probe is a single nop plus an ELF note until a tracer attaches.
+// Strings are passed as (pointer, length) since most of them are not NUL-terminated.
+//
+//   flight_controller  command_publish(cmd, len)  response_receive(body, len)  reconnect(attempt)
+//   tello_controller   amqp_receive(drone, cmd, len)  response_publish(drone, body, len)  reconnect()
+//   Tello              udp_send(ip, data, len)  udp_receive(ip, data, len)  command_timeout(ip, cmd, len)
+//   TelemetryListener  telemetry_parse_start(len)  telemetry_parse_done(ok)
+//
+// Compiled in when CMake finds <sys/sdt.h> (systemtap-sdt-dev) and TELLO_ENABLE_USDT is on.
+
+#if defined(TELLO_USDT) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TELLO_PROBE(name) DTRACE_PROBE(tello, name)
+#define TELLO_PROBE1(name, a) DTRACE_PROBE1(tello, name, a)
+#define TELLO_PROBE2(name, a, b) DTRACE_PROBE2(tello, name, a, b)
+#define TELLO_PROBE3(name, a, b, c) DTRACE_PROBE3(tello, name, a, b, c)
+#else
+#define TELLO_PROBE(name) do {} while (0)
+#define TELLO_PROBE1(name, a) do {} while (0)
+#define TELLO_PROBE2(name, a, b) do {} while (0)
+#define TELLO_PROBE3(name, a, b, c) do {} while (0)
+#endif
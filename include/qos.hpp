@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <uv.h>
+
+// Traffic classes of the controller's sockets, most urgent first. Each maps to a DSCP (IP_TOS),
+// which Wi-Fi drivers turn into a WMM access category, and an SO_PRIORITY, which picks the band
+// of the host's queueing discipline. Emergency and control share the top band; their DSCPs keep
+// them apart on the air.
+enum class TrafficClass { EMERGENCY, CONTROL, TELEMETRY, BULK };
+
+struct TrafficMarking {
+    int dscp; // 6-bit code point; IP_TOS carries it shifted left by 2
+    int priority; // SO_PRIORITY; 0-6 need no privileges
+};
+
+// EMERGENCY: CS6, priority 6. CONTROL: EF, 6. TELEMETRY: best effort, 0. BULK (video): CS1, 2,
+// the lowest pfifo_fast band and the WMM background category.
+TrafficMarking traffic_marking(TrafficClass traffic_class);
+const char* traffic_class_name(TrafficClass traffic_class);
+
+// Mark the socket of a UDP or TCP handle. Returns false, with a message on std::cerr, when the
+// kernel refuses; the socket then keeps sending unmarked.
+bool mark_socket(uv_handle_t* handle, TrafficClass traffic_class);
+
+// Kernel pacing (SO_MAX_PACING_RATE) for bulk TCP sockets: the socket puts at most this many bytes
+// per second on the wire, so it cannot fill the host's queues ahead of commands. 0 lifts the cap.
+bool set_pacing_rate(uv_handle_t* handle, uint64_t bytes_per_second);
+
+// Pacing in user space, for bulk sends the kernel does not pace: a send that would exceed the
+// rate is dropped or deferred by the caller
+class TokenBucket {
+public:
+    TokenBucket(uint64_t bytes_per_second, uint64_t burst_bytes);
+
+    // Take `bytes` if the bucket holds them
+    bool try_consume(uint64_t bytes, uint64_t now_ns);
+
+    // Nanoseconds until `bytes` could be taken (0 if they can now)
+    uint64_t delay_ns(uint64_t bytes, uint64_t now_ns);
+
+    uint64_t rate() const { return rate_; }
+
+private:
+    void refill(uint64_t now_ns);
+
+    uint64_t rate_;
+    uint64_t burst_;
+    double tokens_;
+    uint64_t last_ns_ = 0;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// A command consumed from a queue and not answered yet
+struct InFlightCommand {
+    std::string drone;
+    std::string queue;
+    std::string correlation_id;
+    std::string reply_to;
+    std::string cmd;
+};
+
+// What a standby keeps of each drone
+struct ReplicatedDrone {
+    int link_level = 3; // LinkLevel, GOOD until told otherwise
+    uint64_t srtt_ms = 0; // 0: no query round trip measured yet
+    std::map<std::string, uint64_t> received_from; // Deliveries per command queue, for credits
+    std::string telemetry_frame; // Latest mirrored frame
+};
+
+// State a hot standby needs to take over from the active controller: the commands in flight, the
+// replies to recent commands by correlation id (so a command published again is answered again
+// instead of run twice), and per-drone link state and delivery counts. The active keeps one and
+// replicates every change as a record line; a standby applies the lines to its own copy.
+//
+// One record per line, fields separated by spaces, each %-escaped ("-" when empty):
+//   reset                                             forget everything (starts a snapshot)
+//   session <n>                                       credit session of the active
+//   command <id> <drone> <queue> <correlation> <reply_to> <cmd>
+//   done <id> <response>
+//   reply <correlation> <response>                    dedup window entry, oldest first
+//   drone <id> <link level> <srtt_ms>
+//   received <drone> <queue> <n>
+class ReplicaState {
+public:
+    explicit ReplicaState(size_t dedup_window = 1024);
+
+    // A command was consumed; returns its id for finish()
+    uint64_t begin(InFlightCommand command);
+
+    // The command was answered. Replies that are not errors are kept for recent_reply(), so
+    // errors can be retried.
+    void finish(uint64_t id, const std::string& response);
+
+    // Reply sent to an earlier command with this correlation id, if still in the window
+    const std::string* recent_reply(const std::string& correlation_id) const;
+    bool in_flight(const std::string& correlation_id) const;
+
+    const std::map<uint64_t, InFlightCommand>& commands() const { return in_flight_; }
+    std::map<std::string, ReplicatedDrone>& drones() { return drones_; }
+    uint64_t session() const { return session_; }
+    void set_session(uint64_t session) { session_ = session; }
+
+    static std::string encode_command(uint64_t id, const InFlightCommand& command);
+    static std::string encode_done(uint64_t id, std::string_view response);
+    static std::string encode_drone(std::string_view drone, int link_level, uint64_t srtt_ms);
+    static std::string encode_received(std::string_view drone, std::string_view queue, uint64_t received);
+    static std::string encode_session(uint64_t session);
+
+    // Everything, starting with "reset"
+    std::string snapshot() const;
+
+    // Apply records, one per line; returns how many lines were not understood
+    size_t apply(std::string_view records);
+
+private:
+    void remember(const std::string& correlation_id, const std::string& response);
+    bool apply_line(std::string_view line);
+
+    size_t dedup_window_;
+    uint64_t next_id_ = 1;
+    uint64_t session_ = 0;
+    std::map<uint64_t, InFlightCommand> in_flight_;
+    std::unordered_map<std::string, uint64_t> in_flight_ids_; // Correlation id -> command id
+    std::unordered_map<std::string, std::string> replies_; // Correlation id -> reply
+    std::deque<std::string> reply_order_; // Oldest first, for eviction
+    std::map<std::string, ReplicatedDrone> drones_;
+};
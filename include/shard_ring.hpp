@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Consistent hash ring that places drones on controller instances ("shards"). Every instance has
+// `vnodes` points on a 64-bit ring and a drone belongs to the instance owning the first point at or
+// after the hash of its id. An instance joining or leaving only moves the drones on the arcs its
+// points cover, about 1/N of them. The hash is fixed (FNV-1a, then a 64-bit mix) and points are
+// built from the sorted member list, so instances that agree on the members agree on every owner.
+class HashRing {
+public:
+    explicit HashRing(int vnodes = 64);
+
+    // Both return false when nothing changed
+    bool add(const std::string& instance);
+    bool remove(const std::string& instance);
+
+    bool contains(const std::string& instance) const;
+
+    // Owner of `key`; empty when the ring is empty
+    const std::string& owner(std::string_view key) const;
+
+    const std::vector<std::string>& instances() const { return instances_; } // Sorted
+    size_t size() const { return instances_.size(); }
+
+    static uint64_t hash(std::string_view data);
+
+private:
+    void rebuild();
+
+    int vnodes_;
+    std::vector<std::string> instances_;
+    std::vector<std::pair<uint64_t, size_t>> points_; // Sorted by hash; second indexes instances_
+};
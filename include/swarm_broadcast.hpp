@@ -0,0 +1,123 @@
+#pragma once
+
+#include "busy_poll.hpp"
+#include "qos.hpp"
+#include "udp_binding.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <uv.h>
+#include <vector>
+
+// One datagram to each of many drones in a single sendmmsg(2), for formation steps. Payloads are
+// formatted into one contiguous buffer and sent from one socket to cached addresses, so a step
+// costs one syscall per 1024 drones instead of one per drone, and the last drone's packet
+// leaves microseconds after the first.
+//
+// Replies come back to this socket, not to the drones' Tello sockets, and are matched to drones
+// by source address. Broadcasts bypass the per-drone Tello command queues.
+class SwarmBroadcaster {
+public:
+    // Append drone i's datagram to out; leaving out unchanged skips drone i
+    using Formatter = std::function<void(size_t drone, std::string& out)>;
+    // replies[i] is drone i's answer; std::nullopt if it was skipped, timed out or the send failed
+    using DoneCallback = std::function<void(std::vector<std::optional<std::string>> replies)>;
+
+    explicit SwarmBroadcaster(uv_loop_t& loop, const UdpBinding& binding = UdpBinding{});
+    ~SwarmBroadcaster() = default; // RAII cleanup via unique_ptr
+
+    // Returns the drone's index in formatter calls and replies
+    size_t add_drone(const std::string& ip, int port = 8889);
+    size_t size() const { return addrs_.size(); }
+
+    // Fire and forget (rc setpoints); returns how many datagrams the kernel accepted
+    size_t send(const Formatter& format);
+    size_t send(std::string_view payload);
+
+    // Send and collect one reply per addressed drone. Like Tello, broadcasts that expect replies
+    // run one at a time, in order.
+    void send_async(Formatter format, DoneCallback on_done,
+                    std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    bool mark(TrafficClass traffic_class) {
+        return mark_socket(reinterpret_cast<uv_handle_t*>(udp_socket_.get()), traffic_class);
+    }
+
+    // Receive replies through a busy poller (include/busy_poll.hpp) instead of the loop
+    void receive_with(BusyPoller& poller);
+
+    uint64_t datagrams_sent() const { return datagrams_sent_; }
+    uint64_t syscalls() const { return syscalls_; }
+
+private:
+    struct UdpDeleter {
+        void operator()(uv_udp_t* udp) const {
+            if (udp) {
+                uv_udp_recv_stop(udp);
+                uv_close(reinterpret_cast<uv_handle_t*>(udp), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_udp_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct TimerDeleter {
+        void operator()(uv_timer_t* timer) const {
+            if (timer) {
+                uv_timer_stop(timer);
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct PendingBroadcast {
+        Formatter format;
+        DoneCallback on_done;
+        std::chrono::milliseconds timeout;
+    };
+
+    // Format into batch_ and submit; sent_[i] tells whether drone i's datagram went out
+    size_t submit(const Formatter& format);
+    void start_next();
+    void complete();
+    void on_datagram(const struct sockaddr_in& from, std::string_view data);
+
+    static uint64_t address_key(const struct sockaddr_in& addr) {
+        return (uint64_t(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+    }
+
+    uv_loop_t& loop_;
+    std::unique_ptr<uv_udp_t, UdpDeleter> udp_socket_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> timeout_timer_;
+    std::vector<struct sockaddr_in> addrs_;
+    std::unordered_map<uint64_t, size_t> drone_by_address_;
+
+    // Reused across sends so a steady stream of broadcasts does not allocate
+    std::string batch_;
+    std::vector<size_t> offsets_; // Start of drone i's payload in batch_ (size() + 1 entries)
+    std::vector<size_t> targets_; // Drone index of each message
+    std::vector<char> sent_; // Per drone
+#ifdef __linux__
+    std::vector<struct mmsghdr> messages_;
+#endif
+    std::vector<struct iovec> iovecs_;
+
+    std::deque<PendingBroadcast> pending_; // Front is in flight when in_flight_ is set
+    bool in_flight_ = false;
+    std::vector<std::optional<std::string>> replies_;
+    std::vector<char> expecting_; // Drones the in-flight broadcast still waits on
+    size_t awaiting_ = 0;
+
+    uint64_t datagrams_sent_ = 0;
+    uint64_t syscalls_ = 0;
+    char recv_buffer_[2048];
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "busy_poll.hpp"
+#include "udp_binding.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <uv.h>
+
+// One sample of the Tello state stream (UDP 8890), SDK 2.0 field names
+struct TelloState {
+    int pitch = 0, roll = 0, yaw = 0; // Attitude in degrees
+    int vgx = 0, vgy = 0, vgz = 0; // Speed in cm/s
+    int templ = 0, temph = 0; // Temperature range in degrees Celsius
+    int tof = 0; // Time-of-flight distance in cm
+    int h = 0; // Height in cm
+    int bat = 0; // Battery percentage
+    float baro = 0.0f; // Barometer height in m
+    int time = 0; // Motor time in s
+    float agx = 0.0f, agy = 0.0f, agz = 0.0f; // Acceleration in 0.001 g
+    uint64_t received_us = 0; // Steady clock time of reception in microseconds
+};
+
+// Parse "pitch:0;roll:0;...;\r\n"; returns false if no known field was found
+bool parse_tello_state(std::string_view text, TelloState& state);
+
+// Binary telemetry frame pushed to gateway clients (little endian):
+//   u8  type (1 = telemetry)
+//   u8  drone id length, followed by the id bytes
+//   u64 received_us
+//   i16 pitch, roll, yaw, vgx, vgy, vgz, templ, temph, tof, h, bat
+//   u32 time
+//   f32 baro, agx, agy, agz
+void encode_telemetry_frame(std::string_view drone_id, const TelloState& state, std::string& out);
+
+// Receives the state stream every drone sends to UDP 8890 and demultiplexes it by source address
+class TelemetryListener {
+public:
+    using StateCallback = std::function<void(const std::string& ip, const TelloState& state)>;
+    // Raw state packet with its sender, before parsing
+    using DatagramCallback = std::function<void(const std::string& ip, std::string_view data)>;
+
+    TelemetryListener(uv_loop_t& loop, StateCallback callback, int port = 8890);
+
+    // Listener for one interface (UdpBinding::device). With UdpBinding::shared set, per-interface
+    // listeners and a catch-all one can share the port; the kernel prefers the socket bound to the
+    // interface a packet arrived on.
+    TelemetryListener(uv_loop_t& loop, StateCallback callback, const UdpBinding& binding);
+    ~TelemetryListener() = default; // RAII cleanup via unique_ptr
+
+    // Hand packets to `callback` unparsed instead of to the StateCallback, for parsing elsewhere
+    void set_datagram_callback(DatagramCallback callback) { datagram_callback_ = std::move(callback); }
+
+    // Receive state packets through a busy poller (include/busy_poll.hpp) instead of the loop
+    void receive_with(BusyPoller& poller);
+
+private:
+    struct UdpDeleter {
+        void operator()(uv_udp_t* udp) const {
+            if (udp) {
+                uv_udp_recv_stop(udp);
+                uv_close(reinterpret_cast<uv_handle_t*>(udp), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_udp_t*>(handle);
+                });
+            }
+        }
+    };
+
+    void on_datagram(std::string_view data, const struct sockaddr* from);
+
+    StateCallback callback_;
+    DatagramCallback datagram_callback_;
+    std::unique_ptr<uv_udp_t, UdpDeleter> udp_socket_;
+    char recv_buffer_[1024];
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "telemetry.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// State fields a predicate can name, SDK 2.0 spelling
+enum class TelemetryField : uint8_t {
+    PITCH, ROLL, YAW, VGX, VGY, VGZ, TEMPL, TEMPH, TOF, H, BAT, BARO, TIME, AGX, AGY, AGZ, COUNT
+};
+
+const char* telemetry_field_name(TelemetryField field);
+
+// Samples gathered for one evaluation, one column per field (struct of arrays), so a comparison
+// runs down a contiguous float column. Every field fits a float exactly. `source` says which drone
+// a row came from, a small dense number chosen by the caller.
+class TelemetryBatch {
+public:
+    void add(uint32_t source, const TelloState& state);
+    void clear();
+
+    size_t size() const { return sources_.size(); }
+    uint32_t source(size_t row) const { return sources_[row]; }
+    const float* column(TelemetryField field) const { return columns_[static_cast<size_t>(field)].data(); }
+    float value(TelemetryField field, size_t row) const { return columns_[static_cast<size_t>(field)][row]; }
+
+private:
+    std::vector<float> columns_[static_cast<size_t>(TelemetryField::COUNT)];
+    std::vector<uint32_t> sources_;
+};
+
+struct FilterMatch {
+    uint64_t subscription;
+    size_t row; // In the batch
+};
+
+// Predicate subscriptions over telemetry, such as "bat < 30 or h > 200" for one drone or all of
+// them. add() compiles a predicate once into a postfix program over comparisons. Comparisons are
+// shared: "bat < 30" in a thousand subscriptions is one entry. evaluate() runs each comparison in
+// use once per batch, down its column, into a byte mask. Each subscription then combines masks:
+// one for every drone is vectorized over the batch, one for a single drone only visits that drone's
+// rows. A subscription fires when a drone's sample starts matching, and again only after one of
+// the drone's samples has not matched.
+//
+//   predicate  := or ; or := and ("or" and)* ; and := not ("and" not)* ; not := "not" not | atom
+//   atom       := "(" predicate ")" | field ("<" | "<=" | ">" | ">=" | "==" | "!=") number
+// "||", "&&" and "!" work too. Fields are those of TelemetryField, lower case (bat, h, tof, ...).
+// Predicates nest at most 64 deep.
+class TelemetryFilters {
+public:
+    static constexpr uint32_t kAnySource = UINT32_MAX;
+
+    // Returns the subscription id; throws std::runtime_error naming what is wrong with `predicate`
+    uint64_t add(std::string_view predicate, uint32_t source = kAnySource);
+    bool remove(uint64_t id);
+
+    // Appends the matches of this batch, in subscription order, then row order
+    void evaluate(const TelemetryBatch& batch, std::vector<FilterMatch>& out);
+
+    size_t size() const { return subscriptions_.size(); }
+    size_t comparisons() const { return comparison_index_.size(); } // Distinct ones in use
+
+    // Fields the subscription's predicate names, one bit per TelemetryField
+    uint32_t fields(uint64_t id) const;
+
+private:
+    enum class CompareOp : uint8_t { LT, LE, GT, GE, EQ, NE };
+
+    struct Comparison {
+        TelemetryField field;
+        CompareOp op;
+        float constant;
+        uint32_t refs = 0; // Subscriptions using it; 0 marks a free entry
+    };
+
+    struct Instruction {
+        enum Kind : uint8_t { CMP, AND, OR, NOT } kind;
+        uint32_t comparison; // CMP only
+    };
+
+    struct Subscription {
+        std::vector<Instruction> program;
+        size_t depth = 0; // Stack entries the program needs
+        uint32_t source;
+        uint32_t fields = 0;
+        std::vector<uint8_t> matching; // By source: the drone's last sample matched
+    };
+
+    class Parser;
+
+    uint32_t intern(TelemetryField field, CompareOp op, float constant);
+    void release(const Subscription& subscription);
+    const uint8_t* run_vector(const Subscription& subscription, size_t rows);
+    bool run_scalar(const Subscription& subscription, size_t row, size_t rows) const;
+    void settle(Subscription& subscription, uint64_t id, uint32_t source, size_t row, bool match,
+                std::vector<FilterMatch>& out);
+
+    uint64_t next_id_ = 1;
+    std::map<uint64_t, Subscription> subscriptions_; // Ordered, so evaluation order is stable
+    std::vector<Comparison> comparisons_;
+    std::map<std::tuple<uint8_t, uint8_t, float>, uint32_t> comparison_index_;
+    std::vector<uint32_t> free_comparisons_;
+
+    // Scratch reused between batches
+    std::vector<uint8_t> masks_; // comparisons_.size() rows of `rows` bytes
+    std::vector<uint8_t> stack_; // Masks computed by AND, OR and NOT, one row per stack entry
+    std::vector<const uint8_t*> operands_; // Stack of the vectorized path
+    std::vector<uint32_t> source_start_; // Rows grouped by source: counting sort offsets
+    std::vector<uint32_t> source_cursor_;
+    std::vector<uint32_t> source_rows_;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "telemetry.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Latest telemetry sample of every drone in POSIX shared memory (/dev/shm/<name>), for local
+// processes that would otherwise each subscribe to tello_telemetry. tello_controller is the only
+// writer. Each drone has one 128-byte slot aligned to a cache line and guarded by a seqlock. The
+// writer makes the slot's sequence odd, stores the sample and makes it even again. A reader copies
+// the slot and retries if the sequence was odd or changed under it. So reads take no lock and no
+// syscall, and never slow the writer down. Every write also bumps a table-wide generation that
+// readers can sleep on with a futex. The writer calls FUTEX_WAKE only while a reader is waiting.
+//
+// Both constructors throw std::runtime_error. Names without a leading '/' get one.
+class TelemetryTable {
+public:
+    static constexpr size_t kMaxId = 31;
+
+    struct Snapshot {
+        char id[kMaxId + 1]; // NUL-terminated, truncated to kMaxId
+        TelloState state; // received_us is 0 until the drone's first sample
+    };
+
+    // Writer: creates the table, replacing one left behind by an earlier controller
+    TelemetryTable(const std::string& name, size_t slots);
+    // Reader: maps the table a running controller created
+    explicit TelemetryTable(const std::string& name);
+    // The writer marks the table closed, wakes its readers and unlinks the name
+    ~TelemetryTable();
+
+    TelemetryTable(const TelemetryTable&) = delete;
+    TelemetryTable& operator=(const TelemetryTable&) = delete;
+
+    // Writer: slot of `id`, claiming the next free one; -1 when the table is full
+    int claim(std::string_view id);
+    void write(int slot, const TelloState& state);
+
+    // Reader: slot of `id`, -1 if it has none
+    int find(std::string_view id) const;
+    // Torn-free copy of a slot; false if `slot` is not claimed
+    bool read(size_t slot, Snapshot& out) const;
+
+    size_t slots() const;
+    size_t used() const; // Claimed slots, always the first ones
+    uint32_t generation() const;
+    // Sleep until the generation differs from `seen`, or for timeout_ms (-1: no limit); returns
+    // the current generation. Read it before scanning the slots so no update is missed.
+    uint32_t wait(uint32_t seen, int timeout_ms) const;
+    // The writer went away; a new controller creates a new table under the same name
+    bool closed() const;
+
+private:
+    struct Header;
+    struct Slot;
+
+    void map(int fd, size_t size);
+    Slot& slot_at(size_t index) const;
+
+    std::string name_;
+    bool writer_;
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    Header* header_ = nullptr;
+};
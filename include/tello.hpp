@@ -1,19 +1,89 @@
 #pragma once
 
+#include "busy_poll.hpp"
+#include "histogram.hpp"
+#include "instrumentation.hpp"
+#include "qos.hpp"
+#include "udp_binding.hpp"
 #include <string>
 #include <string_view>
 #include <optional>
 #include <uv.h>
+#include <array>
 #include <memory>
+#include <deque>
+#include <functional>
+#include <chrono>
 
-class Tello {
+// Per-opcode redundancy for lossy Wi-Fi, where one lost datagram otherwise costs a full timeout.
+// Idempotent queries ("battery?" and the like) are hedged: with no reply after the p95 of recent
+// round trips, the query goes out once more and the first reply wins. "land" and "emergency" go
+// out as spaced copies up front. Replies to the extra copies are absorbed before the next command
+// is sent, so they are never taken for its reply.
+struct RedundancyConfig {
+    bool hedge_queries = false;
+    std::chrono::milliseconds initial_hedge_delay{200}; // Until enough round trips have been seen
+    std::chrono::milliseconds min_hedge_delay{5};
+    int critical_copies = 1; // Datagrams per land/emergency
+    std::chrono::milliseconds critical_spacing{20};
+};
+
+// Async client for one drone. Policy (include/instrumentation.hpp) decides whether logging, the
+// RTT histogram and the USDT probes are compiled in; both policies are instantiated in tello.cpp.
+template <typename Policy>
+class BasicTello {
 public:
-    Tello(std::string ip, int port, uv_loop_t& loop);
-    ~Tello() = default; // RAII cleanup via unique_ptr
+    // Called with the drone's reply, or std::nullopt on timeout/failure
+    using ResponseCallback = std::function<void(std::optional<std::string>)>;
+    // Called per answered command with the round trip from its latest copy in microseconds, and
+    // with std::nullopt per timeout; feeds link estimation (include/link_monitor.hpp)
+    using LinkObserver = std::function<void(std::string_view cmd, std::optional<uint64_t> rtt_us)>;
+
+    // bind_port is the local command port; 0 picks an ephemeral one (several drones per host)
+    BasicTello(std::string ip, int port, uv_loop_t& loop, int bind_port = 8889);
+
+    // Command socket bound to a source address, port and/or interface. The socket is connected to
+    // the drone, so the kernel only delivers that drone's replies to it.
+    BasicTello(std::string ip, int port, uv_loop_t& loop, const UdpBinding& binding);
+    ~BasicTello() = default; // RAII cleanup via unique_ptr
 
     std::optional<std::string> connect();
+
+    // Blocking send: runs the loop until the reply arrives or the command times out
     std::optional<std::string> send_command(std::string_view cmd);
 
+    // Non-blocking send. The drone executes one command at a time, so commands are queued and
+    // sent in order; "rc" setpoints (no SDK reply) bypass the queue and complete immediately, and
+    // "emergency" jumps the queue, failing everything queued behind it. See RedundancyConfig for
+    // the extra copies some commands get.
+    void send_command_async(std::string_view cmd, ResponseCallback on_response,
+                            std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+    const std::string& ip() const { return ip_; }
+    size_t queued_commands() const { return pending_.size(); }
+
+    // Fail every command waiting behind the one in flight, except land and emergency; returns how
+    // many were failed
+    size_t cancel_queued();
+
+    void set_redundancy(const RedundancyConfig& config) { redundancy_ = config; }
+    const RedundancyConfig& redundancy() const { return redundancy_; }
+    uint64_t extra_copies_sent() const { return extra_copies_sent_; } // Hedges and critical duplicates
+    uint64_t duplicates_absorbed() const { return duplicates_absorbed_; } // Late replies to extra copies
+
+    void set_link_observer(LinkObserver observer) { link_observer_ = std::move(observer); }
+
+    // Mark command datagrams CONTROL, and land/emergency EMERGENCY (include/qos.hpp). The socket
+    // is re-marked only when the class changes.
+    void set_traffic_marking(bool enabled) { traffic_marking_ = enabled; }
+
+    // Receive replies through a busy poller (include/busy_poll.hpp) instead of the loop
+    void receive_with(BusyPoller& poller);
+
+    // Datagram sent to reply received, in microseconds, for every answered command (empty when
+    // Policy::kMetrics is off)
+    const Histogram& rtt() const { return rtt_us_; }
+
 private:
     struct UdpDeleter {
         void operator()(uv_udp_t* udp) const {
@@ -26,10 +96,64 @@ private:
         }
     };
 
+    struct TimerDeleter {
+        void operator()(uv_timer_t* timer) const {
+            if (timer) {
+                uv_timer_stop(timer);
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct PendingCommand {
+        std::string cmd;
+        ResponseCallback on_response;
+        std::chrono::milliseconds timeout;
+        uint64_t sent_ns = 0;
+        int copies_sent = 0;
+        int copies_left = 0; // Extra copies still to go out on redundancy_timer_
+        uint64_t last_copy_ns = 0; // Latest copy, when timed (the round trip a reply is timed from)
+    };
+
+    bool send_datagram(std::string_view data);
+    void start_next_command();
+    void complete_command(std::optional<std::string> response);
+    void on_datagram(std::string_view data);
+    void send_extra_copy();
+    bool timed() const { return Policy::kMetrics || redundancy_.hedge_queries || link_observer_; }
+    void record_round_trip(uint64_t rtt_us);
+    uint64_t hedge_delay_ms() const;
+
     std::string ip_;
     int port_;
     uv_loop_t& loop_;
+    struct sockaddr_in tello_addr_;
     std::unique_ptr<uv_udp_t, UdpDeleter> udp_socket_;
-    std::string last_response_;
-    bool response_received_ = false;
-};
\ No newline at end of file
+    std::unique_ptr<uv_timer_t, TimerDeleter> timeout_timer_;
+    std::deque<PendingCommand> pending_; // Front is in flight when in_flight_ is set
+    bool in_flight_ = false;
+    Histogram rtt_us_;
+
+    // Redundant sends: the timer paces extra copies while a command is in flight, and otherwise
+    // holds the next command until stray replies are in or absorb_until_ms_ has passed
+    RedundancyConfig redundancy_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> redundancy_timer_;
+    int stray_replies_ = 0;
+    uint64_t absorb_until_ms_ = 0;
+    std::array<uint32_t, 64> recent_rtt_us_{}; // Ring of the latest round trips, for the hedge delay
+    uint64_t round_trips_ = 0;
+    uint64_t hedge_delay_us_ = 0; // p95 of recent_rtt_us_, refreshed every 16 round trips
+    uint64_t extra_copies_sent_ = 0;
+    uint64_t duplicates_absorbed_ = 0;
+    LinkObserver link_observer_;
+    bool traffic_marking_ = false;
+    std::optional<TrafficClass> marked_as_;
+    char recv_buffer_[2048];
+};
+
+extern template class BasicTello<FullInstrumentation>;
+extern template class BasicTello<LeanInstrumentation>;
+
+using Tello = BasicTello<DefaultInstrumentation>;
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <uv.h>
+#include <vector>
+
+struct SimConfig {
+    std::string ip = "127.0.0.2"; // Any 127.0.0.0/8 address works on Linux without aliases
+    int port = 8889;
+    std::string serial = "0TQZSIM0000001"; // Answer to "sn?"
+    std::string telemetry_host = "127.0.0.1"; // Where the state stream is sent
+    std::vector<int> telemetry_ports = {8890}; // Every packet goes to each, e.g. one per shard on the host
+    int telemetry_hz = 10; // State packets per second (0 disables)
+    int reply_delay_ms = 0; // Simulated processing time before each reply
+    std::string allowed_source; // Drop commands from any other address (checks per-drone source binding)
+
+    // Fault injection, a lossy and jittery link for exercising timeouts and redundant sends
+    double command_loss = 0; // Fraction of commands lost on the way in
+    double reply_loss = 0; // Fraction of replies lost on the way out
+    int reply_jitter_ms = 0; // Extra delay per reply, uniform in [0, reply_jitter_ms]
+    uint32_t fault_seed = 1;
+};
+
+// Software stand-in for a Tello: answers SDK commands on ip:8889 and emits the state
+// stream, so controllers can be exercised without hardware
+class SimulatedTello {
+public:
+    SimulatedTello(uv_loop_t& loop, const SimConfig& config);
+    ~SimulatedTello() = default; // RAII cleanup via unique_ptr
+
+    const SimConfig& config() const { return config_; }
+    uint64_t commands_received() const { return commands_received_; }
+    uint64_t states_sent() const { return states_sent_; }
+    uint64_t commands_rejected() const { return commands_rejected_; }
+    uint64_t datagrams_lost() const { return datagrams_lost_; } // By fault injection, both ways
+    bool flying() const { return flying_; }
+
+    // Change reply loss while running, e.g. to cut a drone off mid-flight
+    void set_reply_loss(double fraction) { config_.reply_loss = fraction; }
+
+private:
+    struct UdpDeleter {
+        void operator()(uv_udp_t* udp) const {
+            if (udp) {
+                uv_udp_recv_stop(udp);
+                uv_close(reinterpret_cast<uv_handle_t*>(udp), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_udp_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct TimerDeleter {
+        void operator()(uv_timer_t* timer) const {
+            if (timer) {
+                uv_timer_stop(timer);
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    // Reply to a command, or an empty string when the SDK sends none (rc)
+    std::string handle_command(std::string_view cmd);
+    void reply(const struct sockaddr_in& to, std::string message);
+    void send_state();
+    void send_to(const struct sockaddr_in& to, std::string_view data);
+    bool inject_loss(double probability);
+
+    uv_loop_t& loop_;
+    SimConfig config_;
+    std::vector<struct sockaddr_in> telemetry_addrs_;
+    std::unique_ptr<uv_udp_t, UdpDeleter> udp_socket_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> state_timer_;
+    char recv_buffer_[2048];
+    uint64_t commands_received_ = 0;
+    uint64_t states_sent_ = 0;
+    uint64_t commands_rejected_ = 0;
+    uint64_t datagrams_lost_ = 0;
+    std::mt19937 fault_rng_;
+
+    // Flight state
+    bool sdk_mode_ = false;
+    bool flying_ = false;
+    int height_ = 0; // cm
+    int yaw_ = 0; // degrees
+    int speed_ = 10; // cm/s
+    double battery_ = 100.0; // percent
+    uint64_t airborne_since_ = 0; // uv_now() at takeoff
+    int motor_seconds_ = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <uv.h>
+
+// Local end of a UDP socket. A controller with one Wi-Fi adapter per drone access point binds each
+// drone's sockets to that adapter, since every Tello AP hands out the same 192.168.10.x addresses.
+struct UdpBinding {
+    std::string address = "0.0.0.0"; // Source address
+    int port = 0; // 0 picks an ephemeral port
+    std::string device; // SO_BINDTODEVICE interface, e.g. "wlan1" (needs CAP_NET_RAW); empty for any
+    bool shared = false; // SO_REUSEADDR, so sockets on different interfaces can use the same port
+};
+
+// Initialize `udp` on `loop` and bind it as described. Throws std::runtime_error naming `what` if
+// the address is invalid or the socket cannot be bound.
+void bind_udp(uv_loop_t& loop, uv_udp_t* udp, const UdpBinding& binding, const std::string& what);
+
+// "address:port" plus "%device" when bound to an interface, for logs
+std::string describe_binding(const UdpBinding& binding);
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "qos.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <uv.h>
+
+// Minimal RFC 6455 WebSocket support on libuv: enough for the local teleop gateway
+// (single-frame or fragmented text/binary messages, ping/pong, close). No extensions, no TLS.
+
+enum class WsOpcode : uint8_t { CONTINUATION = 0x0, TEXT = 0x1, BINARY = 0x2, CLOSE = 0x8, PING = 0x9, PONG = 0xA };
+
+struct WsFrame {
+    bool fin = true;
+    WsOpcode opcode = WsOpcode::TEXT;
+    bool masked = false;
+    std::string payload; // Unmasked
+};
+
+// Append one encoded frame to out; clients must set mask (RFC 6455 section 5.3)
+void ws_encode_frame(WsOpcode opcode, std::string_view payload, bool mask, std::string& out);
+
+// Decode one frame from the front of data. Returns the number of bytes consumed,
+// 0 if the frame is incomplete, or SIZE_MAX on a protocol error.
+size_t ws_parse_frame(std::string_view data, size_t max_payload, WsFrame& frame);
+
+// Sec-WebSocket-Accept value for a Sec-WebSocket-Key
+std::string ws_accept_key(std::string_view key);
+
+class WebSocketServer {
+public:
+    using ClientId = uint64_t;
+    using MessageHandler = std::function<void(ClientId client, std::string_view message)>;
+    using CloseHandler = std::function<void(ClientId client)>;
+
+    // max_queued_frames bounds the droppable (telemetry) frames buffered per client;
+    // when a slow client exceeds it the oldest queued frame is dropped
+    WebSocketServer(uv_loop_t& loop, const std::string& host, int port, MessageHandler on_message,
+                    size_t max_queued_frames = 64);
+    ~WebSocketServer();
+
+    WebSocketServer(const WebSocketServer&) = delete;
+    WebSocketServer& operator=(const WebSocketServer&) = delete;
+
+    // Reliable text message to one client (command replies are never dropped)
+    void send_text(ClientId client, std::string_view text);
+
+    // Binary message to every open client that has streaming on, subject to drop-oldest backpressure
+    void broadcast_binary(std::string_view payload);
+
+    // Clients start with streaming on; one that only wants replies can turn it off
+    void set_streaming(ClientId client, bool on);
+
+    // Called when a client goes away, for state kept per client
+    void set_close_handler(CloseHandler on_close) { on_close_ = std::move(on_close); }
+
+    // Mark client sockets with traffic_class and, for a nonzero rate, cap what the gateway sends:
+    // each client socket is paced by the kernel, and broadcast frames over the rate are dropped
+    // here, so ground station traffic cannot queue ahead of drone commands on a shared link
+    void set_qos(TrafficClass traffic_class, uint64_t max_bytes_per_second = 0);
+
+    size_t client_count() const { return clients_.size(); }
+    uint64_t dropped_frames() const { return dropped_frames_; }
+
+private:
+    struct OutFrame {
+        std::string bytes;
+        bool droppable;
+    };
+
+    struct Client {
+        uv_tcp_t tcp;
+        WebSocketServer* server;
+        ClientId id;
+        bool open = false; // Handshake completed
+        bool closing = false;
+        bool streaming = true; // Gets broadcast_binary() frames
+        std::string inbox; // Unparsed bytes
+        std::string message; // Fragments of the current message
+        WsOpcode message_opcode = WsOpcode::CONTINUATION; // CONTINUATION: no fragmented message in progress
+        std::deque<OutFrame> outbox; // Front is being written when writing is set
+        size_t droppable_queued = 0;
+        bool writing = false;
+        size_t written = 0; // Bytes of the front frame already sent by uv_try_write
+        uv_write_t write_req;
+        char read_buffer[16384];
+    };
+
+    void on_connection();
+    void on_read(Client& client, std::string_view data);
+    bool handle_handshake(Client& client);
+    void handle_frame(Client& client, WsFrame& frame);
+    void enqueue(Client& client, std::string bytes, bool droppable);
+    void flush(Client& client);
+    void close_client(Client& client);
+    static void on_client_closed(uv_handle_t* handle);
+
+    uv_loop_t& loop_;
+    uv_tcp_t* listener_; // Freed in the close callback
+    MessageHandler on_message_;
+    CloseHandler on_close_;
+    size_t max_queued_frames_;
+    ClientId next_client_id_ = 1;
+    std::unordered_map<ClientId, Client*> clients_;
+    uint64_t dropped_frames_ = 0;
+    std::string frame_scratch_;
+    std::optional<TrafficClass> traffic_class_;
+    uint64_t max_bytes_per_second_ = 0;
+    std::optional<TokenBucket> broadcast_budget_;
+};
+
+class WebSocketClient {
+public:
+    using OpenHandler = std::function<void(bool success)>;
+    using MessageHandler = std::function<void(WsOpcode opcode, std::string_view payload)>;
+    using CloseHandler = std::function<void()>;
+
+    WebSocketClient(uv_loop_t& loop, const std::string& host, int port, OpenHandler on_open,
+                    MessageHandler on_message, CloseHandler on_close = nullptr);
+    ~WebSocketClient();
+
+    WebSocketClient(const WebSocketClient&) = delete;
+    WebSocketClient& operator=(const WebSocketClient&) = delete;
+
+    bool is_open() const { return open_; }
+    void send_text(std::string_view text);
+    void close();
+
+private:
+    void on_read(std::string_view data);
+    void write_raw(std::string bytes);
+
+    uv_loop_t& loop_;
+    std::string host_;
+    uv_tcp_t* tcp_; // Freed in the close callback; data is reset when the client goes away first
+    OpenHandler on_open_;
+    MessageHandler on_message_;
+    CloseHandler on_close_;
+    std::string key_;
+    std::string inbox_;
+    std::string message_;
+    WsOpcode message_opcode_ = WsOpcode::CONTINUATION;
+    bool open_ = false;
+    bool closed_ = false;
+    char read_buffer_[16384];
+};
@@ -0,0 +1,92 @@
+#include "busy_poll.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+
+bool pin_current_thread(int cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); result != 0) {
+        std::cerr << "Failed to pin thread to CPU " << cpu << ": " << std::strerror(result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+BusyPoller::BusyPoller(uv_loop_t& loop, const BusyPollConfig& config)
+    : loop_(loop), config_(config), buffers_(kBatch * kDatagramSize) {
+    for (unsigned i = 0; i < kBatch; ++i) {
+        iovecs_[i] = {buffers_.data() + i * kDatagramSize, kDatagramSize};
+    }
+}
+
+void BusyPoller::add(uv_udp_t* udp, DatagramHandler handler) {
+    uv_os_fd_t fd;
+    if (int result = uv_fileno(reinterpret_cast<uv_handle_t*>(udp), &fd); result != 0) {
+        std::cerr << "Cannot busy-poll socket: " << uv_strerror(result) << std::endl;
+        return;
+    }
+    uv_udp_recv_stop(udp);
+#ifdef SO_BUSY_POLL
+    if (config_.socket_busy_poll_us > 0
+        && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &config_.socket_busy_poll_us, sizeof(config_.socket_busy_poll_us)) != 0) {
+        std::cerr << "Failed to set SO_BUSY_POLL: " << std::strerror(errno) << std::endl;
+    }
+#endif
+    sockets_.push_back({fd, std::move(handler)});
+}
+
+void BusyPoller::drain(const Socket& socket) {
+    for (;;) {
+        for (unsigned i = 0; i < kBatch; ++i) {
+            messages_[i].msg_hdr = {};
+            messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+            messages_[i].msg_hdr.msg_iovlen = 1;
+            messages_[i].msg_hdr.msg_name = &addresses_[i];
+            messages_[i].msg_hdr.msg_namelen = sizeof(addresses_[i]);
+        }
+        int received = recvmmsg(socket.fd, messages_, kBatch, MSG_DONTWAIT, nullptr);
+        if (received <= 0) {
+            if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // ICMP errors (ECONNREFUSED on a connected socket) are reported once and consumed
+                std::cerr << "Busy-poll receive error: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        batches_++;
+        datagrams_ += received;
+        for (int i = 0; i < received; ++i) {
+            socket.handler(std::string_view(static_cast<const char*>(iovecs_[i].iov_base), messages_[i].msg_len),
+                           reinterpret_cast<const struct sockaddr*>(&addresses_[i]));
+        }
+        if (static_cast<unsigned>(received) < kBatch) {
+            return;
+        }
+    }
+}
+
+bool BusyPoller::poll_once() {
+    spins_++;
+    uint64_t before = datagrams_;
+    for (const Socket& socket : sockets_) {
+        drain(socket);
+    }
+    bool alive = uv_run(&loop_, UV_RUN_NOWAIT) != 0;
+    return alive || datagrams_ != before;
+}
+
+void BusyPoller::run() {
+    if (config_.cpu >= 0) {
+        pin_current_thread(config_.cpu);
+    }
+    std::cout << "Busy-polling " << sockets_.size() << " sockets"
+              << (config_.cpu >= 0 ? " on CPU " + std::to_string(config_.cpu) : std::string()) << std::endl;
+    stopped_ = false;
+    while (!stopped_) {
+        poll_once();
+    }
+}
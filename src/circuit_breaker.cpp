@@ -0,0 +1,109 @@
+#include "circuit_breaker.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+bool is_query(std::string_view cmd) {
+    return !cmd.empty() && cmd.back() == '?';
+}
+
+} // namespace
+
+const char* breaker_state_name(BreakerState state) {
+    switch (state) {
+        case BreakerState::CLOSED: return "CLOSED";
+        case BreakerState::OPEN: return "OPEN";
+        case BreakerState::HALF_OPEN: return "HALF_OPEN";
+    }
+    return "UNKNOWN";
+}
+
+CircuitBreaker::CircuitBreaker(const BreakerConfig& config) : config_(config), open_ms_(config.open_ms) {}
+
+bool CircuitBreaker::allow(std::string_view cmd) const {
+    return state_ == BreakerState::CLOSED || cmd == "land" || cmd == "emergency";
+}
+
+bool CircuitBreaker::is_outlier(uint64_t rtt_us) const {
+    return baseline_us_ > 0 && rtt_us > config_.min_outlier_ms * 1000
+           && rtt_us > static_cast<uint64_t>(config_.outlier_factor * baseline_us_);
+}
+
+void CircuitBreaker::open(uint64_t now_ms) {
+    state_ = BreakerState::OPEN;
+    open_until_ms_ = now_ms + open_ms_;
+    good_probes_ = 0;
+    probe_rtt_us_ = 0;
+    probe_in_flight_ = false;
+}
+
+bool CircuitBreaker::on_result(std::string_view cmd, std::optional<uint64_t> rtt_us, uint64_t now_ms) {
+    if (state_ != BreakerState::CLOSED) {
+        return false;
+    }
+    if (!rtt_us) {
+        failures_++;
+    } else {
+        failures_ = 0;
+        // Other commands are answered once carried out, so only queries say how slow the link is
+        if (is_query(cmd)) {
+            if (is_outlier(*rtt_us)) {
+                outliers_++;
+            } else {
+                outliers_ = 0;
+                baseline_us_ = baseline_us_ == 0 ? *rtt_us : (7 * baseline_us_ + *rtt_us) / 8;
+            }
+        }
+    }
+    if (failures_ < config_.failure_threshold && outliers_ < config_.outlier_threshold) {
+        return false;
+    }
+    trips_++;
+    open(now_ms);
+    return true;
+}
+
+bool CircuitBreaker::probe_due(uint64_t now_ms) {
+    if (state_ == BreakerState::OPEN && now_ms >= open_until_ms_) {
+        state_ = BreakerState::HALF_OPEN;
+    }
+    if (state_ != BreakerState::HALF_OPEN || probe_in_flight_) {
+        return false;
+    }
+    probe_in_flight_ = true;
+    return true;
+}
+
+bool CircuitBreaker::on_probe(std::optional<uint64_t> rtt_us, uint64_t now_ms) {
+    if (state_ != BreakerState::HALF_OPEN) {
+        return false;
+    }
+    probe_in_flight_ = false;
+    // Only a lost probe fails. A link that settled slower than before still answers, and judging it
+    // by the old baseline would keep it open for good.
+    if (!rtt_us) {
+        open_ms_ = std::min(open_ms_ * 2, config_.max_open_ms);
+        open(now_ms);
+        return true;
+    }
+    probe_rtt_us_ += *rtt_us;
+    if (++good_probes_ < config_.close_after) {
+        return false;
+    }
+    state_ = BreakerState::CLOSED;
+    failures_ = 0;
+    outliers_ = 0;
+    baseline_us_ = probe_rtt_us_ / good_probes_; // Outliers are measured against the link as it is now
+    open_ms_ = config_.open_ms;
+    return true;
+}
+
+std::string CircuitBreaker::describe(uint64_t now_ms) const {
+    char text[160];
+    uint64_t retry_ms = state_ == BreakerState::OPEN && open_until_ms_ > now_ms ? open_until_ms_ - now_ms : 0;
+    std::snprintf(text, sizeof(text), "state=%s failures=%d outliers=%d trips=%llu retry_ms=%llu",
+                  breaker_state_name(state_), failures_, outliers_, static_cast<unsigned long long>(trips_),
+                  static_cast<unsigned long long>(retry_ms));
+    return text;
+}
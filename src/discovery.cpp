@@ -0,0 +1,235 @@
+#include "discovery.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint64_t kTickMs = 5;
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.back() == '\r' || text.back() == '\n' || text.back() == ' ')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+std::string format_address(uint32_t address) {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xff) + "."
+           + std::to_string((address >> 8) & 0xff) + "." + std::to_string(address & 0xff);
+}
+
+} // namespace
+
+std::vector<uint32_t> DroneDiscovery::subnet_hosts(const std::string& cidr) {
+    size_t slash = cidr.find('/');
+    int prefix = slash == std::string::npos ? 32 : std::atoi(cidr.c_str() + slash + 1);
+    struct sockaddr_in addr;
+    if (uv_ip4_addr(cidr.substr(0, slash).c_str(), 0, &addr) != 0 || prefix < 0 || prefix > 32) {
+        throw std::runtime_error("Invalid subnet " + cidr + " (expected A.B.C.D/N)");
+    }
+    if (prefix < 16) {
+        throw std::runtime_error("Subnet " + cidr + " is too large to probe (at most /16)");
+    }
+
+    uint32_t mask = prefix == 0 ? 0 : ~uint32_t(0) << (32 - prefix);
+    uint32_t network = ntohl(addr.sin_addr.s_addr) & mask;
+    uint32_t broadcast = network | ~mask;
+    std::vector<uint32_t> hosts;
+    for (uint64_t address = network; address <= broadcast; ++address) {
+        if (prefix < 31 && (address == network || address == broadcast)) {
+            continue;
+        }
+        hosts.push_back(static_cast<uint32_t>(address));
+    }
+    return hosts;
+}
+
+DroneDiscovery::DroneDiscovery(uv_loop_t& loop, const DiscoveryConfig& config) : loop_(loop), config_(config) {
+    for (uint32_t address : subnet_hosts(config_.subnet)) {
+        hosts_[address] = Host{};
+        queue_.push_back(address);
+    }
+
+    udp_socket_ = std::unique_ptr<uv_udp_t, UdpDeleter>(new uv_udp_t);
+    uv_udp_init(&loop_, udp_socket_.get());
+    udp_socket_->data = this;
+
+    // Ephemeral port, so a controller can hold 8889 while it scans
+    struct sockaddr_in bind_addr;
+    uv_ip4_addr("0.0.0.0", 0, &bind_addr);
+    if (int result = uv_udp_bind(udp_socket_.get(), reinterpret_cast<const struct sockaddr*>(&bind_addr), 0);
+        result != 0) {
+        throw std::runtime_error("Failed to bind discovery socket: " + std::string(uv_strerror(result)));
+    }
+
+    tick_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+    uv_timer_init(&loop_, tick_timer_.get());
+    tick_timer_->data = this;
+}
+
+void DroneDiscovery::start(FoundCallback on_found, DoneCallback on_done) {
+    on_found_ = std::move(on_found);
+    on_done_ = std::move(on_done);
+    running_ = true;
+    started_ = uv_now(&loop_);
+    std::cout << "Probing " << hosts_.size() << " address(es) in " << config_.subnet << " for drones..." << std::endl;
+
+    uv_udp_recv_start(udp_socket_.get(),
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            auto* discovery = static_cast<DroneDiscovery*>(handle->data);
+            buf->base = discovery->recv_buffer_;
+            buf->len = sizeof(discovery->recv_buffer_);
+        },
+        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned) {
+            auto* discovery = static_cast<DroneDiscovery*>(handle->data);
+            if (nread <= 0 || !addr || addr->sa_family != AF_INET) {
+                return;
+            }
+            const auto* sin = reinterpret_cast<const struct sockaddr_in*>(addr);
+            if (ntohs(sin->sin_port) != discovery->config_.port) {
+                return;
+            }
+            discovery->on_reply(ntohl(sin->sin_addr.s_addr), std::string_view(buf->base, nread));
+        });
+
+    uv_timer_start(tick_timer_.get(), [](uv_timer_t* timer) {
+        static_cast<DroneDiscovery*>(timer->data)->on_tick();
+    }, 0, kTickMs);
+}
+
+std::vector<DiscoveredDrone> DroneDiscovery::run() {
+    std::vector<DiscoveredDrone> result;
+    bool done = false;
+    start(nullptr, [&result, &done](std::vector<DiscoveredDrone> drones) {
+        result = std::move(drones);
+        done = true;
+    });
+    while (!done) {
+        uv_run(&loop_, UV_RUN_ONCE);
+    }
+    return result;
+}
+
+void DroneDiscovery::on_tick() {
+    uint64_t now = uv_now(&loop_);
+
+    // Expired probes are retried through the paced queue, or the host is given up on
+    while (!in_flight_.empty() && in_flight_.front().first <= now) {
+        auto [deadline, address] = in_flight_.front();
+        in_flight_.pop_front();
+        Host& host = hosts_[address];
+        if (host.deadline != deadline || (host.stage != Stage::PROBED && host.stage != Stage::IDENTIFYING)) {
+            continue; // Answered, or re-probed since
+        }
+        if (host.attempts >= config_.attempts) {
+            if (host.stage == Stage::IDENTIFYING) {
+                std::cerr << "Drone at " << format_address(address) << " did not report its serial" << std::endl;
+            }
+            host.stage = Stage::GONE;
+        } else if (host.stage == Stage::IDENTIFYING) {
+            identify(address, host);
+        } else {
+            host.stage = Stage::QUEUED;
+            queue_.push_front(address);
+        }
+    }
+
+    // Send as many "command" probes as the rate allows since the scan started
+    uint64_t allowed = static_cast<uint64_t>(config_.probes_per_second) * (now - started_ + kTickMs) / 1000;
+    while (!queue_.empty() && paced_sent_ < allowed) {
+        uint32_t address = queue_.front();
+        Host& host = hosts_[address];
+        if (!send_probe(address, host, "command")) {
+            break; // Socket buffer full; try again next tick
+        }
+        queue_.pop_front();
+        host.stage = Stage::PROBED;
+        paced_sent_++;
+    }
+
+    if (queue_.empty() && in_flight_.empty()) {
+        finish();
+    }
+}
+
+bool DroneDiscovery::send_probe(uint32_t address, Host& host, std::string_view probe) {
+    struct sockaddr_in to;
+    uv_ip4_addr(format_address(address).c_str(), config_.port, &to);
+    uv_buf_t buf = uv_buf_init(const_cast<char*>(probe.data()), probe.size());
+    int result = uv_udp_try_send(udp_socket_.get(), &buf, 1, reinterpret_cast<const struct sockaddr*>(&to));
+    if (result == UV_EAGAIN) {
+        return false;
+    }
+    // Other send errors (no route and the like) are left to time out like silence
+    host.attempts++;
+    host.deadline = uv_now(&loop_) + config_.timeout_ms;
+    in_flight_.emplace_back(host.deadline, address);
+    return true;
+}
+
+// A full socket buffer counts as a lost "sn?" and is retried when it times out
+void DroneDiscovery::identify(uint32_t address, Host& host) {
+    host.stage = Stage::IDENTIFYING;
+    if (!send_probe(address, host, "sn?")) {
+        host.attempts++;
+        host.deadline = uv_now(&loop_) + config_.timeout_ms;
+        in_flight_.emplace_back(host.deadline, address);
+    }
+}
+
+void DroneDiscovery::on_reply(uint32_t address, std::string_view reply) {
+    auto it = hosts_.find(address);
+    if (it == hosts_.end()) {
+        return;
+    }
+    Host& host = it->second;
+    reply = trim(reply);
+
+    if (host.stage == Stage::PROBED || (host.stage == Stage::QUEUED && host.attempts > 0)) {
+        // Any answer to "command" means a drone; a late one may arrive after the host was requeued
+        if (host.stage == Stage::QUEUED) {
+            queue_.erase(std::find(queue_.begin(), queue_.end(), address));
+        }
+        host.attempts = 0;
+        identify(address, host);
+        return;
+    }
+    if (host.stage != Stage::IDENTIFYING || reply.empty() || reply == "ok" || reply.substr(0, 5) == "error") {
+        return; // Duplicate "ok" from a retried probe, or a drone that refused "sn?"
+    }
+
+    host.stage = Stage::FOUND;
+    DiscoveredDrone drone{std::string(reply), format_address(address)};
+    bool duplicate = std::any_of(found_.begin(), found_.end(),
+                                 [&drone](const auto& other) { return other.second.serial == drone.serial; });
+    if (duplicate) {
+        std::cerr << "Ignoring drone " << drone.serial << " at " << drone.ip << ": serial already seen" << std::endl;
+        return;
+    }
+    std::cout << "Discovered drone " << drone.serial << " at " << drone.ip << std::endl;
+    const DiscoveredDrone& registered = found_[address] = std::move(drone);
+    if (on_found_) {
+        on_found_(registered);
+    }
+}
+
+void DroneDiscovery::finish() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    uv_timer_stop(tick_timer_.get());
+    uv_udp_recv_stop(udp_socket_.get());
+
+    std::vector<DiscoveredDrone> drones;
+    for (const auto& [address, drone] : found_) {
+        drones.push_back(drone);
+    }
+    std::cout << "Discovery finished in " << uv_now(&loop_) - started_ << " ms: " << drones.size() << " drone(s)"
+              << std::endl;
+    if (on_done_) {
+        on_done_(std::move(drones));
+    }
+}
@@ -0,0 +1,91 @@
+#include "event_bus.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kLine = 64;
+
+} // namespace
+
+void BufferRef::reset() {
+    if (!block_) {
+        return;
+    }
+    if (block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (block_->pool) {
+            block_->pool->release(block_);
+        } else {
+            ::operator delete(block_);
+        }
+    }
+    block_ = nullptr;
+}
+
+BufferPool::BufferPool(size_t buffers, size_t buffer_size) : buffers_(buffers), buffer_size_(buffer_size) {
+    if (buffer_size > UINT32_MAX) {
+        throw std::runtime_error("Buffer size too large");
+    }
+    stride_ = (sizeof(BufferRef::Block) + buffer_size + kLine - 1) / kLine * kLine;
+    if (buffers_ == 0) {
+        return;
+    }
+    storage_ = static_cast<char*>(::operator new(buffers_ * stride_, std::align_val_t(kLine)));
+    for (size_t i = buffers_; i-- > 0;) {
+        auto* block = new (storage_ + i * stride_) BufferRef::Block;
+        block->refs.store(0, std::memory_order_relaxed);
+        block->size = 0;
+        block->pool = this;
+        block->next = free_.load(std::memory_order_relaxed);
+        free_.store(block, std::memory_order_relaxed);
+    }
+    available_.store(buffers_, std::memory_order_relaxed);
+}
+
+BufferPool::~BufferPool() {
+    if (storage_) {
+        ::operator delete(storage_, std::align_val_t(kLine));
+    }
+}
+
+BufferRef BufferPool::acquire(size_t size) {
+    BufferRef::Block* block = nullptr;
+    if (size <= buffer_size_) {
+        // Only this thread pops, so the head cannot be popped and pushed back under the CAS
+        block = free_.load(std::memory_order_acquire);
+        while (block && !free_.compare_exchange_weak(block, block->next, std::memory_order_acquire,
+                                                     std::memory_order_acquire)) {
+        }
+    }
+    if (block) {
+        available_.fetch_sub(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        block = new (::operator new(sizeof(BufferRef::Block) + size)) BufferRef::Block;
+        block->pool = nullptr;
+    }
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size = static_cast<uint32_t>(size);
+    return BufferRef(block);
+}
+
+BufferRef BufferPool::copy(std::string_view bytes) {
+    BufferRef buffer = acquire(bytes.size());
+    std::memcpy(buffer.data(), bytes.data(), bytes.size());
+    return buffer;
+}
+
+void BufferPool::release(BufferRef::Block* block) {
+    BufferRef::Block* head = free_.load(std::memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!free_.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+    available_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t EventBus::next_type_id() {
+    static std::atomic<size_t> next{0};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
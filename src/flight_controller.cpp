@@ -1,12 +1,21 @@
+#include "histogram.hpp"
+#include "instrumentation.hpp"
+#include "mission.hpp"
+#include "mission_vm.hpp"
+#include "probes.hpp"
 #include <amqpcpp.h>
 #include <amqpcpp/libuv.h>
 #include <iostream>
 #include <memory>
 #include <vector>
-#include <queue>
+#include <deque>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cmath>
+#include <cstdlib>
 #include <string_view>
 
 // Configuration struct for all constants, defined outside FlightController
@@ -34,8 +43,29 @@ struct FlightControllerConfig {
     // Flight pattern
     int square_side_distance = 20; // Distance for each side of square in centimeters
     int square_turn_angle = 90; // Turn angle for square pattern in degrees
+
+    // Flow control: commands are published only against credit from tello_controller (the
+    // tello_credits exchange) and otherwise wait in a bounded local spool
+    bool use_credits = true;
+    size_t spool_capacity = 16; // Commands held while disconnected or out of credit
+    int spool_max_age_ms = 1000; // Older spooled commands are dropped, not flown late (the flight loop
+                                 // stops waiting for their reply after default_timeout)
+
+    // Telemetry read by mission scripts, from tello_controller's tello_telemetry mirror. The mirror
+    // carries every drone, so only the one flying the mission is followed: this id, or when empty
+    // the drone behind tello_commands as named in its credit messages. Until that is known, frames
+    // are ignored.
+    std::string telemetry_drone;
+    // An older sample is not read and the script faults instead. On a POOR or LOST link the controller
+    // mirrors at 1 Hz (LinkPolicy::telemetry_mirror_hz), so this allows one period plus AMQP slack.
+    int telemetry_max_age_ms = 2500;
+
+    size_t max_patch_bytes = 64 * 1024; // Larger mission patches are rejected unread
 };
 
+// Policy (include/instrumentation.hpp) compiles progress logging, latency metrics and tracing in
+// or out; main() uses DefaultInstrumentation, which the TELLO_LEAN build option makes lean
+template <typename Policy>
 class FlightController {
 public:
     enum class ConnectionState { DISCONNECTED, CONNECTING, CONNECTED };
@@ -45,14 +75,30 @@ public:
         : config_(config), loop_(create_loop()), handler_(loop_.get()),
           conn_state_(ConnectionState::DISCONNECTED), response_received_(false),
           reconnect_attempts_(0), shutdown_(false) {
+        uv_async_init(loop_.get(), &patch_async_, [](uv_async_t* handle) {
+            static_cast<FlightController*>(handle->data)->publish_patch_replies();
+        });
+        patch_async_.data = this;
+        uv_unref(reinterpret_cast<uv_handle_t*>(&patch_async_)); // Must not keep run_loop() alive
+        patch_thread_ = std::thread([this]() { patch_worker(); });
+
         connect_to_rabbitmq(rabbitmq_host, rabbitmq_port);
         declare_queues();
     }
 
     // Destructor to clean up RabbitMQ connection
     ~FlightController() {
+        {
+            std::lock_guard<std::mutex> lock(patch_mutex_);
+            patch_stop_ = true;
+        }
+        patch_cv_.notify_one();
+        patch_thread_.join();
+        uv_close(reinterpret_cast<uv_handle_t*>(&patch_async_), nullptr);
+        uv_run(loop_.get(), UV_RUN_NOWAIT);
+
         if (conn_) {
-            std::cout << "Closing RabbitMQ connection..." << std::endl;
+            log_info<Policy>("Closing RabbitMQ connection...");
             conn_->close();
             uv_run(loop_.get(), UV_RUN_ONCE);
         }
@@ -61,12 +107,12 @@ public:
     // Connect to RabbitMQ server
     void connect_to_rabbitmq(const std::string& host, int rabbitmq_port) {
         if (conn_state_ == ConnectionState::CONNECTED) {
-            std::cout << "Already connected to RabbitMQ" << std::endl;
+            log_info<Policy>("Already connected to RabbitMQ");
             return;
         }
 
         conn_state_ = ConnectionState::CONNECTING;
-        std::cout << "Attempting to connect to RabbitMQ at " << host << ":" << rabbitmq_port << "..." << std::endl;
+        log_info<Policy>("Attempting to connect to RabbitMQ at ", host, ":", rabbitmq_port, "...");
         AMQP::Address address(host, rabbitmq_port, AMQP::Login("tello_user", "tello_password"), "/", false);
         try {
             conn_ = std::make_unique<AMQP::TcpConnection>(&handler_, address);
@@ -80,7 +126,7 @@ public:
 
         channel_->onError([this, host, rabbitmq_port](const char* message) {
             if (shutdown_) {
-                std::cout << "Channel error during shutdown: " << message << std::endl;
+                log_info<Policy>("Channel error during shutdown: ", message);
                 return;
             }
             std::cerr << "Channel error: " << message << ". Attempt " << reconnect_attempts_ + 1 << " to reconnect..." << std::endl;
@@ -97,8 +143,11 @@ public:
                 throw std::runtime_error("Failed to reconnect to RabbitMQ after " + std::to_string(config_.max_reconnect_attempts) + " attempts");
             }
 
+            if constexpr (Policy::kTracing) {
+                TELLO_PROBE1(reconnect, reconnect_attempts_ + 1);
+            }
             int delay = std::min(config_.reconnect_delay_max, static_cast<int>(std::pow(2, reconnect_attempts_)));
-            std::cout << "Waiting " << delay << " seconds before reconnecting..." << std::endl;
+            log_info<Policy>("Waiting ", delay, " seconds before reconnecting...");
             std::this_thread::sleep_for(std::chrono::seconds(delay));
             reconnect_attempts_++;
 
@@ -109,13 +158,13 @@ public:
         });
 
         channel_->onReady([this]() {
-            std::cout << "Channel is ready" << std::endl;
+            log_info<Policy>("Channel is ready");
             conn_state_ = ConnectionState::CONNECTED;
             reconnect_attempts_ = 0;
             retry_queued_commands();
         });
 
-        std::cout << "RabbitMQ connection initiated" << std::endl;
+        log_info<Policy>("RabbitMQ connection initiated");
     }
 
     // Declare RabbitMQ queues for commands and responses
@@ -127,7 +176,7 @@ public:
 
         channel_->declareQueue("tello_commands", AMQP::durable)
             .onSuccess([]() {
-                std::cout << "Command queue declared successfully" << std::endl;
+                log_info<Policy>("Command queue declared successfully");
             })
             .onError([](const char* message) {
                 std::cerr << "Queue declare error: " << message << std::endl;
@@ -135,12 +184,19 @@ public:
 
         channel_->declareQueue("tello_responses", AMQP::durable)
             .onSuccess([this]() {
-                std::cout << "Response queue declared successfully" << std::endl;
+                log_info<Policy>("Response queue declared successfully");
                 if (channel_) {
                     channel_->consume("tello_responses", AMQP::noack)
                         .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
                             std::string_view response(message.body(), message.bodySize());
-                            std::cout << "Received response: " << response << std::endl;
+                            if constexpr (Policy::kTracing) {
+                                TELLO_PROBE2(response_receive, response.data(), response.size());
+                            }
+                            if (Policy::kMetrics && command_sent_ns_) {
+                                command_rtt_us_.record((uv_hrtime() - command_sent_ns_) / 1000);
+                                command_sent_ns_ = 0;
+                            }
+                            log_info<Policy>("Received response: ", response);
                             last_response_ = std::string(response);
                             response_received_ = true;
                         })
@@ -152,6 +208,169 @@ public:
             .onError([](const char* message) {
                 std::cerr << "Response queue declare error: " << message << std::endl;
             });
+
+        // Credits for tello_commands; a controller that never advertises any is not waited for
+        if (config_.use_credits) {
+            channel_->declareExchange("tello_credits", AMQP::direct);
+            channel_->declareQueue(AMQP::exclusive)
+                .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                    if (!channel_) {
+                        return;
+                    }
+                    channel_->bindQueue("tello_credits", name, "tello_commands");
+                    channel_->consume(name, AMQP::noack)
+                        .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                            on_credit(std::string_view(message.body(), message.bodySize()));
+                        })
+                        .onError([](const char* message) {
+                            std::cerr << "Credit consume error: " << message << std::endl;
+                        });
+                })
+                .onError([](const char* message) {
+                    std::cerr << "Credit queue declare error: " << message << std::endl;
+                });
+        }
+
+        // Mirrored telemetry for the telemetry fields mission scripts read
+        channel_->declareExchange("tello_telemetry", AMQP::fanout);
+        channel_->declareQueue(AMQP::exclusive | AMQP::autodelete)
+            .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                if (!channel_) {
+                    return;
+                }
+                channel_->bindQueue("tello_telemetry", name, "");
+                channel_->consume(name, AMQP::noack)
+                    .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                        on_telemetry(message.routingkey(), std::string_view(message.body(), message.bodySize()));
+                    })
+                    .onError([](const char* message) {
+                        std::cerr << "Telemetry consume error: " << message << std::endl;
+                    });
+            })
+            .onError([](const char* message) {
+                std::cerr << "Telemetry queue declare error: " << message << std::endl;
+            });
+
+        channel_->declareQueue("tello_mission_patches", AMQP::durable)
+            .onSuccess([this]() {
+                log_info<Policy>("Mission patch queue declared successfully");
+                if (channel_) {
+                    channel_->consume("tello_mission_patches", AMQP::noack)
+                        .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                            log_info<Policy>("Received mission patch (", message.bodySize(), " bytes)");
+                            {
+                                std::lock_guard<std::mutex> lock(patch_mutex_);
+                                patch_requests_.push_back({std::string(message.body(), message.bodySize()),
+                                                           message.replyTo(), message.correlationID(),
+                                                           Policy::kMetrics ? uv_hrtime() : 0});
+                            }
+                            patch_cv_.notify_one();
+                        })
+                        .onError([](const char* message) {
+                            std::cerr << "Mission patch consume error: " << message << std::endl;
+                        });
+                }
+            })
+            .onError([](const char* message) {
+                std::cerr << "Mission patch queue declare error: " << message << std::endl;
+            });
+    }
+
+    // Compile mission patches off the flight loop. Accepted plans are published to
+    // pending_plan_ (RCU-style) and picked up by run() at the next step boundary.
+    void patch_worker() {
+        while (true) {
+            PatchRequest request;
+            {
+                std::unique_lock<std::mutex> lock(patch_mutex_);
+                patch_cv_.wait(lock, [this]() { return patch_stop_ || !patch_requests_.empty(); });
+                if (patch_stop_) {
+                    return;
+                }
+                request = std::move(patch_requests_.front());
+                patch_requests_.pop_front();
+            }
+
+            std::string reply = review_patch(request.text);
+            if constexpr (Policy::kMetrics) {
+                patch_latency_us_.record((uv_hrtime() - request.received_ns) / 1000);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(patch_mutex_);
+                patch_replies_.push_back({std::move(request.reply_to), std::move(request.correlation_id), std::move(reply)});
+            }
+            uv_async_send(&patch_async_);
+        }
+    }
+
+    // Compile and check one patch; an accepted plan is published to pending_plan_. Returns the reply.
+    std::string review_patch(const std::string& text) {
+        if (text.size() > config_.max_patch_bytes) {
+            std::string reply = "rejected: patch is larger than " + std::to_string(config_.max_patch_bytes) + " bytes";
+            std::cerr << "Mission patch " << reply << std::endl;
+            return reply;
+        }
+        MissionLimits limits = mission_limits();
+        limits.start_airborne = true;
+        limits.start_battery = last_battery_level_.load();
+
+        // A plain command list is also replayed against the geofence and battery model. A
+        // script's path depends on telemetry, so its commands are range-checked when sent.
+        auto program = std::make_shared<MissionProgram>(compile_mission(text, limits));
+        MissionReport report;
+        if (program->ok() && !program->scripted) {
+            report = validate_mission(text, limits);
+        } else {
+            report.diagnostics = program->diagnostics;
+        }
+        std::string reply;
+        if (!report.ok() || (!program->scripted && report.steps.empty())) {
+            reply = "rejected";
+            for (const auto& d : report.diagnostics) {
+                if (d.severity == MissionDiagnostic::Severity::ERROR || report.steps.empty()) {
+                    reply += ": line " + std::to_string(d.line) + ": " + d.message;
+                    break;
+                }
+            }
+            std::cerr << "Mission patch " << reply << std::endl;
+        } else {
+            auto plan = std::make_shared<MissionPlan>();
+            plan->version = ++plan_version_;
+            plan->program = std::move(program);
+            reply = "accepted " + std::to_string(plan->version) + " ("
+                    + (plan->program->scripted ? "script, " + std::to_string(plan->program->code.size())
+                                                     + " instructions"
+                                               : std::to_string(report.steps.size()) + " steps, "
+                                                     + std::to_string(report.warning_count()) + " warnings")
+                    + ")";
+            std::lock_guard<std::mutex> lock(patch_mutex_);
+            if (mission_finished_) {
+                reply = "rejected: mission finished";
+                std::cerr << "Mission patch " << reply << std::endl;
+                return reply;
+            }
+            log_info<Policy>("Mission patch ", reply);
+            std::atomic_store(&pending_plan_, std::shared_ptr<const MissionPlan>(std::move(plan)));
+        }
+        return reply;
+    }
+
+    // Answer patch submitters that set reply_to (runs on the loop thread)
+    void publish_patch_replies() {
+        std::vector<PatchReply> replies;
+        {
+            std::lock_guard<std::mutex> lock(patch_mutex_);
+            replies.swap(patch_replies_);
+        }
+        for (const auto& reply : replies) {
+            if (reply.reply_to.empty() || !channel_ || conn_state_ != ConnectionState::CONNECTED) {
+                continue;
+            }
+            AMQP::Envelope envelope(reply.body.data(), reply.body.size());
+            envelope.setCorrelationID(reply.correlation_id);
+            channel_->publish("", reply.reply_to, envelope);
+        }
     }
 
     // Validate drone commands
@@ -212,8 +431,6 @@ public:
         }
 
         publish_command("land");
-        response_received_ = false;
-        last_response_.clear(); // Clear previous response
         auto start_time = std::chrono::steady_clock::now();
         while (!response_received_) {
             auto now = std::chrono::steady_clock::now();
@@ -226,9 +443,9 @@ public:
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
         }
 
-        std::cout << "Land response: " << last_response_ << std::endl;
+        log_info<Policy>("Land response: ", last_response_);
         if (last_response_ == "ok" || last_response_ == "error") { // Treat error as valid (already landed)
-            std::cout << "Drone landed successfully or already on ground" << std::endl;
+            log_info<Policy>("Drone landed successfully or already on ground");
             return true;
         } else {
             std::cerr << "Failed to confirm landing: " << last_response_ << std::endl;
@@ -245,8 +462,6 @@ public:
         }
 
         publish_command("battery?");
-        response_received_ = false;
-        last_response_.clear();
         auto start_time = std::chrono::steady_clock::now();
         while (!response_received_) {
             auto now = std::chrono::steady_clock::now();
@@ -266,7 +481,8 @@ public:
             std::cerr << "Invalid battery response: " << last_response_ << std::endl;
             return false;
         }
-        std::cout << "Battery level: " << battery_level << "%" << std::endl;
+        log_info<Policy>("Battery level: ", battery_level, "%");
+        last_battery_level_ = battery_level;
         if (battery_level < config_.min_battery_level) {
             std::cerr << "Battery level too low for flight: " << battery_level << "%" << std::endl;
             return false;
@@ -282,8 +498,6 @@ public:
             }
 
             publish_command("takeoff");
-            response_received_ = false;
-            last_response_.clear();
             start_time = std::chrono::steady_clock::now();
             while (!response_received_) {
                 auto now = std::chrono::steady_clock::now();
@@ -302,7 +516,7 @@ public:
                 std::cerr << "Takeoff attempt " << (config_.max_takeoff_attempts - takeoff_attempts + 1) << " failed with response: " << last_response_ << std::endl;
                 takeoff_attempts--;
                 if (takeoff_attempts > 0) {
-                    std::cout << "Retrying takeoff..." << std::endl;
+                    log_info<Policy>("Retrying takeoff...");
                     issue_land_command();
                     std::this_thread::sleep_for(std::chrono::seconds(config_.command_interval));
                 }
@@ -316,7 +530,7 @@ public:
         }
 
         // Wait for takeoff to complete
-        std::cout << "Waiting " << config_.takeoff_completion_delay << " seconds for takeoff to complete..." << std::endl;
+        log_info<Policy>("Waiting ", config_.takeoff_completion_delay, " seconds for takeoff to complete...");
         std::this_thread::sleep_for(std::chrono::seconds(config_.takeoff_completion_delay));
 
         // Query height to confirm takeoff
@@ -327,8 +541,6 @@ public:
         }
 
         publish_command("height?");
-        response_received_ = false;
-        last_response_.clear();
         start_time = std::chrono::steady_clock::now();
         while (!response_received_) {
             auto now = std::chrono::steady_clock::now();
@@ -350,7 +562,7 @@ public:
             issue_land_command();
             return false;
         }
-        std::cout << "Height after takeoff: " << height << " dm" << std::endl;
+        log_info<Policy>("Height after takeoff: ", height, " dm");
         if (height < config_.min_height_after_takeoff) {
             std::cerr << "Height too low after takeoff: " << height << " dm" << std::endl;
             issue_land_command();
@@ -360,8 +572,12 @@ public:
         return true;
     }
 
-    // Publish a command to RabbitMQ, queuing if connection is not ready
+    // Publish a command to RabbitMQ, spooling it while the connection is not ready or the drone
+    // has no free slot. A full spool fails the command like a drone error would. The previous
+    // response is cleared first, so the caller waits for this command's (or for that failure).
     void publish_command(const std::string_view& cmd) {
+        response_received_ = false;
+        last_response_.clear();
         if (!validate_command(cmd)) {
             std::cerr << "Skipping invalid command: " << cmd << std::endl;
             last_response_ = "invalid command";
@@ -369,38 +585,127 @@ public:
             return;
         }
 
+        // The controller never holds land or emergency back, so neither waits for credit, nor in
+        // the spool where it could expire; what is spooled would only fly after it
+        if (cmd == "land" || cmd == "emergency") {
+            if (!command_spool_.empty()) {
+                std::cerr << "Dropping " << command_spool_.size() << " spooled command(s) for " << cmd << std::endl;
+                command_spool_.clear();
+            }
+            if (!try_publish(cmd, false)) {
+                log_info<Policy>("Connection not ready, holding command: ", cmd);
+                held_command_ = std::string(cmd);
+            }
+            return;
+        }
+
+        expire_spooled_commands();
+        if (command_spool_.empty() && try_publish(cmd)) {
+            return;
+        }
+        if (command_spool_.size() >= config_.spool_capacity) {
+            std::cerr << "Command spool full (" << config_.spool_capacity << "), failing command: " << cmd << std::endl;
+            last_response_ = "spool full";
+            response_received_ = true;
+            return;
+        }
+        log_info<Policy>(conn_state_ != ConnectionState::CONNECTED ? "Connection not ready" : "No credit",
+                         ", spooling command: ", cmd);
+        command_spool_.push_back({std::string(cmd), std::chrono::steady_clock::now()});
+    }
+
+    // Publish now if connected and, unless told otherwise, holding credit
+    bool try_publish(std::string_view cmd, bool needs_credit = true) {
+        if (conn_state_ != ConnectionState::CONNECTED || !channel_ || (needs_credit && credit() <= 0)) {
+            return false;
+        }
         AMQP::Envelope envelope(cmd.data(), cmd.size());
         envelope.setDeliveryMode(2);
+        if constexpr (Policy::kTracing) {
+            TELLO_PROBE2(command_publish, cmd.data(), cmd.size());
+        }
+        if (!channel_->publish("", "tello_commands", envelope)) {
+            std::cerr << "Failed to publish command: " << cmd << ", spooling for retry..." << std::endl;
+            return false;
+        }
+        log_info<Policy>("Published command: ", cmd);
+        commands_published_++;
+        if constexpr (Policy::kMetrics) {
+            command_sent_ns_ = uv_hrtime();
+        }
+        return true;
+    }
 
-        if (conn_state_ != ConnectionState::CONNECTED || !channel_) {
-            std::cout << "Connection not ready, queuing command: " << cmd << std::endl;
-            command_queue_.push(std::string(cmd));
+    // Commands the controller will take without queueing them in RabbitMQ: its last advertised free
+    // slots, less what was published since and not yet counted in its received total
+    int64_t credit() const {
+        if (!config_.use_credits || !credit_session_) {
+            return 1;
+        }
+        int64_t unseen = static_cast<int64_t>(commands_published_ - std::min(commands_published_, credit_received_));
+        return static_cast<int64_t>(credit_free_) - unseen;
+    }
+
+    // "drone=<id> session=<n> received=<n> free=<n>" from tello_controller
+    void on_credit(std::string_view body) {
+        uint64_t session = 0, received = 0, free = 0;
+        std::string_view drone;
+        for (size_t start = 0; start < body.size();) {
+            size_t end = std::min(body.find(' ', start), body.size());
+            std::string_view field = body.substr(start, end - start);
+            size_t equals = field.find('=');
+            if (equals != std::string_view::npos) {
+                std::string_view key = field.substr(0, equals);
+                uint64_t value = std::strtoull(std::string(field.substr(equals + 1)).c_str(), nullptr, 10);
+                if (key == "drone") drone = field.substr(equals + 1);
+                else if (key == "session") session = value;
+                else if (key == "received") received = value;
+                else if (key == "free") free = value;
+            }
+            start = end + 1;
+        }
+        if (session == 0) {
             return;
         }
+        if (config_.telemetry_drone.empty() && !drone.empty()) {
+            log_info<Policy>("Following telemetry of ", drone, ", the drone behind tello_commands");
+            config_.telemetry_drone = std::string(drone);
+        }
+        if (session != credit_session_) {
+            // New or restarted controller: its count starts at zero, so count from here
+            log_info<Policy>("Credit session ", session, ": ", free, " free");
+            credit_session_ = session;
+            commands_published_ = received;
+        }
+        credit_received_ = received;
+        credit_free_ = free;
+        retry_queued_commands();
+    }
 
-        bool success = channel_->publish("", "tello_commands", envelope);
-        if (!success) {
-            std::cerr << "Failed to publish command: " << cmd << ", queuing for retry..." << std::endl;
-            command_queue_.push(std::string(cmd));
-        } else {
-            std::cout << "Published command: " << cmd << std::endl;
+    // Drop spooled commands too old to fly; the flight loop has given up on them and retried
+    void expire_spooled_commands() {
+        auto now = std::chrono::steady_clock::now();
+        while (!command_spool_.empty()
+               && now - command_spool_.front().spooled_at > std::chrono::milliseconds(config_.spool_max_age_ms)) {
+            std::cerr << "Dropping stale spooled command: " << command_spool_.front().cmd << std::endl;
+            command_spool_.pop_front();
         }
     }
 
-    // Retry queued commands when connection is restored
+    // Publish a held land or emergency once connected, then spooled commands, in order, as
+    // connection and credit allow
     void retry_queued_commands() {
-        while (!command_queue_.empty() && conn_state_ == ConnectionState::CONNECTED && channel_) {
-            auto cmd = command_queue_.front();
-            AMQP::Envelope envelope(cmd.data(), cmd.size());
-            envelope.setDeliveryMode(2);
-            bool success = channel_->publish("", "tello_commands", envelope);
-            if (success) {
-                std::cout << "Successfully retried command: " << cmd << std::endl;
-                command_queue_.pop();
-            } else {
-                std::cerr << "Retry failed for command: " << cmd << ", keeping in queue..." << std::endl;
-                break;
+        if (!held_command_.empty()) {
+            if (!try_publish(held_command_, false)) {
+                return;
             }
+            log_info<Policy>("Published held command: ", held_command_);
+            held_command_.clear();
+        }
+        expire_spooled_commands();
+        while (!command_spool_.empty() && try_publish(command_spool_.front().cmd)) {
+            log_info<Policy>("Published spooled command: ", command_spool_.front().cmd);
+            command_spool_.pop_front();
         }
     }
 
@@ -414,19 +719,52 @@ public:
         }
 
         // Define flight pattern using config values
-        std::vector<std::string> commands = {
-            "forward " + std::to_string(config_.square_side_distance),
-            "cw " + std::to_string(config_.square_turn_angle),
-            "forward " + std::to_string(config_.square_side_distance),
-            "cw " + std::to_string(config_.square_turn_angle),
-            "forward " + std::to_string(config_.square_side_distance),
-            "cw " + std::to_string(config_.square_turn_angle),
-            "forward " + std::to_string(config_.square_side_distance),
-            "cw " + std::to_string(config_.square_turn_angle),
-            "land"
-        };
+        auto square = std::make_shared<const MissionProgram>(compile_mission(
+            "repeat 4\n"
+            "forward " + std::to_string(config_.square_side_distance) + "\n"
+            "cw " + std::to_string(config_.square_turn_angle) + "\n"
+            "end\n"
+            "land\n", mission_limits()));
+        if (!square->ok()) {
+            std::cerr << "Invalid flight pattern: " << square->diagnostics.front().message << std::endl;
+            issue_land_command();
+            return false;
+        }
+        auto plan = std::make_shared<const MissionPlan>(MissionPlan{0, square});
+
+        // The mission VM yields each command and timer; everything else it runs between them
+        MissionVm vm(plan->program);
+        while (true) {
+            // Swap in a live patch at a yield point; it replaces the remaining plan
+            if (auto patch = std::atomic_exchange(&pending_plan_, std::shared_ptr<const MissionPlan>())) {
+                log_info<Policy>("Switching to mission patch ", patch->version, " after ", vm.commands_sent(),
+                                 " commands of plan ", plan->version);
+                plan = std::move(patch);
+                vm = MissionVm(plan->program);
+            }
+            uv_run(loop_.get(), UV_RUN_NOWAIT); // Telemetry that arrived during the last command interval
+            feed_telemetry(vm);
+            MissionVm::State state = vm.run();
+            if (state == MissionVm::State::DONE) {
+                // A patch accepted while the last steps ran is still flown; later ones are refused
+                std::lock_guard<std::mutex> lock(patch_mutex_);
+                if (!std::atomic_load(&pending_plan_)) {
+                    mission_finished_ = true;
+                    break;
+                }
+                continue;
+            }
+            if (state == MissionVm::State::FAULT) {
+                std::cerr << "Mission stopped at " << vm.error() << std::endl;
+                issue_land_command();
+                return false;
+            }
+            if (state == MissionVm::State::WAIT) {
+                wait_mission_timer(vm.wait_ms());
+                continue;
+            }
+            const std::string& cmd = vm.command();
 
-        for (const auto& cmd : commands) {
             int retries = config_.max_command_retries;
             bool command_success = false;
 
@@ -438,8 +776,6 @@ public:
                 }
 
                 publish_command(cmd);
-                response_received_ = false;
-                last_response_.clear();
                 auto start_time = std::chrono::steady_clock::now();
                 while (!response_received_) {
                     auto now = std::chrono::steady_clock::now();
@@ -455,7 +791,10 @@ public:
                 if (response_received_) {
                     if (last_response_ == "ok" || (cmd == "land" && last_response_ == "error")) {
                         command_success = true;
-                    } else if (last_response_ == "out of range" || last_response_ == "invalid command") {
+                    } else if (last_response_ == "out of range" || last_response_ == "invalid command"
+                               || last_response_ == "error circuit open") {
+                        // The gateway fails commands to an unresponsive drone at once; retrying
+                        // would only fail again
                         std::cerr << "Unrecoverable error for command " << cmd << ": " << last_response_ << std::endl;
                         issue_land_command();
                         return false;
@@ -463,7 +802,7 @@ public:
                         std::cerr << "Command " << cmd << " failed with response: " << last_response_ << ". Retries left: " << retries - 1 << std::endl;
                         retries--;
                         if (retries > 0) {
-                            std::cout << "Retrying command: " << cmd << std::endl;
+                            log_info<Policy>("Retrying command: ", cmd);
                             std::this_thread::sleep_for(std::chrono::seconds(config_.command_interval));
                             continue;
                         } else {
@@ -475,7 +814,7 @@ public:
                 } else {
                     retries--;
                     if (retries > 0) {
-                        std::cout << "No response, retrying command: " << cmd << ". Retries left: " << retries << std::endl;
+                        log_info<Policy>("No response, retrying command: ", cmd, ". Retries left: ", retries);
                         std::this_thread::sleep_for(std::chrono::seconds(config_.command_interval));
                         continue;
                     } else {
@@ -487,20 +826,92 @@ public:
             }
 
             if (command_success) {
-                std::cout << "Waiting " << config_.command_interval << " seconds before next command..." << std::endl;
+                log_info<Policy>("Waiting ", config_.command_interval, " seconds before next command...");
                 std::this_thread::sleep_for(std::chrono::seconds(config_.command_interval));
             }
         }
 
-        std::cout << "All commands processed successfully" << std::endl;
+        log_info<Policy>("All commands processed successfully");
         return true;
     }
 
+    MissionLimits mission_limits() const {
+        MissionLimits limits;
+        limits.min_distance = config_.min_distance;
+        limits.max_distance = config_.max_distance;
+        limits.min_angle = config_.min_angle;
+        limits.max_angle = config_.max_angle;
+        limits.min_battery_level = config_.min_battery_level;
+        limits.command_overhead = config_.command_interval;
+        return limits;
+    }
+
+    // Binary frame from the tello_telemetry mirror (layout in include/telemetry.hpp)
+    void on_telemetry(std::string_view drone, std::string_view frame) {
+        if (config_.telemetry_drone.empty() || drone != config_.telemetry_drone) {
+            return; // Another drone's, or the mission's drone is not known yet
+        }
+        if (frame.size() < 2 || frame[0] != 1) {
+            return;
+        }
+        size_t offset = 2 + static_cast<uint8_t>(frame[1]) + sizeof(uint64_t); // Type, id, received_us
+        if (frame.size() < offset + 11 * sizeof(int16_t) + sizeof(uint32_t)) {
+            return;
+        }
+        auto le = [frame](size_t at, size_t bytes) {
+            uint32_t value = 0;
+            for (size_t i = 0; i < bytes; ++i) {
+                value |= static_cast<uint32_t>(static_cast<uint8_t>(frame[at + i])) << (8 * i);
+            }
+            return value;
+        };
+        // pitch through bat as i16, in MissionTelemetry order, then time as u32
+        for (size_t i = 0; i < 11; ++i) {
+            telemetry_[i] = static_cast<int16_t>(le(offset + 2 * i, 2));
+        }
+        telemetry_[static_cast<size_t>(MissionTelemetry::TIME)] = le(offset + 22, 4);
+        telemetry_at_ = std::chrono::steady_clock::now();
+        // Patches are checked against the battery model from here on, not from before takeoff
+        last_battery_level_ = static_cast<int>(telemetry_[static_cast<size_t>(MissionTelemetry::BAT)]);
+    }
+
+    // A script reads only a recent sample; without one, a telemetry read faults and the drone lands
+    void feed_telemetry(MissionVm& vm) {
+        if (telemetry_at_ == std::chrono::steady_clock::time_point()
+            || std::chrono::steady_clock::now() - telemetry_at_ > std::chrono::milliseconds(config_.telemetry_max_age_ms)) {
+            vm.clear_telemetry();
+            return;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(MissionTelemetry::COUNT); ++i) {
+            vm.set_telemetry(static_cast<MissionTelemetry>(i), telemetry_[i]);
+        }
+    }
+
+    // A script's "wait"; a mission patch arriving meanwhile ends it early
+    void wait_mission_timer(int64_t ms) {
+        log_info<Policy>("Mission waits ", ms, " ms");
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+        while (!std::atomic_load(&pending_plan_)) {
+            auto left = until - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero()) {
+                break;
+            }
+            uv_run(loop_.get(), UV_RUN_NOWAIT);
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(left, std::chrono::milliseconds(50)));
+        }
+    }
+
     // Shutdown RabbitMQ connection
     void shutdown() {
         shutdown_ = true;
+        if constexpr (Policy::kMetrics) {
+            std::cout << "Command round trip: " << format_latency(command_rtt_us_) << std::endl;
+            if (Histogram patches = patch_latency_us_.snapshot(); patches.count()) {
+                std::cout << "Mission patch receive to switch-ready: " << format_latency(patches) << std::endl;
+            }
+        }
         if (conn_) {
-            std::cout << "Initiating shutdown of RabbitMQ connection..." << std::endl;
+            log_info<Policy>("Initiating shutdown of RabbitMQ connection...");
             conn_->close();
             uv_run(loop_.get(), UV_RUN_ONCE);
         }
@@ -542,12 +953,56 @@ private:
     std::string last_response_;
     int reconnect_attempts_;
     bool shutdown_;
-    std::queue<std::string> command_queue_; // Queue for commands when connection is not ready
+    struct SpooledCommand {
+        std::string cmd;
+        std::chrono::steady_clock::time_point spooled_at;
+    };
+    std::deque<SpooledCommand> command_spool_; // Commands waiting for the connection or for credit
+    std::string held_command_; // land or emergency waiting for the connection only
+
+    // Credit for tello_commands (see on_credit); no session yet means no controller has advertised
+    uint64_t credit_session_ = 0;
+    uint64_t credit_received_ = 0;
+    uint64_t credit_free_ = 0;
+    uint64_t commands_published_ = 0;
+    uint64_t command_sent_ns_ = 0; // uv_hrtime() of the publish awaiting a response
+    Histogram command_rtt_us_; // Publish to response, as seen by the flight loop
+
+    // Live mission patching
+    struct MissionPlan {
+        uint64_t version;
+        std::shared_ptr<const MissionProgram> program;
+    };
+    struct PatchRequest {
+        std::string text;
+        std::string reply_to;
+        std::string correlation_id;
+        uint64_t received_ns = 0;
+    };
+    struct PatchReply {
+        std::string reply_to;
+        std::string correlation_id;
+        std::string body;
+    };
+    std::shared_ptr<const MissionPlan> pending_plan_; // Only accessed through std::atomic_load/store/exchange
+    std::atomic<uint64_t> plan_version_{0};
+    std::atomic<int> last_battery_level_{100};
+    int64_t telemetry_[static_cast<size_t>(MissionTelemetry::COUNT)] = {}; // Latest mirrored sample
+    std::chrono::steady_clock::time_point telemetry_at_; // When it arrived; epoch until the first
+    std::mutex patch_mutex_;
+    std::condition_variable patch_cv_;
+    std::deque<PatchRequest> patch_requests_;
+    std::vector<PatchReply> patch_replies_;
+    bool patch_stop_ = false;
+    bool mission_finished_ = false; // Guarded by patch_mutex_; patches are refused once set
+    std::thread patch_thread_;
+    ConcurrentHistogram patch_latency_us_{2}; // Recorded on the patch worker, read at shutdown
+    uv_async_t patch_async_;
 };
 
 int main() {
     try {
-        FlightController controller("localhost", 5672);
+        FlightController<DefaultInstrumentation> controller("localhost", 5672);
         if (controller.run()) {
             std::cout << "Flight pattern completed successfully" << std::endl;
         } else {
@@ -0,0 +1,241 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+constexpr uint64_t kSubBucketCount = uint64_t(1) << Histogram::kSubBucketBits;
+
+int highest_bit(uint64_t value) {
+    return 63 - __builtin_clzll(value | 1);
+}
+
+// Threads take shard slots round-robin on first use
+unsigned thread_slot() {
+    static std::atomic<unsigned> next_slot{0};
+    thread_local unsigned slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+template <typename T>
+bool parse_number(std::string_view& text, T& value) {
+    while (!text.empty() && text.front() == ' ') {
+        text.remove_prefix(1);
+    }
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc()) {
+        return false;
+    }
+    text.remove_prefix(end - text.data());
+    return true;
+}
+
+} // namespace
+
+Histogram::Histogram() : counts_(kBucketCount, 0) {}
+
+size_t Histogram::bucket_index(uint64_t value) {
+    int msb = highest_bit(value);
+    if (msb < Histogram::kSubBucketBits) {
+        return static_cast<size_t>(value);
+    }
+    int shift = msb - Histogram::kSubBucketBits;
+    return (static_cast<size_t>(shift + 1) << kSubBucketBits) + ((value >> shift) - kSubBucketCount);
+}
+
+uint64_t Histogram::bucket_lower(size_t index) {
+    size_t block = index >> kSubBucketBits;
+    if (block == 0) {
+        return index;
+    }
+    return ((index & (kSubBucketCount - 1)) + kSubBucketCount) << (block - 1);
+}
+
+uint64_t Histogram::bucket_upper(size_t index) {
+    size_t block = index >> kSubBucketBits;
+    if (block == 0) {
+        return index;
+    }
+    return bucket_lower(index) + ((uint64_t(1) << (block - 1)) - 1);
+}
+
+void Histogram::record(uint64_t value, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    counts_[bucket_index(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+void Histogram::reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+}
+
+uint64_t Histogram::quantile(double q) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    if (q <= 0) {
+        return min_;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::clamp(bucket_upper(i), min_, max_);
+        }
+    }
+    return max_;
+}
+
+std::string Histogram::serialize() const {
+    std::string out = "hist1 " + std::to_string(count_) + " " + std::to_string(sum_) + " " + std::to_string(min())
+                      + " " + std::to_string(max_);
+    for (size_t i = 0; i < kBucketCount; ++i) {
+        if (counts_[i]) {
+            out += " " + std::to_string(i) + ":" + std::to_string(counts_[i]);
+        }
+    }
+    return out;
+}
+
+std::optional<Histogram> Histogram::deserialize(std::string_view text) {
+    if (text.substr(0, 6) != "hist1 ") {
+        return std::nullopt;
+    }
+    text.remove_prefix(6);
+
+    Histogram histogram;
+    uint64_t count = 0, sum = 0, min = 0, max = 0;
+    if (!parse_number(text, count) || !parse_number(text, sum) || !parse_number(text, min)
+        || !parse_number(text, max)) {
+        return std::nullopt;
+    }
+    uint64_t bucket_total = 0;
+    while (!text.empty() && text.front() == ' ') {
+        size_t index = 0;
+        uint64_t n = 0;
+        if (!parse_number(text, index) || text.empty() || text.front() != ':') {
+            return std::nullopt;
+        }
+        text.remove_prefix(1);
+        if (!parse_number(text, n) || index >= kBucketCount) {
+            return std::nullopt;
+        }
+        histogram.counts_[index] += n;
+        bucket_total += n;
+    }
+    while (!text.empty() && (text.front() == '\n' || text.front() == '\r')) {
+        text.remove_prefix(1);
+    }
+    if (!text.empty() || bucket_total != count) {
+        return std::nullopt;
+    }
+    histogram.count_ = count;
+    histogram.sum_ = sum;
+    histogram.min_ = count ? min : UINT64_MAX;
+    histogram.max_ = max;
+    return histogram;
+}
+
+ConcurrentHistogram::ConcurrentHistogram(unsigned shards) {
+    shards_.resize(std::max(1u, shards));
+    for (auto& shard : shards_) {
+        shard = std::make_unique<Shard>();
+        shard->counts = std::make_unique<std::atomic<uint64_t>[]>(Histogram::kBucketCount);
+        for (size_t i = 0; i < Histogram::kBucketCount; ++i) {
+            shard->counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+ConcurrentHistogram::Shard& ConcurrentHistogram::local_shard() {
+    return *shards_[thread_slot() % shards_.size()];
+}
+
+void ConcurrentHistogram::record(uint64_t value) {
+    Shard& shard = local_shard();
+    shard.counts[Histogram::bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+    // Threads outnumbering shards can share one, so min/max still need a CAS
+    uint64_t seen = shard.min.load(std::memory_order_relaxed);
+    while (value < seen && !shard.min.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+    seen = shard.max.load(std::memory_order_relaxed);
+    while (value > seen && !shard.max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+Histogram ConcurrentHistogram::snapshot() const {
+    // Counters are read one by one while writers continue; totals are recomputed from the
+    // buckets so a snapshot is always self-consistent, if a few samples behind
+    Histogram merged;
+    for (const auto& shard : shards_) {
+        for (size_t i = 0; i < Histogram::kBucketCount; ++i) {
+            uint64_t n = shard->counts[i].load(std::memory_order_relaxed);
+            merged.counts_[i] += n;
+            merged.count_ += n;
+        }
+        merged.sum_ += shard->sum.load(std::memory_order_relaxed);
+        merged.min_ = std::min(merged.min_, shard->min.load(std::memory_order_relaxed));
+        merged.max_ = std::max(merged.max_, shard->max.load(std::memory_order_relaxed));
+    }
+    return merged;
+}
+
+std::string format_latency(const Histogram& us) {
+    if (us.count() == 0) {
+        return "no samples";
+    }
+    char line[200];
+    std::snprintf(line, sizeof(line), "n=%llu  mean=%.3f  p50=%.3f  p90=%.3f  p99=%.3f  p99.9=%.3f  max=%.3f ms",
+                  static_cast<unsigned long long>(us.count()), us.mean() / 1000, us.quantile(0.5) / 1000.0,
+                  us.quantile(0.9) / 1000.0, us.quantile(0.99) / 1000.0, us.quantile(0.999) / 1000.0,
+                  us.max() / 1000.0);
+    return line;
+}
+
+std::string format_latency_diff(const Histogram& baseline_us, const Histogram& current_us) {
+    static const std::pair<const char*, double> quantiles[] = {
+        {"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}, {"p99.9", 0.999}, {"max", 1.0}};
+
+    std::string out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-6s %12s %12s %12s %9s\n", "", "baseline ms", "current ms", "delta ms",
+                  "change");
+    out += line;
+    for (const auto& [name, q] : quantiles) {
+        double before = (q >= 1.0 ? baseline_us.max() : baseline_us.quantile(q)) / 1000.0;
+        double after = (q >= 1.0 ? current_us.max() : current_us.quantile(q)) / 1000.0;
+        double change = before > 0 ? 100.0 * (after - before) / before : 0.0;
+        std::snprintf(line, sizeof(line), "%-6s %12.3f %12.3f %+12.3f %+8.1f%%\n", name, before, after,
+                      after - before, change);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%-6s %12llu %12llu\n", "n", static_cast<unsigned long long>(baseline_us.count()),
+                  static_cast<unsigned long long>(current_us.count()));
+    out += line;
+    return out;
+}
@@ -0,0 +1,159 @@
+#include "keyed_executor.hpp"
+#include <stdexcept>
+#include <string>
+
+KeyedExecutor::KeyedExecutor(unsigned threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    workers_.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->thread = std::thread([this, i]() { worker_loop(i); });
+    }
+}
+
+KeyedExecutor::~KeyedExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+}
+
+KeyedExecutor::Key KeyedExecutor::add_key() {
+    auto key = std::make_unique<KeyState>();
+    key->home = keys_.size() % workers_.size();
+    keys_.push_back(std::move(key));
+    return keys_.size() - 1;
+}
+
+void KeyedExecutor::submit(Key key, Task task) {
+    if (key >= keys_.size()) {
+        throw std::out_of_range("Unknown executor key " + std::to_string(key));
+    }
+    KeyState& state = *keys_[key];
+    pending_.fetch_add(1);
+    state.tasks.push(std::move(task));
+    // Whoever flips scheduled schedules the key: this producer, or the worker finishing its turn
+    if (!state.scheduled.exchange(true)) {
+        schedule(state);
+    }
+}
+
+void KeyedExecutor::schedule(KeyState& key) {
+    Worker& worker = *workers_[key.home.load(std::memory_order_relaxed)];
+    ready_.fetch_add(1); // Counted before the push so a fast worker never underflows it
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.ready.push_back(&key);
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_); // Pairs with the predicate check of a worker going to sleep
+    }
+    wake_cv_.notify_one();
+}
+
+void KeyedExecutor::wait_idle() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    idle_cv_.wait(lock, [this]() { return pending_.load() == 0; });
+}
+
+KeyedExecutor::KeyState* KeyedExecutor::pop_local(size_t index) {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.ready.empty()) {
+        return nullptr;
+    }
+    KeyState* key = worker.ready.front();
+    worker.ready.pop_front();
+    return key;
+}
+
+KeyedExecutor::KeyState* KeyedExecutor::steal(size_t thief) {
+    for (size_t offset = 1; offset < workers_.size(); ++offset) {
+        Worker& victim = *workers_[(thief + offset) % workers_.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.ready.empty()) {
+            continue;
+        }
+        // The back waited least, so taking it delays the victim's oldest keys least
+        KeyState* key = victim.ready.back();
+        victim.ready.pop_back();
+        key->home.store(thief, std::memory_order_relaxed);
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return key;
+    }
+    return nullptr;
+}
+
+void KeyedExecutor::run_key(KeyState& key) {
+    Task task;
+    int ran = 0;
+    while (ran < kBudget && key.tasks.pop(task)) {
+        task();
+        task = nullptr;
+        ran++;
+    }
+    if (ran > 0 && pending_.fetch_sub(ran) == static_cast<size_t>(ran)) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        idle_cv_.notify_all();
+    }
+
+    // Give the key up, then look again: a task pushed after the last pop either sees scheduled
+    // cleared and schedules the key itself, or is seen here
+    key.scheduled.store(false);
+    if (!key.tasks.empty() && !key.scheduled.exchange(true)) {
+        schedule(key);
+    }
+}
+
+void KeyedExecutor::worker_loop(size_t index) {
+    while (true) {
+        KeyState* key = pop_local(index);
+        if (!key) {
+            key = steal(index);
+        }
+        if (key) {
+            ready_.fetch_sub(1);
+            run_key(*key);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_cv_.wait(lock, [this]() { return stop_ || ready_.load() > 0; });
+        if (stop_ && ready_.load() == 0) {
+            return;
+        }
+    }
+}
+
+LoopMailbox::LoopMailbox(uv_loop_t& loop) : async_(new uv_async_t) {
+    uv_async_init(&loop, async_.get(), [](uv_async_t* async) {
+        static_cast<LoopMailbox*>(async->data)->drain();
+    });
+    async_->data = this;
+}
+
+LoopMailbox::~LoopMailbox() = default;
+
+void LoopMailbox::post(Task task) {
+    tasks_.push(std::move(task));
+    uv_async_send(async_.get()); // Coalesces: one wakeup drains everything posted so far
+}
+
+void LoopMailbox::drain() {
+    Task task;
+    while (tasks_.pop(task)) {
+        task();
+    }
+    // A push caught halfway is not visible to pop yet; come back for it
+    if (!tasks_.empty()) {
+        uv_async_send(async_.get());
+    }
+}
@@ -0,0 +1,143 @@
+#include "link_monitor.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+constexpr double kLossGain = 0.1; // Per command
+constexpr double kTelemetryGain = 0.5; // Per evaluation window
+
+LinkLevel worse(LinkLevel a, LinkLevel b) {
+    return std::min(a, b);
+}
+
+} // namespace
+
+const char* link_level_name(LinkLevel level) {
+    switch (level) {
+        case LinkLevel::LOST: return "LOST";
+        case LinkLevel::POOR: return "POOR";
+        case LinkLevel::DEGRADED: return "DEGRADED";
+        case LinkLevel::GOOD: return "GOOD";
+    }
+    return "UNKNOWN";
+}
+
+LinkEstimator::LinkEstimator(const LinkThresholds& thresholds, int telemetry_hz)
+    : thresholds_(thresholds), telemetry_period_ms_(1000 / std::max(1, telemetry_hz)) {}
+
+void LinkEstimator::on_command(std::string_view cmd, std::optional<uint64_t> rtt_us, uint64_t now_ms) {
+    loss_ = (1 - kLossGain) * loss_ + (rtt_us ? 0 : kLossGain);
+    if (!rtt_us) {
+        last_timeout_ms_ = now_ms;
+        return;
+    }
+    last_reply_ms_ = now_ms;
+    if (cmd.empty() || cmd.back() != '?') {
+        return;
+    }
+    // RFC 6298: rttvar first, from the old srtt
+    if (!have_rtt_) {
+        srtt_us_ = *rtt_us;
+        rttvar_us_ = *rtt_us / 2;
+        have_rtt_ = true;
+    } else {
+        uint64_t deviation = srtt_us_ > *rtt_us ? srtt_us_ - *rtt_us : *rtt_us - srtt_us_;
+        rttvar_us_ = (3 * rttvar_us_ + deviation) / 4;
+        srtt_us_ = (7 * srtt_us_ + *rtt_us) / 8;
+    }
+}
+
+void LinkEstimator::on_telemetry(uint64_t now_ms) {
+    telemetry_in_window_++;
+    last_telemetry_ms_ = now_ms;
+    seen_telemetry_ = true;
+}
+
+LinkLevel LinkEstimator::measure(uint64_t now_ms) const {
+    uint64_t last_heard = std::max(last_telemetry_ms_, last_reply_ms_);
+    if (now_ms - last_heard > thresholds_.lost_after_ms && (seen_telemetry_ || last_timeout_ms_ > last_reply_ms_)) {
+        return LinkLevel::LOST;
+    }
+
+    auto grade_low = [](double value, double degraded, double poor) {
+        return value > poor ? LinkLevel::POOR : value > degraded ? LinkLevel::DEGRADED : LinkLevel::GOOD;
+    };
+    auto grade_high = [](double value, double degraded, double poor) {
+        return value < poor ? LinkLevel::POOR : value < degraded ? LinkLevel::DEGRADED : LinkLevel::GOOD;
+    };
+    LinkLevel level = grade_low(loss_, thresholds_.degraded_loss, thresholds_.poor_loss);
+    if (seen_telemetry_) {
+        level = worse(level, grade_high(telemetry_ratio_, thresholds_.degraded_telemetry, thresholds_.poor_telemetry));
+    }
+    if (have_rtt_) {
+        level = worse(level, grade_low(static_cast<double>(srtt_ms()), thresholds_.degraded_rtt_ms,
+                                       thresholds_.poor_rtt_ms));
+    }
+    if (snr_) {
+        level = worse(level, grade_high(*snr_, thresholds_.degraded_snr, thresholds_.poor_snr));
+    }
+    return level;
+}
+
+bool LinkEstimator::evaluate(uint64_t now_ms) {
+    if (!started_) {
+        started_ = true;
+        window_start_ms_ = last_reply_ms_ = now_ms;
+        return false;
+    }
+
+    // Telemetry delivered over the window, against what the drone's rate promises
+    uint64_t expected = (now_ms - window_start_ms_) / telemetry_period_ms_;
+    if (seen_telemetry_ && expected > 0) {
+        double ratio = std::min(1.0, static_cast<double>(telemetry_in_window_) / expected);
+        telemetry_ratio_ = (1 - kTelemetryGain) * telemetry_ratio_ + kTelemetryGain * ratio;
+        telemetry_in_window_ = 0;
+        window_start_ms_ = now_ms;
+    }
+
+    LinkLevel measured = measure(now_ms);
+    if (measured < level_) {
+        level_ = measured;
+        candidate_count_ = 0;
+        return true;
+    }
+    if (measured == level_) {
+        candidate_count_ = 0;
+        return false;
+    }
+    // Better: hold off until it has lasted, and then step up to the worst level seen meanwhile
+    candidate_ = candidate_count_ == 0 ? measured : worse(candidate_, measured);
+    if (++candidate_count_ < thresholds_.upgrade_after) {
+        return false;
+    }
+    level_ = candidate_;
+    candidate_count_ = 0;
+    return true;
+}
+
+void LinkEstimator::restore(LinkLevel level, uint64_t srtt_ms) {
+    level_ = candidate_ = level;
+    candidate_count_ = 0;
+    if (srtt_ms > 0) {
+        srtt_us_ = srtt_ms * 1000;
+        rttvar_us_ = srtt_us_ / 2;
+        have_rtt_ = true;
+    }
+}
+
+uint64_t LinkEstimator::query_timeout_ms(const LinkPolicy& policy) const {
+    if (!have_rtt_) {
+        return policy.max_query_timeout_ms;
+    }
+    uint64_t rto_ms = (srtt_us_ + 4 * rttvar_us_) / 1000;
+    return std::clamp(rto_ms, policy.min_query_timeout_ms, policy.max_query_timeout_ms);
+}
+
+std::string LinkEstimator::describe() const {
+    char text[160];
+    std::snprintf(text, sizeof(text), "level=%s loss=%.2f telemetry=%.2f srtt_ms=%llu snr=%s",
+                  link_level_name(level_), loss_, telemetry_ratio_, static_cast<unsigned long long>(srtt_ms()),
+                  snr_ ? std::to_string(*snr_).c_str() : "-");
+    return text;
+}
@@ -0,0 +1,370 @@
+#include "mission.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Argument kinds of the Tello SDK 2.0 command grammar
+enum class Arg { DISTANCE, ANGLE, SPEED, CURVE_SPEED, COORD, RC, FLIP, TEXT };
+
+struct CommandSpec {
+    std::string_view name;
+    std::vector<Arg> args;
+};
+
+const std::vector<CommandSpec>& grammar() {
+    static const std::vector<CommandSpec> specs = {
+        {"command", {}}, {"takeoff", {}}, {"land", {}}, {"streamon", {}}, {"streamoff", {}},
+        {"emergency", {}}, {"stop", {}},
+        {"up", {Arg::DISTANCE}}, {"down", {Arg::DISTANCE}}, {"left", {Arg::DISTANCE}},
+        {"right", {Arg::DISTANCE}}, {"forward", {Arg::DISTANCE}}, {"back", {Arg::DISTANCE}},
+        {"cw", {Arg::ANGLE}}, {"ccw", {Arg::ANGLE}},
+        {"flip", {Arg::FLIP}},
+        {"go", {Arg::COORD, Arg::COORD, Arg::COORD, Arg::SPEED}},
+        {"curve", {Arg::COORD, Arg::COORD, Arg::COORD, Arg::COORD, Arg::COORD, Arg::COORD, Arg::CURVE_SPEED}},
+        {"speed", {Arg::SPEED}},
+        {"rc", {Arg::RC, Arg::RC, Arg::RC, Arg::RC}},
+        {"wifi", {Arg::TEXT, Arg::TEXT}},
+        {"speed?", {}}, {"battery?", {}}, {"time?", {}}, {"wifi?", {}}, {"sdk?", {}}, {"sn?", {}},
+        {"height?", {}}, {"temp?", {}}, {"attitude?", {}}, {"baro?", {}}, {"tof?", {}}, {"acceleration?", {}},
+    };
+    return specs;
+}
+
+const CommandSpec* find_spec(std::string_view name) {
+    for (const auto& spec : grammar()) {
+        if (spec.name == name) {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<std::string_view> split_words(std::string_view text) {
+    std::vector<std::string_view> words;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t start = text.find_first_not_of(" \t\r", pos);
+        if (start == std::string_view::npos) {
+            break;
+        }
+        size_t end = text.find_first_of(" \t\r", start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        words.push_back(text.substr(start, end - start));
+        pos = end;
+    }
+    return words;
+}
+
+bool parse_int(std::string_view word, int& value) {
+    const char* first = word.data();
+    const char* last = word.data() + word.size();
+    if (first != last && *first == '+') {
+        ++first;
+    }
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    return ec == std::errc() && ptr == last;
+}
+
+std::string range_error(std::string_view cmd, const char* what, int value, int min, int max, const char* unit) {
+    return std::string(what) + " parameter for " + std::string(cmd) + " must be between " + std::to_string(min)
+           + " and " + std::to_string(max) + " " + unit + ", got: " + std::to_string(value);
+}
+
+// Validate the words of one command; fills ints with the numeric arguments
+std::string check_words(const std::vector<std::string_view>& words, const MissionLimits& limits, std::vector<int>& ints) {
+    ints.clear();
+    if (words.empty()) {
+        return "empty command";
+    }
+
+    const CommandSpec* spec = find_spec(words[0]);
+    if (!spec) {
+        return "unknown command: " + std::string(words[0]);
+    }
+    if (words.size() - 1 != spec->args.size()) {
+        return std::string(spec->name) + " expects " + std::to_string(spec->args.size()) + " argument(s), got "
+               + std::to_string(words.size() - 1);
+    }
+
+    for (size_t i = 0; i < spec->args.size(); ++i) {
+        std::string_view word = words[i + 1];
+        Arg arg = spec->args[i];
+        if (arg == Arg::TEXT) {
+            continue;
+        }
+        if (arg == Arg::FLIP) {
+            if (word != "l" && word != "r" && word != "f" && word != "b") {
+                return "flip direction must be one of l, r, f, b, got: " + std::string(word);
+            }
+            continue;
+        }
+
+        int value = 0;
+        if (!parse_int(word, value)) {
+            return "invalid parameter in command " + std::string(spec->name) + ": " + std::string(word);
+        }
+        switch (arg) {
+        case Arg::DISTANCE:
+            if (value < limits.min_distance || value > limits.max_distance) {
+                return range_error(spec->name, "Distance", value, limits.min_distance, limits.max_distance, "cm");
+            }
+            break;
+        case Arg::ANGLE:
+            if (value < limits.min_angle || value > limits.max_angle) {
+                return range_error(spec->name, "Angle", value, limits.min_angle, limits.max_angle, "degrees");
+            }
+            break;
+        case Arg::SPEED:
+            if (value < limits.min_speed || value > limits.max_speed) {
+                return range_error(spec->name, "Speed", value, limits.min_speed, limits.max_speed, "cm/s");
+            }
+            break;
+        case Arg::CURVE_SPEED:
+            if (value < limits.min_speed || value > limits.max_curve_speed) {
+                return range_error(spec->name, "Speed", value, limits.min_speed, limits.max_curve_speed, "cm/s");
+            }
+            break;
+        case Arg::COORD:
+            if (value < -limits.max_distance || value > limits.max_distance) {
+                return range_error(spec->name, "Coordinate", value, -limits.max_distance, limits.max_distance, "cm");
+            }
+            break;
+        case Arg::RC:
+            if (value < -100 || value > 100) {
+                return range_error(spec->name, "Channel", value, -100, 100, "");
+            }
+            break;
+        default:
+            break;
+        }
+        ints.push_back(value);
+    }
+
+    // go/curve targets may not lie within +/-20 cm on all three axes at once
+    auto too_close = [](int x, int y, int z) {
+        return std::abs(x) <= 20 && std::abs(y) <= 20 && std::abs(z) <= 20;
+    };
+    if (spec->name == "go" && too_close(ints[0], ints[1], ints[2])) {
+        return "go target must be more than 20 cm away on at least one axis";
+    }
+    if (spec->name == "curve" && (too_close(ints[0], ints[1], ints[2]) || too_close(ints[3], ints[4], ints[5]))) {
+        return "curve points must be more than 20 cm away on at least one axis";
+    }
+    return {};
+}
+
+std::string format_percent(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1f%%", value);
+    return buf;
+}
+
+// Dead-reckoning model of the drone used for the geofence and battery checks.
+// World frame: x forward and y right of the takeoff heading, z up; yaw grows clockwise.
+struct FlightModel {
+    const MissionLimits& limits;
+    bool flying;
+    double x = 0.0, y = 0.0, z;
+    double yaw = 0.0; // degrees
+    double speed;
+    double airborne_seconds = 0.0;
+    double battery;
+
+    explicit FlightModel(const MissionLimits& l)
+        : limits(l), flying(l.start_airborne), z(l.start_airborne ? l.takeoff_height : 0.0),
+          speed(l.default_speed), battery(l.start_battery) {}
+
+    void move_body(double forward, double right, double up) {
+        double rad = yaw * 3.14159265358979323846 / 180.0;
+        x += forward * std::cos(rad) - right * std::sin(rad);
+        y += forward * std::sin(rad) + right * std::cos(rad);
+        z += up;
+    }
+
+    void spend(double seconds) {
+        if (flying) {
+            airborne_seconds += seconds;
+            battery -= seconds * limits.drain_per_second;
+        }
+    }
+
+    bool outside_fence() const {
+        return std::abs(x) > limits.fence_half_width || std::abs(y) > limits.fence_half_width
+               || z > limits.fence_ceiling;
+    }
+};
+
+} // namespace
+
+bool MissionReport::ok() const {
+    return error_count() == 0;
+}
+
+size_t MissionReport::error_count() const {
+    return std::count_if(diagnostics.begin(), diagnostics.end(), [](const MissionDiagnostic& d) {
+        return d.severity == MissionDiagnostic::Severity::ERROR;
+    });
+}
+
+size_t MissionReport::warning_count() const {
+    return diagnostics.size() - error_count();
+}
+
+const std::vector<std::string_view>& mission_command_names() {
+    static const std::vector<std::string_view> names = [] {
+        std::vector<std::string_view> result;
+        for (const auto& spec : grammar()) {
+            result.push_back(spec.name);
+        }
+        return result;
+    }();
+    return names;
+}
+
+int mission_command_arity(std::string_view name) {
+    const CommandSpec* spec = find_spec(name);
+    return spec ? static_cast<int>(spec->args.size()) : -1;
+}
+
+std::string check_mission_command(std::string_view cmd, const MissionLimits& limits) {
+    std::vector<int> ints;
+    return check_words(split_words(cmd), limits, ints);
+}
+
+MissionReport validate_mission(std::string_view text, const MissionLimits& limits) {
+    MissionReport report;
+    FlightModel model(limits);
+    std::vector<int> ints;
+
+    auto error = [&report](size_t line, std::string message) {
+        report.diagnostics.push_back({line, MissionDiagnostic::Severity::ERROR, std::move(message)});
+    };
+    auto warning = [&report](size_t line, std::string message) {
+        report.diagnostics.push_back({line, MissionDiagnostic::Severity::WARNING, std::move(message)});
+    };
+
+    size_t line_no = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos) {
+            eol = text.size();
+        }
+        std::string_view line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        ++line_no;
+
+        if (size_t comment = line.find('#'); comment != std::string_view::npos) {
+            line = line.substr(0, comment);
+        }
+        auto words = split_words(line);
+        if (words.empty()) {
+            continue;
+        }
+
+        if (std::string message = check_words(words, limits, ints); !message.empty()) {
+            error(line_no, std::move(message));
+            continue;
+        }
+
+        std::string normalized(words[0]);
+        for (size_t i = 1; i < words.size(); ++i) {
+            normalized += ' ';
+            normalized += words[i];
+        }
+        report.steps.push_back({line_no, normalized});
+
+        std::string_view name = words[0];
+        bool is_move = name == "up" || name == "down" || name == "left" || name == "right" || name == "forward"
+                       || name == "back" || name == "cw" || name == "ccw" || name == "go" || name == "curve"
+                       || name == "flip" || name == "rc";
+        if (is_move && !model.flying) {
+            error(line_no, std::string(name) + " issued before takeoff");
+            continue;
+        }
+
+        double seconds = 0.0;
+        if (name == "takeoff") {
+            if (model.flying) {
+                warning(line_no, "takeoff while already airborne");
+            } else {
+                model.flying = true;
+                model.z = limits.takeoff_height;
+                model.battery -= limits.takeoff_cost;
+            }
+            seconds = 5.0;
+        } else if (name == "land") {
+            if (!model.flying) {
+                warning(line_no, "land while not airborne");
+            }
+            model.spend(3.0);
+            model.flying = false;
+            model.z = 0.0;
+        } else if (name == "emergency") {
+            warning(line_no, "emergency stops the motors immediately");
+            model.flying = false;
+            model.z = 0.0;
+        } else if (name == "up" || name == "down") {
+            model.move_body(0, 0, name == "up" ? ints[0] : -ints[0]);
+            seconds = ints[0] / model.speed;
+        } else if (name == "forward" || name == "back") {
+            model.move_body(name == "forward" ? ints[0] : -ints[0], 0, 0);
+            seconds = ints[0] / model.speed;
+        } else if (name == "left" || name == "right") {
+            model.move_body(0, name == "right" ? ints[0] : -ints[0], 0);
+            seconds = ints[0] / model.speed;
+        } else if (name == "cw" || name == "ccw") {
+            model.yaw += name == "cw" ? ints[0] : -ints[0];
+            seconds = static_cast<double>(ints[0]) / limits.yaw_rate;
+        } else if (name == "go") {
+            // SDK frame: x forward, y left, z up
+            model.move_body(ints[0], -ints[1], ints[2]);
+            seconds = std::sqrt(double(ints[0]) * ints[0] + double(ints[1]) * ints[1] + double(ints[2]) * ints[2])
+                      / ints[3];
+        } else if (name == "curve") {
+            double dx = ints[3] - ints[0], dy = ints[4] - ints[1], dz = ints[5] - ints[2];
+            double path = std::sqrt(double(ints[0]) * ints[0] + double(ints[1]) * ints[1] + double(ints[2]) * ints[2])
+                          + std::sqrt(dx * dx + dy * dy + dz * dz);
+            model.move_body(ints[3], -ints[4], ints[5]);
+            seconds = path / ints[6];
+        } else if (name == "speed") {
+            model.speed = ints[0];
+        } else if (name == "flip") {
+            if (model.battery < 50.0) {
+                warning(line_no, "flip requires more than 50% battery, estimated " + format_percent(model.battery));
+            }
+            seconds = 2.0;
+        } else if (name == "rc") {
+            warning(line_no, "rc setpoints are not modeled by the geofence check");
+        }
+
+        model.spend(seconds + limits.command_overhead);
+
+        if (model.flying && model.outside_fence()) {
+            char where[96];
+            std::snprintf(where, sizeof(where), "(%.0f, %.0f, %.0f) cm", model.x, model.y, model.z);
+            error(line_no, std::string("leaves the geofence at ") + where);
+        } else if (model.flying && model.z < 0.0) {
+            error(line_no, "descends below the takeoff point");
+        }
+    }
+
+    if (report.steps.empty()) {
+        warning(line_no, "mission contains no commands");
+    } else if (model.flying) {
+        warning(line_no, "mission ends airborne (no land command)");
+    }
+
+    report.estimated_seconds = model.airborne_seconds;
+    report.estimated_battery = model.battery;
+    if (model.battery < limits.min_battery_level) {
+        error(line_no, "estimated battery at landing " + format_percent(model.battery) + " is below the "
+                           + std::to_string(limits.min_battery_level) + "% reserve");
+    }
+    return report;
+}
@@ -0,0 +1,706 @@
+#include "mission_vm.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <map>
+
+namespace {
+
+const char* const kTelemetryNames[] = {"pitch", "roll", "yaw", "vgx", "vgy", "vgz", "templ", "temph", "tof", "h",
+                                       "bat", "time"};
+static_assert(sizeof(kTelemetryNames) / sizeof(kTelemetryNames[0]) == static_cast<size_t>(MissionTelemetry::COUNT),
+              "One name per telemetry field");
+
+constexpr size_t kMaxRegisters = 256;
+constexpr size_t kMaxCode = 65536; // Jump targets are 16 bits
+constexpr size_t kMaxNesting = 64; // Parentheses, "-" and "not"; the parser recurses on each
+
+int telemetry_index(std::string_view name) {
+    for (size_t i = 0; i < static_cast<size_t>(MissionTelemetry::COUNT); ++i) {
+        if (name == kTelemetryNames[i]) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool is_keyword(std::string_view word) {
+    for (std::string_view keyword : {"set", "if", "else", "end", "while", "until", "repeat", "wait", "break", "and",
+                                     "or", "not"}) {
+        if (word == keyword) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Overflow wraps, as it would in two's complement, rather than being undefined
+int64_t wrap_add(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+int64_t wrap_sub(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+int64_t wrap_mul(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+int64_t wrap_div(int64_t a, int64_t b) { return b == -1 ? wrap_sub(0, a) : a / b; }
+int64_t wrap_mod(int64_t a, int64_t b) { return b == -1 ? 0 : a % b; }
+
+struct CompileError {
+    std::string message;
+};
+
+// A value while compiling: known now, or computed into a register at run time
+struct Operand {
+    bool constant;
+    int64_t value;
+    uint8_t reg;
+};
+
+// Words of a line; "{...}" is one word whatever it contains
+std::vector<std::string_view> split_line(std::string_view line) {
+    std::vector<std::string_view> words;
+    size_t pos = 0;
+    while (pos < line.size()) {
+        if (std::isspace(static_cast<unsigned char>(line[pos]))) {
+            pos++;
+            continue;
+        }
+        size_t start = pos;
+        if (line[pos] == '{') {
+            pos = line.find('}', pos);
+            if (pos == std::string_view::npos) {
+                throw CompileError{"unclosed {"};
+            }
+            pos++;
+        } else {
+            while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos]))) {
+                pos++;
+            }
+        }
+        words.push_back(line.substr(start, pos - start));
+    }
+    return words;
+}
+
+class Compiler {
+public:
+    explicit Compiler(MissionProgram& program) : program_(program) {}
+
+    void compile(std::string_view text) {
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t eol = text.find('\n', pos);
+            if (eol == std::string_view::npos) {
+                eol = text.size();
+            }
+            std::string_view line = text.substr(pos, eol - pos);
+            pos = eol + 1;
+            ++line_;
+            if (size_t comment = line.find('#'); comment != std::string_view::npos) {
+                line = line.substr(0, comment);
+            }
+            try {
+                statement(line);
+            } catch (const CompileError& e) {
+                error(line_, e.message);
+            }
+        }
+        for (const Block& block : blocks_) {
+            error(block.line, std::string(block.keyword) + " has no end");
+        }
+        emit(MissionOp::HALT);
+        if (program_.code.size() > kMaxCode) {
+            error(line_, "mission is too long");
+        }
+    }
+
+private:
+    struct Block {
+        const char* keyword;
+        size_t line;
+        bool loop;
+
+        Block(const char* keyword, size_t line, bool loop) : keyword(keyword), line(line), loop(loop) {}
+
+        size_t top = 0; // Loops: where `end` jumps back to
+        size_t exit = SIZE_MAX; // Jump to patch with the end (or else) of the block
+        std::vector<size_t> breaks;
+        bool has_else = false;
+    };
+
+    void error(size_t line, std::string message) {
+        program_.diagnostics.push_back({line, MissionDiagnostic::Severity::ERROR, std::move(message)});
+    }
+
+    size_t emit(MissionOp op, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0) {
+        program_.code.push_back({op, a, b, c});
+        program_.lines.push_back(static_cast<uint32_t>(line_));
+        return program_.code.size() - 1;
+    }
+
+    size_t emit_wide(MissionOp op, uint8_t a, size_t bx) {
+        return emit(op, a, static_cast<uint8_t>(bx & 0xff), static_cast<uint8_t>((bx >> 8) & 0xff));
+    }
+
+    void patch(size_t at, size_t target) {
+        program_.code[at].b = static_cast<uint8_t>(target & 0xff);
+        program_.code[at].c = static_cast<uint8_t>((target >> 8) & 0xff);
+    }
+
+    size_t here() const { return program_.code.size(); }
+
+    uint8_t allocate() {
+        if (next_register_ >= kMaxRegisters) {
+            throw CompileError{"too many variables or expression too complex"};
+        }
+        program_.registers = std::max(program_.registers, next_register_ + 1);
+        return static_cast<uint8_t>(next_register_++);
+    }
+
+    size_t constant(int64_t value) {
+        auto [it, added] = constant_index_.try_emplace(value, program_.constants.size());
+        if (added) {
+            program_.constants.push_back(value);
+        }
+        return it->second;
+    }
+
+    uint8_t materialize(const Operand& operand) {
+        if (!operand.constant) {
+            return operand.reg;
+        }
+        uint8_t reg = allocate();
+        emit_wide(MissionOp::LOADK, reg, constant(operand.value));
+        return reg;
+    }
+
+    void statement(std::string_view line) {
+        auto words = split_line(line);
+        if (words.empty()) {
+            return;
+        }
+        next_register_ = variables_count_; // Temporaries of the last statement are dead
+        std::string_view head = words[0];
+        std::string_view rest = line.substr(line.find(head) + head.size());
+
+        if (head == "set") {
+            program_.scripted = true;
+            size_t equals = rest.find('=');
+            if (equals == std::string_view::npos) {
+                throw CompileError{"set expects: set <name> = <expression>"};
+            }
+            std::string name = trim(rest.substr(0, equals));
+            check_name(name);
+            Operand value = expression(rest.substr(equals + 1));
+            auto it = variables_.find(name);
+            uint8_t reg = it != variables_.end() ? it->second : declare(name);
+            if (value.constant) {
+                emit_wide(MissionOp::LOADK, reg, constant(value.value));
+            } else if (value.reg != reg) {
+                emit(MissionOp::MOVE, reg, value.reg);
+            }
+        } else if (head == "if" || head == "while" || head == "until") {
+            program_.scripted = true;
+            blocks_.emplace_back(head == "if" ? "if" : head == "while" ? "while" : "until", line_, head != "if");
+            Block& block = blocks_.back(); // Opened before the condition, so a bad one leaves its end matched
+            block.top = here();
+            Operand condition = expression(rest);
+            bool exit_when = head == "until"; // Value of the condition that skips the body
+            if (!condition.constant) {
+                block.exit = emit_wide(exit_when ? MissionOp::JMPT : MissionOp::JMPF, condition.reg, 0);
+            } else if ((condition.value != 0) == exit_when) {
+                block.exit = emit_wide(MissionOp::JMP, 0, 0);
+            }
+        } else if (head == "repeat") {
+            program_.scripted = true;
+            blocks_.emplace_back("repeat", line_, true);
+            Operand count = expression(rest);
+            uint8_t counter = declare(""); // Hidden, but lives as long as a variable
+            if (count.constant) {
+                emit_wide(MissionOp::LOADK, counter, constant(count.value));
+            } else {
+                emit(MissionOp::MOVE, counter, count.reg);
+            }
+            Block& block = blocks_.back();
+            block.top = here();
+            block.exit = emit_wide(MissionOp::LOOP, counter, 0);
+        } else if (head == "else") {
+            program_.scripted = true;
+            expect_alone(words);
+            if (blocks_.empty() || std::string_view(blocks_.back().keyword) != "if" || blocks_.back().has_else) {
+                throw CompileError{"else without if"};
+            }
+            Block& block = blocks_.back();
+            size_t skip = emit_wide(MissionOp::JMP, 0, 0);
+            if (block.exit != SIZE_MAX) {
+                patch(block.exit, here());
+            }
+            block.exit = skip;
+            block.has_else = true;
+        } else if (head == "end") {
+            program_.scripted = true;
+            expect_alone(words);
+            if (blocks_.empty()) {
+                throw CompileError{"end without a block"};
+            }
+            Block block = std::move(blocks_.back());
+            blocks_.pop_back();
+            if (block.loop) {
+                emit_wide(MissionOp::JMP, 0, block.top);
+            }
+            if (block.exit != SIZE_MAX) {
+                patch(block.exit, here());
+            }
+            for (size_t at : block.breaks) {
+                patch(at, here());
+            }
+        } else if (head == "break") {
+            program_.scripted = true;
+            expect_alone(words);
+            auto loop = std::find_if(blocks_.rbegin(), blocks_.rend(), [](const Block& b) { return b.loop; });
+            if (loop == blocks_.rend()) {
+                throw CompileError{"break outside a loop"};
+            }
+            loop->breaks.push_back(emit_wide(MissionOp::JMP, 0, 0));
+        } else if (head == "wait") {
+            program_.scripted = true;
+            emit(MissionOp::WAIT, materialize(expression(rest)));
+        } else {
+            command(words);
+        }
+    }
+
+    // An SDK command; literal arguments are checked now, {expression} ones when sent
+    void command(const std::vector<std::string_view>& words) {
+        int arity = mission_command_arity(words[0]);
+        if (arity < 0) {
+            throw CompileError{"unknown command: " + std::string(words[0])};
+        }
+        if (words.size() - 1 != static_cast<size_t>(arity)) {
+            throw CompileError{std::string(words[0]) + " expects " + std::to_string(arity) + " argument(s), got "
+                               + std::to_string(words.size() - 1)};
+        }
+        MissionCommandTemplate templ;
+        templ.parts.emplace_back(words[0]);
+        for (size_t i = 1; i < words.size(); ++i) {
+            templ.parts.back() += ' ';
+            std::string_view word = words[i];
+            if (word.front() != '{') {
+                templ.parts.back() += word;
+                continue;
+            }
+            program_.scripted = true;
+            Operand value = expression(word.substr(1, word.size() - 2));
+            if (value.constant) {
+                templ.parts.back() += std::to_string(value.value);
+            } else {
+                templ.registers.push_back(value.reg);
+                templ.parts.emplace_back();
+            }
+        }
+        if (templ.registers.empty()) {
+            if (std::string message = check_mission_command(templ.parts[0], program_.limits); !message.empty()) {
+                throw CompileError{message};
+            }
+            auto [it, added] = command_index_.try_emplace(templ.parts[0], program_.commands.size());
+            if (added) {
+                program_.commands.push_back(templ.parts[0]);
+            }
+            emit_wide(MissionOp::SEND, 0, it->second);
+        } else {
+            program_.templates.push_back(std::move(templ));
+            emit_wide(MissionOp::SENDF, 0, program_.templates.size() - 1);
+        }
+    }
+
+    // May take the register of one of this statement's temporaries; they have all been computed,
+    // and the MOVE or LOADK that fills the variable comes last
+    uint8_t declare(const std::string& name) {
+        if (variables_count_ >= kMaxRegisters) {
+            throw CompileError{"too many variables"};
+        }
+        uint8_t reg = static_cast<uint8_t>(variables_count_++);
+        program_.registers = std::max(program_.registers, variables_count_);
+        next_register_ = std::max(next_register_, variables_count_);
+        if (!name.empty()) {
+            variables_[name] = reg;
+        }
+        return reg;
+    }
+
+    void check_name(const std::string& name) {
+        bool valid = !name.empty() && (std::isalpha(static_cast<unsigned char>(name[0])) || name[0] == '_');
+        for (char ch : name) {
+            valid = valid && (std::isalnum(static_cast<unsigned char>(ch)) || ch == '_');
+        }
+        if (!valid) {
+            throw CompileError{"invalid variable name: " + name};
+        }
+        if (is_keyword(name) || telemetry_index(name) >= 0 || mission_command_arity(name) >= 0) {
+            throw CompileError{name + " is reserved"};
+        }
+    }
+
+    static void expect_alone(const std::vector<std::string_view>& words) {
+        if (words.size() > 1) {
+            throw CompileError{std::string(words[0]) + " takes nothing after it"};
+        }
+    }
+
+    static std::string trim(std::string_view text) {
+        size_t start = text.find_first_not_of(" \t\r");
+        if (start == std::string_view::npos) {
+            return {};
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return std::string(text.substr(start, end - start + 1));
+    }
+
+    // Expressions: or := and ("or" and)* ; and := not ("and" not)* ; not := "not" not | comparison
+    // comparison := sum (op sum)? ; sum := product (("+" | "-") product)* ;
+    // product := unary (("*" | "/" | "%") unary)* ; unary := "-" unary | number | name | "(" or ")"
+    Operand expression(std::string_view text) {
+        text_ = text;
+        pos_ = 0;
+        nesting_ = 0;
+        Operand value = parse_or();
+        skip_space();
+        if (pos_ < text_.size()) {
+            throw CompileError{"unexpected '" + std::string(text_.substr(pos_)) + "' in expression"};
+        }
+        return value;
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            pos_++;
+        }
+    }
+
+    bool accept_word(std::string_view word) {
+        skip_space();
+        if (text_.substr(pos_, word.size()) != word) {
+            return false;
+        }
+        size_t after = pos_ + word.size();
+        if (after < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[after])) || text_[after] == '_')) {
+            return false;
+        }
+        pos_ = after;
+        return true;
+    }
+
+    bool accept(std::string_view symbol) {
+        skip_space();
+        if (text_.substr(pos_, symbol.size()) != symbol) {
+            return false;
+        }
+        pos_ += symbol.size();
+        return true;
+    }
+
+    // "and"/"or" short-circuit, so the right side is not evaluated (and cannot fault) needlessly
+    Operand logical(bool is_and, Operand left, Operand (Compiler::*next)()) {
+        uint8_t result = allocate();
+        emit(MissionOp::BOOL, result, materialize(left));
+        size_t skip = emit_wide(is_and ? MissionOp::JMPF : MissionOp::JMPT, result, 0);
+        Operand right = (this->*next)();
+        emit(MissionOp::BOOL, result, materialize(right));
+        patch(skip, here());
+        return {false, 0, result};
+    }
+
+    Operand parse_or() {
+        Operand left = parse_and();
+        while (accept_word("or")) {
+            left = logical(false, left, &Compiler::parse_and);
+        }
+        return left;
+    }
+
+    Operand parse_and() {
+        Operand left = parse_not();
+        while (accept_word("and")) {
+            left = logical(true, left, &Compiler::parse_not);
+        }
+        return left;
+    }
+
+    Operand parse_not() {
+        if (accept_word("not")) {
+            nest();
+            Operand value = parse_not();
+            nesting_--;
+            return unary(MissionOp::NOT, value);
+        }
+        return parse_comparison();
+    }
+
+    Operand parse_comparison() {
+        Operand left = parse_sum();
+        // Longest symbols first; > and >= swap their operands onto LT and LE
+        if (accept("<=")) return binary(MissionOp::LE, left, parse_sum());
+        if (accept(">=")) return binary(MissionOp::LE, parse_sum(), left);
+        if (accept("==")) return binary(MissionOp::EQ, left, parse_sum());
+        if (accept("!=")) return binary(MissionOp::NE, left, parse_sum());
+        if (accept("<")) return binary(MissionOp::LT, left, parse_sum());
+        if (accept(">")) return binary(MissionOp::LT, parse_sum(), left);
+        return left;
+    }
+
+    Operand parse_sum() {
+        Operand left = parse_product();
+        for (;;) {
+            if (accept("+")) {
+                left = binary(MissionOp::ADD, left, parse_product());
+            } else if (accept("-")) {
+                left = binary(MissionOp::SUB, left, parse_product());
+            } else {
+                return left;
+            }
+        }
+    }
+
+    Operand parse_product() {
+        Operand left = parse_unary();
+        for (;;) {
+            if (accept("*")) {
+                left = binary(MissionOp::MUL, left, parse_unary());
+            } else if (accept("/")) {
+                left = binary(MissionOp::DIV, left, parse_unary());
+            } else if (accept("%")) {
+                left = binary(MissionOp::MOD, left, parse_unary());
+            } else {
+                return left;
+            }
+        }
+    }
+
+    Operand parse_unary() {
+        if (accept("-")) {
+            nest();
+            Operand value = parse_unary();
+            nesting_--;
+            return unary(MissionOp::NEG, value);
+        }
+        if (accept("(")) {
+            nest();
+            Operand value = parse_or();
+            nesting_--;
+            if (!accept(")")) {
+                throw CompileError{"missing )"};
+            }
+            return value;
+        }
+        skip_space();
+        size_t start = pos_;
+        if (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))) {
+            int64_t value = 0;
+            auto [ptr, ec] = std::from_chars(text_.data() + pos_, text_.data() + text_.size(), value);
+            if (ec != std::errc()) {
+                throw CompileError{"number out of range"};
+            }
+            pos_ = static_cast<size_t>(ptr - text_.data());
+            return {true, value, 0};
+        }
+        while (pos_ < text_.size() && (std::isalnum(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '_')) {
+            pos_++;
+        }
+        std::string name(text_.substr(start, pos_ - start));
+        if (name.empty()) {
+            throw CompileError{pos_ < text_.size() ? "unexpected '" + std::string(1, text_[pos_]) + "' in expression"
+                                                   : std::string("expression expected")};
+        }
+        if (auto it = variables_.find(name); it != variables_.end()) {
+            return {false, 0, it->second};
+        }
+        if (int field = telemetry_index(name); field >= 0) {
+            uint8_t reg = allocate();
+            emit(MissionOp::TEL, reg, static_cast<uint8_t>(field));
+            return {false, 0, reg};
+        }
+        throw CompileError{"unknown name " + name + " (variables need a set first)"};
+    }
+
+    // Patches come off a queue with any content; deep nesting must not run the parser off the stack
+    void nest() {
+        if (++nesting_ > kMaxNesting) {
+            throw CompileError{"expression nests more than " + std::to_string(kMaxNesting) + " deep"};
+        }
+    }
+
+    Operand unary(MissionOp op, Operand value) {
+        if (value.constant) {
+            switch (op) {
+                case MissionOp::NEG: return {true, wrap_sub(0, value.value), 0};
+                default: return {true, value.value == 0 ? 1 : 0, 0};
+            }
+        }
+        uint8_t result = allocate();
+        emit(op, result, value.reg);
+        return {false, 0, result};
+    }
+
+    Operand binary(MissionOp op, Operand left, Operand right) {
+        if (left.constant && right.constant) {
+            int64_t a = left.value, b = right.value;
+            if ((op == MissionOp::DIV || op == MissionOp::MOD) && b == 0) {
+                throw CompileError{"division by zero"};
+            }
+            switch (op) {
+                case MissionOp::ADD: return {true, wrap_add(a, b), 0};
+                case MissionOp::SUB: return {true, wrap_sub(a, b), 0};
+                case MissionOp::MUL: return {true, wrap_mul(a, b), 0};
+                case MissionOp::DIV: return {true, wrap_div(a, b), 0};
+                case MissionOp::MOD: return {true, wrap_mod(a, b), 0};
+                case MissionOp::LT: return {true, a < b, 0};
+                case MissionOp::LE: return {true, a <= b, 0};
+                case MissionOp::EQ: return {true, a == b, 0};
+                default: return {true, a != b, 0};
+            }
+        }
+        uint8_t a = materialize(left);
+        uint8_t b = materialize(right);
+        uint8_t result = allocate();
+        emit(op, result, a, b);
+        return {false, 0, result};
+    }
+
+    MissionProgram& program_;
+    size_t line_ = 0;
+    std::vector<Block> blocks_;
+    std::map<std::string, uint8_t> variables_;
+    size_t variables_count_ = 0; // Registers below this hold variables and repeat counters
+    size_t next_register_ = 0;
+    std::map<int64_t, size_t> constant_index_;
+    std::map<std::string, size_t> command_index_;
+    std::string_view text_; // Expression being parsed
+    size_t pos_ = 0;
+    size_t nesting_ = 0;
+};
+
+} // namespace
+
+bool MissionProgram::ok() const {
+    return std::none_of(diagnostics.begin(), diagnostics.end(), [](const MissionDiagnostic& d) {
+        return d.severity == MissionDiagnostic::Severity::ERROR;
+    });
+}
+
+MissionProgram compile_mission(std::string_view text, const MissionLimits& limits) {
+    MissionProgram program;
+    program.limits = limits;
+    Compiler(program).compile(text);
+    if (!program.ok()) {
+        program.code.clear();
+        program.lines.clear();
+    }
+    return program;
+}
+
+MissionVm::MissionVm(std::shared_ptr<const MissionProgram> program)
+    : program_(std::move(program)), registers_(std::max<size_t>(program_->registers, 1)) {
+    if (program_->code.empty()) {
+        state_ = State::FAULT;
+        error_ = "mission did not compile";
+    }
+}
+
+void MissionVm::set_telemetry(MissionTelemetry field, int64_t value) {
+    telemetry_[static_cast<size_t>(field)] = value;
+    telemetry_valid_ |= 1u << static_cast<size_t>(field);
+}
+
+size_t MissionVm::line() const {
+    return pc_ < program_->lines.size() ? program_->lines[pc_] : 0;
+}
+
+MissionVm::State MissionVm::fault(size_t pc, std::string message) {
+    pc_ = pc;
+    error_ = "line " + std::to_string(line()) + ": " + message;
+    state_ = State::FAULT;
+    return state_;
+}
+
+MissionVm::State MissionVm::run(uint64_t budget) {
+    if (state_ == State::DONE || state_ == State::FAULT) {
+        return state_;
+    }
+    const MissionInstruction* code = program_->code.data();
+    const int64_t* constants = program_->constants.data();
+    int64_t* r = registers_.data();
+    size_t pc = pc_;
+    uint64_t count = 0;
+    // The instruction count is settled on every way out, so the loop itself only bumps a local
+    auto leave = [&](State state) {
+        pc_ = pc;
+        executed_ += count;
+        state_ = state;
+        return state;
+    };
+    while (count < budget) {
+        const MissionInstruction in = code[pc++];
+        count++;
+        switch (in.op) {
+            case MissionOp::LOADK: r[in.a] = constants[in.bx()]; break;
+            case MissionOp::MOVE: r[in.a] = r[in.b]; break;
+            case MissionOp::TEL:
+                if (!(telemetry_valid_ & (1u << in.b))) {
+                    executed_ += count;
+                    return fault(pc - 1, std::string("no telemetry for ") + kTelemetryNames[in.b]);
+                }
+                r[in.a] = telemetry_[in.b];
+                break;
+            case MissionOp::ADD: r[in.a] = wrap_add(r[in.b], r[in.c]); break;
+            case MissionOp::SUB: r[in.a] = wrap_sub(r[in.b], r[in.c]); break;
+            case MissionOp::MUL: r[in.a] = wrap_mul(r[in.b], r[in.c]); break;
+            case MissionOp::DIV:
+            case MissionOp::MOD:
+                if (r[in.c] == 0) {
+                    executed_ += count;
+                    return fault(pc - 1, "division by zero");
+                }
+                r[in.a] = in.op == MissionOp::DIV ? wrap_div(r[in.b], r[in.c]) : wrap_mod(r[in.b], r[in.c]);
+                break;
+            case MissionOp::LT: r[in.a] = r[in.b] < r[in.c]; break;
+            case MissionOp::LE: r[in.a] = r[in.b] <= r[in.c]; break;
+            case MissionOp::EQ: r[in.a] = r[in.b] == r[in.c]; break;
+            case MissionOp::NE: r[in.a] = r[in.b] != r[in.c]; break;
+            case MissionOp::NEG: r[in.a] = wrap_sub(0, r[in.b]); break;
+            case MissionOp::NOT: r[in.a] = r[in.b] == 0; break;
+            case MissionOp::BOOL: r[in.a] = r[in.b] != 0; break;
+            case MissionOp::JMP: pc = in.bx(); break;
+            case MissionOp::JMPF: if (r[in.a] == 0) pc = in.bx(); break;
+            case MissionOp::JMPT: if (r[in.a] != 0) pc = in.bx(); break;
+            case MissionOp::LOOP:
+                if (r[in.a] <= 0) {
+                    pc = in.bx();
+                } else {
+                    r[in.a]--;
+                }
+                break;
+            case MissionOp::SEND:
+                command_ = program_->commands[in.bx()];
+                commands_sent_++;
+                return leave(State::COMMAND);
+            case MissionOp::SENDF: {
+                const MissionCommandTemplate& templ = program_->templates[in.bx()];
+                command_ = templ.parts[0];
+                for (size_t i = 0; i < templ.registers.size(); ++i) {
+                    command_ += std::to_string(r[templ.registers[i]]);
+                    command_ += templ.parts[i + 1];
+                }
+                if (std::string message = check_mission_command(command_, program_->limits); !message.empty()) {
+                    executed_ += count;
+                    return fault(pc - 1, command_ + ": " + message);
+                }
+                commands_sent_++;
+                return leave(State::COMMAND);
+            }
+            case MissionOp::WAIT:
+                wait_ms_ = std::max<int64_t>(0, r[in.a]);
+                return leave(State::WAIT);
+            case MissionOp::HALT:
+                pc--; // Stays on HALT
+                return leave(State::DONE);
+        }
+    }
+    executed_ += count;
+    return fault(pc, "no command or wait in " + std::to_string(budget) + " instructions");
+}
@@ -0,0 +1,98 @@
+#include "qos.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/socket.h>
+
+TrafficMarking traffic_marking(TrafficClass traffic_class) {
+    switch (traffic_class) {
+        case TrafficClass::EMERGENCY: return {48, 6};
+        case TrafficClass::CONTROL: return {46, 6};
+        case TrafficClass::TELEMETRY: return {0, 0};
+        case TrafficClass::BULK: return {8, 2};
+    }
+    return {0, 0};
+}
+
+const char* traffic_class_name(TrafficClass traffic_class) {
+    switch (traffic_class) {
+        case TrafficClass::EMERGENCY: return "emergency";
+        case TrafficClass::CONTROL: return "control";
+        case TrafficClass::TELEMETRY: return "telemetry";
+        case TrafficClass::BULK: return "bulk";
+    }
+    return "unknown";
+}
+
+bool mark_socket(uv_handle_t* handle, TrafficClass traffic_class) {
+    uv_os_fd_t fd;
+    if (uv_fileno(handle, &fd) != 0) {
+        return false;
+    }
+    TrafficMarking marking = traffic_marking(traffic_class);
+    int tos = marking.dscp << 2;
+    if (setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+        std::cerr << "Failed to set DSCP " << marking.dscp << " for " << traffic_class_name(traffic_class)
+                  << " traffic: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+#ifdef SO_PRIORITY
+    if (setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &marking.priority, sizeof(marking.priority)) != 0) {
+        std::cerr << "Failed to set socket priority " << marking.priority << " for "
+                  << traffic_class_name(traffic_class) << " traffic: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool set_pacing_rate(uv_handle_t* handle, uint64_t bytes_per_second) {
+#ifdef SO_MAX_PACING_RATE
+    uv_os_fd_t fd;
+    if (uv_fileno(handle, &fd) != 0) {
+        return false;
+    }
+    // 32-bit option on older kernels; ~0U means unlimited
+    unsigned int rate = bytes_per_second == 0 ? ~0U : static_cast<unsigned int>(std::min<uint64_t>(bytes_per_second, ~0U - 1));
+    if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) != 0) {
+        std::cerr << "Failed to set pacing rate: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+#else
+    (void)handle;
+    (void)bytes_per_second;
+    return false;
+#endif
+}
+
+TokenBucket::TokenBucket(uint64_t bytes_per_second, uint64_t burst_bytes)
+    : rate_(std::max<uint64_t>(1, bytes_per_second)), burst_(std::max<uint64_t>(1, burst_bytes)),
+      tokens_(static_cast<double>(burst_)) {}
+
+void TokenBucket::refill(uint64_t now_ns) {
+    if (last_ns_ != 0 && now_ns > last_ns_) {
+        tokens_ = std::min<double>(burst_, tokens_ + (now_ns - last_ns_) * 1e-9 * rate_);
+    }
+    last_ns_ = now_ns;
+}
+
+bool TokenBucket::try_consume(uint64_t bytes, uint64_t now_ns) {
+    refill(now_ns);
+    if (tokens_ < bytes) {
+        return false;
+    }
+    tokens_ -= bytes;
+    return true;
+}
+
+uint64_t TokenBucket::delay_ns(uint64_t bytes, uint64_t now_ns) {
+    refill(now_ns);
+    if (tokens_ >= bytes) {
+        return 0;
+    }
+    return static_cast<uint64_t>((bytes - tokens_) * 1e9 / rate_);
+}
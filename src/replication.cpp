@@ -0,0 +1,228 @@
+#include "replication.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+void append_field(std::string& out, std::string_view field) {
+    out += ' ';
+    if (field.empty()) {
+        out += '-';
+        return;
+    }
+    if (field == "-") {
+        out += "%2D";
+        return;
+    }
+    for (char c : field) {
+        if (c == '%' || c == ' ' || c == '\n' || c == '\r') {
+            char escaped[4];
+            std::snprintf(escaped, sizeof(escaped), "%%%02X", static_cast<unsigned char>(c));
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+}
+
+std::string unescape(std::string_view field) {
+    if (field == "-") {
+        return std::string();
+    }
+    std::string out;
+    out.reserve(field.size());
+    for (size_t i = 0; i < field.size(); ++i) {
+        if (field[i] == '%' && i + 2 < field.size()) {
+            out += static_cast<char>(std::strtol(std::string(field.substr(i + 1, 2)).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            out += field[i];
+        }
+    }
+    return out;
+}
+
+std::vector<std::string> split_fields(std::string_view line) {
+    std::vector<std::string> fields;
+    while (!line.empty()) {
+        size_t space = line.find(' ');
+        fields.push_back(unescape(line.substr(0, space)));
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    }
+    return fields;
+}
+
+uint64_t to_u64(const std::string& field) {
+    return std::strtoull(field.c_str(), nullptr, 10);
+}
+
+} // namespace
+
+ReplicaState::ReplicaState(size_t dedup_window) : dedup_window_(dedup_window) {}
+
+uint64_t ReplicaState::begin(InFlightCommand command) {
+    uint64_t id = next_id_++;
+    drones_[command.drone].received_from[command.queue]++;
+    if (!command.correlation_id.empty()) {
+        in_flight_ids_[command.correlation_id] = id;
+    }
+    in_flight_[id] = std::move(command);
+    return id;
+}
+
+void ReplicaState::finish(uint64_t id, const std::string& response) {
+    auto it = in_flight_.find(id);
+    if (it == in_flight_.end()) {
+        return;
+    }
+    const std::string& correlation_id = it->second.correlation_id;
+    if (!correlation_id.empty()) {
+        in_flight_ids_.erase(correlation_id);
+        if (response.compare(0, 5, "error") != 0) {
+            remember(correlation_id, response);
+        }
+    }
+    in_flight_.erase(it);
+}
+
+void ReplicaState::remember(const std::string& correlation_id, const std::string& response) {
+    if (dedup_window_ == 0) {
+        return;
+    }
+    auto [it, inserted] = replies_.insert_or_assign(correlation_id, response);
+    if (!inserted) {
+        return; // Keeps its place in the window
+    }
+    reply_order_.push_back(correlation_id);
+    while (reply_order_.size() > dedup_window_) {
+        replies_.erase(reply_order_.front());
+        reply_order_.pop_front();
+    }
+}
+
+const std::string* ReplicaState::recent_reply(const std::string& correlation_id) const {
+    auto it = replies_.find(correlation_id);
+    return it == replies_.end() ? nullptr : &it->second;
+}
+
+bool ReplicaState::in_flight(const std::string& correlation_id) const {
+    return in_flight_ids_.count(correlation_id) > 0;
+}
+
+std::string ReplicaState::encode_command(uint64_t id, const InFlightCommand& command) {
+    std::string record = "command " + std::to_string(id);
+    append_field(record, command.drone);
+    append_field(record, command.queue);
+    append_field(record, command.correlation_id);
+    append_field(record, command.reply_to);
+    append_field(record, command.cmd);
+    return record;
+}
+
+std::string ReplicaState::encode_done(uint64_t id, std::string_view response) {
+    std::string record = "done " + std::to_string(id);
+    append_field(record, response);
+    return record;
+}
+
+std::string ReplicaState::encode_drone(std::string_view drone, int link_level, uint64_t srtt_ms) {
+    std::string record = "drone";
+    append_field(record, drone);
+    record += " " + std::to_string(link_level) + " " + std::to_string(srtt_ms);
+    return record;
+}
+
+std::string ReplicaState::encode_received(std::string_view drone, std::string_view queue, uint64_t received) {
+    std::string record = "received";
+    append_field(record, drone);
+    append_field(record, queue);
+    record += " " + std::to_string(received);
+    return record;
+}
+
+std::string ReplicaState::encode_session(uint64_t session) {
+    return "session " + std::to_string(session);
+}
+
+std::string ReplicaState::snapshot() const {
+    std::string out = "reset\n" + encode_session(session_) + "\n";
+    for (const auto& correlation_id : reply_order_) {
+        out += "reply";
+        append_field(out, correlation_id);
+        append_field(out, replies_.at(correlation_id));
+        out += "\n";
+    }
+    for (const auto& [id, command] : in_flight_) {
+        out += encode_command(id, command) + "\n";
+    }
+    // After the commands, whose records count a delivery each, so these set the totals
+    for (const auto& [id, drone] : drones_) {
+        out += encode_drone(id, drone.link_level, drone.srtt_ms) + "\n";
+        for (const auto& [queue, received] : drone.received_from) {
+            out += encode_received(id, queue, received) + "\n";
+        }
+    }
+    return out;
+}
+
+size_t ReplicaState::apply(std::string_view records) {
+    size_t bad = 0;
+    while (!records.empty()) {
+        size_t end = records.find('\n');
+        std::string_view line = records.substr(0, end);
+        records = end == std::string_view::npos ? std::string_view() : records.substr(end + 1);
+        if (!line.empty() && !apply_line(line)) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+bool ReplicaState::apply_line(std::string_view line) {
+    std::vector<std::string> f = split_fields(line);
+    const std::string& type = f[0];
+    if (type == "reset" && f.size() == 1) {
+        in_flight_.clear();
+        in_flight_ids_.clear();
+        replies_.clear();
+        reply_order_.clear();
+        drones_.clear();
+        return true;
+    }
+    if (type == "session" && f.size() == 2) {
+        session_ = to_u64(f[1]);
+        return true;
+    }
+    if (type == "command" && f.size() == 7) {
+        uint64_t id = to_u64(f[1]);
+        next_id_ = std::max(next_id_, id + 1);
+        InFlightCommand command{f[2], f[3], f[4], f[5], f[6]};
+        drones_[command.drone].received_from[command.queue]++;
+        if (!command.correlation_id.empty()) {
+            in_flight_ids_[command.correlation_id] = id;
+        }
+        in_flight_[id] = std::move(command);
+        return true;
+    }
+    if (type == "done" && f.size() == 3) {
+        finish(to_u64(f[1]), f[2]);
+        return true;
+    }
+    if (type == "reply" && f.size() == 3) {
+        remember(f[1], f[2]);
+        return true;
+    }
+    if (type == "drone" && f.size() == 4) {
+        ReplicatedDrone& drone = drones_[f[1]];
+        drone.link_level = std::atoi(f[2].c_str());
+        drone.srtt_ms = to_u64(f[3]);
+        return true;
+    }
+    if (type == "received" && f.size() == 4) {
+        drones_[f[1]].received_from[f[2]] = to_u64(f[3]);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,68 @@
+#include "shard_ring.hpp"
+#include <algorithm>
+
+HashRing::HashRing(int vnodes) : vnodes_(std::max(1, vnodes)) {}
+
+uint64_t HashRing::hash(std::string_view data) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    // FNV-1a alone barely spreads ids that differ in the last character ("tello1", "tello2")
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool HashRing::add(const std::string& instance) {
+    auto it = std::lower_bound(instances_.begin(), instances_.end(), instance);
+    if (it != instances_.end() && *it == instance) {
+        return false;
+    }
+    instances_.insert(it, instance);
+    rebuild();
+    return true;
+}
+
+bool HashRing::remove(const std::string& instance) {
+    auto it = std::lower_bound(instances_.begin(), instances_.end(), instance);
+    if (it == instances_.end() || *it != instance) {
+        return false;
+    }
+    instances_.erase(it);
+    rebuild();
+    return true;
+}
+
+bool HashRing::contains(const std::string& instance) const {
+    return std::binary_search(instances_.begin(), instances_.end(), instance);
+}
+
+void HashRing::rebuild() {
+    points_.clear();
+    points_.reserve(instances_.size() * vnodes_);
+    for (size_t i = 0; i < instances_.size(); ++i) {
+        for (int vnode = 0; vnode < vnodes_; ++vnode) {
+            points_.emplace_back(hash(instances_[i] + "#" + std::to_string(vnode)), i);
+        }
+    }
+    // Ties (practically never) go to the instance sorting first, the same on every instance
+    std::sort(points_.begin(), points_.end());
+}
+
+const std::string& HashRing::owner(std::string_view key) const {
+    static const std::string none;
+    if (points_.empty()) {
+        return none;
+    }
+    uint64_t h = hash(key);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, size_t{0}));
+    if (it == points_.end()) {
+        it = points_.begin(); // Wrap around
+    }
+    return instances_[it->second];
+}
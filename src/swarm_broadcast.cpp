@@ -0,0 +1,191 @@
+#include "swarm_broadcast.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kMaxBatch = 1024; // UIO_MAXIOV, the most messages one sendmmsg() takes
+
+} // namespace
+
+SwarmBroadcaster::SwarmBroadcaster(uv_loop_t& loop, const UdpBinding& binding) : loop_(loop) {
+    udp_socket_ = std::unique_ptr<uv_udp_t, UdpDeleter>(new uv_udp_t);
+    bind_udp(loop_, udp_socket_.get(), binding, "swarm broadcast socket");
+    udp_socket_->data = this;
+
+    timeout_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+    uv_timer_init(&loop_, timeout_timer_.get());
+    timeout_timer_->data = this;
+
+    uv_udp_recv_start(udp_socket_.get(),
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            auto* broadcaster = static_cast<SwarmBroadcaster*>(handle->data);
+            buf->base = broadcaster->recv_buffer_;
+            buf->len = sizeof(broadcaster->recv_buffer_);
+        },
+        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned) {
+            auto* broadcaster = static_cast<SwarmBroadcaster*>(handle->data);
+            if (nread > 0 && addr && addr->sa_family == AF_INET) {
+                broadcaster->on_datagram(*reinterpret_cast<const struct sockaddr_in*>(addr),
+                                         std::string_view(buf->base, nread));
+            } else if (nread < 0) {
+                std::cerr << "Swarm broadcast receive error: " << uv_strerror(nread) << std::endl;
+            }
+        });
+}
+
+void SwarmBroadcaster::receive_with(BusyPoller& poller) {
+    poller.add(udp_socket_.get(), [this](std::string_view data, const struct sockaddr* from) {
+        if (from->sa_family == AF_INET) {
+            on_datagram(*reinterpret_cast<const struct sockaddr_in*>(from), data);
+        }
+    });
+}
+
+size_t SwarmBroadcaster::add_drone(const std::string& ip, int port) {
+    struct sockaddr_in addr;
+    if (int result = uv_ip4_addr(ip.c_str(), port, &addr); result != 0) {
+        throw std::runtime_error("Invalid drone address " + ip + ": " + std::string(uv_strerror(result)));
+    }
+    if (!drone_by_address_.emplace(address_key(addr), addrs_.size()).second) {
+        throw std::runtime_error("Drone " + ip + ":" + std::to_string(port) + " added twice");
+    }
+    addrs_.push_back(addr);
+    return addrs_.size() - 1;
+}
+
+size_t SwarmBroadcaster::send(const Formatter& format) {
+    return submit(format);
+}
+
+size_t SwarmBroadcaster::send(std::string_view payload) {
+    return submit([payload](size_t, std::string& out) { out.append(payload); });
+}
+
+size_t SwarmBroadcaster::submit(const Formatter& format) {
+    // Format everything first: batch_ may reallocate while it grows, so the iovecs are taken after
+    batch_.clear();
+    offsets_.assign(1, 0);
+    targets_.clear();
+    for (size_t i = 0; i < addrs_.size(); ++i) {
+        format(i, batch_);
+        if (batch_.size() > offsets_.back()) {
+            targets_.push_back(i);
+        }
+        offsets_.push_back(batch_.size());
+    }
+    sent_.assign(addrs_.size(), 0);
+
+    size_t count = targets_.size();
+    iovecs_.resize(count);
+    for (size_t m = 0; m < count; ++m) {
+        size_t drone = targets_[m];
+        iovecs_[m].iov_base = batch_.data() + offsets_[drone];
+        iovecs_[m].iov_len = offsets_[drone + 1] - offsets_[drone];
+    }
+
+    uv_os_fd_t fd;
+    uv_fileno(reinterpret_cast<const uv_handle_t*>(udp_socket_.get()), &fd);
+    size_t accepted = 0;
+    size_t next = 0;
+#ifdef __linux__
+    messages_.resize(count);
+    for (size_t m = 0; m < count; ++m) {
+        struct msghdr& header = messages_[m].msg_hdr;
+        header = {};
+        header.msg_name = &addrs_[targets_[m]];
+        header.msg_namelen = sizeof(struct sockaddr_in);
+        header.msg_iov = &iovecs_[m];
+        header.msg_iovlen = 1;
+    }
+    while (next < count) {
+        int n = sendmmsg(fd, messages_.data() + next, std::min(count - next, kMaxBatch), MSG_DONTWAIT);
+        syscalls_++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break; // Socket buffer full: the rest of this step is dropped, like a lost datagram
+            }
+            // sendmmsg() reports an error only for the first message; skip it and go on
+            std::cerr << "Swarm broadcast to drone " << targets_[next] << " failed: " << std::strerror(errno)
+                      << std::endl;
+            next++;
+            continue;
+        }
+        for (int m = 0; m < n; ++m) {
+            sent_[targets_[next + m]] = 1;
+        }
+        next += n;
+        accepted += n;
+    }
+#else
+    for (; next < count; ++next) {
+        const auto* to = reinterpret_cast<const struct sockaddr*>(&addrs_[targets_[next]]);
+        ssize_t n = sendto(fd, iovecs_[next].iov_base, iovecs_[next].iov_len, MSG_DONTWAIT, to, sizeof(addrs_[0]));
+        syscalls_++;
+        if (n >= 0) {
+            sent_[targets_[next]] = 1;
+            accepted++;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+    }
+#endif
+    datagrams_sent_ += accepted;
+    return accepted;
+}
+
+void SwarmBroadcaster::send_async(Formatter format, DoneCallback on_done, std::chrono::milliseconds timeout) {
+    pending_.push_back({std::move(format), std::move(on_done), timeout});
+    start_next();
+}
+
+void SwarmBroadcaster::start_next() {
+    if (in_flight_ || pending_.empty()) {
+        return;
+    }
+    in_flight_ = true;
+    submit(pending_.front().format);
+    replies_.assign(addrs_.size(), std::nullopt);
+    expecting_ = sent_;
+    awaiting_ = std::count(expecting_.begin(), expecting_.end(), 1);
+    if (awaiting_ == 0) {
+        complete();
+        return;
+    }
+    uv_timer_start(timeout_timer_.get(), [](uv_timer_t* timer) {
+        static_cast<SwarmBroadcaster*>(timer->data)->complete();
+    }, pending_.front().timeout.count(), 0);
+}
+
+void SwarmBroadcaster::complete() {
+    uv_timer_stop(timeout_timer_.get());
+    PendingBroadcast done = std::move(pending_.front());
+    pending_.pop_front();
+    in_flight_ = false;
+    std::vector<std::optional<std::string>> replies = std::move(replies_);
+
+    start_next();
+    done.on_done(std::move(replies));
+}
+
+void SwarmBroadcaster::on_datagram(const struct sockaddr_in& from, std::string_view data) {
+    auto it = drone_by_address_.find(address_key(from));
+    if (!in_flight_ || it == drone_by_address_.end()) {
+        return;
+    }
+    size_t drone = it->second;
+    if (drone >= expecting_.size() || !expecting_[drone]) {
+        return; // Not addressed in this broadcast, or a duplicate
+    }
+    expecting_[drone] = 0;
+    replies_[drone] = std::string(data);
+    if (--awaiting_ == 0) {
+        complete();
+    }
+}
@@ -0,0 +1,141 @@
+#include "telemetry.hpp"
+#include "probes.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+bool parse_number(std::string_view text, T& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc();
+}
+
+template <typename T>
+void put_le(std::string& out, T value) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        // Store least significant byte first regardless of host order
+        out.push_back(static_cast<char>(bytes[__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? i : sizeof(T) - 1 - i]));
+    }
+}
+
+} // namespace
+
+bool parse_tello_state(std::string_view text, TelloState& state) {
+    bool found = false;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(';', pos);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        std::string_view field = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t colon = field.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = field.substr(0, colon);
+        std::string_view value = field.substr(colon + 1);
+
+        bool ok = true;
+        if (key == "pitch") ok = parse_number(value, state.pitch);
+        else if (key == "roll") ok = parse_number(value, state.roll);
+        else if (key == "yaw") ok = parse_number(value, state.yaw);
+        else if (key == "vgx") ok = parse_number(value, state.vgx);
+        else if (key == "vgy") ok = parse_number(value, state.vgy);
+        else if (key == "vgz") ok = parse_number(value, state.vgz);
+        else if (key == "templ") ok = parse_number(value, state.templ);
+        else if (key == "temph") ok = parse_number(value, state.temph);
+        else if (key == "tof") ok = parse_number(value, state.tof);
+        else if (key == "h") ok = parse_number(value, state.h);
+        else if (key == "bat") ok = parse_number(value, state.bat);
+        else if (key == "baro") ok = parse_number(value, state.baro);
+        else if (key == "time") ok = parse_number(value, state.time);
+        else if (key == "agx") ok = parse_number(value, state.agx);
+        else if (key == "agy") ok = parse_number(value, state.agy);
+        else if (key == "agz") ok = parse_number(value, state.agz);
+        else continue; // Mission pad fields (mid, x, y, z, mpry) are not used
+
+        found = found || ok;
+    }
+    return found;
+}
+
+void encode_telemetry_frame(std::string_view drone_id, const TelloState& state, std::string& out) {
+    out.clear();
+    out.push_back(1);
+    out.push_back(static_cast<char>(std::min<size_t>(drone_id.size(), 255)));
+    out.append(drone_id.data(), std::min<size_t>(drone_id.size(), 255));
+    put_le<uint64_t>(out, state.received_us);
+    for (int value : {state.pitch, state.roll, state.yaw, state.vgx, state.vgy, state.vgz, state.templ,
+                      state.temph, state.tof, state.h, state.bat}) {
+        put_le<int16_t>(out, static_cast<int16_t>(value));
+    }
+    put_le<uint32_t>(out, static_cast<uint32_t>(state.time));
+    for (float value : {state.baro, state.agx, state.agy, state.agz}) {
+        put_le<float>(out, value);
+    }
+}
+
+TelemetryListener::TelemetryListener(uv_loop_t& loop, StateCallback callback, int port)
+    : TelemetryListener(loop, std::move(callback), UdpBinding{"0.0.0.0", port, "", false}) {}
+
+TelemetryListener::TelemetryListener(uv_loop_t& loop, StateCallback callback, const UdpBinding& binding)
+    : callback_(std::move(callback)) {
+    udp_socket_ = std::unique_ptr<uv_udp_t, UdpDeleter>(new uv_udp_t);
+    bind_udp(loop, udp_socket_.get(), binding, "telemetry socket");
+    udp_socket_->data = this;
+    std::cout << "Telemetry socket bound to " << describe_binding(binding) << std::endl;
+
+    uv_udp_recv_start(udp_socket_.get(),
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            // State packets are small and handled synchronously, so one buffer is enough
+            auto* listener = static_cast<TelemetryListener*>(handle->data);
+            buf->base = listener->recv_buffer_;
+            buf->len = sizeof(listener->recv_buffer_);
+        },
+        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned) {
+            auto* listener = static_cast<TelemetryListener*>(handle->data);
+            if (nread < 0) {
+                std::cerr << "Telemetry receive error: " << uv_strerror(nread) << std::endl;
+                return;
+            }
+            if (nread > 0 && addr) {
+                listener->on_datagram(std::string_view(buf->base, nread), addr);
+            }
+        });
+}
+
+void TelemetryListener::receive_with(BusyPoller& poller) {
+    poller.add(udp_socket_.get(), [this](std::string_view data, const struct sockaddr* from) {
+        on_datagram(data, from);
+    });
+}
+
+void TelemetryListener::on_datagram(std::string_view data, const struct sockaddr* from) {
+    char ip[INET_ADDRSTRLEN];
+    uv_ip4_name(reinterpret_cast<const struct sockaddr_in*>(from), ip, sizeof(ip));
+    if (datagram_callback_) {
+        datagram_callback_(ip, data);
+        return;
+    }
+
+    TelloState state;
+    TELLO_PROBE1(telemetry_parse_start, data.size());
+    bool parsed = parse_tello_state(data, state);
+    TELLO_PROBE1(telemetry_parse_done, parsed);
+    if (!parsed) {
+        return;
+    }
+    state.received_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    callback_(ip, state);
+}
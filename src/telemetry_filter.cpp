@@ -0,0 +1,405 @@
+#include "telemetry_filter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kFieldCount = static_cast<size_t>(TelemetryField::COUNT);
+constexpr size_t kMaxDepth = 64;
+
+const char* const kFieldNames[kFieldCount] = {"pitch", "roll", "yaw", "vgx", "vgy", "vgz", "templ", "temph",
+                                              "tof", "h", "bat", "baro", "time", "agx", "agy", "agz"};
+
+} // namespace
+
+const char* telemetry_field_name(TelemetryField field) {
+    size_t index = static_cast<size_t>(field);
+    return index < kFieldCount ? kFieldNames[index] : "?";
+}
+
+void TelemetryBatch::add(uint32_t source, const TelloState& state) {
+    const float values[kFieldCount] = {
+        static_cast<float>(state.pitch), static_cast<float>(state.roll), static_cast<float>(state.yaw),
+        static_cast<float>(state.vgx), static_cast<float>(state.vgy), static_cast<float>(state.vgz),
+        static_cast<float>(state.templ), static_cast<float>(state.temph), static_cast<float>(state.tof),
+        static_cast<float>(state.h), static_cast<float>(state.bat), state.baro, static_cast<float>(state.time),
+        state.agx, state.agy, state.agz};
+    for (size_t field = 0; field < kFieldCount; ++field) {
+        columns_[field].push_back(values[field]);
+    }
+    sources_.push_back(source);
+}
+
+void TelemetryBatch::clear() {
+    for (auto& column : columns_) {
+        column.clear();
+    }
+    sources_.clear();
+}
+
+// Recursive descent straight to postfix; the stack depth is tracked as instructions are emitted
+class TelemetryFilters::Parser {
+public:
+    Parser(TelemetryFilters& filters, std::string_view text, Subscription& out)
+        : filters_(filters), text_(text), out_(out) {}
+
+    void parse() {
+        parse_or();
+        skip_space();
+        if (pos_ != text_.size()) {
+            fail("expected \"and\", \"or\" or the end");
+        }
+    }
+
+private:
+    void parse_or() {
+        parse_and();
+        while (accept_word("or") || accept("||")) {
+            parse_and();
+            emit(Instruction::OR);
+        }
+    }
+
+    void parse_and() {
+        parse_not();
+        while (accept_word("and") || accept("&&")) {
+            parse_not();
+            emit(Instruction::AND);
+        }
+    }
+
+    void parse_not() {
+        if (accept_word("not") || accept("!")) {
+            nest();
+            parse_not();
+            nesting_--;
+            emit(Instruction::NOT);
+            return;
+        }
+        parse_atom();
+    }
+
+    void parse_atom() {
+        if (accept("(")) {
+            nest();
+            parse_or();
+            nesting_--;
+            if (!accept(")")) {
+                fail("expected \")\"");
+            }
+            return;
+        }
+        skip_space();
+        size_t start = pos_;
+        while (pos_ < text_.size() && std::isalpha(static_cast<unsigned char>(text_[pos_]))) {
+            pos_++;
+        }
+        std::string_view name = text_.substr(start, pos_ - start);
+        auto field = std::find(std::begin(kFieldNames), std::end(kFieldNames), name);
+        if (name.empty() || field == std::end(kFieldNames)) {
+            pos_ = start;
+            fail("expected a state field such as bat or h");
+        }
+
+        CompareOp op;
+        if (accept("<=")) {
+            op = CompareOp::LE;
+        } else if (accept(">=")) {
+            op = CompareOp::GE;
+        } else if (accept("==")) {
+            op = CompareOp::EQ;
+        } else if (accept("!=")) {
+            op = CompareOp::NE;
+        } else if (accept("<")) {
+            op = CompareOp::LT;
+        } else if (accept(">")) {
+            op = CompareOp::GT;
+        } else {
+            fail("expected a comparison");
+        }
+
+        skip_space();
+        std::string number(text_.substr(pos_, std::min<size_t>(32, text_.size() - pos_)));
+        char* end = nullptr;
+        float constant = std::strtof(number.c_str(), &end);
+        if (end == number.c_str() || !std::isfinite(constant)) {
+            fail("expected a number");
+        }
+        pos_ += end - number.c_str();
+
+        out_.fields |= 1u << (field - std::begin(kFieldNames));
+        out_.program.push_back({Instruction::CMP, filters_.intern(
+            static_cast<TelemetryField>(field - std::begin(kFieldNames)), op, constant)});
+        depth_++;
+        out_.depth = std::max(out_.depth, depth_);
+        if (out_.depth > kMaxDepth) {
+            fail("predicate nests too deep");
+        }
+    }
+
+    // Parentheses and negations recurse; a client's predicate must not run the parser off the stack
+    void nest() {
+        if (++nesting_ > kMaxDepth) {
+            fail("predicate nests too deep");
+        }
+    }
+
+    void emit(Instruction::Kind kind) {
+        out_.program.push_back({kind, 0});
+        if (kind != Instruction::NOT) {
+            depth_--;
+        }
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            pos_++;
+        }
+    }
+
+    bool accept(std::string_view token) {
+        skip_space();
+        if (text_.substr(pos_, token.size()) != token) {
+            return false;
+        }
+        // "!" is not the start of "!="
+        if (token == "!" && text_.substr(pos_, 2) == "!=") {
+            return false;
+        }
+        pos_ += token.size();
+        return true;
+    }
+
+    bool accept_word(std::string_view word) {
+        skip_space();
+        size_t end = pos_ + word.size();
+        if (text_.substr(pos_, word.size()) != word ||
+            (end < text_.size() && std::isalnum(static_cast<unsigned char>(text_[end])))) {
+            return false;
+        }
+        pos_ = end;
+        return true;
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("Bad predicate at column " + std::to_string(pos_ + 1) + ": " + what);
+    }
+
+    TelemetryFilters& filters_;
+    std::string_view text_;
+    Subscription& out_;
+    size_t pos_ = 0;
+    size_t depth_ = 0;
+    size_t nesting_ = 0; // Open parentheses and negations
+};
+
+uint64_t TelemetryFilters::add(std::string_view predicate, uint32_t source) {
+    Subscription subscription;
+    subscription.source = source;
+    try {
+        Parser(*this, predicate, subscription).parse();
+    } catch (...) {
+        release(subscription);
+        throw;
+    }
+    uint64_t id = next_id_++;
+    subscriptions_.emplace(id, std::move(subscription));
+    return id;
+}
+
+bool TelemetryFilters::remove(uint64_t id) {
+    auto it = subscriptions_.find(id);
+    if (it == subscriptions_.end()) {
+        return false;
+    }
+    release(it->second);
+    subscriptions_.erase(it);
+    return true;
+}
+
+uint32_t TelemetryFilters::fields(uint64_t id) const {
+    auto it = subscriptions_.find(id);
+    return it == subscriptions_.end() ? 0 : it->second.fields;
+}
+
+uint32_t TelemetryFilters::intern(TelemetryField field, CompareOp op, float constant) {
+    auto key = std::make_tuple(static_cast<uint8_t>(field), static_cast<uint8_t>(op), constant);
+    auto [it, inserted] = comparison_index_.emplace(key, 0);
+    if (inserted) {
+        if (free_comparisons_.empty()) {
+            it->second = static_cast<uint32_t>(comparisons_.size());
+            comparisons_.push_back({field, op, constant});
+        } else {
+            it->second = free_comparisons_.back();
+            free_comparisons_.pop_back();
+            comparisons_[it->second] = {field, op, constant};
+        }
+    }
+    comparisons_[it->second].refs++;
+    return it->second;
+}
+
+void TelemetryFilters::release(const Subscription& subscription) {
+    for (const auto& instruction : subscription.program) {
+        if (instruction.kind != Instruction::CMP) {
+            continue;
+        }
+        Comparison& comparison = comparisons_[instruction.comparison];
+        if (--comparison.refs == 0) {
+            comparison_index_.erase(std::make_tuple(static_cast<uint8_t>(comparison.field),
+                                                    static_cast<uint8_t>(comparison.op), comparison.constant));
+            free_comparisons_.push_back(instruction.comparison);
+        }
+    }
+}
+
+// One tight loop per operator, so the compiler can vectorize each
+static void compare(const float* column, uint8_t op, float constant, uint8_t* out, size_t rows) {
+    switch (op) {
+        case 0: for (size_t i = 0; i < rows; ++i) out[i] = column[i] < constant; break;
+        case 1: for (size_t i = 0; i < rows; ++i) out[i] = column[i] <= constant; break;
+        case 2: for (size_t i = 0; i < rows; ++i) out[i] = column[i] > constant; break;
+        case 3: for (size_t i = 0; i < rows; ++i) out[i] = column[i] >= constant; break;
+        case 4: for (size_t i = 0; i < rows; ++i) out[i] = column[i] == constant; break;
+        default: for (size_t i = 0; i < rows; ++i) out[i] = column[i] != constant; break;
+    }
+}
+
+void TelemetryFilters::evaluate(const TelemetryBatch& batch, std::vector<FilterMatch>& out) {
+    size_t rows = batch.size();
+    if (rows == 0 || subscriptions_.empty()) {
+        return;
+    }
+
+    // Each comparison in use, once for every subscription sharing it
+    masks_.resize(comparisons_.size() * rows);
+    for (size_t index = 0; index < comparisons_.size(); ++index) {
+        const Comparison& comparison = comparisons_[index];
+        if (comparison.refs > 0) {
+            compare(batch.column(comparison.field), static_cast<uint8_t>(comparison.op), comparison.constant,
+                    &masks_[index * rows], rows);
+        }
+    }
+
+    // Rows grouped by source, for subscriptions to one drone
+    uint32_t sources = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        sources = std::max(sources, batch.source(row) + 1);
+    }
+    source_start_.assign(sources + 1, 0);
+    for (size_t row = 0; row < rows; ++row) {
+        source_start_[batch.source(row) + 1]++;
+    }
+    for (uint32_t source = 0; source < sources; ++source) {
+        source_start_[source + 1] += source_start_[source];
+    }
+    source_cursor_ = source_start_;
+    source_rows_.resize(rows);
+    for (size_t row = 0; row < rows; ++row) {
+        source_rows_[source_cursor_[batch.source(row)]++] = static_cast<uint32_t>(row);
+    }
+
+    for (auto& [id, subscription] : subscriptions_) {
+        if (subscription.source == kAnySource) {
+            const uint8_t* match = run_vector(subscription, rows);
+            if (subscription.matching.size() < sources) {
+                subscription.matching.resize(sources, 0);
+            }
+            uint8_t* matching = subscription.matching.data();
+            for (size_t row = 0; row < rows; ++row) {
+                uint8_t& was = matching[batch.source(row)];
+                if (match[row] & ~was) {
+                    out.push_back({id, row});
+                }
+                was = match[row];
+            }
+        } else if (subscription.source < sources) {
+            for (uint32_t k = source_start_[subscription.source]; k < source_start_[subscription.source + 1]; ++k) {
+                size_t row = source_rows_[k];
+                settle(subscription, id, subscription.source, row, run_scalar(subscription, row, rows), out);
+            }
+        }
+    }
+}
+
+const uint8_t* TelemetryFilters::run_vector(const Subscription& subscription, size_t rows) {
+    if (subscription.program.size() == 1) {
+        return &masks_[subscription.program[0].comparison * rows]; // A lone comparison is its own mask
+    }
+    stack_.resize(subscription.depth * rows);
+    operands_.resize(subscription.depth);
+    size_t top = 0;
+    for (const auto& instruction : subscription.program) {
+        switch (instruction.kind) {
+            case Instruction::CMP:
+                operands_[top++] = &masks_[instruction.comparison * rows];
+                break;
+            case Instruction::NOT: {
+                const uint8_t* a = operands_[top - 1];
+                uint8_t* result = &stack_[(top - 1) * rows];
+                for (size_t i = 0; i < rows; ++i) {
+                    result[i] = a[i] ^ 1;
+                }
+                operands_[top - 1] = result;
+                break;
+            }
+            case Instruction::AND:
+            case Instruction::OR: {
+                const uint8_t* b = operands_[--top];
+                const uint8_t* a = operands_[top - 1];
+                uint8_t* result = &stack_[(top - 1) * rows];
+                if (instruction.kind == Instruction::AND) {
+                    for (size_t i = 0; i < rows; ++i) {
+                        result[i] = a[i] & b[i];
+                    }
+                } else {
+                    for (size_t i = 0; i < rows; ++i) {
+                        result[i] = a[i] | b[i];
+                    }
+                }
+                operands_[top - 1] = result;
+                break;
+            }
+        }
+    }
+    return operands_[0];
+}
+
+bool TelemetryFilters::run_scalar(const Subscription& subscription, size_t row, size_t rows) const {
+    bool stack[kMaxDepth];
+    size_t top = 0;
+    for (const auto& instruction : subscription.program) {
+        switch (instruction.kind) {
+            case Instruction::CMP:
+                stack[top++] = masks_[instruction.comparison * rows + row] != 0;
+                break;
+            case Instruction::NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            case Instruction::AND:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case Instruction::OR:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+        }
+    }
+    return stack[0];
+}
+
+void TelemetryFilters::settle(Subscription& subscription, uint64_t id, uint32_t source, size_t row, bool match,
+                              std::vector<FilterMatch>& out) {
+    if (source >= subscription.matching.size()) {
+        subscription.matching.resize(source + 1, 0);
+    }
+    uint8_t& was = subscription.matching[source];
+    if (match && !was) {
+        out.push_back({id, row});
+    }
+    was = match;
+}
@@ -0,0 +1,244 @@
+#include "telemetry_table.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x544c4d54; // "TMLT"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kWords = sizeof(TelemetryTable::Snapshot) / sizeof(uint64_t);
+
+static_assert(sizeof(TelemetryTable::Snapshot) % sizeof(uint64_t) == 0, "Snapshot must be whole words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared atomics must be lock-free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The generation is a futex word");
+
+long futex(std::atomic<uint32_t>& word, int op, uint32_t value, const struct timespec* timeout) {
+    // Not FUTEX_PRIVATE_FLAG: waiters and the writer are different processes
+    return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), op, value, timeout, nullptr, 0);
+}
+
+std::string shm_name(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+} // namespace
+
+struct alignas(64) TelemetryTable::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;
+    std::atomic<uint32_t> used;
+    std::atomic<uint32_t> generation; // Futex word
+    std::atomic<uint32_t> waiters; // Readers inside wait(); one that crashed there only costs wakes
+    std::atomic<uint32_t> closed;
+};
+
+// The sample is stored as relaxed atomic words, so a read racing a write is not a data race;
+// the sequence tells the reader whether to keep the copy
+struct alignas(64) TelemetryTable::Slot {
+    std::atomic<uint32_t> sequence; // Odd while the writer is inside
+    std::atomic<uint64_t> words[kWords];
+};
+
+TelemetryTable::TelemetryTable(const std::string& name, size_t slots) : name_(shm_name(name)), writer_(true) {
+    if (slots == 0 || slots > 65536) {
+        throw std::runtime_error("Telemetry table needs 1 to 65536 slots");
+    }
+    // Readers still mapping a table from an earlier run keep it; they see it closed or stale
+    ::shm_unlink(name_.c_str());
+    int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create shared memory " + name_ + ": " + std::strerror(errno));
+    }
+    size_t size = sizeof(Header) + slots * sizeof(Slot);
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        int err = errno;
+        ::close(fd);
+        ::shm_unlink(name_.c_str());
+        throw std::runtime_error("Failed to size shared memory " + name_ + ": " + std::strerror(err));
+    }
+    map(fd, size); // Zero-filled by ftruncate
+    header_->slots = static_cast<uint32_t>(slots);
+    header_->slot_size = sizeof(Slot);
+    header_->version = kVersion;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = kMagic;
+}
+
+TelemetryTable::TelemetryTable(const std::string& name) : name_(shm_name(name)), writer_(false) {
+    int fd = ::shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open shared memory " + name_ + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to stat shared memory " + name_ + ": " + std::strerror(err));
+    }
+    if (static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        throw std::runtime_error(name_ + " is not a telemetry table");
+    }
+    map(fd, static_cast<size_t>(st.st_size));
+    if (header_->magic != kMagic || header_->version != kVersion || header_->slot_size != sizeof(Slot) ||
+        size_ < sizeof(Header) + header_->slots * sizeof(Slot)) {
+        ::munmap(data_, size_);
+        throw std::runtime_error(name_ + " is not a telemetry table of this version");
+    }
+}
+
+void TelemetryTable::map(int fd, size_t size) {
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    if (data == MAP_FAILED) {
+        if (writer_) {
+            ::shm_unlink(name_.c_str());
+        }
+        throw std::runtime_error("Failed to map shared memory " + name_ + ": " + std::strerror(err));
+    }
+    data_ = data;
+    size_ = size;
+    header_ = static_cast<Header*>(data);
+}
+
+TelemetryTable::~TelemetryTable() {
+    if (writer_) {
+        header_->closed.store(1);
+        header_->generation.fetch_add(1);
+        futex(header_->generation, FUTEX_WAKE, INT_MAX, nullptr);
+        ::shm_unlink(name_.c_str());
+    }
+    ::munmap(data_, size_);
+}
+
+TelemetryTable::Slot& TelemetryTable::slot_at(size_t index) const {
+    static_assert(sizeof(Slot) == 128, "Two cache lines per drone");
+    return reinterpret_cast<Slot*>(static_cast<char*>(data_) + sizeof(Header))[index];
+}
+
+int TelemetryTable::claim(std::string_view id) {
+    if (int slot = find(id); slot >= 0) {
+        return slot;
+    }
+    uint32_t used = header_->used.load(std::memory_order_relaxed);
+    if (used >= header_->slots) {
+        return -1;
+    }
+    // Written before `used` covers the slot, so readers never see it without its id
+    Snapshot snapshot{};
+    std::memcpy(snapshot.id, id.data(), std::min(id.size(), kMaxId));
+    uint64_t words[kWords];
+    std::memcpy(words, &snapshot, sizeof(snapshot));
+    Slot& slot = slot_at(used);
+    for (size_t i = 0; i < kWords; ++i) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    header_->used.store(used + 1, std::memory_order_release);
+    return static_cast<int>(used);
+}
+
+void TelemetryTable::write(int index, const TelloState& state) {
+    if (index < 0 || static_cast<size_t>(index) >= used()) {
+        return;
+    }
+    Slot& slot = slot_at(index);
+    // The id words are left alone; only the writer changes a slot, so they need no copy-in
+    constexpr size_t first = offsetof(Snapshot, state) / sizeof(uint64_t);
+    uint64_t words[kWords - first];
+    std::memcpy(words, &state, sizeof(state));
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = first; i < kWords; ++i) {
+        slot.words[i].store(words[i - first], std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+
+    // Sequentially consistent against the reader's waiters increment, so a reader either sees the
+    // new generation before sleeping or is counted here and woken
+    header_->generation.fetch_add(1);
+    if (header_->waiters.load() > 0) {
+        futex(header_->generation, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+int TelemetryTable::find(std::string_view id) const {
+    size_t count = used();
+    for (size_t index = 0; index < count; ++index) {
+        Snapshot snapshot;
+        if (read(index, snapshot) && id == snapshot.id) {
+            return static_cast<int>(index);
+        }
+    }
+    return -1;
+}
+
+bool TelemetryTable::read(size_t index, Snapshot& out) const {
+    if (index >= used()) {
+        return false;
+    }
+    const Slot& slot = slot_at(index);
+    uint64_t words[kWords];
+    for (;;) {
+        uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+        for (size_t i = 0; i < kWords; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+    std::memcpy(&out, words, sizeof(out));
+    out.id[kMaxId] = '\0';
+    return true;
+}
+
+size_t TelemetryTable::slots() const {
+    return header_->slots;
+}
+
+size_t TelemetryTable::used() const {
+    return std::min<size_t>(header_->used.load(std::memory_order_acquire), header_->slots);
+}
+
+uint32_t TelemetryTable::generation() const {
+    return header_->generation.load(std::memory_order_acquire);
+}
+
+uint32_t TelemetryTable::wait(uint32_t seen, int timeout_ms) const {
+    uint32_t current = generation();
+    if (current != seen || closed()) {
+        return current;
+    }
+    struct timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    header_->waiters.fetch_add(1);
+    // Returns at once if the generation already moved on since `seen`
+    futex(header_->generation, FUTEX_WAIT, seen, timeout_ms < 0 ? nullptr : &timeout);
+    header_->waiters.fetch_sub(1);
+    return generation();
+}
+
+bool TelemetryTable::closed() const {
+    return header_->closed.load(std::memory_order_acquire) != 0;
+}
@@ -1,85 +1,346 @@
 #include "tello.hpp"
+#include "probes.hpp"
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
 #include <iostream>
-#include <thread>
 
-Tello::Tello(std::string ip, int port, uv_loop_t& loop)
+namespace {
+
+// Answers do not change when asked twice, so a query may be sent again while one is outstanding
+bool is_idempotent_query(std::string_view cmd) {
+    return !cmd.empty() && cmd.back() == '?';
+}
+
+bool is_critical(std::string_view cmd) {
+    return cmd == "land" || cmd == "emergency";
+}
+
+} // namespace
+
+template <typename Policy>
+BasicTello<Policy>::BasicTello(std::string ip, int port, uv_loop_t& loop, int bind_port)
+    : BasicTello(std::move(ip), port, loop, UdpBinding{"0.0.0.0", bind_port, "", false}) {}
+
+template <typename Policy>
+BasicTello<Policy>::BasicTello(std::string ip, int port, uv_loop_t& loop, const UdpBinding& binding)
     : ip_(std::move(ip)), port_(port), loop_(loop) {
+    if (int result = uv_ip4_addr(ip_.c_str(), port_, &tello_addr_); result != 0) {
+        throw std::runtime_error("Invalid Tello address " + ip_ + ": " + std::string(uv_strerror(result)));
+    }
+
     udp_socket_ = std::unique_ptr<uv_udp_t, UdpDeleter>(new uv_udp_t);
-    uv_udp_init(&loop_, udp_socket_.get());
+    bind_udp(loop_, udp_socket_.get(), binding, "command socket for " + ip_);
     udp_socket_->data = this;
-
-    struct sockaddr_in bind_addr;
-    uv_ip4_addr("0.0.0.0", 8889, &bind_addr);
-    int result = uv_udp_bind(udp_socket_.get(), reinterpret_cast<const struct sockaddr*>(&bind_addr), 0);
-    if (result != 0) {
-        throw std::runtime_error("Failed to bind UDP socket to port 8889: " + std::string(uv_strerror(result)));
+    if (int result = uv_udp_connect(udp_socket_.get(), reinterpret_cast<const struct sockaddr*>(&tello_addr_));
+        result != 0) {
+        throw std::runtime_error("Failed to connect UDP socket to " + ip_ + ": " + std::string(uv_strerror(result)));
     }
-    std::cout << "UDP socket bound to port 8889" << std::endl;
+
+    timeout_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+    uv_timer_init(&loop_, timeout_timer_.get());
+    timeout_timer_->data = this;
+
+    redundancy_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+    uv_timer_init(&loop_, redundancy_timer_.get());
+    redundancy_timer_->data = this;
+
+    struct sockaddr_in bound;
+    int namelen = sizeof(bound);
+    uv_udp_getsockname(udp_socket_.get(), reinterpret_cast<struct sockaddr*>(&bound), &namelen);
+    char source[INET_ADDRSTRLEN];
+    uv_ip4_name(&bound, source, sizeof(source));
+    log_info<Policy>("UDP socket for ", ip_, " bound to ", source, ":", ntohs(bound.sin_port),
+                     binding.device.empty() ? "" : " on ", binding.device);
 
     uv_udp_recv_start(udp_socket_.get(),
-        [](uv_handle_t* handle, size_t suggested_size, uv_buf_t* buf) {
-            buf->base = static_cast<char*>(malloc(suggested_size));
-            buf->len = suggested_size;
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            // Replies are consumed synchronously in the read callback, so one buffer is enough
+            auto* tello = static_cast<BasicTello*>(handle->data);
+            buf->base = tello->recv_buffer_;
+            buf->len = sizeof(tello->recv_buffer_);
         },
-        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned flags) {
-            auto* tello = static_cast<Tello*>(handle->data);
+        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr*, unsigned) {
+            // The socket is connected, so everything that arrives comes from this drone
+            auto* tello = static_cast<BasicTello*>(handle->data);
             if (nread > 0) {
-                // Check source port (should be 8889 for command responses)
-                const struct sockaddr_in* sin = reinterpret_cast<const struct sockaddr_in*>(addr);
-                int src_port = ntohs(sin->sin_port);
-                if (src_port != 8889) {
-                    std::cout << "Ignoring UDP data from port " << src_port << " (expected 8889)" << std::endl;
-                    free(buf->base);
-                    return;
-                }
-
-                tello->last_response_ = std::string(buf->base, nread);
-                tello->response_received_ = true;
-                std::cout << "Received UDP data: " << tello->last_response_ << std::endl;
+                tello->on_datagram(std::string_view(buf->base, nread));
             } else if (nread < 0) {
-                std::cerr << "UDP receive error: " << uv_strerror(nread) << std::endl;
+                std::cerr << "UDP receive error from " << tello->ip_ << ": " << uv_strerror(nread) << std::endl;
             }
-            free(buf->base);
         });
 }
 
-std::optional<std::string> Tello::connect() {
+template <typename Policy>
+void BasicTello<Policy>::receive_with(BusyPoller& poller) {
+    poller.add(udp_socket_.get(), [this](std::string_view data, const struct sockaddr*) { on_datagram(data); });
+}
+
+template <typename Policy>
+std::optional<std::string> BasicTello<Policy>::connect() {
     return send_command("command");
 }
 
-std::optional<std::string> Tello::send_command(std::string_view cmd) {
+template <typename Policy>
+std::optional<std::string> BasicTello<Policy>::send_command(std::string_view cmd) {
+    std::optional<std::string> result;
+    bool done = false;
+    send_command_async(cmd, [&result, &done](std::optional<std::string> response) {
+        result = std::move(response);
+        done = true;
+    });
+    while (!done) {
+        uv_run(&loop_, UV_RUN_ONCE);
+    }
+    return result;
+}
+
+template <typename Policy>
+void BasicTello<Policy>::send_command_async(std::string_view cmd, ResponseCallback on_response, std::chrono::milliseconds timeout) {
     if (!udp_socket_) {
         std::cerr << "UDP socket not initialized" << std::endl;
-        return std::nullopt;
+        on_response(std::nullopt);
+        return;
+    }
+
+    if (cmd.substr(0, 3) == "rc ") {
+        // rc setpoints get no reply from the drone; report them as done once sent
+        bool sent = send_datagram(cmd);
+        on_response(sent ? std::optional<std::string>("ok") : std::nullopt);
+        return;
+    }
+
+    if (cmd == "emergency") {
+        // Stop the motors right away; anything queued behind it is moot
+        std::deque<PendingCommand> dropped;
+        dropped.swap(pending_);
+        int preempted_copies = in_flight_ ? dropped.front().copies_sent : 0;
+        in_flight_ = false;
+        uv_timer_stop(timeout_timer_.get());
+        uv_timer_stop(redundancy_timer_.get());
+        if (preempted_copies > 0 || stray_replies_ > 0) {
+            // Replies are matched by position, and some are still due: to earlier copies, to the
+            // preempted command, and to this copy. All are absorbed before emergency is sent again
+            // and awaited, so none is taken for its reply.
+            stray_replies_ += preempted_copies + (send_datagram(cmd) ? 1 : 0);
+            absorb_until_ms_ = std::max(absorb_until_ms_, uv_now(&loop_) + hedge_delay_ms());
+        }
+        pending_.push_back({std::string(cmd), std::move(on_response), timeout});
+        start_next_command();
+        for (auto& command : dropped) {
+            command.on_response(std::nullopt);
+        }
+        return;
     }
 
-    uv_buf_t buf = uv_buf_init(const_cast<char*>(cmd.data()), cmd.size());
-    auto req = std::make_unique<uv_udp_send_t>();
-    struct sockaddr_in tello_addr;
-    uv_ip4_addr(ip_.c_str(), port_, &tello_addr);
+    pending_.push_back({std::string(cmd), std::move(on_response), timeout});
+    start_next_command();
+}
+
+template <typename Policy>
+size_t BasicTello<Policy>::cancel_queued() {
+    std::deque<PendingCommand> dropped;
+    auto first = pending_.begin() + (in_flight_ ? 1 : 0);
+    auto kept = std::stable_partition(first, pending_.end(), [](const PendingCommand& command) {
+        return is_critical(command.cmd);
+    });
+    std::move(kept, pending_.end(), std::back_inserter(dropped));
+    pending_.erase(kept, pending_.end());
+    for (auto& command : dropped) {
+        command.on_response(std::nullopt);
+    }
+    return dropped.size();
+}
+
+template <typename Policy>
+bool BasicTello<Policy>::send_datagram(std::string_view data) {
+    if constexpr (Policy::kTracing) {
+        TELLO_PROBE3(udp_send, ip_.c_str(), data.data(), data.size());
+    }
+    if (traffic_marking_) {
+        TrafficClass traffic_class = is_critical(data) ? TrafficClass::EMERGENCY : TrafficClass::CONTROL;
+        if (marked_as_ != traffic_class) {
+            mark_socket(reinterpret_cast<uv_handle_t*>(udp_socket_.get()), traffic_class);
+            marked_as_ = traffic_class;
+        }
+    }
+    uv_buf_t buf = uv_buf_init(const_cast<char*>(data.data()), data.size());
+    int result = uv_udp_try_send(udp_socket_.get(), &buf, 1, nullptr);
+    if (result >= 0) {
+        return true;
+    }
+    if (result != UV_EAGAIN) {
+        std::cerr << "Failed to send command: " << uv_strerror(result) << std::endl;
+        return false;
+    }
 
-    int result = uv_udp_send(req.get(), udp_socket_.get(), &buf, 1,
-                             reinterpret_cast<const struct sockaddr*>(&tello_addr),
-                             [](uv_udp_send_t* req, int status) {
-                                 if (status) {
-                                     std::cerr << "UDP send failed: " << uv_strerror(status) << std::endl;
-                                 }
-                             });
+    // Socket buffer full: fall back to a queued send that owns a copy of the payload
+    struct SendRequest {
+        uv_udp_send_t req;
+        std::string data;
+    };
+    auto* request = new SendRequest{{}, std::string(data)};
+    request->req.data = request;
+    buf = uv_buf_init(request->data.data(), request->data.size());
+    result = uv_udp_send(&request->req, udp_socket_.get(), &buf, 1, nullptr, [](uv_udp_send_t* req, int status) {
+        if (status) {
+            std::cerr << "UDP send failed: " << uv_strerror(status) << std::endl;
+        }
+        delete static_cast<SendRequest*>(req->data);
+    });
     if (result != 0) {
         std::cerr << "Failed to send command: " << uv_strerror(result) << std::endl;
-        return std::nullopt;
+        delete request;
+        return false;
     }
+    return true;
+}
 
-    response_received_ = false;
-    for (int i = 0; i < 10 && !response_received_; ++i) {
-        uv_run(&loop_, UV_RUN_ONCE);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+template <typename Policy>
+void BasicTello<Policy>::start_next_command() {
+    while (!in_flight_ && !pending_.empty()) {
+        if (stray_replies_ > 0) {
+            // Replies to the last command's extra copies may still be on their way
+            uint64_t now = uv_now(&loop_);
+            if (now < absorb_until_ms_) {
+                uv_timer_start(redundancy_timer_.get(), [](uv_timer_t* timer) {
+                    auto* tello = static_cast<BasicTello*>(timer->data);
+                    tello->stray_replies_ = 0;
+                    tello->start_next_command();
+                }, absorb_until_ms_ - now, 0);
+                return;
+            }
+            stray_replies_ = 0;
+        }
+
+        PendingCommand& command = pending_.front();
+        if (!send_datagram(command.cmd)) {
+            PendingCommand failed = std::move(command);
+            pending_.pop_front();
+            failed.on_response(std::nullopt);
+            continue;
+        }
+
+        in_flight_ = true;
+        command.copies_sent = 1;
+        if (timed()) {
+            command.sent_ns = command.last_copy_ns = uv_hrtime();
+        }
+        if (is_critical(command.cmd) && redundancy_.critical_copies > 1) {
+            command.copies_left = redundancy_.critical_copies - 1;
+            uint64_t spacing = std::max<int64_t>(1, redundancy_.critical_spacing.count());
+            uv_timer_start(redundancy_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTello*>(timer->data)->send_extra_copy();
+            }, spacing, spacing);
+        } else if (redundancy_.hedge_queries && is_idempotent_query(command.cmd)) {
+            command.copies_left = 1;
+            uv_timer_start(redundancy_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTello*>(timer->data)->send_extra_copy();
+            }, hedge_delay_ms(), 0);
+        }
+        uv_timer_start(timeout_timer_.get(), [](uv_timer_t* timer) {
+            auto* tello = static_cast<BasicTello*>(timer->data);
+            const std::string& cmd = tello->pending_.front().cmd;
+            if constexpr (Policy::kTracing) {
+                TELLO_PROBE3(command_timeout, tello->ip_.c_str(), cmd.data(), cmd.size());
+            }
+            std::cerr << "No response received for command: " << cmd << std::endl;
+            if (tello->link_observer_) {
+                tello->link_observer_(cmd, std::nullopt);
+            }
+            tello->complete_command(std::nullopt);
+        }, command.timeout.count(), 0);
+    }
+}
+
+template <typename Policy>
+void BasicTello<Policy>::send_extra_copy() {
+    PendingCommand& command = pending_.front();
+    if (send_datagram(command.cmd)) {
+        command.copies_sent++;
+        command.last_copy_ns = timed() ? uv_hrtime() : 0;
+        extra_copies_sent_++;
+    }
+    if (--command.copies_left <= 0) {
+        uv_timer_stop(redundancy_timer_.get());
     }
+}
+
+template <typename Policy>
+void BasicTello<Policy>::complete_command(std::optional<std::string> response) {
+    uv_timer_stop(timeout_timer_.get());
+    uv_timer_stop(redundancy_timer_.get());
+    PendingCommand done = std::move(pending_.front());
+    pending_.pop_front();
+    in_flight_ = false;
 
-    if (!response_received_) {
-        std::cerr << "No response received for command: " << cmd << std::endl;
-        return std::nullopt;
+    // Each other copy may still be answered; give the answers one hedge delay to arrive
+    if (response && done.copies_sent > 1) {
+        stray_replies_ = done.copies_sent - 1;
+        absorb_until_ms_ = uv_now(&loop_) + hedge_delay_ms();
     }
-    return last_response_;
-}
\ No newline at end of file
+
+    // Put the next command on the wire before running the callback
+    start_next_command();
+    done.on_response(std::move(response));
+}
+
+template <typename Policy>
+void BasicTello<Policy>::on_datagram(std::string_view data) {
+    if constexpr (Policy::kTracing) {
+        TELLO_PROBE3(udp_receive, ip_.c_str(), data.data(), data.size());
+    }
+    log_info<Policy>("Received UDP data: ", data);
+    if (!in_flight_) {
+        if (stray_replies_ > 0) {
+            duplicates_absorbed_++;
+            if (--stray_replies_ == 0) {
+                uv_timer_stop(redundancy_timer_.get());
+                start_next_command();
+            }
+            return;
+        }
+        log_info<Policy>("Ignoring unsolicited response: ", data);
+        return;
+    }
+    if (timed()) {
+        const PendingCommand& command = pending_.front();
+        uint64_t now = uv_hrtime();
+        if constexpr (Policy::kMetrics) {
+            rtt_us_.record((now - command.sent_ns) / 1000);
+        }
+        // Timed from the latest copy: timing a hedged reply from the first copy would feed the
+        // hedge delay back into its own estimate and drive it up to the timeout
+        uint64_t rtt_us = (now - command.last_copy_ns) / 1000;
+        if (redundancy_.hedge_queries) {
+            record_round_trip(rtt_us);
+        }
+        if (link_observer_) {
+            link_observer_(command.cmd, rtt_us);
+        }
+    }
+    complete_command(std::string(data));
+}
+
+template <typename Policy>
+void BasicTello<Policy>::record_round_trip(uint64_t rtt_us) {
+    recent_rtt_us_[round_trips_ % recent_rtt_us_.size()] = static_cast<uint32_t>(std::min<uint64_t>(rtt_us, UINT32_MAX));
+    if (++round_trips_ % 16 == 0) {
+        std::array<uint32_t, 64> sorted = recent_rtt_us_;
+        size_t count = std::min<uint64_t>(round_trips_, sorted.size());
+        size_t p95 = count * 95 / 100;
+        std::nth_element(sorted.begin(), sorted.begin() + p95, sorted.begin() + count);
+        hedge_delay_us_ = sorted[p95];
+    }
+}
+
+template <typename Policy>
+uint64_t BasicTello<Policy>::hedge_delay_ms() const {
+    if (hedge_delay_us_ == 0) {
+        return redundancy_.initial_hedge_delay.count();
+    }
+    return std::max<uint64_t>(redundancy_.min_hedge_delay.count(), (hedge_delay_us_ + 999) / 1000);
+}
+
+template class BasicTello<FullInstrumentation>;
+template class BasicTello<LeanInstrumentation>;
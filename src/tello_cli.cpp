@@ -0,0 +1,457 @@
+#include "histogram.hpp"
+#include "mission.hpp"
+#include "telemetry_table.hpp"
+#include "tello.hpp"
+#include "websocket.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Bench-testing client: an interactive REPL with tab completion, or a batch runner for scripts.
+// Talks to a drone directly through the async Tello client, or through the tello_controller gateway.
+// With --shm it instead prints the telemetry table a local tello_controller keeps in shared memory.
+
+struct CliConfig {
+    std::string drone_ip = "192.168.10.1";
+    UdpBinding bind{"0.0.0.0", 8889, "", false}; // Local end of the direct UDP link
+    std::string gateway_host; // Set to go through the WebSocket gateway instead of UDP
+    int gateway_port = 8765;
+    std::string script; // Batch mode input ("-" for stdin)
+    int repeat = 1; // Batch mode: run the script this many times
+    int timeout_ms = 1000;
+    std::string shm_table; // Watch this telemetry table instead
+};
+
+class TelloCli {
+public:
+    explicit TelloCli(const CliConfig& config) : config_(config), loop_(uv_default_loop()) {}
+
+    int run() {
+        if (!open_transport()) {
+            return 1;
+        }
+        if (!config_.script.empty() || !isatty(STDIN_FILENO)) {
+            return run_batch();
+        }
+        return run_interactive();
+    }
+
+private:
+    using Reply = std::function<void(std::optional<std::string>)>;
+
+    bool open_transport() {
+        if (config_.gateway_host.empty()) {
+            tello_ = std::make_unique<Tello>(config_.drone_ip, 8889, *loop_, config_.bind);
+            if (!tello_->connect()) {
+                std::cerr << "Drone at " << config_.drone_ip << " did not answer \"command\"" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        bool opened = false;
+        bool done = false;
+        gateway_ = std::make_unique<WebSocketClient>(*loop_, config_.gateway_host, config_.gateway_port,
+            [&opened, &done](bool ok) {
+                opened = ok;
+                done = true;
+            },
+            [this](WsOpcode opcode, std::string_view payload) {
+                if (opcode != WsOpcode::TEXT) {
+                    return; // Telemetry frames
+                }
+                size_t space = payload.find(' ');
+                auto it = gateway_replies_.find(std::string(payload.substr(0, space)));
+                if (it == gateway_replies_.end()) {
+                    return;
+                }
+                Reply reply = std::move(it->second);
+                gateway_replies_.erase(it);
+                reply(space == std::string_view::npos ? std::string() : std::string(payload.substr(space + 1)));
+            },
+            [this]() {
+                std::cerr << "\r\nGateway connection closed\r" << std::endl;
+                uv_stop(loop_);
+            });
+        while (!done) {
+            uv_run(loop_, UV_RUN_ONCE);
+        }
+        return opened;
+    }
+
+    void send(const std::string& cmd, Reply reply) {
+        if (tello_) {
+            tello_->send_command_async(cmd, std::move(reply), std::chrono::milliseconds(config_.timeout_ms));
+            return;
+        }
+        std::string tag = std::to_string(next_tag_++);
+        gateway_replies_[tag] = std::move(reply);
+        gateway_->send_text(tag + " " + cmd);
+    }
+
+    // --- Batch mode ---------------------------------------------------------
+
+    int run_batch() {
+        std::vector<std::string> lines;
+        std::ifstream file;
+        if (!config_.script.empty() && config_.script != "-") {
+            file.open(config_.script);
+            if (!file) {
+                std::cerr << "Cannot open script " << config_.script << std::endl;
+                return 1;
+            }
+        }
+        std::istream& in = file.is_open() ? static_cast<std::istream&>(file) : std::cin;
+        for (std::string line; std::getline(in, line);) {
+            if (size_t comment = line.find('#'); comment != std::string::npos) {
+                line.erase(comment);
+            }
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+        }
+
+        for (int round = 0; round < config_.repeat; ++round) {
+            for (const auto& cmd : lines) {
+                if (std::string error = check_mission_command(cmd); !error.empty()) {
+                    std::cerr << cmd << ": " << error << std::endl;
+                    failures_++;
+                    continue;
+                }
+                bool done = false;
+                uint64_t start = uv_hrtime();
+                send(cmd, [this, &done, &cmd, start](std::optional<std::string> response) {
+                    double rtt = (uv_hrtime() - start) / 1e6;
+                    print_reply(cmd, response, rtt, "\n");
+                    done = true;
+                });
+                while (!done) {
+                    if (uv_run(loop_, UV_RUN_ONCE) == 0 && !done) {
+                        std::cerr << "Connection lost" << std::endl;
+                        print_summary();
+                        return 1;
+                    }
+                }
+            }
+        }
+        print_summary();
+        return failures_ == 0 ? 0 : 1;
+    }
+
+    // --- Interactive mode ---------------------------------------------------
+
+    int run_interactive() {
+        uv_tty_init(loop_, &tty_, STDIN_FILENO, 1);
+        uv_tty_set_mode(&tty_, UV_TTY_MODE_RAW);
+        tty_.data = this;
+        std::cout << "Connected to " << (tello_ ? config_.drone_ip : config_.gateway_host + " (gateway)")
+                  << ". Tab completes commands, \"help\" lists built-ins.\r\n";
+        redraw();
+        uv_read_start(reinterpret_cast<uv_stream_t*>(&tty_),
+            [](uv_handle_t*, size_t suggested, uv_buf_t* buf) {
+                static char buffer[256];
+                buf->base = buffer;
+                buf->len = std::min(suggested, sizeof(buffer));
+            },
+            [](uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+                auto* cli = static_cast<TelloCli*>(stream->data);
+                if (nread < 0) {
+                    cli->quit();
+                    return;
+                }
+                for (ssize_t i = 0; i < nread; ++i) {
+                    cli->on_key(buf->base[i]);
+                }
+            });
+        uv_run(loop_, UV_RUN_DEFAULT);
+        uv_tty_reset_mode();
+        std::cout << std::endl;
+        print_summary();
+        return 0;
+    }
+
+    void quit() {
+        uv_read_stop(reinterpret_cast<uv_stream_t*>(&tty_));
+        uv_close(reinterpret_cast<uv_handle_t*>(&tty_), nullptr);
+        if (gateway_) {
+            gateway_->close();
+        }
+        uv_stop(loop_);
+    }
+
+    void on_key(char c) {
+        // Arrow keys arrive as ESC [ A/B/C/D
+        if (escape_ == 1) {
+            escape_ = c == '[' ? 2 : 0;
+            return;
+        }
+        if (escape_ == 2) {
+            escape_ = 0;
+            if (c == 'A' && history_pos_ > 0) {
+                line_ = history_[--history_pos_];
+            } else if (c == 'B' && history_pos_ < history_.size()) {
+                line_ = ++history_pos_ < history_.size() ? history_[history_pos_] : std::string();
+            }
+            redraw();
+            return;
+        }
+
+        switch (c) {
+        case 0x1B:
+            escape_ = 1;
+            break;
+        case 0x03: // Ctrl-C clears the line
+            line_.clear();
+            std::cout << "^C\r\n";
+            redraw();
+            break;
+        case 0x04: // Ctrl-D on an empty line exits
+            if (line_.empty()) {
+                quit();
+            }
+            break;
+        case 0x7F:
+        case 0x08:
+            if (!line_.empty()) {
+                line_.pop_back();
+            }
+            redraw();
+            break;
+        case '\t':
+            complete();
+            break;
+        case '\r':
+        case '\n':
+            submit();
+            break;
+        default:
+            if (c >= 0x20 && c < 0x7F) {
+                line_.push_back(c);
+                std::cout << c << std::flush;
+            }
+        }
+    }
+
+    // Complete the command word from the mission grammar
+    void complete() {
+        if (line_.find(' ') != std::string::npos) {
+            return;
+        }
+        std::vector<std::string_view> matches;
+        for (std::string_view name : mission_command_names()) {
+            if (name.substr(0, line_.size()) == line_) {
+                matches.push_back(name);
+            }
+        }
+        for (std::string_view name : {std::string_view("help"), std::string_view("quit"), std::string_view("stats")}) {
+            if (name.substr(0, line_.size()) == line_) {
+                matches.push_back(name);
+            }
+        }
+        if (matches.empty()) {
+            return;
+        }
+        if (matches.size() == 1) {
+            line_ = std::string(matches[0]);
+            if (line_.back() != '?') {
+                line_ += ' ';
+            }
+            redraw();
+            return;
+        }
+
+        // Extend to the longest common prefix, otherwise list the candidates
+        std::string_view prefix = matches[0];
+        for (std::string_view match : matches) {
+            size_t n = 0;
+            while (n < prefix.size() && n < match.size() && prefix[n] == match[n]) {
+                ++n;
+            }
+            prefix = prefix.substr(0, n);
+        }
+        if (prefix.size() > line_.size()) {
+            line_ = std::string(prefix);
+        } else {
+            std::cout << "\r\n";
+            for (std::string_view match : matches) {
+                std::cout << match << "  ";
+            }
+            std::cout << "\r\n";
+        }
+        redraw();
+    }
+
+    void submit() {
+        std::string cmd = line_;
+        line_.clear();
+        std::cout << "\r\n";
+        cmd.erase(cmd.find_last_not_of(' ') + 1);
+        if (!cmd.empty() && (history_.empty() || history_.back() != cmd)) {
+            history_.push_back(cmd);
+        }
+        history_pos_ = history_.size();
+
+        if (cmd.empty()) {
+            // Nothing to do
+        } else if (cmd == "quit" || cmd == "exit") {
+            quit();
+            return;
+        } else if (cmd == "help") {
+            std::cout << "Built-ins: help, stats, quit. Any SDK command is validated and sent;\r\n"
+                      << "the reply is shown with its round-trip time.\r\n";
+        } else if (cmd == "stats") {
+            print_summary("\r\n");
+        } else if (std::string error = check_mission_command(cmd); !error.empty()) {
+            std::cout << "error: " << error << "\r\n";
+        } else {
+            uint64_t start = uv_hrtime();
+            send(cmd, [this, cmd, start](std::optional<std::string> response) {
+                double rtt = (uv_hrtime() - start) / 1e6;
+                std::cout << "\r\x1b[K";
+                print_reply(cmd, response, rtt, "\r\n");
+                redraw();
+            });
+        }
+        redraw();
+    }
+
+    void redraw() {
+        std::cout << "\r\x1b[Ktello> " << line_ << std::flush;
+    }
+
+    void print_reply(const std::string& cmd, const std::optional<std::string>& response, double rtt, const char* eol) {
+        char timing[32];
+        std::snprintf(timing, sizeof(timing), "%8.2f ms", rtt);
+        std::cout << timing << "  " << cmd << " -> " << (response ? *response : std::string("timeout")) << eol
+                  << std::flush;
+        if (response && *response != "error") {
+            rtt_us_.record(static_cast<uint64_t>(rtt * 1000));
+        } else {
+            failures_++;
+        }
+    }
+
+    void print_summary(const char* eol = "\n") {
+        if (rtt_us_.count() == 0) {
+            std::cout << "No successful commands" << (failures_ ? " (" + std::to_string(failures_) + " failed)" : "")
+                      << eol << std::flush;
+            return;
+        }
+        char line[160];
+        std::snprintf(line, sizeof(line), "%llu ok, %d failed; RTT p50=%.2f p90=%.2f p99=%.2f max=%.2f ms",
+                      static_cast<unsigned long long>(rtt_us_.count()), failures_, rtt_us_.quantile(0.5) / 1000.0,
+                      rtt_us_.quantile(0.9) / 1000.0, rtt_us_.quantile(0.99) / 1000.0, rtt_us_.max() / 1000.0);
+        std::cout << line << eol << std::flush;
+    }
+
+    CliConfig config_;
+    uv_loop_t* loop_;
+    std::unique_ptr<Tello> tello_;
+    std::unique_ptr<WebSocketClient> gateway_;
+    std::map<std::string, Reply> gateway_replies_;
+    uint64_t next_tag_ = 1;
+    uv_tty_t tty_;
+    std::string line_;
+    std::vector<std::string> history_;
+    size_t history_pos_ = 0;
+    int escape_ = 0;
+    Histogram rtt_us_;
+    int failures_ = 0;
+};
+
+// Print each drone's sample as the controller updates the table, sleeping on its futex in between
+static int watch_table(const std::string& name) {
+    TelemetryTable table(name);
+    std::vector<uint64_t> shown(table.slots());
+    uint32_t generation = table.generation();
+    while (!table.closed()) {
+        TelemetryTable::Snapshot snapshot;
+        for (size_t slot = 0; table.read(slot, snapshot); ++slot) {
+            if (snapshot.state.received_us == shown[slot]) {
+                continue;
+            }
+            shown[slot] = snapshot.state.received_us;
+            const TelloState& state = snapshot.state;
+            std::printf("%-12s bat=%d%% h=%dcm tof=%dcm pitch=%d roll=%d yaw=%d vg=%d,%d,%d\n", snapshot.id,
+                        state.bat, state.h, state.tof, state.pitch, state.roll, state.yaw, state.vgx, state.vgy,
+                        state.vgz);
+        }
+        std::fflush(stdout);
+        generation = table.wait(generation, 1000);
+    }
+    std::cerr << "tello_controller closed " << name << std::endl;
+    return 0;
+}
+
+static void print_usage() {
+    std::cerr << "Usage: tello_cli [options]\n"
+              << "  --drone IP            Talk to the drone directly over UDP (default: 192.168.10.1)\n"
+              << "  --bind ADDR[:PORT]    Local address and port of the UDP link (default: 0.0.0.0:8889)\n"
+              << "  --dev IFACE           Send through this network interface (needs CAP_NET_RAW)\n"
+              << "  --gateway HOST:PORT   Go through the tello_controller WebSocket gateway instead\n"
+              << "  --script FILE         Batch mode: run the commands in FILE (\"-\" for stdin)\n"
+              << "  --repeat N            Batch mode: run the script N times\n"
+              << "  --timeout MS          Reply timeout in direct mode (default: 1000)\n"
+              << "  --shm NAME            Print the telemetry table of a local tello_controller --shm NAME" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    CliConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--drone") {
+            config.drone_ip = value;
+        } else if (arg == "--bind") {
+            size_t colon = value.rfind(':');
+            config.bind.address = value.substr(0, colon);
+            if (colon != std::string::npos) {
+                config.bind.port = std::atoi(value.c_str() + colon + 1);
+            }
+        } else if (arg == "--dev") {
+            config.bind.device = value;
+        } else if (arg == "--gateway") {
+            size_t colon = value.rfind(':');
+            config.gateway_host = value.substr(0, colon);
+            if (colon != std::string::npos) {
+                config.gateway_port = std::atoi(value.c_str() + colon + 1);
+            }
+        } else if (arg == "--script") {
+            config.script = value;
+        } else if (arg == "--repeat") {
+            config.repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--timeout") {
+            config.timeout_ms = std::atoi(value.c_str());
+        } else if (arg == "--shm") {
+            config.shm_table = value;
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+
+    try {
+        if (!config.shm_table.empty()) {
+            return watch_table(config.shm_table);
+        }
+        TelloCli cli(config);
+        return cli.run();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
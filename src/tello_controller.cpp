@@ -1,39 +1,542 @@
+#include "busy_poll.hpp"
+#include "circuit_breaker.hpp"
+#include "discovery.hpp"
+#include "event_bus.hpp"
+#include "histogram.hpp"
+#include "instrumentation.hpp"
+#include "keyed_executor.hpp"
+#include "link_monitor.hpp"
+#include "probes.hpp"
+#include "replication.hpp"
+#include "shard_ring.hpp"
+#include "swarm_broadcast.hpp"
 #include "tello.hpp"
+#include "telemetry.hpp"
+#include "telemetry_filter.hpp"
+#include "telemetry_table.hpp"
+#include "websocket.hpp"
 #include <amqpcpp.h>
 #include <amqpcpp/libuv.h>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <thread>
 #include <stdexcept>
 #include <chrono>
+#include <cctype>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+
+// One drone managed by the controller
+struct DroneEndpoint {
+    std::string id = "tello"; // Routing key suffix and name used in telemetry frames
+    std::string ip = "192.168.10.1";
+    int port = 8889;
+
+    // Local end of the drone's sockets, for boxes with one Wi-Fi adapter per drone AP
+    std::string bind_address = "0.0.0.0";
+    int bind_port = -1; // -1: TelloControllerConfig::bind_port for the first drone, ephemeral for the others
+    std::string device; // Interface to bind to; the drone then also gets its own telemetry socket
+};
+
+// Configuration struct for the drone gateway
+struct TelloControllerConfig {
+    // Endpoints
+    std::vector<DroneEndpoint> drones = {DroneEndpoint{}}; // The first drone also serves the legacy tello_commands queue
+    int bind_port = 8889; // Local command port of the first drone; the others use ephemeral ports (0 for all)
+    int telemetry_port = 8890; // State stream of drones not bound to an interface; Tellos send to 8890
+    std::string discover_subnet; // Probe this CIDR at startup and add every responder, named by serial
+    std::string rabbitmq_host = "localhost";
+    int rabbitmq_port = 5672;
+
+    // WebSocket gateway for local ground stations (empty host disables it)
+    std::string gateway_host = "127.0.0.1";
+    int gateway_port = 8765;
+    size_t gateway_max_queued_frames = 64; // Telemetry frames buffered per slow client before dropping the oldest
+    uint64_t gateway_max_bytes_per_second = 0; // Paces what the gateway sends, so it cannot crowd out commands (0: unpaced)
+
+    // Rates
+    int rc_rate_hz = 20; // Max rate rc setpoints are forwarded to the drone (latest setpoint wins)
+    int telemetry_mirror_hz = 10; // Max rate telemetry is mirrored to the tello_telemetry exchange (0 disables)
+    int metrics_interval_ms = 1000; // Loop lag and throughput published to the tello_metrics exchange (0 disables)
+
+    // Per-drone circuit breaker (include/circuit_breaker.hpp): a drone that keeps timing out or
+    // answering far slower than usual has its commands failed at once ("error circuit open") and
+    // is probed with "battery?" until it answers again. State changes go to the tello_health exchange.
+    bool circuit_breaker = true;
+
+    // Credit flow control: free command slots per drone are advertised on the tello_credits
+    // exchange, so publishers hold commands back instead of piling them up in RabbitMQ
+    int credit_window = 4; // Commands a drone may have queued or in flight (0 disables credits)
+    int credit_interval_ms = 500; // Re-advertised this often, for publishers that just started
+
+    // Redundant sends for lossy Wi-Fi (RedundancyConfig in include/tello.hpp)
+    bool hedge_queries = true; // Re-send a query unanswered after the p95 round trip
+    int critical_copies = 3; // Datagrams per land/emergency, 20 ms apart
+
+    // Link adaptation (include/link_monitor.hpp): each drone's rc rate, telemetry mirror rate and
+    // query timeouts, and optionally its video settings, follow its link level. The rates above
+    // are the ones used on a GOOD link.
+    bool adapt_link = true;
+    bool adapt_video = false; // setbitrate/setfps; needs a drone whose SDK has them
+    int link_interval_ms = 1000; // Link level evaluation
+    int wifi_probe_interval_ms = 2000; // "wifi?" to idle drones, for the SNR
+
+    // DSCP and socket priority per traffic class (include/qos.hpp): drone commands go out as
+    // control, land/emergency as emergency, gateway traffic as telemetry
+    bool mark_traffic = true;
+
+    // Busy polling for a dedicated core (include/busy_poll.hpp): drone and telemetry sockets are
+    // drained with non-blocking recvmmsg in a spin loop that also runs the AMQP connection, instead
+    // of sleeping in epoll. Lower reply latency for a core at 100%.
+    bool busy_poll = false;
+    int busy_poll_cpu = -1; // Core to pin the loop to (-1: unpinned)
+    int socket_busy_poll_us = 0; // SO_BUSY_POLL, needs CAP_NET_ADMIN (0: off)
+
+    // Threads that parse and encode telemetry, in order per drone and in parallel across drones
+    // (include/keyed_executor.hpp); 0 does it on the loop. Sockets and AMQP stay on the loop.
+    int workers = 0;
+
+    // Latest sample per drone in shared memory (include/telemetry_table.hpp), so local processes
+    // read telemetry without an AMQP subscription each. Shards on one host need their own names.
+    std::string shm_table; // Empty: off
+    size_t shm_slots = 64;
+
+    // Sharding (include/shard_ring.hpp): instances given the same drones split them by consistent
+    // hashing of drone ids. Each connects only to its own and takes over or hands off drones as
+    // instances join or leave, which they learn from heartbeats on the tello_shards exchange.
+    std::string shard; // This instance's name (empty: not sharded, every drone is served)
+    std::vector<std::string> shard_peers; // Instances expected at startup; dropped if never heard from
+    int shard_vnodes = 64; // Ring points per instance
+    int shard_heartbeat_ms = 1000; // An instance not heard from for 3 heartbeats has left
+
+    // Hot standby (include/replication.hpp): the active instance streams its in-flight commands,
+    // recent replies, link state and latest telemetry to the tello_replication exchange. A standby
+    // follows the stream without touching queues or drones, and takes both over once
+    // ha_missed_heartbeats heartbeats in a row are missing.
+    std::string ha_role; // "active", "standby", or empty for neither
+    std::string ha_group; // Names the pair in routing keys (default: the shard name, else "tello")
+    int ha_heartbeat_ms = 100;
+    int ha_missed_heartbeats = 3;
+    size_t dedup_window = 1024; // Replies kept by correlation id, so a command published twice runs once (0: off)
+};
+
+// Policy (include/instrumentation.hpp) compiles logging, metrics and tracing in or out; main()
+// instantiates DefaultInstrumentation, which the TELLO_LEAN build option switches to lean
+template <typename Policy>
+class BasicTelloController {
+    struct TimerDeleter {
+        void operator()(uv_timer_t* timer) const {
+            if (timer) {
+                uv_timer_stop(timer);
+                uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_timer_t*>(handle);
+                });
+            }
+        }
+    };
+
+    struct CheckDeleter {
+        void operator()(uv_check_t* check) const {
+            if (check) {
+                uv_check_stop(check);
+                uv_close(reinterpret_cast<uv_handle_t*>(check), [](uv_handle_t* handle) {
+                    delete reinterpret_cast<uv_check_t*>(handle);
+                });
+            }
+        }
+    };
+
+    // Per-drone link and rate-limiting state
+    struct Drone {
+        std::string id;
+        uint32_t index = 0; // Dense, in order added; the source of its rows in filter batches
+        std::string device;
+        BasicTelloController* owner = nullptr;
+        std::unique_ptr<BasicTello<Policy>> tello;
+        std::unique_ptr<TelemetryListener> telemetry; // Only for drones bound to an interface
+        size_t broadcast_index = 0; // In broadcaster_; drones bound to an interface are not in it
+        std::unique_ptr<uv_timer_t, TimerDeleter> rc_timer;
+        std::string pending_rc;
+        uint64_t last_rc_sent = 0;
+        uint64_t last_mirror = 0;
+
+        LinkEstimator link;
+        int rc_rate_hz = 0; // From the link policy at the current level
+        int telemetry_mirror_hz = 0;
+        uint64_t last_wifi_probe = 0;
+
+        KeyedExecutor::Key key = 0; // Telemetry decoding, with config.workers > 0
+        int table_slot = -2; // In table_; -2 until the first sample, -1 when the table was full
+
+        CircuitBreaker breaker;
+
+        std::map<std::string, uint64_t> received_from; // Deliveries per command queue, for credits
+        std::map<std::string, size_t> queued_from; // Per command queue, passed to the drone and not yet answered
+
+        bool active = true; // Served here; false once handed to another shard
+        std::set<std::string> consuming; // Command queues consumed for it, each under its name as tag
+    };
+
+    // In-process events (include/event_bus.hpp). The gateway, AMQP mirror and shared-memory table
+    // subscribe to telemetry, metrics to responses and drone changes; recorders and detectors can
+    // subscribe next to them without touching the paths that publish. Drones live as long as the
+    // controller, so headers point at them.
+    struct TelemetryEvent {
+        Drone* drone;
+        TelloState state; // received_us is 0 when only the frame is known
+    }; // Payload: the encoded frame
+
+    struct ResponseEvent {
+        Drone* drone; // Null for a drone not served here
+        bool error;
+    }; // Payload: the response
+
+    enum class DroneChange : uint8_t { ADOPTED, RELEASED, LINK, BREAKER };
+
+    struct DroneEvent {
+        Drone* drone;
+        DroneChange change;
+    };
 
-class TelloController {
 public:
-    TelloController(std::string ip, int port, std::string rabbitmq_host, int rabbitmq_port)
-        : loop_(create_loop()), handler_(loop_.get()),
-          tello_(std::move(ip), port, *loop_) {
-        if (auto result = tello_.connect(); !result) {
-            std::cerr << "Failed to connect to Tello" << std::endl;
-            throw std::runtime_error("Tello connection failed");
+    explicit BasicTelloController(const TelloControllerConfig& config)
+        : config_(config), loop_(create_loop()), handler_(loop_.get()) {
+        // Rates never go above the configured ones, whatever the level
+        for (int level = 0; level < 4; ++level) {
+            link_policy_.rc_rate_hz[level] = std::min(link_policy_.rc_rate_hz[level], config_.rc_rate_hz);
+            link_policy_.telemetry_mirror_hz[level] =
+                std::min(link_policy_.telemetry_mirror_hz[level], config_.telemetry_mirror_hz);
+        }
+        link_policy_.rc_rate_hz[static_cast<int>(LinkLevel::GOOD)] = config_.rc_rate_hz;
+        link_policy_.telemetry_mirror_hz[static_cast<int>(LinkLevel::GOOD)] = config_.telemetry_mirror_hz;
+
+        // A standby stays off the drones' sockets and the gateway port until it takes over
+        standby_ = config_.ha_role == "standby";
+        if (config_.ha_group.empty()) {
+            config_.ha_group = config_.shard.empty() ? "tello" : config_.shard;
+        }
+        if (standby_ && !config_.discover_subnet.empty()) {
+            throw std::runtime_error("A standby cannot discover drones without contacting them; list them with --drone");
+        }
+        replica_ = ReplicaState(config_.dedup_window);
+        instance_ = std::to_string(session_) + "-" + std::to_string(getpid());
+
+        if (!config_.discover_subnet.empty()) {
+            discover_drones();
+        }
+        if (config_.drones.empty()) {
+            throw std::runtime_error("No drones configured or discovered");
+        }
+
+        // The ring starts out with the expected peers, so instances started together do not each
+        // connect to every drone first
+        if (!config_.shard.empty()) {
+            ring_ = HashRing(config_.shard_vnodes);
+            ring_.add(config_.shard);
+            for (const auto& peer : config_.shard_peers) {
+                ring_.add(peer);
+            }
         }
 
-        connect_to_rabbitmq(rabbitmq_host, rabbitmq_port);
+        // Formation steps reach every drone not bound to an interface in one batched send
+        broadcaster_ = std::make_unique<SwarmBroadcaster>(*loop_);
+        if (config_.mark_traffic) {
+            broadcaster_->mark(TrafficClass::CONTROL);
+        }
+
+        // State packets are copied off the loop and parsed on the drone's key; the frames come
+        // back through the mailbox in order
+        if (config_.workers > 0) {
+            mailbox_ = std::make_unique<LoopMailbox>(*loop_);
+            executor_ = std::make_unique<KeyedExecutor>(config_.workers);
+            log_info<Policy>("Decoding telemetry on ", config_.workers, " worker thread(s)");
+        }
+
+        // Subscribers on the loop run once per loop iteration, after its I/O callbacks
+        if (config_.telemetry_mirror_hz > 0) {
+            mirror_events_ = &bus_.subscribe<TelemetryEvent>("mirror");
+        }
+        if (Policy::kMetrics && config_.metrics_interval_ms > 0) {
+            response_events_ = &bus_.subscribe<ResponseEvent>("metrics");
+            drone_events_ = &bus_.subscribe<DroneEvent>("metrics");
+        }
+        bus_check_ = std::unique_ptr<uv_check_t, CheckDeleter>(new uv_check_t);
+        uv_check_init(loop_.get(), bus_check_.get());
+        bus_check_->data = this;
+        uv_check_start(bus_check_.get(), [](uv_check_t* check) {
+            static_cast<BasicTelloController*>(check->data)->drain_events();
+        });
+
+        for (const auto& endpoint : config_.drones) {
+            if (standby_ || !owns(endpoint.id)) {
+                continue;
+            }
+            Drone& drone = add_drone(endpoint);
+            if (auto result = drone.tello->connect(); !result) {
+                std::cerr << "Failed to connect to Tello " << endpoint.id << " at " << endpoint.ip << std::endl;
+                throw std::runtime_error("Tello connection failed");
+            }
+        }
+
+        if (!standby_) {
+            open_listeners();
+        }
+
+        link_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), link_timer_.get());
+        link_timer_->data = this;
+        if (config_.adapt_link) {
+            uint64_t interval = std::max(100, config_.link_interval_ms);
+            uv_timer_start(link_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTelloController*>(timer->data)->on_link_tick();
+            }, interval, interval);
+        }
+
+        breaker_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), breaker_timer_.get());
+        breaker_timer_->data = this;
+        if (config_.circuit_breaker) {
+            uv_timer_start(breaker_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTelloController*>(timer->data)->on_breaker_tick();
+            }, kBreakerTickMs, kBreakerTickMs);
+        }
+
+        credit_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), credit_timer_.get());
+        credit_timer_->data = this;
+        if (config_.credit_window > 0) {
+            uint64_t interval = std::max(50, config_.credit_interval_ms);
+            uv_timer_start(credit_timer_.get(), [](uv_timer_t* timer) {
+                auto* controller = static_cast<BasicTelloController*>(timer->data);
+                for (auto& [id, drone] : controller->drones_) {
+                    if (drone->active) {
+                        controller->advertise_credits(*drone);
+                    }
+                }
+            }, interval, interval);
+        }
+
+        shard_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), shard_timer_.get());
+        shard_timer_->data = this;
+        if (!config_.shard.empty()) {
+            // Peers get a full expiry window from now, not from before the drones were connected
+            uv_update_time(loop_.get());
+            for (const auto& peer : ring_.instances()) {
+                if (peer != config_.shard) {
+                    shard_seen_[peer] = uv_now(loop_.get());
+                }
+            }
+            uint64_t interval = std::max(100, config_.shard_heartbeat_ms);
+            uv_timer_start(shard_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTelloController*>(timer->data)->on_shard_tick();
+            }, interval, interval);
+            log_info<Policy>("Shard ", config_.shard, " of ", ring_.size(), " serving ", drones_.size(), " of ",
+                             config_.drones.size(), " drone(s)");
+        }
+
+        ha_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), ha_timer_.get());
+        ha_timer_->data = this;
+        if (!config_.ha_role.empty()) {
+            uint64_t interval = std::max(10, config_.ha_heartbeat_ms);
+            uv_timer_start(ha_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTelloController*>(timer->data)->on_ha_tick();
+            }, interval, interval);
+        }
+
+        lag_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), lag_timer_.get());
+        lag_timer_->data = this;
+        if (Policy::kMetrics && config_.metrics_interval_ms > 0) {
+            lag_expected_ns_ = uv_hrtime() + kLagProbeMs * 1000000;
+            uv_timer_start(lag_timer_.get(), [](uv_timer_t* timer) {
+                static_cast<BasicTelloController*>(timer->data)->on_lag_probe();
+            }, kLagProbeMs, kLagProbeMs);
+        }
+
+        connect_to_rabbitmq(config_.rabbitmq_host, config_.rabbitmq_port);
         setup_consumer();
     }
 
+    // Telemetry and gateway sockets; a standby opens them when it takes over. Drones bound to an
+    // interface have their own listener; the rest share one and are told apart by source address.
+    // Shards on one host each listen on their own --telemetry-port, since only one socket bound to
+    // a port gets its packets; samples of drones served elsewhere are dropped.
+    void open_listeners() {
+        if (!config_.shm_table.empty()) {
+            table_ = std::make_unique<TelemetryTable>(config_.shm_table, config_.shm_slots);
+            table_events_ = &bus_.subscribe<TelemetryEvent>("table");
+            log_info<Policy>("Telemetry table in shared memory ", config_.shm_table, " (", config_.shm_slots,
+                             " slots)");
+        }
+        bool any_device = false, any_shared = false;
+        for (const auto& endpoint : config_.drones) {
+            any_device = any_device || !endpoint.device.empty();
+            any_shared = any_shared || endpoint.device.empty();
+        }
+        if (any_shared) {
+            telemetry_ = std::make_unique<TelemetryListener>(*loop_,
+                [this](const std::string& ip, const TelloState& state) {
+                    on_telemetry(ip, state);
+                },
+                UdpBinding{"0.0.0.0", config_.telemetry_port, "", any_device || !config_.shard.empty()});
+            if (executor_) {
+                telemetry_->set_datagram_callback([this](const std::string& ip, std::string_view data) {
+                    if (auto it = drones_by_ip_.find(ip); it != drones_by_ip_.end()) {
+                        decode_telemetry(*it->second, data);
+                    }
+                });
+            }
+        }
+
+        if (!config_.gateway_host.empty()) {
+            gateway_ = std::make_unique<WebSocketServer>(*loop_, config_.gateway_host, config_.gateway_port,
+                [this](WebSocketServer::ClientId client, std::string_view message) {
+                    on_gateway_message(client, message);
+                },
+                config_.gateway_max_queued_frames);
+            if (config_.mark_traffic || config_.gateway_max_bytes_per_second > 0) {
+                gateway_->set_qos(TrafficClass::TELEMETRY, config_.gateway_max_bytes_per_second);
+            }
+            gateway_->set_close_handler([this](WebSocketServer::ClientId client) {
+                on_gateway_close(client);
+            });
+            gateway_events_ = &bus_.subscribe<TelemetryEvent>("gateway");
+            filter_events_ = &bus_.subscribe<TelemetryEvent>("filters");
+        }
+        // Opened by a standby taking over while busy polling
+        if (busy_poller_ && telemetry_) {
+            telemetry_->receive_with(*busy_poller_);
+        }
+    }
+
+    // Station-mode drones get DHCP addresses; find them on the subnet and key them by serial.
+    // Drones also given with --drone keep their configured id.
+    void discover_drones() {
+        DiscoveryConfig discovery;
+        discovery.subnet = config_.discover_subnet;
+        DroneDiscovery scan(*loop_, discovery);
+        for (const auto& found : scan.run()) {
+            bool known = std::any_of(config_.drones.begin(), config_.drones.end(),
+                                     [&found](const DroneEndpoint& drone) { return drone.ip == found.ip; });
+            if (!known) {
+                DroneEndpoint endpoint;
+                endpoint.id = found.serial;
+                endpoint.ip = found.ip;
+                endpoint.port = discovery.port;
+                config_.drones.push_back(endpoint);
+            }
+        }
+    }
+
+    // Drones on different interfaces may share an address (every Tello AP is 192.168.10.1).
+    // The drone is not sent "command" yet; the caller connects it.
+    Drone& add_drone(const DroneEndpoint& endpoint) {
+        bool duplicate = drones_.count(endpoint.id) > 0;
+        for (const auto& [id, other] : drones_) {
+            duplicate = duplicate || (other->tello->ip() == endpoint.ip && other->device == endpoint.device);
+        }
+        if (duplicate) {
+            throw std::runtime_error("Duplicate drone " + endpoint.id + " (" + endpoint.ip + ")");
+        }
+        auto drone = std::make_unique<Drone>();
+        drone->id = endpoint.id;
+        drone->index = static_cast<uint32_t>(drones_.size()); // Drones are never removed
+        drone->device = endpoint.device;
+        drone->owner = this;
+        UdpBinding binding{endpoint.bind_address,
+                           endpoint.bind_port >= 0 ? endpoint.bind_port
+                                                   : (endpoint.id == config_.drones.front().id ? config_.bind_port : 0),
+                           endpoint.device, false};
+        drone->tello = std::make_unique<BasicTello<Policy>>(endpoint.ip, endpoint.port, *loop_, binding);
+        RedundancyConfig redundancy;
+        redundancy.hedge_queries = config_.hedge_queries;
+        redundancy.critical_copies = std::max(1, config_.critical_copies);
+        drone->tello->set_redundancy(redundancy);
+        drone->tello->set_traffic_marking(config_.mark_traffic);
+        drone->rc_rate_hz = config_.rc_rate_hz;
+        drone->telemetry_mirror_hz = config_.telemetry_mirror_hz;
+        if (config_.adapt_link || config_.circuit_breaker) {
+            Drone* target = drone.get();
+            drone->tello->set_link_observer([this, target](std::string_view cmd, std::optional<uint64_t> rtt_us) {
+                uint64_t now = uv_now(loop_.get());
+                if (config_.adapt_link) {
+                    target->link.on_command(cmd, rtt_us, now);
+                }
+                if (config_.circuit_breaker && target->breaker.on_result(cmd, rtt_us, now)) {
+                    on_breaker_change(*target);
+                }
+            });
+        }
+        drone->rc_timer = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+        uv_timer_init(loop_.get(), drone->rc_timer.get());
+        drone->rc_timer->data = drone.get();
+
+        if (endpoint.device.empty()) {
+            drones_by_ip_[endpoint.ip] = drone.get();
+        } else {
+            Drone* target = drone.get();
+            drone->telemetry = std::make_unique<TelemetryListener>(*loop_,
+                [this, target](const std::string&, const TelloState& state) {
+                    on_drone_telemetry(*target, state);
+                },
+                UdpBinding{"0.0.0.0", 8890, endpoint.device, true});
+        }
+        if (endpoint.device.empty()) {
+            drone->broadcast_index = broadcaster_->add_drone(endpoint.ip, endpoint.port);
+            broadcast_drones_.push_back(drone.get());
+        }
+        if (executor_) {
+            drone->key = executor_->add_key();
+            if (drone->telemetry) {
+                Drone* target = drone.get();
+                drone->telemetry->set_datagram_callback([this, target](const std::string&, std::string_view data) {
+                    decode_telemetry(*target, data);
+                });
+            }
+        }
+        // Taken over while running
+        if (busy_poller_) {
+            drone->tello->receive_with(*busy_poller_);
+            if (drone->telemetry) {
+                drone->telemetry->receive_with(*busy_poller_);
+            }
+        }
+        if (endpoint.id == config_.drones.front().id) {
+            default_drone_ = drone.get();
+        }
+        Drone& added = *drone;
+        drones_[endpoint.id] = std::move(drone);
+        return added;
+    }
+
     void connect_to_rabbitmq(const std::string& host, int port) {
         AMQP::Address address(host, port, AMQP::Login("guest", "guest"), "/");
-        std::cout << "Attempting to connect to RabbitMQ at " << host << ":" << port << "..." << std::endl;
+        log_info<Policy>("Attempting to connect to RabbitMQ at ", host, ":", port, "...");
         conn_ = std::make_unique<AMQP::TcpConnection>(&handler_, address);
         channel_ = std::make_unique<AMQP::TcpChannel>(conn_.get());
 
         channel_->onError([this, host, port](const char* message) {
             std::cerr << "Channel error: " << message << ". Reconnecting..." << std::endl;
+            if constexpr (Policy::kTracing) {
+                TELLO_PROBE(reconnect);
+            }
             conn_->close();
             channel_.reset();
             conn_.reset();
+            for (auto& [id, drone] : drones_) {
+                drone->consuming.clear();
+            }
+            replication_ready_ = false;
             std::this_thread::sleep_for(std::chrono::seconds(1));
             connect_to_rabbitmq(host, port);
             setup_consumer();
@@ -41,49 +544,1226 @@ public:
     }
 
     void setup_consumer() {
-        channel_->declareQueue("tello_commands", AMQP::durable)
+        channel_->declareExchange("tello_telemetry", AMQP::fanout)
+            .onError([](const char* message) {
+                std::cerr << "Telemetry exchange declare error: " << message << std::endl;
+            });
+
+        channel_->declareExchange("tello_metrics", AMQP::fanout)
+            .onError([](const char* message) {
+                std::cerr << "Metrics exchange declare error: " << message << std::endl;
+            });
+
+        channel_->declareExchange("tello_health", AMQP::fanout)
+            .onError([](const char* message) {
+                std::cerr << "Health exchange declare error: " << message << std::endl;
+            });
+
+        channel_->declareExchange("tello_credits", AMQP::direct)
+            .onError([](const char* message) {
+                std::cerr << "Credit exchange declare error: " << message << std::endl;
+            });
+
+        channel_->declareQueue("tello_responses", AMQP::durable)
+            .onError([](const char* message) {
+                std::cerr << "Response queue declare error: " << message << std::endl;
+            });
+
+        // Swarm routing: "drone.<id>" reaches one drone, "drone.all" every drone
+        channel_->declareExchange("tello_swarm", AMQP::topic)
             .onSuccess([this]() {
-                channel_->declareQueue("tello_responses", AMQP::durable)
+                for (auto& [id, drone] : drones_) {
+                    if (drone->active) {
+                        serve_commands(*drone);
+                    }
+                }
+            })
+            .onError([](const char* message) {
+                std::cerr << "Swarm exchange declare error: " << message << std::endl;
+            });
+
+        if (!standby_) {
+            consume_formations();
+        }
+        if (!config_.ha_role.empty()) {
+            follow_replication();
+        }
+
+        // Shard membership: every instance hears every heartbeat on its own queue
+        if (!config_.shard.empty()) {
+            std::string membership = "tello_shards." + config_.shard;
+            channel_->declareExchange("tello_shards", AMQP::fanout)
+                .onError([](const char* message) {
+                    std::cerr << "Shard exchange declare error: " << message << std::endl;
+                });
+            channel_->declareQueue(membership, AMQP::exclusive)
+                .onSuccess([this, membership]() {
+                    channel_->bindQueue("tello_shards", membership, "");
+                    channel_->consume(membership, AMQP::noack)
+                        .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                            on_shard_heartbeat(std::string_view(message.body(), message.bodySize()));
+                        })
+                        .onError([membership](const char* message) {
+                            std::cerr << "Consume error on " << membership << ": " << message << std::endl;
+                        });
+                })
+                .onError([membership](const char* message) {
+                    std::cerr << "Queue " << membership << " declare error: " << message << std::endl;
+                });
+        }
+
+        if (standby_) {
+            log_info<Policy>("TelloController standing by for ", config_.ha_group, "...");
+        } else {
+            log_info<Policy>("TelloController started with ", drones_.size(), " drone(s), listening for RabbitMQ commands...");
+        }
+    }
+
+    // Formation steps: one message addresses the whole swarm (see on_formation). Every shard
+    // gets its own copy and sends to its own drones; its queue goes away with the shard.
+    std::string formation_queue() const {
+        return config_.shard.empty() ? "tello_formation" : "tello_formation." + config_.shard;
+    }
+
+    void consume_formations() {
+        std::string formation = formation_queue();
+        channel_->declareQueue(formation, config_.shard.empty() ? AMQP::durable : AMQP::autodelete)
+            .onSuccess([this, formation]() {
+                channel_->bindQueue("tello_swarm", formation, "formation");
+                channel_->consume(formation, formation, AMQP::noack)
+                    .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                        on_formation(message);
+                    })
+                    .onError([formation](const char* message) {
+                        std::cerr << "Consume error on " << formation << ": " << message << std::endl;
+                    });
+            })
+            .onError([formation](const char* message) {
+                std::cerr << "Queue " << formation << " declare error: " << message << std::endl;
+            });
+    }
+
+    // Both members of a pair hear everything sent under "<group>." on the tello_replication topic
+    // exchange and skip their own messages
+    void follow_replication() {
+        channel_->declareExchange("tello_replication", AMQP::topic)
+            .onError([](const char* message) {
+                std::cerr << "Replication exchange declare error: " << message << std::endl;
+            });
+        channel_->declareQueue(AMQP::exclusive)
+            .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                channel_->bindQueue("tello_replication", name, config_.ha_group + ".#");
+                channel_->consume(name, AMQP::noack)
+                    .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                        on_replication(message);
+                    })
                     .onSuccess([this]() {
-                        channel_->consume("tello_commands", AMQP::noack)
-                            .onSuccess([]() {
-                                std::cout << "Consumer started successfully" << std::endl;
-                            })
-                            .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
-                                std::string_view cmd(message.body(), message.bodySize());
-                                std::cout << "Received command: " << cmd << std::endl;
-                                std::string response;
-                                if (auto result = tello_.send_command(cmd)) {
-                                    std::cout << "Tello response: " << *result << std::endl;
-                                    response = *result;
-                                } else {
-                                    std::cerr << "Failed to send command: " << cmd << std::endl;
-                                    response = "error";
-                                }
-                                AMQP::Envelope envelope(response.data(), response.size());
-                                envelope.setDeliveryMode(2);
-                                channel_->publish("", "tello_responses", envelope);
-                            })
-                            .onError([](const char* message) {
-                                std::cerr << "Consume error: " << message << std::endl;
-                            });
+                        replication_ready_ = true;
+                        last_heartbeat_ = uv_now(loop_.get());
+                        if (standby_) {
+                            request_snapshot();
+                        }
                     })
                     .onError([](const char* message) {
-                        std::cerr << "Response queue declare error: " << message << std::endl;
+                        std::cerr << "Consume error on replication queue: " << message << std::endl;
                     });
             })
             .onError([](const char* message) {
-                std::cerr << "Queue declare error: " << message << std::endl;
+                std::cerr << "Replication queue declare error: " << message << std::endl;
             });
+    }
 
-        std::cout << "TelloController started, listening for RabbitMQ commands..." << std::endl;
+    // The drone's tello_commands.<id> queue, and tello_commands for the default drone. The queues
+    // outlive their consumers, so commands published while a drone moves between shards wait there
+    // for its new owner.
+    void serve_commands(Drone& drone) {
+        if (!channel_) {
+            return;
+        }
+        Drone* target = &drone;
+        if (target == default_drone_) {
+            channel_->declareQueue("tello_commands", AMQP::durable)
+                .onSuccess([this, target]() {
+                    consume_commands("tello_commands", *target);
+                })
+                .onError([](const char* message) {
+                    std::cerr << "Queue declare error: " << message << std::endl;
+                });
+        }
+        std::string queue = "tello_commands." + drone.id;
+        channel_->declareQueue(queue, AMQP::durable)
+            .onSuccess([this, queue, target]() {
+                channel_->bindQueue("tello_swarm", queue, "drone." + target->id);
+                channel_->bindQueue("tello_swarm", queue, "drone.all");
+                consume_commands(queue, *target);
+            })
+            .onError([queue](const char* message) {
+                std::cerr << "Queue " << queue << " declare error: " << message << std::endl;
+            });
+    }
+
+    // Consumes under the queue name as tag, so release_drone() can cancel it
+    void consume_commands(const std::string& queue, Drone& drone) {
+        // Handed off or already consuming by the time the queue was declared
+        if (!drone.active || !drone.consuming.insert(queue).second) {
+            return;
+        }
+        uint64_t* received = &drone.received_from[queue];
+        channel_->consume(queue, queue, AMQP::noack)
+            .onSuccess([this, queue, &drone]() {
+                log_info<Policy>("Consumer started on ", queue);
+                advertise_credits(drone);
+            })
+            .onReceived([this, &drone, received, queue](const AMQP::Message& message, uint64_t, bool) {
+                (*received)++;
+                std::string cmd(message.body(), message.bodySize());
+                if constexpr (Policy::kTracing) {
+                    TELLO_PROBE3(amqp_receive, drone.id.c_str(), cmd.data(), cmd.size());
+                }
+                log_info<Policy>("Received command for ", drone.id, ": ", cmd);
+                uint64_t received_ns = 0;
+                if constexpr (Policy::kMetrics) {
+                    commands_handled_++;
+                    received_ns = uv_hrtime();
+                }
+                // Published again after it was answered, or while it still runs: answered from the
+                // first run rather than flown twice
+                const std::string& correlation_id = message.correlationID();
+                if (!correlation_id.empty()) {
+                    if (const std::string* reply = replica_.recent_reply(correlation_id)) {
+                        publish_response(drone, *reply, correlation_id, message.replyTo());
+                        return;
+                    }
+                    if (replica_.in_flight(correlation_id)) {
+                        return;
+                    }
+                }
+                if (!drone.breaker.allow(cmd)) {
+                    publish_response(drone, kCircuitOpen, correlation_id, message.replyTo());
+                    return;
+                }
+                InFlightCommand command{drone.id, queue, correlation_id, message.replyTo(), cmd};
+                uint64_t id = replica_.begin(command);
+                replicate(ReplicaState::encode_command(id, command));
+                drone.queued_from[queue]++;
+                drone.tello->send_command_async(cmd,
+                    [this, &drone, queue, cmd, correlation_id, reply_to = message.replyTo(), received_ns,
+                     id](std::optional<std::string> result) {
+                        if constexpr (Policy::kMetrics) {
+                            command_us_.record((uv_hrtime() - received_ns) / 1000);
+                        }
+                        std::string response;
+                        if (result) {
+                            log_info<Policy>("Tello ", drone.id, " response: ", *result);
+                            response = *result;
+                        } else {
+                            std::cerr << "Failed to send command to " << drone.id << ": " << cmd << std::endl;
+                            response = drone.breaker.state() == BreakerState::CLOSED ? "error" : kCircuitOpen;
+                        }
+                        replica_.finish(id, response);
+                        replicate(ReplicaState::encode_done(id, response));
+                        publish_response(drone, response, correlation_id, reply_to);
+                        drone.queued_from[queue]--;
+                        advertise_credits(drone);
+                    },
+                    command_timeout(drone, cmd));
+            })
+            .onError([queue](const char* message) {
+                std::cerr << "Consume error on " << queue << ": " << message << std::endl;
+            });
+    }
+
+    // A formation body is either one command for every drone or lines of "@<id> <command>", one
+    // per addressed drone. Steps made only of rc setpoints are sent as is (not held to rc_rate_hz;
+    // the publisher paces the formation) and answered once with "ok <sent>/<addressed>". Other
+    // commands are answered per drone like tello_commands.<id>, but bypass the drones' command
+    // queues, so a formation should not overlap single-drone commands to the same drones.
+    void on_formation(const AMQP::Message& message) {
+        std::string_view body(message.body(), message.bodySize());
+        std::vector<std::pair<Drone*, std::string>> commands;
+        if (body.empty() || body.front() != '@') {
+            while (!body.empty() && (body.back() == '\n' || body.back() == '\r')) {
+                body.remove_suffix(1);
+            }
+            for (auto& [id, drone] : drones_) {
+                if (drone->active) {
+                    commands.emplace_back(drone.get(), std::string(body));
+                }
+            }
+        } else {
+            while (!body.empty()) {
+                size_t end = body.find('\n');
+                std::string_view line = body.substr(0, end);
+                body = end == std::string_view::npos ? std::string_view() : body.substr(end + 1);
+                if (!line.empty() && line.back() == '\r') {
+                    line.remove_suffix(1);
+                }
+                size_t space = line.find(' ');
+                if (line.empty() || line.front() != '@' || space == std::string_view::npos) {
+                    continue;
+                }
+                std::string id(line.substr(1, space - 1));
+                auto it = drones_.find(id);
+                if (it == drones_.end() || !it->second->active) {
+                    if (!configured(id)) {
+                        std::cerr << "Formation step names unknown drone: " << line << std::endl;
+                    }
+                    continue; // Otherwise another shard's
+                }
+                commands.emplace_back(it->second.get(), std::string(line.substr(space + 1)));
+            }
+        }
+        if (commands.empty()) {
+            return;
+        }
+        if constexpr (Policy::kMetrics) {
+            commands_handled_ += commands.size();
+        }
+        log_info<Policy>("Formation step for ", commands.size(), " drone(s)");
+
+        formation_payloads_.assign(broadcast_drones_.size(), std::string());
+        bool all_rc = true;
+        for (auto& [drone, cmd] : commands) {
+            all_rc = all_rc && cmd.compare(0, 3, "rc ") == 0;
+        }
+        std::string correlation_id = message.correlationID();
+        std::string reply_to = message.replyTo();
+        size_t sent = 0;
+        for (auto& [drone, cmd] : commands) {
+            if (!drone->breaker.allow(cmd)) {
+                if (!all_rc) {
+                    publish_response(*drone, kCircuitOpen, correlation_id, reply_to);
+                }
+            } else if (drone->device.empty()) {
+                formation_payloads_[drone->broadcast_index] = std::move(cmd);
+            } else if (all_rc) {
+                drone->tello->send_command_async(cmd, [](std::optional<std::string>) {});
+                sent++;
+            } else {
+                Drone* target = drone;
+                drone->tello->send_command_async(cmd,
+                    [this, target, correlation_id, reply_to](std::optional<std::string> result) {
+                        publish_response(*target, result ? *result : std::string("error"), correlation_id,
+                                         reply_to);
+                    });
+            }
+        }
+        if (all_rc) {
+            sent += broadcaster_->send([this](size_t drone, std::string& out) { out += formation_payloads_[drone]; });
+            std::string response = "ok " + std::to_string(sent) + "/" + std::to_string(commands.size());
+            publish_response(*commands.front().first, response, correlation_id, reply_to);
+            return;
+        }
+        // Queued behind any broadcast still waiting on replies, so it keeps its own payloads
+        auto payloads = std::make_shared<std::vector<std::string>>(std::move(formation_payloads_));
+        broadcaster_->send_async([payloads](size_t drone, std::string& out) { out += (*payloads)[drone]; },
+            [this, payloads, correlation_id, reply_to](std::vector<std::optional<std::string>> replies) {
+                for (size_t i = 0; i < replies.size(); ++i) {
+                    if (!(*payloads)[i].empty()) {
+                        publish_response(*broadcast_drones_[i], replies[i] ? *replies[i] : std::string("error"),
+                                         correlation_id, reply_to);
+                    }
+                }
+            });
+    }
+
+    // Probe drones whose breaker is due with a cheap query, one probe per drone at a time
+    void on_breaker_tick() {
+        uint64_t now = uv_now(loop_.get());
+        for (auto& [id, drone] : drones_) {
+            if (!drone->active || !drone->breaker.probe_due(now)) {
+                continue;
+            }
+            Drone* target = drone.get();
+            uint64_t sent_ns = uv_hrtime();
+            drone->tello->send_command_async("battery?", [this, target, sent_ns](std::optional<std::string> reply) {
+                std::optional<uint64_t> rtt_us;
+                if (reply) {
+                    rtt_us = (uv_hrtime() - sent_ns) / 1000;
+                }
+                if (target->breaker.on_probe(rtt_us, uv_now(loop_.get()))) {
+                    on_breaker_change(*target);
+                }
+            }, std::chrono::milliseconds(kBreakerProbeTimeoutMs));
+        }
+    }
+
+    // Opening fails what is queued for the drone. Its credit is still advertised: commands that
+    // arrive while it is open are failed at once, so a publisher hears "error circuit open" and can
+    // land instead of waiting for credit. Every change is published on tello_health
+    // ("drone=<id> state=OPEN ..."), keyed by drone id, for schedulers that route around
+    // unhealthy drones
+    void on_breaker_change(Drone& drone) {
+        uint64_t now = uv_now(loop_.get());
+        std::string description = drone.breaker.describe(now);
+        if (drone.breaker.state() == BreakerState::CLOSED) {
+            log_info<Policy>("Circuit to ", drone.id, " closed: ", description);
+        } else {
+            std::cerr << "Circuit to " << drone.id << " " << description << std::endl;
+        }
+        if (drone.breaker.state() == BreakerState::OPEN) {
+            drone.tello->cancel_queued();
+        }
+        bus_.publish(DroneEvent{&drone, DroneChange::BREAKER});
+        advertise_credits(drone);
+        if (!channel_) {
+            return;
+        }
+        std::string body = "drone=" + drone.id + " " + description;
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setContentType("text/plain");
+        channel_->publish("tello_health", drone.id, envelope);
+    }
+
+    // Tell publishers how many more commands each of the drone's queues may send: routing key is the
+    // queue name, body "drone=<id> session=<n> received=<n> free=<n>". received counts deliveries
+    // from that queue, so a publisher subtracts what it sent since and not yet counted; session
+    // changes when the controller restarts and its counters start over. The window is split between
+    // the drone's queues, at least one slot each, so their publishers together stay within it.
+    void advertise_credits(const Drone& drone) {
+        if (config_.credit_window <= 0 || !channel_ || drone.received_from.empty()) {
+            return;
+        }
+        size_t window = static_cast<size_t>(config_.credit_window);
+        size_t queued = drone.tello->queued_commands();
+        size_t drone_free = queued < window ? window - queued : 0;
+        size_t queues = drone.received_from.size(), index = 0;
+        for (const auto& [queue, received] : drone.received_from) {
+            size_t share = std::max<size_t>(1, window / queues + (index++ < window % queues ? 1 : 0));
+            auto held = drone.queued_from.find(queue);
+            size_t pending = held == drone.queued_from.end() ? 0 : held->second;
+            size_t free = std::min(drone_free, pending < share ? share - pending : 0);
+            char body[160];
+            int size = std::snprintf(body, sizeof(body), "drone=%s session=%llu received=%llu free=%zu",
+                                     drone.id.c_str(), static_cast<unsigned long long>(session_),
+                                     static_cast<unsigned long long>(received), free);
+            AMQP::Envelope envelope(body, std::min<size_t>(size, sizeof(body) - 1));
+            envelope.setContentType("text/plain");
+            channel_->publish("tello_credits", queue, envelope);
+        }
+    }
+
+    bool owns(const std::string& id) const {
+        return config_.shard.empty() || ring_.owner(id) == config_.shard;
+    }
+
+    bool configured(const std::string& id) const {
+        return std::any_of(config_.drones.begin(), config_.drones.end(),
+                           [&id](const DroneEndpoint& endpoint) { return endpoint.id == id; });
+    }
+
+    // Heartbeats are "shard=<name> drones=<served>" on the tello_shards fanout exchange. An
+    // instance not yet on the ring joins it with the first one.
+    void on_shard_heartbeat(std::string_view body) {
+        size_t start = body.find("shard=");
+        if (start == std::string_view::npos) {
+            return;
+        }
+        start += 6;
+        std::string name(body.substr(start, body.find(' ', start) - start));
+        if (name.empty() || name == config_.shard) {
+            return;
+        }
+        shard_seen_[name] = uv_now(loop_.get());
+        if (ring_.add(name)) {
+            log_info<Policy>("Shard ", name, " joined, ", ring_.size(), " instance(s)");
+            rebalance();
+        }
+    }
+
+    // Drop instances not heard from for 3 heartbeats, then send our own
+    void on_shard_tick() {
+        uint64_t now = uv_now(loop_.get());
+        uint64_t expiry = 3 * static_cast<uint64_t>(std::max(100, config_.shard_heartbeat_ms));
+        bool left = false;
+        for (auto it = shard_seen_.begin(); it != shard_seen_.end();) {
+            if (now - it->second < expiry) {
+                ++it;
+                continue;
+            }
+            std::cerr << "Shard " << it->first << " not heard from for " << now - it->second << " ms, dropping it"
+                      << std::endl;
+            ring_.remove(it->first);
+            it = shard_seen_.erase(it);
+            left = true;
+        }
+        if (left) {
+            rebalance();
+        }
+
+        if (!channel_ || standby_) {
+            return;
+        }
+        size_t served = std::count_if(drones_.begin(), drones_.end(),
+                                      [](const auto& entry) { return entry.second->active; });
+        std::string body = "shard=" + config_.shard + " drones=" + std::to_string(served);
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setContentType("text/plain");
+        channel_->publish("tello_shards", "", envelope);
+    }
+
+    // Take over the drones the ring now puts here and hand off the ones it put elsewhere. Drones
+    // whose owner did not change are left alone.
+    void rebalance() {
+        if (standby_) {
+            return; // The ring is kept; take_over() connects what it assigns
+        }
+        size_t adopted = 0, released = 0;
+        for (const auto& endpoint : config_.drones) {
+            auto it = drones_.find(endpoint.id);
+            Drone* drone = it == drones_.end() ? nullptr : it->second.get();
+            bool serving = drone && drone->active;
+            if (owns(endpoint.id) && !serving) {
+                adopted += adopt_drone(endpoint, drone) ? 1 : 0;
+            } else if (!owns(endpoint.id) && serving) {
+                release_drone(*drone);
+                released++;
+            }
+        }
+        log_info<Policy>("Rebalanced over ", ring_.size(), " shard(s): took over ", adopted, " drone(s), handed off ",
+                         released);
+    }
+
+    // Connects without blocking the loop: commands consumed meanwhile queue behind "command".
+    // A drone served here before keeps its sockets and state.
+    bool adopt_drone(const DroneEndpoint& endpoint, Drone* drone) {
+        if (!drone) {
+            try {
+                drone = &add_drone(endpoint);
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot take over drone " << endpoint.id << ": " << e.what() << std::endl;
+                return false;
+            }
+        }
+        drone->active = true;
+        bus_.publish(DroneEvent{drone, DroneChange::ADOPTED});
+        drone->tello->send_command_async("command", [id = drone->id](std::optional<std::string> reply) {
+            if (!reply || reply->compare(0, 2, "ok") != 0) {
+                std::cerr << "Drone " << id << " taken over but not in SDK mode: " << reply.value_or("timeout")
+                          << std::endl;
+            }
+        });
+        serve_commands(*drone);
+        return true;
+    }
+
+    // Queued commands fail; what is still in its RabbitMQ queues waits there for the new owner
+    void release_drone(Drone& drone) {
+        drone.active = false;
+        bus_.publish(DroneEvent{&drone, DroneChange::RELEASED});
+        drone.pending_rc.clear();
+        drone.tello->cancel_queued();
+        if (channel_) {
+            for (const auto& queue : drone.consuming) {
+                channel_->cancel(queue);
+            }
+        }
+        drone.consuming.clear();
+    }
+
+    // Send records (include/replication.hpp) to the standby, under a "from=<instance> epoch=<n>" line
+    void replicate(const std::string& records) {
+        if (config_.ha_role.empty() || standby_ || !channel_) {
+            return;
+        }
+        std::string body = "from=" + instance_ + " epoch=" + std::to_string(epoch_) + "\n" + records;
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setContentType("text/plain");
+        channel_->publish("tello_replication", config_.ha_group + ".records", envelope);
+    }
+
+    void request_snapshot() {
+        std::string body = "from=" + instance_;
+        AMQP::Envelope envelope(body.data(), body.size());
+        channel_->publish("tello_replication", config_.ha_group + ".sync", envelope);
+    }
+
+    // Link state and delivery counts of a drone, as records
+    std::string drone_records(const Drone& drone) const {
+        std::string records = ReplicaState::encode_drone(drone.id, static_cast<int>(drone.link.level()),
+                                                         drone.link.srtt_ms());
+        for (const auto& [queue, received] : drone.received_from) {
+            records += "\n" + ReplicaState::encode_received(drone.id, queue, received);
+        }
+        return records;
+    }
+
+    // "<group>.records" carries records from the active, "<group>.sync" a standby asking for a
+    // snapshot, "<group>.telemetry.<drone>" the drone's latest mirrored frame
+    void on_replication(const AMQP::Message& message) {
+        std::string_view key = message.routingkey();
+        std::string_view body(message.body(), message.bodySize());
+        if (key.size() <= config_.ha_group.size() || key.compare(0, config_.ha_group.size(), config_.ha_group) != 0) {
+            return;
+        }
+        key.remove_prefix(config_.ha_group.size() + 1);
+        if (key == "sync") {
+            if (!standby_ && body != "from=" + instance_) {
+                for (const auto& [id, drone] : drones_) {
+                    if (drone->active) {
+                        replica_.apply(drone_records(*drone));
+                    }
+                }
+                replica_.set_session(session_);
+                replicate(replica_.snapshot());
+            }
+            return;
+        }
+        if (key.compare(0, 10, "telemetry.") == 0) {
+            if (standby_) {
+                replica_.drones()[std::string(key.substr(10))].telemetry_frame.assign(body);
+            }
+            return;
+        }
+        if (key != "records") {
+            return;
+        }
+
+        size_t end = body.find('\n');
+        std::string_view header = body.substr(0, end);
+        std::string_view records = end == std::string_view::npos ? std::string_view() : body.substr(end + 1);
+        size_t from = header.find("from=");
+        size_t epoch_at = header.find(" epoch=");
+        if (from != 0 || epoch_at == std::string_view::npos) {
+            return;
+        }
+        std::string sender(header.substr(5, epoch_at - 5));
+        uint64_t epoch = std::strtoull(std::string(header.substr(epoch_at + 7)).c_str(), nullptr, 10);
+        if (sender == instance_) {
+            return;
+        }
+        if (!standby_) {
+            // Two actives: the later takeover wins, and the larger instance id breaks a tie
+            if (epoch > epoch_ || (epoch == epoch_ && sender > instance_)) {
+                step_down(sender, epoch);
+            }
+            return;
+        }
+        if (epoch < epoch_) {
+            return; // From an active that has lost to a newer one
+        }
+        epoch_ = epoch;
+        last_heartbeat_ = uv_now(loop_.get());
+        if (size_t bad = replica_.apply(records); bad > 0) {
+            std::cerr << "Ignored " << bad << " replication record(s) from " << sender << std::endl;
+        }
+    }
+
+    // The active sends its heartbeat (the credit session) every tick and drone state every
+    // second; a standby checks for missed heartbeats
+    void on_ha_tick() {
+        uint64_t now = uv_now(loop_.get());
+        uint64_t interval = std::max(10, config_.ha_heartbeat_ms);
+        if (standby_) {
+            uint64_t silent = now - last_heartbeat_;
+            if (replication_ready_ && silent >= interval * std::max(1, config_.ha_missed_heartbeats)) {
+                take_over(silent);
+            }
+            return;
+        }
+        std::string records = ReplicaState::encode_session(session_);
+        if (++ha_ticks_ % std::max<uint64_t>(1, 1000 / interval) == 0) {
+            for (const auto& [id, drone] : drones_) {
+                if (drone->active) {
+                    records += "\n" + drone_records(*drone);
+                }
+            }
+        }
+        replicate(records);
+    }
+
+    // Become the active: open the listeners, connect the drones, consume their queues, and carry
+    // on with the replicated state. Queries, land and emergency the old active left unanswered are
+    // sent again, as repeating them is harmless; other commands it left unanswered may or may not
+    // have reached the drone and are failed with "error failover", so the caller decides whether
+    // to send them again.
+    void take_over(uint64_t silent_ms) {
+        uint64_t start_ns = uv_hrtime();
+        standby_ = false;
+        epoch_++;
+        std::cerr << "No heartbeat from the active for " << silent_ms << " ms, taking over " << config_.ha_group
+                  << " (epoch " << epoch_ << ")" << std::endl;
+        if (replica_.session() != 0) {
+            session_ = replica_.session(); // Publishers keep their credit counts
+        }
+        try {
+            if (!telemetry_ && !gateway_) {
+                open_listeners();
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Taking over without telemetry or gateway: " << e.what() << std::endl;
+        }
+
+        for (const auto& endpoint : config_.drones) {
+            auto it = drones_.find(endpoint.id);
+            Drone* drone = it == drones_.end() ? nullptr : it->second.get();
+            if (!owns(endpoint.id) || (drone && drone->active)) {
+                continue;
+            }
+            if (!drone) {
+                try {
+                    drone = &add_drone(endpoint);
+                } catch (const std::exception& e) {
+                    std::cerr << "Cannot take over drone " << endpoint.id << ": " << e.what() << std::endl;
+                    continue;
+                }
+            }
+            // Counts first, so the credits advertised once its queues are consumed carry on
+            if (auto state = replica_.drones().find(endpoint.id); state != replica_.drones().end()) {
+                drone->link.restore(static_cast<LinkLevel>(std::clamp(state->second.link_level, 0, 3)),
+                                    state->second.srtt_ms);
+                apply_link_policy(*drone);
+                for (const auto& [queue, received] : state->second.received_from) {
+                    drone->received_from[queue] = received;
+                }
+            }
+            adopt_drone(endpoint, drone);
+        }
+        if (channel_) {
+            consume_formations();
+        }
+
+        // The last frames the old active mirrored, so ground stations are not left blank
+        for (auto& [id, state] : replica_.drones()) {
+            auto it = drones_.find(id);
+            if (!state.telemetry_frame.empty() && it != drones_.end() && it->second->active) {
+                publish_telemetry(*it->second, TelloState{}, state.telemetry_frame);
+            }
+        }
+
+        std::vector<std::pair<uint64_t, InFlightCommand>> orphans(replica_.commands().begin(),
+                                                                  replica_.commands().end());
+        size_t asked = 0;
+        for (auto& [id, command] : orphans) {
+            auto it = drones_.find(command.drone);
+            bool repeatable = (!command.cmd.empty() && command.cmd.back() == '?') || command.cmd == "land"
+                              || command.cmd == "emergency";
+            if (!repeatable || it == drones_.end() || !it->second->active) {
+                replica_.finish(id, kFailover);
+                replicate(ReplicaState::encode_done(id, kFailover));
+                publish_response(command.drone, kFailover, command.correlation_id, command.reply_to);
+                continue;
+            }
+            asked++;
+            Drone& drone = *it->second;
+            drone.tello->send_command_async(command.cmd,
+                [this, id, command](std::optional<std::string> result) {
+                    std::string response = result ? *result : std::string("error");
+                    replica_.finish(id, response);
+                    replicate(ReplicaState::encode_done(id, response));
+                    publish_response(command.drone, response, command.correlation_id, command.reply_to);
+                },
+                command_timeout(drone, command.cmd));
+        }
+        replicate(replica_.snapshot()); // For a standby started since
+        log_info<Policy>("Took over in ", (uv_hrtime() - start_ns) / 1000, " us: ", drones_.size(), " drone(s), ",
+                         orphans.size(), " unanswered command(s), ", asked, " asked again");
+    }
+
+    // Another instance took over while this one was cut off or stalled; stop serving before both
+    // send to the drones. Its listeners stay open, its drones and queues go.
+    void step_down(const std::string& other, uint64_t epoch) {
+        std::cerr << "Instance " << other << " is active for " << config_.ha_group << " (epoch " << epoch
+                  << "), standing by" << std::endl;
+        standby_ = true;
+        epoch_ = epoch;
+        last_heartbeat_ = uv_now(loop_.get());
+        for (auto& [id, drone] : drones_) {
+            if (drone->active) {
+                release_drone(*drone);
+            }
+        }
+        if (channel_) {
+            channel_->cancel(formation_queue());
+            request_snapshot();
+        }
+    }
+
+    // Publish a drone reply to the request's reply_to queue (tello_responses when unset), echoing its
+    // correlation id so callers can match it; the "drone" header names the drone that answered
+    void publish_response(const Drone& drone, const std::string& response, const std::string& correlation_id,
+                          const std::string& reply_to) {
+        publish_response(drone.id, response, correlation_id, reply_to);
+    }
+
+    void publish_response(const std::string& drone_id, const std::string& response,
+                          const std::string& correlation_id, const std::string& reply_to) {
+        if (bus_.has_subscribers<ResponseEvent>()) {
+            auto it = drones_.find(drone_id);
+            Drone* drone = it == drones_.end() ? nullptr : it->second.get();
+            bus_.publish(ResponseEvent{drone, response.compare(0, 5, "error") == 0}, bus_.pool().copy(response));
+        }
+        if (!channel_) {
+            std::cerr << "Dropping response, RabbitMQ channel is down: " << response << std::endl;
+            return;
+        }
+        if constexpr (Policy::kTracing) {
+            TELLO_PROBE3(response_publish, drone_id.c_str(), response.data(), response.size());
+        }
+        AMQP::Envelope envelope(response.data(), response.size());
+        envelope.setDeliveryMode(2);
+        if (!correlation_id.empty()) {
+            envelope.setCorrelationID(correlation_id);
+        }
+        AMQP::Table headers;
+        headers.set("drone", drone_id);
+        envelope.setHeaders(headers);
+        channel_->publish("", reply_to.empty() ? "tello_responses" : reply_to, envelope);
+    }
+
+    // Gateway frames are "<tag> [@<drone>] <command>"; the reply is "<tag> <response>" (tag "-" asks
+    // for no reply). Without @<drone> the default drone is addressed, except by watch, which then
+    // covers every drone served here.
+    void on_gateway_message(WebSocketServer::ClientId client, std::string_view message) {
+        size_t space = message.find(' ');
+        if (space == std::string_view::npos || space == 0) {
+            gateway_->send_text(client, std::string(message) + " error");
+            return;
+        }
+        std::string tag(message.substr(0, space));
+        std::string_view cmd = message.substr(space + 1);
+
+        Drone* drone = default_drone_;
+        bool addressed = !cmd.empty() && cmd.front() == '@';
+        if (addressed) {
+            size_t end = cmd.find(' ');
+            std::string id(cmd.substr(1, end == std::string_view::npos ? end : end - 1));
+            auto it = drones_.find(id);
+            if ((it == drones_.end() && !configured(id)) || end == std::string_view::npos) {
+                if (tag != "-") {
+                    gateway_->send_text(client, tag + " error unknown drone");
+                }
+                return;
+            }
+            drone = it == drones_.end() ? nullptr : it->second.get();
+            cmd = cmd.substr(end + 1);
+        }
+        if (cmd.substr(0, 6) == "watch " || cmd.substr(0, 8) == "unwatch " || cmd.substr(0, 7) == "stream ") {
+            std::string reply = on_gateway_watch(client, tag, drone, addressed, cmd);
+            if (tag != "-") {
+                gateway_->send_text(client, tag + " " + reply);
+            }
+            return;
+        }
+        if (!drone || !drone->active) {
+            if (tag != "-") {
+                gateway_->send_text(client, tag + " error drone on another shard");
+            }
+            return;
+        }
+
+        if (!drone->breaker.allow(cmd)) {
+            if (tag != "-") {
+                gateway_->send_text(client, tag + " " + kCircuitOpen);
+            }
+            return;
+        }
+
+        if (cmd.substr(0, 3) == "rc ") {
+            submit_rc(*drone, cmd);
+            if (tag != "-") {
+                gateway_->send_text(client, tag + " ok");
+            }
+            return;
+        }
+
+        drone->tello->send_command_async(cmd, [this, client, tag](std::optional<std::string> result) {
+            if (tag != "-" && gateway_) {
+                gateway_->send_text(client, tag + " " + (result ? *result : std::string("error")));
+            }
+        }, command_timeout(*drone, cmd));
+    }
+
+    // Subscriptions kept by the controller rather than sent to a drone:
+    //   watch <predicate>  alert on "<tag> alert <drone> <field>=<value>..." when a drone's sample
+    //                      starts matching (include/telemetry_filter.hpp); replies "ok <id>"
+    //   unwatch <id>       drop one of this client's watches
+    //   stream on|off      whether this client gets the binary telemetry frames
+    std::string on_gateway_watch(WebSocketServer::ClientId client, const std::string& tag, Drone* drone,
+                                 bool addressed, std::string_view cmd) {
+        std::string_view arg = cmd.substr(cmd.find(' ') + 1);
+        if (cmd.substr(0, 6) == "watch ") {
+            // A drone that is configured but not served here must not turn into a watch on all of them
+            if (addressed && (!drone || !drone->active)) {
+                return "error drone on another shard";
+            }
+            if (!addressed) {
+                drone = nullptr;
+            }
+            uint64_t id;
+            try {
+                id = filters_.add(arg, drone ? drone->index : TelemetryFilters::kAnySource);
+            } catch (const std::exception& e) {
+                return std::string("error ") + e.what();
+            }
+            watchers_[id] = Watcher{client, tag};
+            return "ok " + std::to_string(id);
+        }
+        if (cmd.substr(0, 8) == "unwatch ") {
+            uint64_t id = std::strtoull(std::string(arg).c_str(), nullptr, 10);
+            auto it = watchers_.find(id);
+            if (it == watchers_.end() || it->second.client != client) {
+                return "error unknown watch";
+            }
+            filters_.remove(id);
+            watchers_.erase(it);
+            return "ok";
+        }
+        if (arg != "on" && arg != "off") {
+            return "error stream on|off";
+        }
+        gateway_->set_streaming(client, arg == "on");
+        return "ok";
+    }
+
+    void on_gateway_close(WebSocketServer::ClientId client) {
+        for (auto it = watchers_.begin(); it != watchers_.end();) {
+            if (it->second.client == client) {
+                filters_.remove(it->first);
+                it = watchers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // One batch per drain: every watch is evaluated over the samples of this loop iteration at once
+    void evaluate_watches() {
+        if (filter_batch_.size() == 0) {
+            return;
+        }
+        filter_matches_.clear();
+        filters_.evaluate(filter_batch_, filter_matches_);
+        for (const FilterMatch& match : filter_matches_) {
+            auto it = watchers_.find(match.subscription);
+            if (it == watchers_.end()) {
+                continue;
+            }
+            std::string alert = it->second.tag + " alert " + filter_drones_[match.row]->id;
+            uint32_t fields = filters_.fields(match.subscription);
+            for (size_t field = 0; field < static_cast<size_t>(TelemetryField::COUNT); ++field) {
+                if (fields & (1u << field)) {
+                    char value[32];
+                    std::snprintf(value, sizeof(value), "=%g",
+                                  filter_batch_.value(static_cast<TelemetryField>(field), match.row));
+                    alert += ' ';
+                    alert += telemetry_field_name(static_cast<TelemetryField>(field));
+                    alert += value;
+                }
+            }
+            gateway_->send_text(it->second.client, alert);
+        }
+        filter_batch_.clear();
+        filter_drones_.clear();
+    }
+
+    // Forward rc setpoints at most the drone's rc rate; a newer setpoint replaces one still waiting
+    void submit_rc(Drone& drone, std::string_view cmd) {
+        drone.pending_rc = std::string(cmd);
+        uint64_t period = 1000 / std::max(1, drone.rc_rate_hz);
+        uint64_t now = uv_now(loop_.get());
+        if (now - drone.last_rc_sent >= period) {
+            flush_rc(drone);
+        } else if (!uv_is_active(reinterpret_cast<uv_handle_t*>(drone.rc_timer.get()))) {
+            uv_timer_start(drone.rc_timer.get(), [](uv_timer_t* timer) {
+                auto* drone = static_cast<Drone*>(timer->data);
+                drone->owner->flush_rc(*drone);
+            }, drone.last_rc_sent + period - now, 0);
+        }
+    }
+
+    void flush_rc(Drone& drone) {
+        if (drone.pending_rc.empty()) {
+            return;
+        }
+        drone.last_rc_sent = uv_now(loop_.get());
+        drone.tello->send_command_async(drone.pending_rc, [](std::optional<std::string>) {});
+        drone.pending_rc.clear();
+    }
+
+    void on_telemetry(const std::string& ip, const TelloState& state) {
+        if (auto it = drones_by_ip_.find(ip); it != drones_by_ip_.end()) {
+            on_drone_telemetry(*it->second, state);
+        }
+    }
+
+    void on_drone_telemetry(Drone& drone, const TelloState& state) {
+        encode_telemetry_frame(drone.id, state, telemetry_frame_);
+        publish_telemetry(drone, state, telemetry_frame_);
+    }
+
+    // Worker side of on_drone_telemetry. Runs on the drone's key, so one drone's samples are
+    // parsed and published in the order they arrived.
+    void decode_telemetry(Drone& drone, std::string_view data) {
+        uint64_t received_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        executor_->submit(drone.key, [this, &drone, packet = std::string(data), received_us]() {
+            TelloState state;
+            if constexpr (Policy::kTracing) {
+                TELLO_PROBE1(telemetry_parse_start, packet.size());
+            }
+            bool parsed = parse_tello_state(packet, state);
+            if constexpr (Policy::kTracing) {
+                TELLO_PROBE1(telemetry_parse_done, parsed);
+            }
+            if (!parsed) {
+                return;
+            }
+            state.received_us = received_us;
+            std::string frame;
+            encode_telemetry_frame(drone.id, state, frame);
+            mailbox_->post([this, &drone, frame = std::move(frame), state]() {
+                publish_telemetry(drone, state, frame);
+            });
+        });
+    }
+
+    // Table subscriber; on the loop, so the table has a single writer
+    void record_telemetry(Drone& drone, const TelloState& state) {
+        if (!drone.active || state.received_us == 0) {
+            return;
+        }
+        if (drone.table_slot == -2) {
+            drone.table_slot = table_->claim(drone.id);
+            if (drone.table_slot < 0) {
+                std::cerr << "Telemetry table full, " << drone.id << " left out (raise --shm-slots)" << std::endl;
+            }
+        }
+        table_->write(drone.table_slot, state);
+    }
+
+    // Loop side: link estimation, then the frame is copied once into a pooled buffer that every
+    // telemetry subscriber shares
+    void publish_telemetry(Drone& drone, const TelloState& state, std::string_view frame) {
+        if (!drone.active) {
+            return; // Its new owner publishes it once the drone sends there
+        }
+        drone.link.on_telemetry(uv_now(loop_.get()));
+        if (bus_.has_subscribers<TelemetryEvent>()) {
+            bus_.publish(TelemetryEvent{&drone, state}, bus_.pool().copy(frame));
+        }
+    }
+
+    // Mirror subscriber: to AMQP at a bounded rate; the gateway gets every sample
+    void mirror_telemetry(Drone& drone, std::string_view frame) {
+        if (!drone.active || drone.telemetry_mirror_hz <= 0 || !channel_) {
+            return;
+        }
+        uint64_t now = uv_now(loop_.get());
+        if (now - drone.last_mirror < static_cast<uint64_t>(1000 / drone.telemetry_mirror_hz)) {
+            return;
+        }
+        drone.last_mirror = now;
+        AMQP::Envelope envelope(frame.data(), frame.size());
+        envelope.setContentType("application/x-tello-telemetry");
+        channel_->publish("tello_telemetry", drone.id, envelope);
+        if (!config_.ha_role.empty()) {
+            channel_->publish("tello_replication", config_.ha_group + ".telemetry." + drone.id, envelope);
+        }
+    }
+
+    // After each loop iteration's I/O, so a burst of samples reaches the subscribers together
+    void drain_events() {
+        if (gateway_events_) {
+            gateway_events_->drain([this](const Event<TelemetryEvent>& event) {
+                if (event.header.drone->active) {
+                    gateway_->broadcast_binary(event.payload.view());
+                }
+            });
+        }
+        if (filter_events_) {
+            filter_events_->drain([this](const Event<TelemetryEvent>& event) {
+                const TelemetryEvent& sample = event.header;
+                if (filters_.size() > 0 && sample.drone->active && sample.state.received_us != 0) {
+                    filter_batch_.add(sample.drone->index, sample.state);
+                    filter_drones_.push_back(sample.drone);
+                }
+            });
+            evaluate_watches();
+        }
+        if (mirror_events_) {
+            mirror_events_->drain([this](const Event<TelemetryEvent>& event) {
+                mirror_telemetry(*event.header.drone, event.payload.view());
+            });
+        }
+        if (table_events_) {
+            table_events_->drain([this](const Event<TelemetryEvent>& event) {
+                record_telemetry(*event.header.drone, event.header.state);
+            });
+        }
+        if (response_events_) {
+            response_events_->drain([this](const Event<ResponseEvent>& event) {
+                responses_++;
+                response_errors_ += event.header.error ? 1 : 0;
+            });
+        }
+        if (drone_events_) {
+            drone_changes_ += drone_events_->drain([](const Event<DroneEvent>&) {});
+        }
+    }
+
+    // Queries time out after the drone's retransmission timeout; other commands are answered only
+    // once the drone has carried them out, so they keep the fixed one
+    std::chrono::milliseconds command_timeout(const Drone& drone, std::string_view cmd) const {
+        if (!config_.adapt_link || cmd.empty() || cmd.back() != '?') {
+            return std::chrono::milliseconds(1000);
+        }
+        return std::chrono::milliseconds(drone.link.query_timeout_ms(link_policy_));
+    }
+
+    void on_link_tick() {
+        uint64_t now = uv_now(loop_.get());
+        for (auto& [id, drone] : drones_) {
+            if (!drone->active) {
+                continue;
+            }
+            // The SNR comes from "wifi?", asked only of drones with nothing queued
+            if (now - drone->last_wifi_probe >= static_cast<uint64_t>(config_.wifi_probe_interval_ms)
+                && drone->tello->queued_commands() == 0) {
+                drone->last_wifi_probe = now;
+                Drone* target = drone.get();
+                drone->tello->send_command_async("wifi?", [target](std::optional<std::string> reply) {
+                    if (reply && !reply->empty() && std::isdigit(static_cast<unsigned char>(reply->front()))) {
+                        target->link.on_snr(std::atoi(reply->c_str()));
+                    }
+                }, command_timeout(*drone, "wifi?"));
+            }
+            if (drone->link.evaluate(now)) {
+                apply_link_policy(*drone);
+            }
+        }
+    }
+
+    void apply_link_policy(Drone& drone) {
+        LinkLevel level = drone.link.level();
+        int index = static_cast<int>(level);
+        bool worse = link_policy_.rc_rate_hz[index] < drone.rc_rate_hz;
+        drone.rc_rate_hz = link_policy_.rc_rate_hz[index];
+        drone.telemetry_mirror_hz = link_policy_.telemetry_mirror_hz[index];
+        bus_.publish(DroneEvent{&drone, DroneChange::LINK});
+        if (worse || level == LinkLevel::LOST) {
+            std::cerr << "Link to " << drone.id << " now " << drone.link.describe() << "; rc at " << drone.rc_rate_hz
+                      << " Hz" << std::endl;
+        } else {
+            log_info<Policy>("Link to ", drone.id, " now ", drone.link.describe(), "; rc at ", drone.rc_rate_hz, " Hz");
+        }
+        if (config_.adapt_video && level != LinkLevel::LOST) {
+            for (std::string cmd : {"setbitrate " + std::to_string(link_policy_.video_bitrate[index]),
+                                    std::string("setfps ") + link_policy_.video_fps[index]}) {
+                drone.tello->send_command_async(cmd, [id = drone.id, cmd](std::optional<std::string> reply) {
+                    if (!reply || reply->compare(0, 2, "ok") != 0) {
+                        std::cerr << "Drone " << id << " did not take " << cmd << ": " << reply.value_or("timeout")
+                                  << std::endl;
+                    }
+                });
+            }
+        }
+    }
+
+    // A short repeating timer fires late by however long the loop was busy; that delay is the
+    // queueing every command and telemetry sample sees on top of its own processing
+    void on_lag_probe() {
+        uint64_t now = uv_hrtime();
+        lag_us_.record(now > lag_expected_ns_ ? (now - lag_expected_ns_) / 1000 : 0);
+        lag_expected_ns_ = now + kLagProbeMs * 1000000;
+
+        if (lag_us_.count() * kLagProbeMs >= static_cast<uint64_t>(config_.metrics_interval_ms)) {
+            publish_metrics();
+            lag_us_.reset();
+            command_us_.reset();
+        }
+    }
+
+    // First line is a summary; the histograms that follow ("<name> hist1 ...") let consumers
+    // merge intervals into exact run-wide percentiles. loop_lag and command cover this interval,
+    // drone_rtt the whole run. With link adaptation, a "link <id> level=..." line per drone follows,
+    // and with circuit breakers a "breaker <id> state=..." line. Sharded instances add a
+    // "shard <name> members=<a,b,...>" line and count only the drones they serve. The last line,
+    // "bus responses=... <subscriber>=<delivered>/<dropped> ...", covers the in-process event bus.
+    void publish_metrics() {
+        if (!channel_) {
+            return;
+        }
+        Histogram drone_rtt_us;
+        size_t served = 0;
+        for (const auto& [id, drone] : drones_) {
+            drone_rtt_us.merge(drone->tello->rtt());
+            served += drone->active ? 1 : 0;
+        }
+
+        char summary[200];
+        std::snprintf(summary, sizeof(summary),
+                      "loop_lag_mean_ms=%.3f loop_lag_p99_ms=%.3f loop_lag_max_ms=%.3f command_p50_ms=%.3f "
+                      "command_p99_ms=%.3f commands=%llu drones=%zu\n",
+                      lag_us_.mean() / 1000, lag_us_.quantile(0.99) / 1000.0, lag_us_.max() / 1000.0,
+                      command_us_.quantile(0.5) / 1000.0, command_us_.quantile(0.99) / 1000.0,
+                      static_cast<unsigned long long>(commands_handled_), served);
+        std::string body = summary;
+        body += "loop_lag " + lag_us_.serialize() + "\n";
+        body += "command " + command_us_.serialize() + "\n";
+        body += "drone_rtt " + drone_rtt_us.serialize() + "\n";
+        if (config_.adapt_link) {
+            for (const auto& [id, drone] : drones_) {
+                if (drone->active) {
+                    body += "link " + id + " " + drone->link.describe() + "\n";
+                }
+            }
+        }
+        if (config_.circuit_breaker) {
+            uint64_t now = uv_now(loop_.get());
+            for (const auto& [id, drone] : drones_) {
+                if (drone->active) {
+                    body += "breaker " + id + " " + drone->breaker.describe(now) + "\n";
+                }
+            }
+        }
+        if (!config_.shard.empty()) {
+            body += "shard " + config_.shard + " members=";
+            for (const auto& member : ring_.instances()) {
+                body += (&member == &ring_.instances().front() ? "" : ",") + member;
+            }
+            body += "\n";
+        }
+        body += "bus responses=" + std::to_string(responses_) + " errors=" + std::to_string(response_errors_) +
+                " drone_changes=" + std::to_string(drone_changes_) + " pool_free=" +
+                std::to_string(bus_.pool().available()) + " pool_misses=" + std::to_string(bus_.pool().misses());
+        bus_.for_each_subscription([&body](const std::string& name, uint64_t delivered, uint64_t dropped) {
+            body += " " + name + "=" + std::to_string(delivered) + "/" + std::to_string(dropped);
+        });
+        body += "\n";
+
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setContentType("text/plain");
+        channel_->publish("tello_metrics", "", envelope);
     }
 
     void run() {
-        uv_run(loop_.get(), UV_RUN_DEFAULT);
+        if (!config_.busy_poll) {
+            uv_run(loop_.get(), UV_RUN_DEFAULT);
+            return;
+        }
+        busy_poller_ = std::make_unique<BusyPoller>(*loop_,
+            BusyPollConfig{config_.busy_poll_cpu, config_.socket_busy_poll_us});
+        for (const auto& [id, drone] : drones_) {
+            drone->tello->receive_with(*busy_poller_);
+            if (drone->telemetry) {
+                drone->telemetry->receive_with(*busy_poller_);
+            }
+        }
+        if (telemetry_) {
+            telemetry_->receive_with(*busy_poller_);
+        }
+        broadcaster_->receive_with(*busy_poller_);
+        busy_poller_->run();
     }
 
 private:
+    static constexpr uint64_t kLagProbeMs = 50;
+    static constexpr uint64_t kBreakerTickMs = 100;
+    static constexpr int kBreakerProbeTimeoutMs = 500;
+    static constexpr const char* kCircuitOpen = "error circuit open";
+    static constexpr const char* kFailover = "error failover";
+
     struct LoopDeleter {
         void operator()(uv_loop_t* loop) const {
             if (loop) {
@@ -102,20 +1782,246 @@ private:
         return std::unique_ptr<uv_loop_t, LoopDeleter>(loop);
     }
 
+    TelloControllerConfig config_;
     std::unique_ptr<uv_loop_t, LoopDeleter> loop_;
     AMQP::LibUvHandler handler_;
     std::unique_ptr<AMQP::TcpConnection> conn_;
     std::unique_ptr<AMQP::TcpChannel> channel_;
-    Tello tello_;
+    std::map<std::string, std::unique_ptr<Drone>> drones_;
+    std::unordered_map<std::string, Drone*> drones_by_ip_;
+    Drone* default_drone_ = nullptr;
+    std::unique_ptr<TelemetryListener> telemetry_;
+    std::unique_ptr<TelemetryTable> table_;
+    EventBus bus_{1024, 256}; // Buffers of one telemetry frame or response each
+    Subscription<TelemetryEvent>* gateway_events_ = nullptr;
+    Subscription<TelemetryEvent>* mirror_events_ = nullptr;
+    Subscription<TelemetryEvent>* table_events_ = nullptr;
+    Subscription<TelemetryEvent>* filter_events_ = nullptr; // Gateway watches
+    Subscription<ResponseEvent>* response_events_ = nullptr; // Metrics
+    Subscription<DroneEvent>* drone_events_ = nullptr; // Metrics
+    uint64_t responses_ = 0;
+    uint64_t response_errors_ = 0;
+    uint64_t drone_changes_ = 0;
+    std::unique_ptr<uv_check_t, CheckDeleter> bus_check_;
+    std::unique_ptr<SwarmBroadcaster> broadcaster_;
+    std::vector<Drone*> broadcast_drones_; // By broadcast_index
+    std::vector<std::string> formation_payloads_; // By broadcast_index; reused between steps
+    std::unique_ptr<WebSocketServer> gateway_;
+
+    struct Watcher {
+        WebSocketServer::ClientId client;
+        std::string tag; // Alerts go out under the tag of the watch command
+    };
+    TelemetryFilters filters_;
+    std::map<uint64_t, Watcher> watchers_; // By filter subscription id
+    TelemetryBatch filter_batch_;
+    std::vector<Drone*> filter_drones_; // By batch row
+    std::vector<FilterMatch> filter_matches_;
+    std::string telemetry_frame_;
+    std::unique_ptr<BusyPoller> busy_poller_; // After the sockets it reads, so it goes first
+    std::unique_ptr<LoopMailbox> mailbox_;
+    std::unique_ptr<KeyedExecutor> executor_; // After the drones and mailbox its tasks use, so it joins first
+
+    LinkPolicy link_policy_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> link_timer_;
+
+    std::unique_ptr<uv_timer_t, TimerDeleter> breaker_timer_;
+    std::unique_ptr<uv_timer_t, TimerDeleter> credit_timer_;
+    uint64_t session_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    HashRing ring_; // Empty unless sharded
+    std::map<std::string, uint64_t> shard_seen_; // Other instances on the ring, by last heartbeat (uv_now)
+    std::unique_ptr<uv_timer_t, TimerDeleter> shard_timer_;
+
+    // Hot standby
+    ReplicaState replica_; // In-flight commands and the dedup window; a standby's copy of the active's
+    std::string instance_; // Tells this process's replication messages from the rest of the pair's
+    bool standby_ = false;
+    uint64_t epoch_ = 0; // Raised by every takeover; of two actives the one with the higher epoch stays
+    uint64_t last_heartbeat_ = 0; // uv_now() of the active's last message, while standing by
+    bool replication_ready_ = false; // The standby's clock starts once it can hear the active
+    uint64_t ha_ticks_ = 0;
+    std::unique_ptr<uv_timer_t, TimerDeleter> ha_timer_;
+
+    // Metrics over the current interval
+    std::unique_ptr<uv_timer_t, TimerDeleter> lag_timer_;
+    uint64_t lag_expected_ns_ = 0;
+    Histogram lag_us_;
+    Histogram command_us_; // AMQP delivery to response publish
+    uint64_t commands_handled_ = 0;
 };
 
-int main() {
+static void print_usage() {
+    std::cerr << "Usage: tello_controller [options]\n"
+              << "  --drone [ID=]IP[:PORT][,bind=ADDR[:PORT]][,dev=IFACE]\n"
+              << "                        Drone to manage; repeat for a swarm (default: tello=192.168.10.1).\n"
+              << "                        bind= sets the local source address and port, dev= the interface\n"
+              << "  --discover CIDR       Add every drone answering on this subnet, named by serial number\n"
+              << "  --bind-port PORT      Local command port of the first drone, 0 for ephemeral (default: 8889)\n"
+              << "  --telemetry-port PORT State stream port for drones without dev=; one per shard on a host (default: 8890)\n"
+              << "  --rabbitmq HOST:PORT  RabbitMQ broker (default: localhost:5672)\n"
+              << "  --gateway HOST:PORT   WebSocket gateway address, or \"off\" (default: 127.0.0.1:8765)\n"
+              << "  --rc-rate HZ          Max rc setpoint rate (default: 20)\n"
+              << "  --hedge on|off        Re-send queries unanswered after the p95 round trip (default: on)\n"
+              << "  --critical-copies N   Datagrams sent per land/emergency (default: 3)\n"
+              << "  --adapt-link on|off   Adapt rc/mirror rates and query timeouts to link quality (default: on)\n"
+              << "  --qos on|off          DSCP and socket priority per traffic class (default: on)\n"
+              << "  --gateway-rate KB/S   Pace gateway traffic to this many kilobytes per second (default: unpaced)\n"
+              << "  --adapt-video on|off  Also lower video bitrate/fps on weak links (default: off)\n"
+              << "  --busy-poll off|on|CPU\n"
+              << "                        Spin on the drone sockets instead of sleeping in epoll, pinned to CPU\n"
+              << "                        if given; costs a full core (default: off)\n"
+              << "  --workers N           Threads parsing telemetry per drone, off the loop (default: 0)\n"
+              << "  --shm NAME            Keep the latest telemetry in shared memory /dev/shm/NAME for local readers\n"
+              << "  --shm-slots N         Drones the shared-memory table holds (default: 64)\n"
+              << "  --socket-busy-poll US SO_BUSY_POLL per drone socket in busy-poll mode (needs CAP_NET_ADMIN)\n"
+              << "  --breaker on|off      Fail commands fast to drones that keep timing out (default: on)\n"
+              << "  --credits N           Command slots per drone advertised on tello_credits, 0 to disable (default: 4)\n"
+              << "  --shard NAME          Serve only this instance's share of the drones, by consistent hashing\n"
+              << "  --shard-peers A,B,... Other instances expected to be running (default: learned from heartbeats)\n"
+              << "  --shard-vnodes N      Ring points per instance; must match on every instance (default: 64)\n"
+              << "  --ha active|standby   Replicate to, or stand by for, the other instance of a pair (default: off)\n"
+              << "  --ha-group NAME       Pair name (default: the shard name, else tello)\n"
+              << "  --dedup N             Replies kept by correlation id to answer repeated commands (default: 1024)\n"
+              << "  --metrics MS          tello_metrics publish interval, 0 to disable (default: 1000; off in lean builds)" << std::endl;
+}
+
+// Split "host:port"; the port is left untouched when absent
+static void parse_endpoint(const std::string& value, std::string& host, int& port) {
+    size_t colon = value.rfind(':');
+    host = value.substr(0, colon);
+    if (colon != std::string::npos) {
+        port = std::atoi(value.c_str() + colon + 1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    TelloControllerConfig config;
+    bool default_drones = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            print_usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--drone") {
+            if (default_drones) {
+                config.drones.clear();
+                default_drones = false;
+            }
+            DroneEndpoint drone;
+            size_t comma = value.find(',');
+            for (size_t start = comma; start != std::string::npos;) {
+                size_t end = value.find(',', start + 1);
+                std::string option = value.substr(start + 1, end == std::string::npos ? end : end - start - 1);
+                if (option.compare(0, 5, "bind=") == 0) {
+                    drone.bind_port = 0;
+                    parse_endpoint(option.substr(5), drone.bind_address, drone.bind_port);
+                } else if (option.compare(0, 4, "dev=") == 0) {
+                    drone.device = option.substr(4);
+                } else {
+                    print_usage();
+                    return 2;
+                }
+                start = end;
+            }
+            value = value.substr(0, comma);
+            size_t equals = value.find('=');
+            if (equals != std::string::npos) {
+                drone.id = value.substr(0, equals);
+                value = value.substr(equals + 1);
+            } else if (!config.drones.empty()) {
+                drone.id = "tello" + std::to_string(config.drones.size() + 1);
+            }
+            parse_endpoint(value, drone.ip, drone.port);
+            config.drones.push_back(drone);
+        } else if (arg == "--discover") {
+            if (default_drones) {
+                config.drones.clear();
+                default_drones = false;
+            }
+            config.discover_subnet = value;
+        } else if (arg == "--bind-port") {
+            config.bind_port = std::atoi(value.c_str());
+        } else if (arg == "--telemetry-port") {
+            config.telemetry_port = std::atoi(value.c_str());
+        } else if (arg == "--rabbitmq") {
+            parse_endpoint(value, config.rabbitmq_host, config.rabbitmq_port);
+        } else if (arg == "--gateway") {
+            if (value == "off") {
+                config.gateway_host.clear();
+            } else {
+                parse_endpoint(value, config.gateway_host, config.gateway_port);
+            }
+        } else if (arg == "--rc-rate") {
+            config.rc_rate_hz = std::atoi(value.c_str());
+        } else if (arg == "--hedge") {
+            config.hedge_queries = value != "off";
+        } else if (arg == "--critical-copies") {
+            config.critical_copies = std::atoi(value.c_str());
+        } else if (arg == "--qos") {
+            config.mark_traffic = value != "off";
+        } else if (arg == "--gateway-rate") {
+            config.gateway_max_bytes_per_second = std::strtoull(value.c_str(), nullptr, 10) * 1000;
+        } else if (arg == "--adapt-link") {
+            config.adapt_link = value != "off";
+        } else if (arg == "--adapt-video") {
+            config.adapt_video = value == "on";
+        } else if (arg == "--busy-poll") {
+            config.busy_poll = value != "off";
+            if (config.busy_poll && value != "on") {
+                config.busy_poll_cpu = std::atoi(value.c_str());
+            }
+        } else if (arg == "--workers") {
+            config.workers = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--shm") {
+            config.shm_table = value;
+        } else if (arg == "--shm-slots") {
+            config.shm_slots = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        } else if (arg == "--socket-busy-poll") {
+            config.socket_busy_poll_us = std::atoi(value.c_str());
+        } else if (arg == "--breaker") {
+            config.circuit_breaker = value != "off";
+        } else if (arg == "--credits") {
+            config.credit_window = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--shard") {
+            config.shard = value;
+        } else if (arg == "--shard-peers") {
+            for (size_t start = 0; start <= value.size();) {
+                size_t end = std::min(value.find(',', start), value.size());
+                if (end > start) {
+                    config.shard_peers.push_back(value.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+        } else if (arg == "--shard-vnodes") {
+            config.shard_vnodes = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--ha") {
+            if (value != "active" && value != "standby" && value != "off") {
+                print_usage();
+                return 2;
+            }
+            config.ha_role = value == "off" ? "" : value;
+        } else if (arg == "--ha-group") {
+            config.ha_group = value;
+        } else if (arg == "--dedup") {
+            config.dedup_window = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--metrics") {
+            config.metrics_interval_ms = std::atoi(value.c_str());
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+
     try {
-        TelloController controller("192.168.10.1", 8889, "localhost", 5672);
+        BasicTelloController<DefaultInstrumentation> controller(config);
         controller.run();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1111 @@
+// Synthetic load for the tello_controller command and telemetry pipeline.
+//
+// Publishes commands open-loop at a fixed offered rate onto tello_commands or the tello_swarm
+// routing keys, optionally backed by N in-process simulated drones, and reports achieved vs.
+// offered load and reply latency. Latency is measured from each command's scheduled send
+// time, so a stalled publisher shows up as latency instead of silently lowering the load.
+//
+// With --sweep it starts its own controller for each drone count and raises the rate until
+// p99 latency or reply loss crosses a threshold, then prints a capacity table with the
+// controller's CPU, memory and event loop lag at every point.
+//
+// With --failover-after it also starts a hot standby next to the spawned controller, kills the
+// active one mid-run and reports how long replies stopped.
+//
+// With --flight-check it runs flight_controller against the spawned controller instead of
+// offering load, cuts the drone's replies off mid-flight and checks that it still gets landed.
+#include "histogram.hpp"
+#include "tello_sim.hpp"
+#include <amqpcpp.h>
+#include <amqpcpp/libuv.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+struct LoadgenConfig {
+    std::string rabbitmq_host = "localhost";
+    int rabbitmq_port = 5672;
+    double rate = 50; // Offered commands per second (first step of a sweep)
+    double duration_s = 10; // Per step
+    int drain_ms = 2000; // Wait for stragglers after the last send
+    std::string target = "auto"; // legacy, each, all, or auto (each with drones, legacy without)
+    std::vector<std::pair<std::string, double>> mix = {{"battery?", 4}, {"speed?", 2}, {"rc 0 0 0 0", 4}};
+    std::vector<std::string> drone_ids; // Swarm targets; defaults to the simulated drones
+
+    // Simulated drones on 127.0.0.2, 127.0.0.3, ...
+    int sim_drones = 0;
+    int sim_telemetry_hz = 10;
+    int sim_reply_delay_ms = 0;
+    double sim_loss = 0; // Fraction of commands, and of replies, each simulated drone loses
+    int sim_jitter_ms = 0;
+    std::vector<int> sim_telemetry_ports = {8890}; // State stream goes to each; the controller listens on the first
+    bool discover = false; // Spawned controller finds the simulated drones with --discover; ids are serials
+    bool bind_sources = false; // Drone i is bound to source 127.0.1.(2 + i):8889, and its simulator checks that
+
+    // Controller to spawn against the simulated drones (empty: started by hand)
+    std::string controller;
+    double failover_after_s = 0; // SIGKILL the spawned controller this far into the run; a standby takes over
+
+    // flight_controller to fly against the first simulated drone, which stops answering this long
+    // after takeoff; the check fails unless the drone is landed anyway
+    std::string flight_check;
+    double silence_after_s = 3;
+
+    // Saturation sweep
+    bool sweep = false;
+    std::vector<int> drone_counts = {1, 2, 4, 8, 16, 32};
+    double rate_step = 1.5; // Rate multiplier between steps
+    double max_rate = 20000;
+    double max_p99_ms = 50; // A step fails above this p99...
+    double max_loss_pct = 1; // ...or when more replies than this go missing
+    std::string profile = "unnamed"; // Hardware profile label for the capacity table
+
+    // Latency histograms: one "<label> hist1 ..." line per run or sweep step
+    std::string save_path;
+    std::string baseline_path; // Earlier --save output to compare against
+};
+
+// Result of one fixed-rate step
+struct StepResult {
+    int drones = 0;
+    double offered = 0; // cmd/s
+    double achieved = 0; // replies/s
+    size_t expected = 0;
+    size_t received = 0;
+    size_t errors = 0;
+    double loss_pct = 0;
+    double p50_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+    Histogram latency_us;
+    double controller_cpu_pct = -1; // Of one core; -1 when the controller is not ours to watch
+    double controller_rss_mb = -1;
+    double loadgen_cpu_pct = 0;
+    double loop_lag_p99_ms = -1; // Merged from tello_metrics; -1 when none arrived
+    double loop_lag_max_ms = -1;
+    double failover_ms = -1; // SIGKILL of the active to the first reply to a command sent after it
+    size_t failed_over = 0; // Replies "error failover": commands the active had not answered
+    bool ok = false;
+};
+
+// utime + stime of a process in clock ticks, from /proc/<pid>/stat
+static uint64_t process_cpu_ticks(const std::string& pid) {
+    std::ifstream stat("/proc/" + pid + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return 0;
+    }
+    // The command name may contain spaces; fields are counted from the closing paren
+    size_t paren = line.rfind(')');
+    if (paren == std::string::npos) {
+        return 0;
+    }
+    std::istringstream fields(line.substr(paren + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; fields >> field; ++i) {
+        if (i == 14) {
+            utime = std::strtoull(field.c_str(), nullptr, 10);
+        } else if (i == 15) {
+            stime = std::strtoull(field.c_str(), nullptr, 10);
+            break;
+        }
+    }
+    return utime + stime;
+}
+
+// A "Key: value" line from /proc files, parsed as a number (0 when missing)
+static double proc_value(const std::string& path, const std::string& key) {
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        if (line.compare(0, key.size(), key) == 0 && line.size() > key.size() && line[key.size()] == ':') {
+            return std::atof(line.c_str() + key.size() + 1);
+        }
+    }
+    return 0;
+}
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const LoadgenConfig& config)
+        : config_(config), loop_(uv_default_loop()), handler_(loop_) {
+        if (config_.sweep && config_.controller.empty()) {
+            throw std::runtime_error("--sweep needs --controller to restart it for each drone count");
+        }
+        if (config_.discover) {
+            config_.drone_ids.clear(); // Discovered drones are named by serial
+        }
+        if (config_.discover && config_.bind_sources) {
+            throw std::runtime_error("--bind-sources needs the drones listed, not discovered");
+        }
+        if (config_.target == "auto") {
+            bool swarm = config_.sweep || config_.sim_drones > 0 || !config_.drone_ids.empty();
+            config_.target = swarm ? "each" : "legacy";
+        }
+        if (config_.target != "legacy" && config_.target != "each" && config_.target != "all") {
+            throw std::runtime_error("Unknown target " + config_.target);
+        }
+        if (config_.target == "each" && config_.drone_ids.empty() && config_.sim_drones == 0 && !config_.sweep) {
+            throw std::runtime_error("--target each needs --drones or --ids");
+        }
+        if (config_.failover_after_s > 0 && (config_.controller.empty() || config_.sweep || config_.sim_drones == 0)) {
+            throw std::runtime_error("--failover-after needs --controller and --drones, and no --sweep");
+        }
+        if (!config_.flight_check.empty()
+            && (config_.controller.empty() || config_.sweep || config_.failover_after_s > 0 || config_.discover)) {
+            throw std::runtime_error("--flight-check needs --controller, and no --sweep, --failover-after or --discover");
+        }
+        if (!config_.flight_check.empty()) {
+            config_.sim_drones = std::max(config_.sim_drones, 1);
+        }
+
+        double total_weight = 0;
+        for (const auto& [cmd, weight] : config_.mix) {
+            total_weight += weight;
+            cumulative_weights_.push_back(total_weight);
+        }
+        if (config_.mix.empty() || total_weight <= 0) {
+            throw std::runtime_error("Empty command mix");
+        }
+
+        tick_timer_ = new uv_timer_t;
+        uv_timer_init(loop_, tick_timer_);
+        tick_timer_->data = this;
+        failover_timer_ = new uv_timer_t;
+        uv_timer_init(loop_, failover_timer_);
+        failover_timer_->data = this;
+
+        AMQP::Address address(config_.rabbitmq_host, config_.rabbitmq_port, AMQP::Login("guest", "guest"), "/");
+        conn_ = std::make_unique<AMQP::TcpConnection>(&handler_, address);
+        channel_ = std::make_unique<AMQP::TcpChannel>(conn_.get());
+        channel_->onError([](const char* message) {
+            std::cerr << "Channel error: " << message << std::endl;
+            uv_stop(uv_default_loop());
+        });
+
+        // Private reply queue: replies come back here via reply_to, matched by correlation id
+        channel_->declareQueue(AMQP::exclusive | AMQP::autodelete)
+            .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                reply_queue_ = name;
+                channel_->consume(name, AMQP::noack)
+                    .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                        on_reply(message.correlationID(), std::string_view(message.body(), message.bodySize()));
+                    })
+                    .onSuccess([this]() {
+                        begin();
+                    });
+            });
+
+        // Count the telemetry the controller mirrors to AMQP, and collect its loop lag reports
+        channel_->declareExchange("tello_telemetry", AMQP::fanout);
+        channel_->declareQueue(AMQP::exclusive | AMQP::autodelete)
+            .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                channel_->bindQueue("tello_telemetry", name, "");
+                channel_->consume(name, AMQP::noack)
+                    .onReceived([this](const AMQP::Message&, uint64_t, bool) {
+                        telemetry_mirrored_++;
+                    });
+            });
+        channel_->declareExchange("tello_metrics", AMQP::fanout);
+        channel_->declareQueue(AMQP::exclusive | AMQP::autodelete)
+            .onSuccess([this](const std::string& name, uint32_t, uint32_t) {
+                channel_->bindQueue("tello_metrics", name, "");
+                channel_->consume(name, AMQP::noack)
+                    .onReceived([this](const AMQP::Message& message, uint64_t, bool) {
+                        on_metrics(std::string(message.body(), message.bodySize()));
+                    });
+            });
+    }
+
+    void run() {
+        uv_run(loop_, UV_RUN_DEFAULT);
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    struct Outstanding {
+        uint64_t scheduled_ns;
+        size_t replies_left;
+    };
+
+    using Action = std::function<void()>;
+
+    // The phases run one after another, so a single timer drives all of them
+    void after(uint64_t delay_ms, Action action, uint64_t repeat_ms = 0) {
+        timer_action_ = std::move(action);
+        uv_timer_stop(tick_timer_);
+        uv_timer_start(tick_timer_, [](uv_timer_t* timer) {
+            auto* self = static_cast<LoadGenerator*>(timer->data);
+            Action action = self->timer_action_; // May replace itself
+            action();
+        }, delay_ms, repeat_ms);
+    }
+
+    void begin() {
+        if (!config_.flight_check.empty()) {
+            setup_drones(config_.sim_drones, [this]() { start_flight_check(); });
+            return;
+        }
+        if (!config_.sweep) {
+            setup_drones(config_.sim_drones, [this]() {
+                start_step(config_.rate, [this](const StepResult& result) {
+                    report(result);
+                    save_histograms({result});
+                    compare_with_baseline({result});
+                    shutdown();
+                });
+            });
+            return;
+        }
+
+        std::printf("Capacity sweep, profile %s: %s, %u cores, %.0f MB\n", config_.profile.c_str(),
+                    cpu_model().c_str(), std::thread::hardware_concurrency(),
+                    proc_value("/proc/meminfo", "MemTotal") / 1024);
+        std::printf("Thresholds: p99 <= %.1f ms, loss <= %.1f%%, %.0f s per step\n\n", config_.max_p99_ms,
+                    config_.max_loss_pct, config_.duration_s);
+        print_row_header();
+        next_drone_count();
+    }
+
+    void next_drone_count() {
+        if (count_index_ >= config_.drone_counts.size()) {
+            print_capacity_table();
+            save_histograms(results_);
+            compare_with_baseline(results_);
+            shutdown();
+            return;
+        }
+        int drones = config_.drone_counts[count_index_++];
+        setup_drones(drones, [this]() {
+            sweep_rate_ = config_.rate;
+            next_rate();
+        });
+    }
+
+    // Raise the rate until a step fails; a count that fails at the first rate ends the sweep
+    void next_rate() {
+        start_step(sweep_rate_, [this](const StepResult& result) {
+            results_.push_back(result);
+            print_row(result);
+            if (result.ok && sweep_rate_ * config_.rate_step <= config_.max_rate) {
+                sweep_rate_ *= config_.rate_step;
+                next_rate();
+            } else if (!result.ok && sweep_rate_ == config_.rate) {
+                std::printf("%d drones saturate at the lowest rate, stopping\n", result.drones);
+                count_index_ = config_.drone_counts.size();
+                next_drone_count();
+            } else {
+                next_drone_count();
+            }
+        });
+    }
+
+    // Replace the simulated drones (and a spawned controller) with `count` fresh ones
+    void setup_drones(int count, Action on_ready) {
+        if (controller_) {
+            on_controller_exit_ = [this, count, on_ready]() { setup_drones(count, on_ready); };
+            uv_process_kill(controller_, SIGTERM);
+            return;
+        }
+        if (!sims_.empty()) {
+            // Closing sockets finish on the next loop iteration; rebind after that
+            sims_.clear();
+            after(200, [this, count, on_ready]() { setup_drones(count, on_ready); });
+            return;
+        }
+
+        if (config_.sweep) {
+            config_.drone_ids.clear();
+        }
+        for (int i = 0; i < count; ++i) {
+            SimConfig sim;
+            sim.ip = "127.0.0." + std::to_string(2 + i);
+            sim.serial = "0TQZSIM" + std::to_string(1000000 + i);
+            sim.telemetry_hz = config_.sim_telemetry_hz;
+            sim.reply_delay_ms = config_.sim_reply_delay_ms;
+            sim.command_loss = sim.reply_loss = config_.sim_loss;
+            sim.reply_jitter_ms = config_.sim_jitter_ms;
+            sim.telemetry_ports = config_.sim_telemetry_ports;
+            sim.fault_seed = 1 + i;
+            if (config_.bind_sources) {
+                sim.allowed_source = "127.0.1." + std::to_string(2 + i);
+            }
+            sims_.push_back(std::make_unique<SimulatedTello>(*loop_, sim));
+            if (config_.drone_ids.size() < sims_.size()) {
+                config_.drone_ids.push_back(config_.discover ? sim.serial : "sim" + std::to_string(i + 1));
+            }
+        }
+        replies_per_command_ = config_.target == "all" ? std::max<size_t>(1, config_.drone_ids.size()) : 1;
+
+        if (!sims_.empty()) {
+            std::vector<std::string> args = {config_.controller.empty() ? "tello_controller" : config_.controller,
+                                             "--bind-port", "0", "--gateway", "off", "--rabbitmq",
+                                             config_.rabbitmq_host + ":" + std::to_string(config_.rabbitmq_port),
+                                             "--telemetry-port", std::to_string(config_.sim_telemetry_ports.front())};
+            if (config_.discover) {
+                // Smallest subnet of 127.0.0.0 whose host range covers 127.0.0.2 .. 127.0.0.(count + 1)
+                int prefix = 30;
+                while ((1 << (32 - prefix)) < count + 3) {
+                    prefix--;
+                }
+                args.push_back("--discover");
+                args.push_back("127.0.0.0/" + std::to_string(prefix));
+            } else {
+                for (size_t i = 0; i < sims_.size(); ++i) {
+                    const SimConfig& sim = sims_[i]->config();
+                    args.push_back("--drone");
+                    args.push_back(config_.drone_ids[i] + "=" + sim.ip
+                                   + (sim.allowed_source.empty() ? "" : ",bind=" + sim.allowed_source + ":8889"));
+                }
+            }
+            if (config_.controller.empty()) {
+                std::cout << "Simulating " << sims_.size() << " drone(s); start the controller with:\n ";
+                for (const auto& arg : args) {
+                    std::cout << " " << arg;
+                }
+                std::cout << std::endl;
+            } else if (config_.failover_after_s > 0) {
+                std::vector<std::string> active = args, standby = args;
+                active.insert(active.end(), {"--ha", "active"});
+                standby.insert(standby.end(), {"--ha", "standby"});
+                controller_ = spawn_controller(active);
+                controller_pid_ = std::to_string(controller_->pid);
+                standby_ = spawn_controller(standby);
+            } else {
+                controller_ = spawn_controller(args);
+                controller_pid_ = std::to_string(controller_->pid);
+            }
+        }
+        wait_until_ready(std::move(on_ready));
+    }
+
+    uv_process_t* spawn_controller(const std::vector<std::string>& args) {
+        std::vector<char*> argv;
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        // The controller logs every command; keep that off the report
+        uv_stdio_container_t stdio[3];
+        stdio[0].flags = UV_IGNORE;
+        stdio[1].flags = UV_IGNORE;
+        stdio[2].flags = UV_INHERIT_FD;
+        stdio[2].data.fd = 2;
+
+        uv_process_options_t options{};
+        options.file = argv[0];
+        options.args = argv.data();
+        options.stdio = stdio;
+        options.stdio_count = 3;
+        options.exit_cb = [](uv_process_t* process, int64_t status, int signal) {
+            auto* self = static_cast<LoadGenerator*>(process->data);
+            uv_close(reinterpret_cast<uv_handle_t*>(process), [](uv_handle_t* handle) {
+                delete reinterpret_cast<uv_process_t*>(handle);
+            });
+            if (process == self->flight_) {
+                self->flight_ = nullptr; // check_flight() judges by the drone, not the exit status
+                return;
+            }
+            if (process == self->standby_) {
+                self->standby_ = nullptr;
+                if (!self->shutting_down_) {
+                    std::cerr << "Standby controller exited (status " << status << ", signal " << signal << ")"
+                              << std::endl;
+                }
+                return;
+            }
+            self->controller_ = nullptr;
+            if (!self->on_controller_exit_) {
+                std::cerr << "Controller exited unexpectedly (status " << status << ", signal " << signal << ")"
+                          << std::endl;
+                self->shutdown();
+                return;
+            }
+            Action next = std::move(self->on_controller_exit_);
+            self->on_controller_exit_ = nullptr;
+            next();
+        };
+
+        auto* process = new uv_process_t;
+        process->data = this;
+        if (int result = uv_spawn(loop_, process, &options); result != 0) {
+            delete process;
+            throw std::runtime_error("Failed to start " + args[0] + ": " + uv_strerror(result));
+        }
+        return process;
+    }
+
+    // The standby has to notice the silence, connect the drones and consume their queues; the
+    // first reply to a command sent after the kill ends the outage
+    void kill_active() {
+        if (!controller_ || !standby_) {
+            return;
+        }
+        failover_kill_ns_ = uv_hrtime();
+        on_controller_exit_ = [this]() {
+            controller_ = standby_;
+            standby_ = nullptr;
+            controller_pid_ = std::to_string(controller_->pid);
+        };
+        uv_process_kill(controller_, SIGKILL);
+        std::cout << "Killed the active controller " << (failover_kill_ns_ - start_ns_) / 1000000 << " ms into the run"
+                  << std::endl;
+    }
+
+    // The drone goes silent once airborne. Its commands then time out until the breaker opens, the
+    // next one is failed at once with "error circuit open", and flight_controller has to get land
+    // through while the drone's credit is held by a breaker that will not close.
+    void start_flight_check() {
+        std::cout << "Flying " << config_.flight_check << " on " << config_.drone_ids.front() << ", silent "
+                  << config_.silence_after_s << " s after takeoff" << std::endl;
+        flight_ = spawn_controller({config_.flight_check});
+        flight_start_ns_ = uv_hrtime();
+        airborne_ns_ = silenced_ns_ = 0;
+        after(100, [this]() { check_flight(); }, 100);
+    }
+
+    void check_flight() {
+        SimulatedTello& drone = *sims_.front();
+        uint64_t now = uv_hrtime();
+        if (!silenced_ns_) {
+            if (!airborne_ns_ && drone.flying()) {
+                airborne_ns_ = now;
+            }
+            if (airborne_ns_ && now - airborne_ns_ >= static_cast<uint64_t>(config_.silence_after_s * 1e9)) {
+                drone.set_reply_loss(1);
+                silenced_ns_ = now;
+                std::cout << "Drone stopped answering" << std::endl;
+            } else if (airborne_ns_ && !drone.flying()) {
+                finish_flight_check(false, "landed before it went silent; raise --silence-after");
+            } else if (!airborne_ns_ && (!flight_ || now - flight_start_ns_ > kFlightCheckDeadlineS * 1000000000)) {
+                finish_flight_check(false, "flight_controller never took off");
+            }
+            return;
+        }
+        if (!drone.flying()) {
+            char detail[64];
+            std::snprintf(detail, sizeof(detail), "landed %.1f s after the drone went silent", (now - silenced_ns_) / 1e9);
+            finish_flight_check(true, detail);
+        } else if (now - silenced_ns_ > kFlightCheckDeadlineS * 1000000000) {
+            finish_flight_check(false, "still airborne " + std::to_string(kFlightCheckDeadlineS)
+                                           + " s after the drone went silent");
+        }
+    }
+
+    void finish_flight_check(bool passed, const std::string& detail) {
+        std::printf("flight check %s: %s\n", passed ? "passed" : "FAILED", detail.c_str());
+        failed_ = !passed;
+        shutdown();
+    }
+
+    // Ready once every simulated drone is in SDK mode and a probe sent to all of them comes back,
+    // which also proves the controller's AMQP consumers are up
+    void wait_until_ready(Action on_ready) {
+        on_ready_ = std::move(on_ready);
+        waiting_reported_ = false;
+        after(0, [this]() {
+            bool connected = std::all_of(sims_.begin(), sims_.end(),
+                                         [](const auto& sim) { return sim->commands_received() > 0; });
+            if (!connected) {
+                if (!waiting_reported_) {
+                    std::cout << "Waiting for tello_controller to connect to the simulated drones..." << std::endl;
+                    waiting_reported_ = true;
+                }
+                return;
+            }
+            probe_id_ = "probe-" + std::to_string(++probe_count_);
+            probe_replies_ = 0;
+            std::string cmd = "sdk?";
+            AMQP::Envelope envelope(cmd.data(), cmd.size());
+            envelope.setCorrelationID(probe_id_);
+            envelope.setReplyTo(reply_queue_);
+            if (config_.target == "legacy") {
+                channel_->publish("", "tello_commands", envelope);
+            } else {
+                channel_->publish("tello_swarm", "drone.all", envelope);
+            }
+        }, 500);
+    }
+
+    void start_step(double rate, std::function<void(const StepResult&)> on_done) {
+        if (!config_.sweep) {
+            std::cout << "Offering " << rate << " cmd/s for " << config_.duration_s << " s to " << config_.target
+                      << std::endl;
+        }
+        on_step_done_ = std::move(on_done);
+        step_rate_ = rate;
+        total_commands_ = static_cast<uint64_t>(rate * config_.duration_s);
+        sent_ = 0;
+        last_reply_ns_ = 0;
+        outstanding_.clear();
+        latency_us_.reset();
+        errors_ = 0;
+        step_active_ = true;
+        loop_lag_us_.reset();
+        telemetry_mirrored_ = 0;
+        telemetry_base_ = 0;
+        for (const auto& sim : sims_) {
+            telemetry_base_ += sim->states_sent();
+        }
+        self_ticks_ = process_cpu_ticks("self");
+        controller_ticks_ = controller_ ? process_cpu_ticks(controller_pid_) : 0;
+        failover_kill_ns_ = 0;
+        failover_reply_ns_ = 0;
+        failed_over_ = 0;
+        start_ns_ = uv_hrtime();
+        after(0, [this]() { publish_due(); }, 1);
+        if (standby_ && config_.failover_after_s > 0) {
+            uv_timer_start(failover_timer_, [](uv_timer_t* timer) {
+                static_cast<LoadGenerator*>(timer->data)->kill_active();
+            }, static_cast<uint64_t>(config_.failover_after_s * 1000), 0);
+        }
+    }
+
+    // Open loop: send everything whose scheduled time has passed, regardless of replies
+    void publish_due() {
+        uint64_t now = uv_hrtime();
+        double interval_ns = 1e9 / step_rate_;
+        while (sent_ < total_commands_ && start_ns_ + static_cast<uint64_t>(sent_ * interval_ns) <= now) {
+            publish(start_ns_ + static_cast<uint64_t>(sent_ * interval_ns));
+        }
+        if (sent_ >= total_commands_) {
+            last_send_ns_ = now;
+            after(config_.drain_ms, [this]() { end_step(); });
+        }
+    }
+
+    void publish(uint64_t scheduled_ns) {
+        double pick = std::uniform_real_distribution<double>(0, cumulative_weights_.back())(rng_);
+        size_t index = std::lower_bound(cumulative_weights_.begin(), cumulative_weights_.end(), pick)
+                       - cumulative_weights_.begin();
+        const std::string& cmd = config_.mix[std::min(index, config_.mix.size() - 1)].first;
+
+        std::string correlation_id = "load-" + std::to_string(step_count_) + "-" + std::to_string(sent_);
+        AMQP::Envelope envelope(cmd.data(), cmd.size());
+        envelope.setCorrelationID(correlation_id);
+        envelope.setReplyTo(reply_queue_);
+        if (config_.target == "legacy") {
+            channel_->publish("", "tello_commands", envelope);
+        } else if (config_.target == "all") {
+            channel_->publish("tello_swarm", "drone.all", envelope);
+        } else {
+            channel_->publish("tello_swarm", "drone." + config_.drone_ids[sent_ % config_.drone_ids.size()], envelope);
+        }
+        outstanding_[correlation_id] = {scheduled_ns, replies_per_command_};
+        sent_++;
+    }
+
+    void on_reply(const std::string& correlation_id, std::string_view body) {
+        if (!probe_id_.empty() && correlation_id == probe_id_) {
+            size_t expected = config_.target == "legacy" ? 1 : std::max<size_t>(1, sims_.size());
+            if (++probe_replies_ >= expected) {
+                probe_id_.clear();
+                Action ready = std::move(on_ready_);
+                uv_timer_stop(tick_timer_);
+                ready();
+            }
+            return;
+        }
+
+        auto it = outstanding_.find(correlation_id);
+        if (it == outstanding_.end()) {
+            return;
+        }
+        uint64_t now = uv_hrtime();
+        latency_us_.record((now - it->second.scheduled_ns) / 1000);
+        last_reply_ns_ = now;
+        if (body.substr(0, 5) == "error") {
+            errors_++;
+        }
+        if (body == "error failover") {
+            failed_over_++;
+        }
+        if (failover_kill_ns_ && !failover_reply_ns_ && it->second.scheduled_ns >= failover_kill_ns_) {
+            failover_reply_ns_ = now;
+        }
+        if (--it->second.replies_left == 0) {
+            outstanding_.erase(it);
+        }
+        if (step_active_ && sent_ >= total_commands_ && outstanding_.empty()) {
+            end_step();
+        }
+    }
+
+    // Merge the controller's per-interval loop lag histograms over the step
+    void on_metrics(const std::string& body) {
+        if (!step_active_) {
+            return;
+        }
+        std::istringstream lines(body);
+        for (std::string line; std::getline(lines, line);) {
+            if (line.compare(0, 9, "loop_lag ") == 0) {
+                if (auto interval = Histogram::deserialize(std::string_view(line).substr(9))) {
+                    loop_lag_us_.merge(*interval);
+                }
+            }
+        }
+    }
+
+    void end_step() {
+        if (!step_active_) {
+            return;
+        }
+        step_active_ = false;
+        step_count_++;
+        uv_timer_stop(tick_timer_);
+        uint64_t end_ns = uv_hrtime();
+        double wall_s = std::max(1e-9, (end_ns - start_ns_) / 1e9);
+        double reply_s = std::max(1e-9, ((last_reply_ns_ ? last_reply_ns_ : end_ns) - start_ns_) / 1e9);
+        double ticks_per_s = static_cast<double>(sysconf(_SC_CLK_TCK));
+
+        StepResult result;
+        result.drones = static_cast<int>(sims_.size());
+        result.offered = step_rate_;
+        result.expected = sent_ * replies_per_command_;
+        result.received = latency_us_.count();
+        result.errors = errors_;
+        result.achieved = result.received / reply_s;
+        result.loss_pct = result.expected ? 100.0 * (result.expected - std::min(result.expected, result.received))
+                                                / result.expected
+                                          : 0;
+        result.latency_us = latency_us_;
+        result.p50_ms = latency_us_.quantile(0.5) / 1000.0;
+        result.p99_ms = latency_us_.quantile(0.99) / 1000.0;
+        result.max_ms = latency_us_.max() / 1000.0;
+        result.loadgen_cpu_pct = 100.0 * (process_cpu_ticks("self") - self_ticks_) / ticks_per_s / wall_s;
+        if (failover_kill_ns_) {
+            result.failover_ms = failover_reply_ns_ ? (failover_reply_ns_ - failover_kill_ns_) / 1e6 : -1;
+            result.failed_over = failed_over_;
+        }
+        if (controller_ && !failover_kill_ns_) { // After a failover the ticks are the standby's
+            result.controller_cpu_pct =
+                100.0 * (process_cpu_ticks(controller_pid_) - controller_ticks_) / ticks_per_s / wall_s;
+            result.controller_rss_mb = proc_value("/proc/" + controller_pid_ + "/status", "VmRSS") / 1024;
+        }
+        if (loop_lag_us_.count()) {
+            result.loop_lag_p99_ms = loop_lag_us_.quantile(0.99) / 1000.0;
+            result.loop_lag_max_ms = loop_lag_us_.max() / 1000.0;
+        }
+        result.ok = result.received > 0 && result.p99_ms <= config_.max_p99_ms
+                    && result.loss_pct <= config_.max_loss_pct;
+
+        auto done = std::move(on_step_done_);
+        done(result);
+    }
+
+    void report(const StepResult& result) {
+        double send_s = std::max(1e-9, (last_send_ns_ - start_ns_) / 1e9);
+        double reply_s = std::max(1e-9, ((last_reply_ns_ ? last_reply_ns_ : uv_hrtime()) - start_ns_) / 1e9);
+
+        std::printf("offered    %.1f cmd/s (%.1f replies/s)\n", result.offered, result.offered * replies_per_command_);
+        std::printf("sent       %llu cmds in %.2f s (%.1f cmd/s)\n", static_cast<unsigned long long>(sent_), send_s,
+                    sent_ / send_s);
+        std::printf("achieved   %.1f replies/s  received=%zu/%zu  errors=%zu  lost=%zu\n", result.achieved,
+                    result.received, result.expected, result.errors,
+                    result.expected - std::min(result.expected, result.received));
+        std::printf("%-10s %s\n", "latency", format_latency(result.latency_us).c_str());
+        if (!sims_.empty()) {
+            uint64_t emitted = 0;
+            for (const auto& sim : sims_) {
+                emitted += sim->states_sent();
+            }
+            emitted -= telemetry_base_;
+            std::printf("telemetry  emitted=%llu (%.1f/s)  mirrored=%llu (%.1f/s)\n",
+                        static_cast<unsigned long long>(emitted), emitted / reply_s,
+                        static_cast<unsigned long long>(telemetry_mirrored_), telemetry_mirrored_ / reply_s);
+            uint64_t rejected = 0;
+            for (const auto& sim : sims_) {
+                rejected += sim->commands_rejected();
+            }
+            if (rejected) {
+                std::printf("misrouted  %llu commands arrived from the wrong source address\n",
+                            static_cast<unsigned long long>(rejected));
+            }
+        }
+        if (result.loop_lag_max_ms >= 0) {
+            std::printf("loop lag   p99=%.3f  max=%.3f ms\n", result.loop_lag_p99_ms, result.loop_lag_max_ms);
+        }
+        if (failover_kill_ns_ && result.failover_ms >= 0) {
+            std::printf("failover   %.1f ms from SIGKILL to the next reply  failed_over=%zu\n", result.failover_ms,
+                        result.failed_over);
+        } else if (failover_kill_ns_) {
+            std::printf("failover   no reply to a command sent after SIGKILL\n");
+        }
+        if (result.received < result.expected || sent_ / send_s < 0.95 * result.offered) {
+            std::printf("saturated: the pipeline did not keep up with the offered load\n");
+        }
+    }
+
+    static void print_row_header() {
+        std::printf("%6s %9s %9s %7s %8s %8s %7s %8s %9s %9s %7s  %s\n", "drones", "offered", "achieved", "loss%",
+                    "p50 ms", "p99 ms", "cpu%", "rss MB", "lag p99", "lag max", "gen%", "");
+    }
+
+    static void print_row(const StepResult& r) {
+        std::printf("%6d %9.1f %9.1f %7.2f %8.3f %8.3f %7.1f %8.1f %9.3f %9.3f %7.1f  %s\n", r.drones, r.offered,
+                    r.achieved, r.loss_pct, r.p50_ms, r.p99_ms, r.controller_cpu_pct, r.controller_rss_mb,
+                    r.loop_lag_p99_ms, r.loop_lag_max_ms, r.loadgen_cpu_pct, r.ok ? "ok" : "FAIL");
+        std::fflush(stdout);
+    }
+
+    // Highest passing rate per drone count, normalised to one controller core
+    void print_capacity_table() const {
+        std::printf("\nCapacity (%s)\n", config_.profile.c_str());
+        std::printf("%6s %12s %7s %8s %9s %14s %15s\n", "drones", "max cmd/s", "cpu%", "rss MB", "lag p99",
+                    "cmd/s per core", "drones per core");
+        for (int drones : config_.drone_counts) {
+            const StepResult* best = nullptr;
+            for (const auto& result : results_) {
+                if (result.drones == drones && result.ok && (!best || result.achieved > best->achieved)) {
+                    best = &result;
+                }
+            }
+            if (!best) {
+                continue;
+            }
+            double cores = std::max(0.01, best->controller_cpu_pct / 100);
+            std::printf("%6d %12.1f %7.1f %8.1f %9.3f %14.1f %15.1f\n", drones, best->achieved,
+                        best->controller_cpu_pct, best->controller_rss_mb, best->loop_lag_p99_ms,
+                        best->achieved / cores, drones / cores);
+        }
+        bool generator_bound = std::any_of(results_.begin(), results_.end(),
+                                           [](const StepResult& r) { return r.loadgen_cpu_pct > 90; });
+        if (generator_bound) {
+            std::printf("note: tello_loadgen itself used over 90%% of a core; rerun it on a separate machine\n");
+        }
+    }
+
+    // "run" for a single run, "d<drones>@<rate>" for sweep steps, so two sweeps with the same
+    // counts and rates line up
+    std::string label(const StepResult& result) const {
+        if (!config_.sweep) {
+            return "run";
+        }
+        char label[48];
+        std::snprintf(label, sizeof(label), "d%d@%.0f", result.drones, result.offered);
+        return label;
+    }
+
+    void save_histograms(const std::vector<StepResult>& results) const {
+        if (config_.save_path.empty()) {
+            return;
+        }
+        std::ofstream out(config_.save_path);
+        for (const auto& result : results) {
+            out << label(result) << " " << result.latency_us.serialize() << "\n";
+        }
+        if (!out) {
+            std::cerr << "Failed to write " << config_.save_path << std::endl;
+            return;
+        }
+        std::cout << "Saved latency histograms to " << config_.save_path << std::endl;
+    }
+
+    void compare_with_baseline(const std::vector<StepResult>& results) const {
+        if (config_.baseline_path.empty()) {
+            return;
+        }
+        std::map<std::string, Histogram> baseline;
+        std::ifstream in(config_.baseline_path);
+        for (std::string line; std::getline(in, line);) {
+            size_t space = line.find(' ');
+            if (space == std::string::npos) {
+                continue;
+            }
+            if (auto histogram = Histogram::deserialize(std::string_view(line).substr(space + 1))) {
+                baseline.emplace(line.substr(0, space), std::move(*histogram));
+            }
+        }
+        if (baseline.empty()) {
+            std::cerr << "No latency histograms in " << config_.baseline_path << std::endl;
+            return;
+        }
+
+        std::printf("\nCompared with %s:\n", config_.baseline_path.c_str());
+        for (const auto& result : results) {
+            auto it = baseline.find(label(result));
+            if (it == baseline.end()) {
+                continue;
+            }
+            if (!config_.sweep) {
+                std::printf("%s", format_latency_diff(it->second, result.latency_us).c_str());
+                continue;
+            }
+            double before = it->second.quantile(0.99) / 1000.0;
+            double after = result.latency_us.quantile(0.99) / 1000.0;
+            std::printf("%-12s p99 %.3f -> %.3f ms (%+.1f%%)\n", label(result).c_str(), before, after,
+                        before > 0 ? 100.0 * (after - before) / before : 0.0);
+        }
+    }
+
+    static std::string cpu_model() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        for (std::string line; std::getline(cpuinfo, line);) {
+            if (line.compare(0, 10, "model name") == 0) {
+                size_t colon = line.find(':');
+                return colon == std::string::npos ? line : line.substr(colon + 2);
+            }
+        }
+        return "unknown cpu";
+    }
+
+    void shutdown() {
+        if (shutting_down_) {
+            return;
+        }
+        shutting_down_ = true;
+        if (controller_) {
+            on_controller_exit_ = []() {};
+            uv_process_kill(controller_, SIGTERM);
+        }
+        if (standby_) {
+            uv_process_kill(standby_, SIGTERM);
+        }
+        if (flight_) {
+            uv_process_kill(flight_, SIGTERM);
+        }
+        for (uv_timer_t* timer : {tick_timer_, failover_timer_}) {
+            uv_timer_stop(timer);
+            uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+                delete reinterpret_cast<uv_timer_t*>(handle);
+            });
+        }
+        sims_.clear();
+        conn_->close();
+    }
+
+    LoadgenConfig config_;
+    uv_loop_t* loop_;
+    AMQP::LibUvHandler handler_;
+    std::unique_ptr<AMQP::TcpConnection> conn_;
+    std::unique_ptr<AMQP::TcpChannel> channel_;
+    std::vector<std::unique_ptr<SimulatedTello>> sims_;
+    uv_timer_t* tick_timer_ = nullptr;
+    Action timer_action_;
+    std::string reply_queue_;
+    std::vector<double> cumulative_weights_;
+    std::mt19937 rng_{42};
+    size_t replies_per_command_ = 1;
+    bool shutting_down_ = false;
+
+    // Spawned controller
+    uv_process_t* controller_ = nullptr;
+    std::string controller_pid_;
+    Action on_controller_exit_;
+    uv_process_t* standby_ = nullptr; // With --failover-after
+
+    // Failover
+    uv_timer_t* failover_timer_ = nullptr;
+    uint64_t failover_kill_ns_ = 0;
+    uint64_t failover_reply_ns_ = 0;
+    size_t failed_over_ = 0;
+
+    // Flight check
+    static constexpr uint64_t kFlightCheckDeadlineS = 30; // To take off, and to land once silent
+    uv_process_t* flight_ = nullptr;
+    uint64_t flight_start_ns_ = 0;
+    uint64_t airborne_ns_ = 0;
+    uint64_t silenced_ns_ = 0;
+    bool failed_ = false;
+
+    // Readiness probe
+    Action on_ready_;
+    std::string probe_id_;
+    size_t probe_replies_ = 0;
+    uint64_t probe_count_ = 0;
+    bool waiting_reported_ = false;
+
+    // Current step
+    std::function<void(const StepResult&)> on_step_done_;
+    bool step_active_ = false;
+    uint64_t step_count_ = 0;
+    double step_rate_ = 0;
+    uint64_t total_commands_ = 0;
+    uint64_t sent_ = 0;
+    uint64_t start_ns_ = 0;
+    uint64_t last_send_ns_ = 0;
+    uint64_t last_reply_ns_ = 0;
+    std::unordered_map<std::string, Outstanding> outstanding_;
+    Histogram latency_us_;
+    size_t errors_ = 0;
+    uint64_t telemetry_base_ = 0;
+    uint64_t telemetry_mirrored_ = 0;
+    Histogram loop_lag_us_;
+    uint64_t self_ticks_ = 0;
+    uint64_t controller_ticks_ = 0;
+
+    // Sweep
+    size_t count_index_ = 0;
+    double sweep_rate_ = 0;
+    std::vector<StepResult> results_;
+};
+
+static void print_usage() {
+    std::cerr << "Usage: tello_loadgen [options]\n"
+              << "  --rabbitmq HOST:PORT  RabbitMQ broker (default: localhost:5672)\n"
+              << "  --rate N              Offered commands per second (default: 50)\n"
+              << "  --duration S          Length of the run, or of each sweep step, in seconds (default: 10)\n"
+              << "  --mix CMD=W,...       Weighted command mix (default: battery?=4,speed?=2,rc 0 0 0 0=4)\n"
+              << "  --target T            legacy (tello_commands), each (round-robin drone.<id>) or all (drone.all)\n"
+              << "  --drones N            Simulate N drones on 127.0.0.2 and up (default: 0)\n"
+              << "  --ids ID,...          Swarm drone ids when not simulating\n"
+              << "  --telemetry-hz N      State rate of each simulated drone (default: 10)\n"
+              << "  --reply-delay MS      Simulated drone processing time (default: 0)\n"
+              << "  --loss PCT            Commands and replies each simulated drone loses, each way (default: 0)\n"
+              << "  --jitter MS           Extra random reply delay of the simulated drones, up to MS (default: 0)\n"
+              << "  --telemetry-ports P,...\n"
+              << "                        Send the simulated state stream to each port, e.g. one per local shard\n"
+              << "                        (default: 8890)\n"
+              << "  --controller PATH     Start this tello_controller against the simulated drones\n"
+              << "  --failover-after S    Also start a standby controller, SIGKILL the active one S seconds into\n"
+              << "                        the run, and report how long replies stopped\n"
+              << "  --flight-check PATH   Fly this flight_controller (it uses localhost:5672) on the first simulated\n"
+              << "                        drone, silence the drone mid-flight and fail unless it still lands\n"
+              << "  --silence-after S     Seconds after takeoff the drone stops answering (default: 3)\n"
+              << "  --discover            Let the controller find the simulated drones by subnet probing\n"
+              << "  --bind-sources        Bind each drone to its own loopback source address, all on port 8889\n"
+              << "  --sweep               Find the saturation point for each drone count (needs --controller)\n"
+              << "  --counts N,...        Sweep drone counts (default: 1,2,4,8,16,32)\n"
+              << "  --rate-step X         Sweep rate multiplier (default: 1.5)\n"
+              << "  --max-p99 MS          Sweep p99 latency threshold (default: 50)\n"
+              << "  --max-loss PCT        Sweep lost reply threshold (default: 1)\n"
+              << "  --profile NAME        Hardware profile label for the capacity table\n"
+              << "  --save FILE           Write the latency histograms of this run to FILE\n"
+              << "  --baseline FILE       Compare latencies with an earlier --save" << std::endl;
+}
+
+static std::vector<std::string> split(const std::string& value, char separator) {
+    std::vector<std::string> parts;
+    std::istringstream stream(value);
+    for (std::string part; std::getline(stream, part, separator);) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+int main(int argc, char* argv[]) {
+    LoadgenConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sweep") {
+            config.sweep = true;
+            continue;
+        }
+        if (arg == "--discover") {
+            config.discover = true;
+            continue;
+        }
+        if (arg == "--bind-sources") {
+            config.bind_sources = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--rabbitmq") {
+            size_t colon = value.rfind(':');
+            config.rabbitmq_host = value.substr(0, colon);
+            if (colon != std::string::npos) {
+                config.rabbitmq_port = std::atoi(value.c_str() + colon + 1);
+            }
+        } else if (arg == "--rate") {
+            config.rate = std::atof(value.c_str());
+        } else if (arg == "--duration") {
+            config.duration_s = std::atof(value.c_str());
+        } else if (arg == "--mix") {
+            config.mix.clear();
+            for (const auto& entry : split(value, ',')) {
+                size_t equals = entry.rfind('=');
+                double weight = equals == std::string::npos ? 1 : std::atof(entry.c_str() + equals + 1);
+                config.mix.emplace_back(entry.substr(0, equals), weight);
+            }
+        } else if (arg == "--target") {
+            config.target = value;
+        } else if (arg == "--drones") {
+            config.sim_drones = std::clamp(std::atoi(value.c_str()), 0, 250);
+        } else if (arg == "--ids") {
+            config.drone_ids = split(value, ',');
+        } else if (arg == "--telemetry-hz") {
+            config.sim_telemetry_hz = std::atoi(value.c_str());
+        } else if (arg == "--reply-delay") {
+            config.sim_reply_delay_ms = std::atoi(value.c_str());
+        } else if (arg == "--loss") {
+            config.sim_loss = std::clamp(std::atof(value.c_str()) / 100, 0.0, 1.0);
+        } else if (arg == "--jitter") {
+            config.sim_jitter_ms = std::atoi(value.c_str());
+        } else if (arg == "--telemetry-ports") {
+            config.sim_telemetry_ports.clear();
+            for (const auto& port : split(value, ',')) {
+                config.sim_telemetry_ports.push_back(std::atoi(port.c_str()));
+            }
+            if (config.sim_telemetry_ports.empty()) {
+                print_usage();
+                return 2;
+            }
+        } else if (arg == "--controller") {
+            config.controller = value;
+        } else if (arg == "--failover-after") {
+            config.failover_after_s = std::atof(value.c_str());
+        } else if (arg == "--flight-check") {
+            config.flight_check = value;
+        } else if (arg == "--silence-after") {
+            config.silence_after_s = std::atof(value.c_str());
+        } else if (arg == "--counts") {
+            config.drone_counts.clear();
+            for (const auto& count : split(value, ',')) {
+                config.drone_counts.push_back(std::clamp(std::atoi(count.c_str()), 1, 250));
+            }
+        } else if (arg == "--rate-step") {
+            config.rate_step = std::atof(value.c_str());
+        } else if (arg == "--max-p99") {
+            config.max_p99_ms = std::atof(value.c_str());
+        } else if (arg == "--max-loss") {
+            config.max_loss_pct = std::atof(value.c_str());
+        } else if (arg == "--profile") {
+            config.profile = value;
+        } else if (arg == "--save") {
+            config.save_path = value;
+        } else if (arg == "--baseline") {
+            config.baseline_path = value;
+        } else {
+            print_usage();
+            return 2;
+        }
+    }
+    if (config.rate <= 0 || config.duration_s <= 0 || config.rate_step <= 1) {
+        print_usage();
+        return 2;
+    }
+
+    try {
+        LoadGenerator loadgen(config);
+        loadgen.run();
+        if (loadgen.failed()) {
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
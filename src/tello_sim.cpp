@@ -0,0 +1,210 @@
+#include "tello_sim.hpp"
+#include "mission.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+SimulatedTello::SimulatedTello(uv_loop_t& loop, const SimConfig& config)
+    : loop_(loop), config_(config), fault_rng_(config.fault_seed) {
+    for (int port : config_.telemetry_ports) {
+        struct sockaddr_in addr;
+        if (int result = uv_ip4_addr(config_.telemetry_host.c_str(), port, &addr); result != 0) {
+            throw std::runtime_error("Invalid telemetry address " + config_.telemetry_host + ": " + uv_strerror(result));
+        }
+        telemetry_addrs_.push_back(addr);
+    }
+
+    udp_socket_ = std::unique_ptr<uv_udp_t, UdpDeleter>(new uv_udp_t);
+    uv_udp_init(&loop_, udp_socket_.get());
+    udp_socket_->data = this;
+
+    struct sockaddr_in bind_addr;
+    uv_ip4_addr(config_.ip.c_str(), config_.port, &bind_addr);
+    int result = uv_udp_bind(udp_socket_.get(), reinterpret_cast<const struct sockaddr*>(&bind_addr), 0);
+    if (result != 0) {
+        throw std::runtime_error("Failed to bind simulated drone to " + config_.ip + ":" + std::to_string(config_.port)
+                                 + ": " + std::string(uv_strerror(result)));
+    }
+
+    uv_udp_recv_start(udp_socket_.get(),
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            auto* sim = static_cast<SimulatedTello*>(handle->data);
+            buf->base = sim->recv_buffer_;
+            buf->len = sizeof(sim->recv_buffer_);
+        },
+        [](uv_udp_t* handle, ssize_t nread, const uv_buf_t* buf, const struct sockaddr* addr, unsigned) {
+            auto* sim = static_cast<SimulatedTello*>(handle->data);
+            if (nread <= 0 || !addr) {
+                return;
+            }
+            const auto* from = reinterpret_cast<const struct sockaddr_in*>(addr);
+            if (!sim->config_.allowed_source.empty()) {
+                char source[INET_ADDRSTRLEN];
+                uv_ip4_name(from, source, sizeof(source));
+                if (sim->config_.allowed_source != source) {
+                    if (sim->commands_rejected_++ == 0) {
+                        std::cerr << "Simulated drone " << sim->config_.ip << " dropping commands from " << source
+                                  << " (expected " << sim->config_.allowed_source << ")" << std::endl;
+                    }
+                    return;
+                }
+            }
+            if (sim->inject_loss(sim->config_.command_loss)) {
+                return;
+            }
+            sim->commands_received_++;
+            std::string response = sim->handle_command(std::string_view(buf->base, nread));
+            if (!response.empty()) {
+                sim->reply(*from, std::move(response));
+            }
+        });
+
+    state_timer_ = std::unique_ptr<uv_timer_t, TimerDeleter>(new uv_timer_t);
+    uv_timer_init(&loop_, state_timer_.get());
+    state_timer_->data = this;
+    if (config_.telemetry_hz > 0) {
+        uint64_t period = std::max(1, 1000 / config_.telemetry_hz);
+        uv_timer_start(state_timer_.get(), [](uv_timer_t* timer) {
+            static_cast<SimulatedTello*>(timer->data)->send_state();
+        }, period, period);
+    }
+}
+
+std::string SimulatedTello::handle_command(std::string_view cmd) {
+    while (!cmd.empty() && (cmd.back() == '\r' || cmd.back() == '\n')) {
+        cmd.remove_suffix(1);
+    }
+    if (cmd == "command") {
+        sdk_mode_ = true;
+        return "ok";
+    }
+    if (!sdk_mode_) {
+        return {}; // A real drone ignores everything until it is in SDK mode
+    }
+
+    if (cmd.substr(0, 3) == "rc ") {
+        return {};
+    }
+    if (!check_mission_command(cmd).empty()) {
+        return "error";
+    }
+
+    size_t space = cmd.find(' ');
+    std::string_view name = cmd.substr(0, space);
+    int value = space == std::string_view::npos ? 0 : std::atoi(std::string(cmd.substr(space + 1)).c_str());
+
+    if (name == "battery?") return std::to_string(static_cast<int>(battery_));
+    if (name == "height?") return std::to_string(height_ / 10) + "dm";
+    if (name == "speed?") return std::to_string(speed_) + ".0";
+    if (name == "time?") return std::to_string(motor_seconds_) + "s";
+    if (name == "wifi?") return "90";
+    if (name == "sdk?") return "20";
+    if (name == "sn?") return config_.serial;
+    if (name == "temp?") return "60~62C";
+    if (name == "attitude?") return "pitch:0;roll:0;yaw:" + std::to_string(yaw_) + ";";
+    if (name == "baro?") return "0.47";
+    if (name == "tof?") return std::to_string(height_ > 0 ? height_ * 10 : 100) + "mm";
+    if (name == "acceleration?") return "agx:0.00;agy:0.00;agz:-1000.00;";
+
+    if (name == "takeoff") {
+        if (!flying_) {
+            flying_ = true;
+            height_ = 80;
+            airborne_since_ = uv_now(&loop_);
+        }
+        return "ok";
+    }
+    if (name == "land" || name == "emergency") {
+        if (flying_) {
+            motor_seconds_ += static_cast<int>((uv_now(&loop_) - airborne_since_) / 1000);
+        }
+        flying_ = false;
+        height_ = 0;
+        return "ok";
+    }
+    if (name == "speed") {
+        speed_ = value;
+        return "ok";
+    }
+    if (name == "streamon" || name == "streamoff" || name == "wifi") {
+        return "ok";
+    }
+
+    // Everything else moves the drone and needs it airborne
+    if (!flying_) {
+        return "error Not joystick";
+    }
+    if (name == "up") height_ += value;
+    else if (name == "down") height_ = std::max(20, height_ - value);
+    else if (name == "cw") yaw_ = (yaw_ + value) % 360;
+    else if (name == "ccw") yaw_ = (yaw_ - value + 360) % 360;
+    return "ok";
+}
+
+void SimulatedTello::reply(const struct sockaddr_in& to, std::string message) {
+    if (inject_loss(config_.reply_loss)) {
+        return;
+    }
+    int delay_ms = config_.reply_delay_ms;
+    if (config_.reply_jitter_ms > 0) {
+        delay_ms += std::uniform_int_distribution<int>(0, config_.reply_jitter_ms)(fault_rng_);
+    }
+    if (delay_ms <= 0) {
+        send_to(to, message);
+        return;
+    }
+
+    struct DelayedReply {
+        uv_timer_t timer;
+        SimulatedTello* sim;
+        struct sockaddr_in to;
+        std::string message;
+    };
+    auto* delayed = new DelayedReply{{}, this, to, std::move(message)};
+    uv_timer_init(&loop_, &delayed->timer);
+    delayed->timer.data = delayed;
+    uv_timer_start(&delayed->timer, [](uv_timer_t* timer) {
+        auto* delayed = static_cast<DelayedReply*>(timer->data);
+        delayed->sim->send_to(delayed->to, delayed->message);
+        uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t* handle) {
+            delete static_cast<DelayedReply*>(handle->data);
+        });
+    }, delay_ms, 0);
+}
+
+void SimulatedTello::send_to(const struct sockaddr_in& to, std::string_view data) {
+    uv_buf_t buf = uv_buf_init(const_cast<char*>(data.data()), data.size());
+    int result = uv_udp_try_send(udp_socket_.get(), &buf, 1, reinterpret_cast<const struct sockaddr*>(&to));
+    if (result < 0 && result != UV_EAGAIN) {
+        std::cerr << "Simulated drone " << config_.ip << " send failed: " << uv_strerror(result) << std::endl;
+    }
+}
+
+bool SimulatedTello::inject_loss(double probability) {
+    if (probability <= 0 || std::uniform_real_distribution<double>(0, 1)(fault_rng_) >= probability) {
+        return false;
+    }
+    datagrams_lost_++;
+    return true;
+}
+
+void SimulatedTello::send_state() {
+    if (!sdk_mode_) {
+        return;
+    }
+    if (flying_) {
+        battery_ = std::max(0.0, battery_ - 0.13 / std::max(1, config_.telemetry_hz));
+    }
+    char state[256];
+    int n = std::snprintf(state, sizeof(state),
+                          "pitch:0;roll:0;yaw:%d;vgx:0;vgy:0;vgz:0;templ:60;temph:62;tof:%d;h:%d;bat:%d;"
+                          "baro:%.2f;time:%d;agx:0.00;agy:0.00;agz:-1000.00;\r\n",
+                          yaw_ > 180 ? yaw_ - 360 : yaw_, height_ > 0 ? height_ : 10, height_,
+                          static_cast<int>(battery_), height_ / 100.0, motor_seconds_);
+    for (const auto& addr : telemetry_addrs_) {
+        send_to(addr, std::string_view(state, std::min<size_t>(n, sizeof(state) - 1)));
+    }
+    states_sent_++;
+}
@@ -0,0 +1,171 @@
+#include "histogram.hpp"
+#include "mission.hpp"
+#include "mission_vm.hpp"
+#include "mapped_file.hpp"
+#include "work_stealing_pool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct FileResult {
+    std::string path;
+    MissionReport report;
+    std::string failure; // Set when the file could not be read at all
+    size_t script_instructions = 0; // Set for scripts (include/mission_vm.hpp), which get no flight replay
+};
+
+static void print_usage() {
+    std::cerr << "Usage: tello_validate [options] <file-or-directory>...\n"
+              << "  -j N            Worker threads (default: all cores)\n"
+              << "  --ext EXT       Mission file extension when scanning directories (default: .mission)\n"
+              << "  --fence CM      Geofence half width around the takeoff point\n"
+              << "  --ceiling CM    Geofence ceiling\n"
+              << "  --battery PCT   Battery level assumed at mission start\n"
+              << "  --reserve PCT   Battery reserve required at landing\n"
+              << "  -q, --quiet     Only print files with diagnostics" << std::endl;
+}
+
+static void collect_files(const fs::path& root, const std::string& ext, std::vector<std::string>& files) {
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        files.push_back(root.string());
+        return;
+    }
+    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            std::cerr << "Error scanning " << root << ": " << ec.message() << std::endl;
+            break;
+        }
+        if (it->is_regular_file(ec) && it->path().extension() == ext) {
+            files.push_back(it->path().string());
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    MissionLimits limits;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string ext = ".mission";
+    bool quiet = false;
+    std::vector<std::string> roots;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next_int = [&]() {
+            if (i + 1 >= argc) {
+                print_usage();
+                std::exit(2);
+            }
+            return std::atoi(argv[++i]);
+        };
+        if (arg == "-j") {
+            threads = static_cast<unsigned>(next_int());
+        } else if (arg == "--ext" && i + 1 < argc) {
+            ext = argv[++i];
+        } else if (arg == "--fence") {
+            limits.fence_half_width = next_int();
+        } else if (arg == "--ceiling") {
+            limits.fence_ceiling = next_int();
+        } else if (arg == "--battery") {
+            limits.start_battery = next_int();
+        } else if (arg == "--reserve") {
+            limits.min_battery_level = next_int();
+        } else if (arg == "-q" || arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "-h" || arg == "--help" || arg[0] == '-') {
+            print_usage();
+            return 2;
+        } else {
+            roots.push_back(arg);
+        }
+    }
+    if (roots.empty()) {
+        print_usage();
+        return 2;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    for (const auto& root : roots) {
+        collect_files(root, ext, files);
+    }
+
+    std::vector<FileResult> results(files.size());
+    ConcurrentHistogram file_us(threads ? threads : std::thread::hardware_concurrency());
+    {
+        WorkStealingPool pool(threads);
+        threads = pool.size();
+        for (size_t i = 0; i < files.size(); ++i) {
+            pool.submit([&results, &files, &limits, &file_us, i]() {
+                auto file_start = std::chrono::steady_clock::now();
+                FileResult& result = results[i];
+                result.path = files[i];
+                try {
+                    MappedFile file(result.path);
+                    result.report = validate_mission(file.view(), limits);
+                    if (!result.report.ok()) {
+                        // Plain missions are validated as before; only a failing one is tried as a script
+                        MissionProgram program = compile_mission(file.view(), limits);
+                        if (program.scripted) {
+                            result.report = MissionReport();
+                            result.report.diagnostics = std::move(program.diagnostics);
+                            result.script_instructions = program.code.size();
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    result.failure = e.what();
+                }
+                file_us.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - file_start).count());
+            });
+        }
+        pool.wait_idle();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+
+    size_t ok = 0, with_warnings = 0, failed = 0;
+    for (const auto& result : results) {
+        if (!result.failure.empty()) {
+            std::cerr << result.path << ": error: " << result.failure << std::endl;
+            failed++;
+            continue;
+        }
+        const MissionReport& report = result.report;
+        for (const auto& d : report.diagnostics) {
+            std::ostream& out = d.severity == MissionDiagnostic::Severity::ERROR ? std::cerr : std::cout;
+            out << result.path << ":" << d.line << ": "
+                << (d.severity == MissionDiagnostic::Severity::ERROR ? "error: " : "warning: ") << d.message << "\n";
+        }
+        if (!report.ok()) {
+            failed++;
+        } else if (report.warning_count() > 0) {
+            with_warnings++;
+        } else {
+            ok++;
+        }
+        if (!quiet && report.ok() && result.script_instructions > 0) {
+            std::cout << result.path << ": ok (script, " << result.script_instructions
+                      << " instructions, not replayed against the geofence)\n";
+        } else if (!quiet && report.ok()) {
+            char estimate[96];
+            std::snprintf(estimate, sizeof(estimate), "%zu steps, ~%.0f s airborne, ~%.1f%% battery left",
+                          report.steps.size(), report.estimated_seconds, report.estimated_battery);
+            std::cout << result.path << ": ok (" << estimate << ")\n";
+        }
+    }
+
+    std::cout << "Validated " << results.size() << " mission files in " << elapsed.count() << " ms on " << threads
+              << " threads: " << ok << " ok, " << with_warnings << " with warnings, " << failed << " failed"
+              << std::endl;
+    if (!quiet && !results.empty()) {
+        std::cout << "Per file: " << format_latency(file_us.snapshot()) << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
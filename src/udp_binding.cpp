@@ -0,0 +1,40 @@
+#include "udp_binding.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+
+void bind_udp(uv_loop_t& loop, uv_udp_t* udp, const UdpBinding& binding, const std::string& what) {
+    // Create the socket up front so the device can be set before bind() picks a route. The handle
+    // is initialized before anything can throw, so the caller can always uv_close() it.
+    uv_udp_init_ex(&loop, udp, AF_INET);
+
+    struct sockaddr_in bind_addr;
+    if (int result = uv_ip4_addr(binding.address.c_str(), binding.port, &bind_addr); result != 0) {
+        throw std::runtime_error("Invalid bind address " + binding.address + " for " + what + ": "
+                                 + uv_strerror(result));
+    }
+    if (!binding.device.empty()) {
+        uv_os_fd_t fd;
+        uv_fileno(reinterpret_cast<uv_handle_t*>(udp), &fd);
+        if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, binding.device.c_str(), binding.device.size()) != 0) {
+            throw std::runtime_error("Failed to bind " + what + " to device " + binding.device + ": "
+                                     + std::strerror(errno));
+        }
+    }
+
+    int result = uv_udp_bind(udp, reinterpret_cast<const struct sockaddr*>(&bind_addr),
+                             binding.shared ? UV_UDP_REUSEADDR : 0);
+    if (result != 0) {
+        throw std::runtime_error("Failed to bind " + what + " to " + describe_binding(binding) + ": "
+                                 + uv_strerror(result));
+    }
+}
+
+std::string describe_binding(const UdpBinding& binding) {
+    std::string out = binding.address + ":" + std::to_string(binding.port);
+    if (!binding.device.empty()) {
+        out += "%" + binding.device;
+    }
+    return out;
+}
@@ -0,0 +1,662 @@
+#include "websocket.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+namespace {
+
+constexpr size_t kMaxMessageSize = 64 * 1024; // Commands and replies are tiny
+constexpr size_t kMaxHandshakeSize = 8 * 1024;
+
+std::mt19937& random_engine() {
+    thread_local std::mt19937 engine{std::random_device{}()};
+    return engine;
+}
+
+std::string base64(const unsigned char* data, size_t size) {
+    std::string encoded(4 * ((size + 2) / 3) + 1, '\0');
+    int n = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(encoded.data()), data, static_cast<int>(size));
+    encoded.resize(n);
+    return encoded;
+}
+
+// Value of an HTTP header (case-insensitive name), or empty if absent
+std::string_view find_header(std::string_view head, std::string_view name) {
+    size_t pos = head.find("\r\n");
+    while (pos != std::string_view::npos && pos + 2 < head.size()) {
+        size_t start = pos + 2;
+        size_t end = head.find("\r\n", start);
+        std::string_view line = head.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        size_t colon = line.find(':');
+        if (colon == name.size()
+            && std::equal(name.begin(), name.end(), line.begin(), [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+               })) {
+            std::string_view value = line.substr(colon + 1);
+            size_t first = value.find_first_not_of(" \t");
+            size_t last = value.find_last_not_of(" \t");
+            return first == std::string_view::npos ? std::string_view() : value.substr(first, last - first + 1);
+        }
+        pos = end;
+    }
+    return {};
+}
+
+} // namespace
+
+void ws_encode_frame(WsOpcode opcode, std::string_view payload, bool mask, std::string& out) {
+    out.push_back(static_cast<char>(0x80 | static_cast<uint8_t>(opcode)));
+    const uint8_t mask_bit = mask ? 0x80 : 0x00;
+    const uint64_t len = payload.size();
+    if (len < 126) {
+        out.push_back(static_cast<char>(mask_bit | len));
+    } else if (len <= 0xFFFF) {
+        out.push_back(static_cast<char>(mask_bit | 126));
+        out.push_back(static_cast<char>(len >> 8));
+        out.push_back(static_cast<char>(len & 0xFF));
+    } else {
+        out.push_back(static_cast<char>(mask_bit | 127));
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<char>((len >> shift) & 0xFF));
+        }
+    }
+
+    if (!mask) {
+        out.append(payload.data(), payload.size());
+        return;
+    }
+    uint32_t key_bits = random_engine()();
+    char key[4];
+    std::memcpy(key, &key_bits, sizeof(key));
+    out.append(key, sizeof(key));
+    for (size_t i = 0; i < payload.size(); ++i) {
+        out.push_back(static_cast<char>(payload[i] ^ key[i & 3]));
+    }
+}
+
+size_t ws_parse_frame(std::string_view data, size_t max_payload, WsFrame& frame) {
+    if (data.size() < 2) {
+        return 0;
+    }
+    const auto b0 = static_cast<uint8_t>(data[0]);
+    const auto b1 = static_cast<uint8_t>(data[1]);
+    if (b0 & 0x70) {
+        return SIZE_MAX; // RSV bits require an extension we never negotiate
+    }
+    frame.fin = (b0 & 0x80) != 0;
+    frame.opcode = static_cast<WsOpcode>(b0 & 0x0F);
+    frame.masked = (b1 & 0x80) != 0;
+    switch (frame.opcode) {
+    case WsOpcode::CONTINUATION: case WsOpcode::TEXT: case WsOpcode::BINARY:
+    case WsOpcode::CLOSE: case WsOpcode::PING: case WsOpcode::PONG:
+        break;
+    default:
+        return SIZE_MAX;
+    }
+
+    uint64_t len = b1 & 0x7F;
+    size_t pos = 2;
+    if (len == 126) {
+        if (data.size() < 4) {
+            return 0;
+        }
+        len = (static_cast<uint64_t>(static_cast<uint8_t>(data[2])) << 8) | static_cast<uint8_t>(data[3]);
+        pos = 4;
+    } else if (len == 127) {
+        if (data.size() < 10) {
+            return 0;
+        }
+        len = 0;
+        for (size_t i = 2; i < 10; ++i) {
+            len = (len << 8) | static_cast<uint8_t>(data[i]);
+        }
+        pos = 10;
+    }
+    if (len > max_payload) {
+        return SIZE_MAX;
+    }
+    const bool control = (b0 & 0x08) != 0;
+    if (control && (len > 125 || !frame.fin)) {
+        return SIZE_MAX;
+    }
+
+    char key[4] = {};
+    if (frame.masked) {
+        if (data.size() < pos + 4) {
+            return 0;
+        }
+        std::memcpy(key, data.data() + pos, sizeof(key));
+        pos += 4;
+    }
+    if (data.size() < pos + len) {
+        return 0;
+    }
+    frame.payload.assign(data.data() + pos, len);
+    if (frame.masked) {
+        for (size_t i = 0; i < frame.payload.size(); ++i) {
+            frame.payload[i] ^= key[i & 3];
+        }
+    }
+    return pos + len;
+}
+
+std::string ws_accept_key(std::string_view key) {
+    std::string input(key);
+    input += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(input.data()), input.size(), digest);
+    return base64(digest, sizeof(digest));
+}
+
+// --- Server -----------------------------------------------------------------
+
+WebSocketServer::WebSocketServer(uv_loop_t& loop, const std::string& host, int port, MessageHandler on_message,
+                                 size_t max_queued_frames)
+    : loop_(loop), listener_(new uv_tcp_t), on_message_(std::move(on_message)),
+      max_queued_frames_(std::max<size_t>(1, max_queued_frames)) {
+    uv_tcp_init(&loop_, listener_);
+    listener_->data = this;
+
+    struct sockaddr_in addr;
+    int result = uv_ip4_addr(host.c_str(), port, &addr);
+    if (result == 0) {
+        result = uv_tcp_bind(listener_, reinterpret_cast<const struct sockaddr*>(&addr), 0);
+    }
+    if (result == 0) {
+        result = uv_listen(reinterpret_cast<uv_stream_t*>(listener_), 16, [](uv_stream_t* server, int status) {
+            if (status < 0) {
+                std::cerr << "WebSocket accept error: " << uv_strerror(status) << std::endl;
+                return;
+            }
+            static_cast<WebSocketServer*>(server->data)->on_connection();
+        });
+    }
+    if (result != 0) {
+        uv_close(reinterpret_cast<uv_handle_t*>(listener_), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_tcp_t*>(handle);
+        });
+        throw std::runtime_error("Failed to listen for WebSocket clients on " + host + ":" + std::to_string(port)
+                                 + ": " + std::string(uv_strerror(result)));
+    }
+    std::cout << "WebSocket gateway listening on ws://" << host << ":" << port << std::endl;
+}
+
+WebSocketServer::~WebSocketServer() {
+    for (auto& [id, client] : clients_) {
+        client->server = nullptr;
+        if (!client->closing) {
+            client->closing = true;
+            uv_close(reinterpret_cast<uv_handle_t*>(&client->tcp), on_client_closed);
+        }
+    }
+    clients_.clear();
+    uv_close(reinterpret_cast<uv_handle_t*>(listener_), [](uv_handle_t* handle) {
+        delete reinterpret_cast<uv_tcp_t*>(handle);
+    });
+}
+
+void WebSocketServer::on_client_closed(uv_handle_t* handle) {
+    auto* client = static_cast<Client*>(handle->data);
+    if (client->server) {
+        client->server->clients_.erase(client->id);
+    }
+    delete client;
+}
+
+void WebSocketServer::on_connection() {
+    auto* client = new Client;
+    client->server = this;
+    client->id = next_client_id_++;
+    uv_tcp_init(&loop_, &client->tcp);
+    client->tcp.data = client;
+    auto* stream = reinterpret_cast<uv_stream_t*>(&client->tcp);
+    if (int result = uv_accept(reinterpret_cast<uv_stream_t*>(listener_), stream); result != 0) {
+        std::cerr << "WebSocket accept failed: " << uv_strerror(result) << std::endl;
+        client->server = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(&client->tcp), on_client_closed);
+        return;
+    }
+    uv_tcp_nodelay(&client->tcp, 1); // Teleop frames are tiny; never wait for Nagle
+    if (traffic_class_) {
+        mark_socket(reinterpret_cast<uv_handle_t*>(&client->tcp), *traffic_class_);
+    }
+    if (max_bytes_per_second_ > 0) {
+        set_pacing_rate(reinterpret_cast<uv_handle_t*>(&client->tcp), max_bytes_per_second_);
+    }
+    clients_[client->id] = client;
+
+    uv_read_start(stream,
+        [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+            auto* client = static_cast<Client*>(handle->data);
+            buf->base = client->read_buffer;
+            buf->len = sizeof(client->read_buffer);
+        },
+        [](uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+            auto* client = static_cast<Client*>(stream->data);
+            if (!client->server) {
+                return;
+            }
+            if (nread < 0) {
+                client->server->close_client(*client);
+            } else if (nread > 0) {
+                client->server->on_read(*client, std::string_view(buf->base, nread));
+            }
+        });
+}
+
+void WebSocketServer::on_read(Client& client, std::string_view data) {
+    client.inbox.append(data.data(), data.size());
+    if (!client.open && !handle_handshake(client)) {
+        return;
+    }
+
+    while (!client.closing) {
+        WsFrame frame;
+        size_t used = ws_parse_frame(client.inbox, kMaxMessageSize, frame);
+        if (used == 0) {
+            break;
+        }
+        if (used == SIZE_MAX || !frame.masked) {
+            std::cerr << "WebSocket protocol error from client " << client.id << std::endl;
+            close_client(client);
+            return;
+        }
+        client.inbox.erase(0, used);
+        handle_frame(client, frame);
+    }
+}
+
+bool WebSocketServer::handle_handshake(Client& client) {
+    size_t end = client.inbox.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (client.inbox.size() > kMaxHandshakeSize) {
+            close_client(client);
+        }
+        return false;
+    }
+
+    std::string_view head(client.inbox.data(), end + 2);
+    std::string_view key = find_header(head, "Sec-WebSocket-Key");
+    if (head.substr(0, 4) != "GET " || key.empty()) {
+        std::cerr << "Rejecting non-WebSocket request from client " << client.id << std::endl;
+        enqueue(client, "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n", false);
+        close_client(client);
+        return false;
+    }
+
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " + ws_accept_key(key) + "\r\n\r\n";
+    client.inbox.erase(0, end + 4);
+    client.open = true;
+    enqueue(client, std::move(response), false);
+    std::cout << "WebSocket client " << client.id << " connected" << std::endl;
+    return true;
+}
+
+void WebSocketServer::handle_frame(Client& client, WsFrame& frame) {
+    std::string out;
+    switch (frame.opcode) {
+    case WsOpcode::PING:
+        ws_encode_frame(WsOpcode::PONG, frame.payload, false, out);
+        enqueue(client, std::move(out), false);
+        break;
+    case WsOpcode::PONG:
+        break;
+    case WsOpcode::CLOSE:
+        ws_encode_frame(WsOpcode::CLOSE, {}, false, out);
+        enqueue(client, std::move(out), false);
+        close_client(client);
+        break;
+    case WsOpcode::TEXT:
+    case WsOpcode::BINARY:
+        if (client.message_opcode != WsOpcode::CONTINUATION) {
+            std::cerr << "WebSocket client " << client.id << " interleaved a message into a fragmented one" << std::endl;
+            close_client(client);
+        } else if (frame.fin) {
+            on_message_(client.id, frame.payload);
+        } else {
+            client.message = std::move(frame.payload);
+            client.message_opcode = frame.opcode;
+        }
+        break;
+    case WsOpcode::CONTINUATION:
+        if (client.message_opcode == WsOpcode::CONTINUATION
+            || client.message.size() + frame.payload.size() > kMaxMessageSize) {
+            std::cerr << "WebSocket protocol error from client " << client.id << std::endl;
+            close_client(client);
+            break;
+        }
+        client.message += frame.payload;
+        if (frame.fin) {
+            std::string message = std::move(client.message);
+            client.message.clear();
+            client.message_opcode = WsOpcode::CONTINUATION;
+            on_message_(client.id, message);
+        }
+        break;
+    }
+}
+
+void WebSocketServer::send_text(ClientId id, std::string_view text) {
+    auto it = clients_.find(id);
+    if (it == clients_.end() || !it->second->open) {
+        return; // Client went away while its command was in flight
+    }
+    std::string out;
+    ws_encode_frame(WsOpcode::TEXT, text, false, out);
+    enqueue(*it->second, std::move(out), false);
+}
+
+void WebSocketServer::set_qos(TrafficClass traffic_class, uint64_t max_bytes_per_second) {
+    traffic_class_ = traffic_class;
+    max_bytes_per_second_ = max_bytes_per_second;
+    broadcast_budget_.reset();
+    if (max_bytes_per_second > 0) {
+        // A tenth of a second of burst absorbs a swarm's telemetry arriving in one loop iteration
+        broadcast_budget_.emplace(max_bytes_per_second, std::max<uint64_t>(max_bytes_per_second / 10, 16384));
+    }
+    for (auto& [id, client] : clients_) {
+        mark_socket(reinterpret_cast<uv_handle_t*>(&client->tcp), traffic_class);
+        set_pacing_rate(reinterpret_cast<uv_handle_t*>(&client->tcp), max_bytes_per_second);
+    }
+}
+
+void WebSocketServer::broadcast_binary(std::string_view payload) {
+    if (clients_.empty()) {
+        return;
+    }
+    frame_scratch_.clear();
+    ws_encode_frame(WsOpcode::BINARY, payload, false, frame_scratch_);
+    if (broadcast_budget_ && !broadcast_budget_->try_consume(frame_scratch_.size() * clients_.size(), uv_hrtime())) {
+        dropped_frames_ += clients_.size();
+        return;
+    }
+    for (auto& [id, client] : clients_) {
+        if (client->open && client->streaming) {
+            enqueue(*client, frame_scratch_, true);
+        }
+    }
+}
+
+void WebSocketServer::set_streaming(ClientId id, bool on) {
+    if (auto it = clients_.find(id); it != clients_.end()) {
+        it->second->streaming = on;
+    }
+}
+
+void WebSocketServer::enqueue(Client& client, std::string bytes, bool droppable) {
+    if (client.closing) {
+        return;
+    }
+    if (droppable) {
+        if (client.droppable_queued >= max_queued_frames_) {
+            // Slow client: drop its oldest queued frame that is not already on the wire
+            auto it = client.outbox.begin();
+            if (client.writing || client.written > 0) {
+                ++it;
+            }
+            for (; it != client.outbox.end(); ++it) {
+                if (it->droppable) {
+                    client.outbox.erase(it);
+                    client.droppable_queued--;
+                    dropped_frames_++;
+                    break;
+                }
+            }
+        }
+        client.droppable_queued++;
+    }
+    client.outbox.push_back({std::move(bytes), droppable});
+    flush(client);
+}
+
+void WebSocketServer::flush(Client& client) {
+    auto* stream = reinterpret_cast<uv_stream_t*>(&client.tcp);
+    while (!client.writing && !client.closing && !client.outbox.empty()) {
+        OutFrame& front = client.outbox.front();
+        uv_buf_t buf = uv_buf_init(front.bytes.data() + client.written,
+                                   static_cast<unsigned int>(front.bytes.size() - client.written));
+        int n = uv_try_write(stream, &buf, 1);
+        if (n >= 0 && static_cast<size_t>(n) == buf.len) {
+            if (front.droppable) {
+                client.droppable_queued--;
+            }
+            client.outbox.pop_front();
+            client.written = 0;
+            continue;
+        }
+        if (n < 0 && n != UV_EAGAIN) {
+            close_client(client);
+            return;
+        }
+        if (n > 0) {
+            client.written += n;
+        }
+
+        // Socket buffer is full: let libuv finish this frame, later frames wait in the outbox
+        buf = uv_buf_init(front.bytes.data() + client.written,
+                          static_cast<unsigned int>(front.bytes.size() - client.written));
+        client.writing = true;
+        client.write_req.data = &client;
+        int result = uv_write(&client.write_req, stream, &buf, 1, [](uv_write_t* req, int status) {
+            auto* client = static_cast<Client*>(req->data);
+            client->writing = false;
+            if (!client->server || status < 0) {
+                return; // Closing; the close callback frees the client
+            }
+            if (client->outbox.front().droppable) {
+                client->droppable_queued--;
+            }
+            client->outbox.pop_front();
+            client->written = 0;
+            client->server->flush(*client);
+        });
+        if (result != 0) {
+            client.writing = false;
+            close_client(client);
+        }
+        return;
+    }
+}
+
+void WebSocketServer::close_client(Client& client) {
+    if (client.closing) {
+        return;
+    }
+    client.closing = true;
+    std::cout << "WebSocket client " << client.id << " disconnected" << std::endl;
+    if (on_close_) {
+        on_close_(client.id);
+    }
+    uv_read_stop(reinterpret_cast<uv_stream_t*>(&client.tcp));
+    uv_close(reinterpret_cast<uv_handle_t*>(&client.tcp), on_client_closed);
+}
+
+// --- Client -----------------------------------------------------------------
+
+WebSocketClient::WebSocketClient(uv_loop_t& loop, const std::string& host, int port, OpenHandler on_open,
+                                 MessageHandler on_message, CloseHandler on_close)
+    : loop_(loop), host_(host + ":" + std::to_string(port)), tcp_(new uv_tcp_t),
+      on_open_(std::move(on_open)), on_message_(std::move(on_message)), on_close_(std::move(on_close)) {
+    uv_tcp_init(&loop_, tcp_);
+    tcp_->data = this;
+
+    struct sockaddr_in addr;
+    int result = uv_ip4_addr(host.c_str(), port, &addr);
+    auto* req = new uv_connect_t;
+    if (result == 0) {
+        result = uv_tcp_connect(req, tcp_, reinterpret_cast<const struct sockaddr*>(&addr),
+            [](uv_connect_t* req, int status) {
+                auto* self = static_cast<WebSocketClient*>(req->handle->data);
+                delete req;
+                if (!self || status == UV_ECANCELED) {
+                    return;
+                }
+                if (status < 0) {
+                    std::cerr << "WebSocket connect to " << self->host_ << " failed: " << uv_strerror(status) << std::endl;
+                    self->close();
+                    self->on_open_(false);
+                    return;
+                }
+                uv_tcp_nodelay(self->tcp_, 1);
+
+                unsigned char nonce[16];
+                for (auto& byte : nonce) {
+                    byte = static_cast<unsigned char>(random_engine()());
+                }
+                self->key_ = base64(nonce, sizeof(nonce));
+                self->write_raw("GET / HTTP/1.1\r\nHost: " + self->host_ + "\r\nUpgrade: websocket\r\n"
+                                "Connection: Upgrade\r\nSec-WebSocket-Key: " + self->key_ + "\r\n"
+                                "Sec-WebSocket-Version: 13\r\n\r\n");
+                uv_read_start(reinterpret_cast<uv_stream_t*>(self->tcp_),
+                    [](uv_handle_t* handle, size_t, uv_buf_t* buf) {
+                        auto* self = static_cast<WebSocketClient*>(handle->data);
+                        buf->base = self->read_buffer_;
+                        buf->len = sizeof(self->read_buffer_);
+                    },
+                    [](uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf) {
+                        auto* self = static_cast<WebSocketClient*>(stream->data);
+                        if (!self) {
+                            return;
+                        }
+                        if (nread < 0) {
+                            self->close();
+                        } else if (nread > 0) {
+                            self->on_read(std::string_view(buf->base, nread));
+                        }
+                    });
+            });
+    }
+    if (result != 0) {
+        delete req;
+        tcp_->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(tcp_), [](uv_handle_t* handle) {
+            delete reinterpret_cast<uv_tcp_t*>(handle);
+        });
+        throw std::runtime_error("Failed to connect to WebSocket gateway " + host_ + ": " + std::string(uv_strerror(result)));
+    }
+}
+
+WebSocketClient::~WebSocketClient() {
+    tcp_->data = nullptr;
+    close();
+}
+
+void WebSocketClient::send_text(std::string_view text) {
+    if (!open_) {
+        return;
+    }
+    std::string out;
+    ws_encode_frame(WsOpcode::TEXT, text, true, out);
+    write_raw(std::move(out));
+}
+
+void WebSocketClient::close() {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    open_ = false;
+    uv_read_stop(reinterpret_cast<uv_stream_t*>(tcp_));
+    uv_close(reinterpret_cast<uv_handle_t*>(tcp_), [](uv_handle_t* handle) {
+        auto* self = static_cast<WebSocketClient*>(handle->data);
+        delete reinterpret_cast<uv_tcp_t*>(handle);
+        if (self && self->on_close_) {
+            self->on_close_();
+        }
+    });
+}
+
+void WebSocketClient::write_raw(std::string bytes) {
+    struct WriteRequest {
+        uv_write_t req;
+        std::string data;
+    };
+    auto* request = new WriteRequest{{}, std::move(bytes)};
+    request->req.data = request;
+    uv_buf_t buf = uv_buf_init(request->data.data(), static_cast<unsigned int>(request->data.size()));
+    int result = uv_write(&request->req, reinterpret_cast<uv_stream_t*>(tcp_), &buf, 1, [](uv_write_t* req, int) {
+        delete static_cast<WriteRequest*>(req->data);
+    });
+    if (result != 0) {
+        delete request;
+        close();
+    }
+}
+
+void WebSocketClient::on_read(std::string_view data) {
+    inbox_.append(data.data(), data.size());
+    if (!open_) {
+        size_t end = inbox_.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return;
+        }
+        std::string_view head(inbox_.data(), end + 2);
+        bool accepted = head.substr(0, 12) == "HTTP/1.1 101"
+                        && find_header(head, "Sec-WebSocket-Accept") == ws_accept_key(key_);
+        inbox_.erase(0, end + 4);
+        if (!accepted) {
+            std::cerr << "WebSocket handshake with " << host_ << " rejected" << std::endl;
+            close();
+            on_open_(false);
+            return;
+        }
+        open_ = true;
+        on_open_(true);
+    }
+
+    while (!closed_) {
+        WsFrame frame;
+        size_t used = ws_parse_frame(inbox_, kMaxMessageSize, frame);
+        if (used == 0) {
+            break;
+        }
+        if (used == SIZE_MAX || frame.masked) {
+            std::cerr << "WebSocket protocol error from " << host_ << std::endl;
+            close();
+            return;
+        }
+        inbox_.erase(0, used);
+
+        std::string out;
+        switch (frame.opcode) {
+        case WsOpcode::PING:
+            ws_encode_frame(WsOpcode::PONG, frame.payload, true, out);
+            write_raw(std::move(out));
+            break;
+        case WsOpcode::PONG:
+            break;
+        case WsOpcode::CLOSE:
+            close();
+            return;
+        case WsOpcode::TEXT:
+        case WsOpcode::BINARY:
+            if (frame.fin) {
+                on_message_(frame.opcode, frame.payload);
+            } else {
+                message_ = std::move(frame.payload);
+                message_opcode_ = frame.opcode;
+            }
+            break;
+        case WsOpcode::CONTINUATION:
+            if (message_opcode_ == WsOpcode::CONTINUATION) {
+                close();
+                return;
+            }
+            message_ += frame.payload;
+            if (frame.fin) {
+                std::string message = std::move(message_);
+                message_.clear();
+                WsOpcode opcode = message_opcode_;
+                message_opcode_ = WsOpcode::CONTINUATION;
+                on_message_(opcode, message);
+            }
+            break;
+        }
+    }
+}